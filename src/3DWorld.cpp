@@ -66,7 +66,7 @@ char *lighting_file[NUM_LIGHTING_TYPES] = {0};
 // Note that these are all the default values when no config variable is specified.
 bool nop_frame(0), combined_gu(0), underwater(0), kbd_text_mode(0), univ_stencil_shadows(1), use_waypoint_app_spots(0), enable_tiled_mesh_ao(0), tiled_terrain_only(0);
 bool show_lightning(0), disable_shader_effects(0), use_waypoints(0), group_back_face_cull(0), start_maximized(0), claim_planet(0), skip_light_vis_test(0);
-bool no_smoke_over_mesh(0), enable_model3d_tex_comp(0), global_lighting_update(0), lighting_update_offline(0), mesh_difuse_tex_comp(1), smoke_dlights(0), keep_keycards_on_death(0);
+bool no_smoke_over_mesh(0), enable_model3d_tex_comp(0), global_lighting_update(0), lighting_update_offline(0), adaptive_ray_tracing(0), incremental_relight(0), mesh_difuse_tex_comp(1), smoke_dlights(0), keep_keycards_on_death(0);
 bool texture_alpha_in_red_comp(0), use_model2d_tex_mipmaps(1), mt_cobj_tree_build(0), two_sided_lighting(0), inf_terrain_scenery(1), invert_model_nmap_bscale(0);
 bool gen_tree_roots(1), fast_water_reflect(0), vsync_enabled(0), use_voxel_cobjs(0), disable_sound(0), enable_depth_clamp(0), volume_lighting(0), no_subdiv_model(0);
 bool detail_normal_map(0), use_core_context(0), enable_multisample(1), dynamic_smap_bias(0), model3d_wn_normal(0), snow_shadows(0), user_action_key(0), use_instanced_pine_trees(0);
@@ -76,7 +76,7 @@ bool enable_model3d_bump_maps(1), use_obj_file_bump_grayscale(1), invert_bump_ma
 bool enable_model3d_custom_mipmaps(1), flatten_tt_mesh_under_models(0), show_map_view_mandelbrot(0), smileys_chase_player(0), disable_fire_delay(0), disable_recoil(0);
 bool enable_dpart_shadows(0), enable_tt_model_reflect(1), enable_tt_model_indir(0), auto_calc_tt_model_zvals(0), use_model_lod_blocks(0), enable_translocator(0), enable_grass_fire(0);
 bool disable_model_textures(0), start_in_inf_terrain(0), allow_shader_invariants(1), config_unlimited_weapons(0), disable_tt_water_reflect(0), allow_model3d_quads(1);
-bool enable_timing_profiler(0);
+bool enable_timing_profiler(0), parallel_obj_advance(0), video_yuv_convert(1);
 int xoff(0), yoff(0), xoff2(0), yoff2(0), rand_gen_index(0), mesh_rgen_index(0), camera_change(1), camera_in_air(0), auto_time_adv(0);
 int animate(1), animate2(1), draw_model(0), init_x(STARTING_INIT_X), fire_key(0), do_run(0), init_num_balls(-1), change_wmode_frame(0);
 int game_mode(0), map_mode(0), load_hmv(0), load_coll_objs(1), read_landscape(0), screen_reset(0), mesh_seed(0), rgen_seed(1);
@@ -98,16 +98,18 @@ unsigned erosion_iters(0), erosion_iters_tt(0), video_framerate(60), context_cle
 float NEAR_CLIP(DEF_NEAR_CLIP), FAR_CLIP(DEF_FAR_CLIP), system_max_orbit(1.0), sky_occlude_scale(0.0), tree_slope_thresh(5.0);
 float water_plane_z(0.0), base_gravity(1.0), crater_depth(1.0), crater_radius(1.0), disabled_mesh_z(FAR_CLIP), vegetation(1.0), atmosphere(1.0), biome_x_offset(0.0);
 float mesh_file_scale(1.0), mesh_file_tz(0.0), speed_mult(1.0), mesh_z_cutoff(-FAR_CLIP), relh_adj_tex(0.0), dodgeball_metalness(1.0), ray_step_size_mult(1.0);
+float adaptive_ray_budget(0.5), adaptive_ray_floor(0.25);
 float water_h_off(0.0), water_h_off_rel(0.0), perspective_fovy(0.0), perspective_nclip(0.0), read_mesh_zmm(0.0), indir_light_exp(1.0), cloud_height_offset(0.0);
 float snow_depth(0.0), snow_random(0.0), cobj_z_bias(DEF_Z_BIAS), init_temperature(DEF_TEMPERATURE), indir_vert_offset(0.25), sm_tree_density(1.0), fog_dist_scale(1.0);
 float CAMERA_RADIUS(DEF_CAMERA_RADIUS), C_STEP_HEIGHT(0.6), waypoint_sz_thresh(1.0), model3d_alpha_thresh(0.9), model3d_texture_anisotropy(1.0), dist_to_fire_sq(0.0);
 float ocean_wave_height(DEF_OCEAN_WAVE_HEIGHT), tree_density_thresh(0.55), model_auto_tc_scale(0.0), model_triplanar_tc_scale(0.0), shadow_map_pcf_offset(0.0);
 float custom_glaciate_exp(0.0), tree_type_rand_zone(0.0), jump_height(1.0), force_czmin(0.0), force_czmax(0.0), smap_thresh_scale(1.0), dlight_intensity_scale(1.0);
 float model_mat_lod_thresh(5.0), clouds_per_tile(0.5), def_atmosphere(1.0), def_vegetation(1.0), ocean_depth_opacity_mult(1.0), erode_amount(1.0), ambient_scale(1.0);
+float max_tex_upload_mb_per_frame(0.0); // 0 = unlimited
 float light_int_scale[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0}, first_ray_weight[NUM_LIGHTING_TYPES] = {1.0, 1.0, 1.0, 1.0, 1.0};
 double camera_zh(0.0);
 point mesh_origin(all_zeros), camera_pos(all_zeros), cube_map_center(all_zeros);
-string user_text, cobjs_out_fn, sphere_materials_fn, hmap_out_fn;
+string user_text, cobjs_out_fn, sphere_materials_fn, hmap_out_fn, texture_cache_dir, tree_cache_dir, waypoint_cache_fn, flow_cache_fn, llvol_cache_fn;
 colorRGB ambient_lighting_scale(1,1,1), mesh_color_scale(1,1,1);
 colorRGBA bkg_color, flower_color(ALPHA0);
 set<unsigned char> keys, keyset;
@@ -123,9 +125,16 @@ point camera_origin(all_zeros), surface_pos(all_zeros), cpos2;
 int orig_window, curr_window;
 char player_name[MAX_CHARS] = "Player";
 bool vert_opt_flags[3] = {0}; // {enable, full_opt, verbose}
+bool vert_opt_forsyth(0), vert_opt_overdraw(0), use_model_meshlets(0);
+int model_qem_lod_levels(0); // number of quadric error simplified LOD levels to generate for each model material, 0 = disabled
+float model_qem_lod_pixels(1.0); // max screen space error of a simplified LOD level, in pixels
+unsigned map_export_levels(4); // number of zoom levels in the exported overhead map tile pyramid
+float map_export_size(0.0); // half width of the exported overhead map region in world units, 0 = scene size
+string map_export_dir;
+int map_export_on_load(0); // 0=only export map tiles with 'H' in map mode, 1=export after the first frame, 2=export after the first frame and quit (headless batch export)
 
 
-extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress;
+extern bool clear_landscape_vbo, use_dense_voxels, tree_4th_branches, model_calc_tan_vect, water_is_lava, use_grass_tess, def_tex_compress, use_sw_occlusion_zbuf;
 extern int camera_flight, DISABLE_WATER, DISABLE_SCENERY, camera_invincible, onscreen_display, mesh_freq_filter, show_waypoints, last_inventory_frame;
 extern int tree_coll_level, GLACIATE, UNLIMITED_WEAPONS, destroy_thresh, MAX_RUN_DIST, mesh_gen_mode, mesh_gen_shape, map_drag_x, map_drag_y;
 extern unsigned NPTS, NRAYS, LOCAL_RAYS, GLOBAL_RAYS, DYNAMIC_RAYS, NUM_THREADS, MAX_RAY_BOUNCES, grass_density, max_unique_trees, shadow_map_sz;
@@ -174,6 +183,7 @@ void free_animal_context();
 void setup_linear_fog(colorRGBA const &color, float fog_end);
 
 void write_map_mode_heightmap_image();
+void export_map_tiles();
 
 // all OpenGL error handling goes through these functions
 bool get_gl_error(unsigned loc_id) {
@@ -1103,7 +1113,7 @@ void keyboard_proc(unsigned char key, int x, int y) {
 
 	case 'H': // save mesh state/modmap/voxel brushes/cobj file/materials/heightmap
 		if (world_mode == WMODE_UNIVERSE) {export_modmap("output.modmap");}
-		else if (map_mode) {write_map_mode_heightmap_image();}
+		else if (map_mode) {write_map_mode_heightmap_image(); export_map_tiles();}
 		else if (world_mode == WMODE_GROUND) {
 			if (voxel_editing) {write_voxel_brushes();}
 			else if (spheres_mode) {
@@ -1628,6 +1638,8 @@ int load_config(string const &config_file) {
 	kwmb.add("mt_cobj_tree_build", mt_cobj_tree_build);
 	kwmb.add("global_lighting_update", global_lighting_update);
 	kwmb.add("lighting_update_offline", lighting_update_offline);
+	kwmb.add("adaptive_ray_tracing", adaptive_ray_tracing); // stratified sky/global rays, concentrated where pilot rays are partially occluded
+	kwmb.add("incremental_relight", incremental_relight); // re-trace lighting near destroyed cobjs in the background
 	kwmb.add("two_sided_lighting", two_sided_lighting);
 	kwmb.add("disable_sound", disable_sound);
 	kwmb.add("start_maximized", start_maximized);
@@ -1671,6 +1683,9 @@ int load_config(string const &config_file) {
 	kwmb.add("auto_calc_tt_model_zvals", auto_calc_tt_model_zvals);
 	kwmb.add("disable_tt_water_reflect", disable_tt_water_reflect);
 	kwmb.add("use_model_lod_blocks", use_model_lod_blocks);
+	kwmb.add("use_model_meshlets", use_model_meshlets); // split model triangles into small clusters for VFC and backface cone culling
+	kwmb.add("vertex_opt_forsyth", vert_opt_forsyth); // use the slower Forsyth vertex cache optimizer rather than tipsify
+	kwmb.add("vertex_opt_overdraw", vert_opt_overdraw); // sort triangle clusters to reduce overdraw after vertex cache optimization
 	kwmb.add("flatten_tt_mesh_under_models", flatten_tt_mesh_under_models);
 	kwmb.add("show_map_view_mandelbrot", show_map_view_mandelbrot);
 	kwmb.add("def_texture_compress", def_tex_compress);
@@ -1687,6 +1702,8 @@ int load_config(string const &config_file) {
 	kwmb.add("allow_model3d_quads", allow_model3d_quads);
 	kwmb.add("keep_keycards_on_death", keep_keycards_on_death);
 	kwmb.add("enable_timing_profiler", enable_timing_profiler);
+	kwmb.add("parallel_obj_advance", parallel_obj_advance); // advance collision free airborne dynamic objects in parallel
+	kwmb.add("sw_occlusion_zbuf", use_sw_occlusion_zbuf); // CPU rasterized hierarchical depth buffer for occlusion culling
 
 	kw_to_val_map_t<int> kwmi(error);
 	kwmi.add("verbose", verbose_mode);
@@ -1694,6 +1711,7 @@ int load_config(string const &config_file) {
 	kwmi.add("glaciate", GLACIATE);
 	kwmi.add("dynamic_mesh_scroll", dynamic_mesh_scroll);
 	kwmi.add("mesh_seed", mesh_seed);
+	kwmi.add("model_qem_lod_levels", model_qem_lod_levels);
 	kwmi.add("rgen_seed", rgen_seed);
 	kwmi.add("universe_only", universe_only);
 	kwmi.add("disable_universe", disable_universe);
@@ -1721,6 +1739,7 @@ int load_config(string const &config_file) {
 	kwmi.add("init_game_mode", game_mode);
 	kwmi.add("init_num_balls", init_num_balls);
 	kwmi.add("use_voxel_rocks", use_voxel_rocks); // 0=never, 1=always, 2=only when no vegetation
+	kwmi.add("map_export_on_load", map_export_on_load);
 
 	kw_to_val_map_t<unsigned> kwmu(error);
 	kwmu.add("grass_density", grass_density);
@@ -1738,7 +1757,9 @@ int load_config(string const &config_file) {
 	kwmu.add("snow_coverage_resolution", snow_coverage_resolution);
 	kwmu.add("dlight_grid_bitshift", DL_GRID_BS);
 	kwmu.add("video_framerate", video_framerate);
+	kwmu.add("map_export_levels", map_export_levels);
 	kwmu.add("num_video_threads", num_video_threads);
+	kwmb.add("video_yuv_convert", video_yuv_convert); // convert video frames to YUV420 before sending them to ffmpeg
 
 	kw_to_val_map_t<float> kwmf(error);
 	kwmf.add("gravity", base_gravity);
@@ -1802,6 +1823,8 @@ int load_config(string const &config_file) {
 	kwmf.add("force_czmax", force_czmax);
 	kwmf.add("dlight_intensity_scale", dlight_intensity_scale);
 	kwmf.add("model_mat_lod_thresh", model_mat_lod_thresh);
+	kwmf.add("model_qem_lod_pixels", model_qem_lod_pixels);
+	kwmf.add("map_export_size", map_export_size);
 	kwmf.add("def_texture_aniso", def_tex_aniso);
 	kwmf.add("clouds_per_tile", clouds_per_tile);
 	kwmf.add("atmosphere", def_atmosphere);
@@ -1810,8 +1833,11 @@ int load_config(string const &config_file) {
 	kwmf.add("erode_amount", erode_amount);
 	kwmf.add("ambient_scale", ambient_scale);
 	kwmf.add("ray_step_size_mult", ray_step_size_mult);
+	kwmf.add("adaptive_ray_budget", adaptive_ray_budget); // fraction of the sky/global ray count traced in adaptive mode
+	kwmf.add("adaptive_ray_floor",  adaptive_ray_floor);  // fraction of adaptive rays spread uniformly over all tiles, at least 0.01
 	kwmf.add("system_max_orbit", system_max_orbit);
 	kwmf.add("sky_occlude_scale", sky_occlude_scale);
+	kwmf.add("max_tex_upload_mb_per_frame", max_tex_upload_mb_per_frame); // model textures only; 0.0 = unlimited
 
 	kwmf.add("hmap_plat_bot",    hmap_params.plat_bot);
 	kwmf.add("hmap_plat_height", hmap_params.plat_h);
@@ -1830,6 +1856,12 @@ int load_config(string const &config_file) {
 
 	kw_to_val_map_t<string> kwms(error);
 	kwms.add("cobjs_out_filename", cobjs_out_fn);
+	kwms.add("texture_cache_dir", texture_cache_dir); // enables CPU texture compression with a persistent cache
+	kwms.add("tree_cache_dir", tree_cache_dir); // enables a persistent cache of generated tree branches and leaves
+	kwms.add("waypoint_cache_file", waypoint_cache_fn); // reuses the waypoint graph across runs when the scene is unchanged
+	kwms.add("flow_cache_file", flow_cache_fn); // reuses the lightmap particle flow values across runs when the scene is unchanged
+	kwms.add("dlight_volume_cache_file", llvol_cache_fn); // one indexed file for all indirect dynamic light group volumes, validated by scene hash
+	kwms.add("map_export_dir", map_export_dir); // output directory for the overhead map tile pyramid written with 'H' in map mode or on load (see map_export_on_load)
 
 	while (read_str(fp, strc)) { // slow but should be OK: these ones require special handling
 		string const str(strc);
@@ -1142,6 +1142,13 @@ template<typename T> uint32_t jenkins_one_at_a_time_hash(const T* key, size_t le
 	return hash;
 }
 
+template<typename T> uint64_t fnv1a_64_hash(const T* key, size_t length) { // T is an unsigned integer type; for keys where 32-bit collisions are a concern
+
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t i = 0; i != length; ++i) {hash ^= key[i]; hash *= 1099511628211ULL;}
+	return hash;
+}
+
 template<typename T> struct hash_by_bytes { // should work with all packed vertex types
 	uint32_t operator()(T const &v) const {return jenkins_one_at_a_time_hash((const uint8_t*)&v, sizeof(T));} // slower but better quality hash
 	//uint32_t operator()(T const &v) const {return jenkins_one_at_a_time_hash((const uint32_t*)&v, sizeof(T)>>2);} // faster but lower quality hash
@@ -1319,8 +1326,9 @@ protected:
 	unsigned tid;
 	colorRGBA color;
 	vector<unsigned> mm_offsets;
+	std::string cache_fn; // DDS file written by the CPU block compressor
 
-	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, NUM_DEFER_TYPE};
+	enum {DEFER_TYPE_NONE=0, DEFER_TYPE_DDS, DEFER_TYPE_DDS_CACHE, NUM_DEFER_TYPE};
 
 	void maybe_swap_rb(unsigned char *ptr) const;
 
@@ -1343,6 +1351,7 @@ public:
 	void copy_alpha_from_texture(texture_t const &at, bool alpha_in_red_comp);
 	void merge_in_alpha_channel(texture_t const &at);
 	void build_mipmaps();
+	void calc_custom_mipmap_level(vector<unsigned char> const &idata, unsigned w1, unsigned h1, vector<unsigned char> &odata) const;
 	void create_custom_mipmaps();
 	unsigned char const *get_mipmap_data(unsigned level) const;
 	void set_to_color(colorRGBA const &c);
@@ -1372,6 +1381,11 @@ public:
 	void gen_rand_texture(unsigned char val, unsigned char a_add=0, unsigned a_rand=256);
 	void load_from_gl();
 	void deferred_load_and_bind();
+	std::string get_comp_cache_fn() const;
+	bool can_cpu_compress() const;
+	bool use_compressed_format() const;
+	bool compress_and_cache();
+	void drop_comp_cache();
 	void update_texture_data(int x1, int y1, int x2, int y2);
 	int write_to_jpg(std::string const &fn) const;
 	int write_to_bmp(std::string const &fn) const;
@@ -41,7 +41,17 @@ struct text_message_params {
 int following(0), camera_flight(0), blood_spilled(0), camera_invincible(0), br_source(0), UNLIMITED_WEAPONS(0), last_inventory_frame(0);
 float camera_health(100.0), team_damage(1.0), self_damage(1.0), player_damage(1.0), smiley_damage(1.0);
 point orig_camera(all_zeros), orig_cdir(plus_z);
+
+struct exp_world_effect_t { // deferred crater and cobj destroy part of an explosion
+	point pos;
+	int shooter, type;
+	float damage, size;
+
+	exp_world_effect_t(point const &pos_, int shooter_, float damage_, float size_, int type_) : pos(pos_), shooter(shooter_), type(type_), damage(damage_), size(size_) {}
+};
+
 vector<spark_t> sparks;
+vector<exp_world_effect_t> exp_world_effects;
 vector<beam3d> beams;
 text_message_params msg_params;
 string message;
@@ -1177,9 +1187,10 @@ bool check_explosion_damage(point const &p1, point const &p2, int cobj) {
 }
 
 
-void exp_damage_groups(point const &pos, int shooter, int chain_level, float damage, float size, int type, bool cview) { // slow
+void exp_damage_groups(point const &pos, int shooter, int chain_level, float damage, float size, int type, bool cview) {
 
 	float dist(distance_to_camera(pos));
+	vector<unsigned> ixs; // Note: not static, since this function can be called recursively through blast_radius()
 
 	if (!spectate && dist <= size && (type != IMPACT || shooter != CAMERA_ID) && (type != SEEK_D || !cview)) {
 		if (check_explosion_damage(pos, get_camera_pos(), camera_coll_id)) {
@@ -1200,12 +1211,13 @@ void exp_damage_groups(point const &pos, int shooter, int chain_level, float dam
 		assert(object_types[type2].mass > 0.0);
 		bool const can_move(object_types[type2].friction_factor < 3.0*STICK_THRESHOLD);
 		float const dscale(0.1/sqrt(object_types[type2].mass));
-		unsigned const nobj(objg.end_id);
-		assert(nobj <= objg.max_objects());
+		assert(objg.end_id <= objg.max_objects());
+		objg.get_objs_within_dist(pos, size, ixs); // size+radius?
 
-		for (unsigned i = 0; i < nobj; ++i) {
-			if (!objg.obj_within_dist(i, pos, size)) continue; // size+radius?
+		for (auto ix = ixs.begin(); ix != ixs.end(); ++ix) {
+			unsigned const i(*ix);
 			dwobject &obj(objg.get_obj(i));
+			if (obj.disabled()) continue; // destroyed by a chained explosion
 			if (large_obj && !check_explosion_damage(pos, obj.pos, obj.coll_id)) continue; // blocked by an object
 			float const damage2(damage*(1.02 - p2p_dist(obj.pos, pos)/size));
 			
@@ -1371,6 +1383,21 @@ void create_explosion(point const &pos, int shooter, int chain_level, float dama
 		unsigned const max_parts((type == PLASMA) ? 250 : 50), num_parts(rand() % int(max_parts*size));
 		gen_particles(pos, num_parts);
 	}
+	// craters and cobj destruction are applied later, batched with the other explosions of this frame
+	if ((type == IMPACT || damage > 1000.0) || (damage > 100.0 && destroy_thresh <= 1)) {
+		exp_world_effects.push_back(exp_world_effect_t(pos, shooter, damage, size, type));
+	}
+	//PRINT_TIME("Blast Radius");
+}
+
+
+void apply_explosion_crater(exp_world_effect_t const &e) {
+
+	point const &pos(e.pos);
+	int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y)), type(e.type);
+	float const damage(e.damage);
+	float size(e.size);
+
 	// large damage - throws up dirt and makes craters (later destroys trees)
 	if ((type == IMPACT || damage > 1000.0) && is_over_mesh(pos) && !point_outside_mesh(xpos, ypos)) {
 		float const zval(interpolate_mesh_zval(pos.x, pos.y, 0.0, 0, 1));
@@ -1387,18 +1414,40 @@ void create_explosion(point const &pos, int shooter, int chain_level, float dama
 				update_mesh_height(xpos, ypos, int(crater_dist/HALF_DXY), damage2, 0.0, 0, (crater_radius*crater_depth > 0.25));
 			}
 			if ((h_collision_matrix[ypos][xpos] - mesh_height[ypos][xpos]) < SMALL_NUMBER) {
-				create_ground_rubble(pos, shooter, hv, close, !crater);
+				create_ground_rubble(pos, e.shooter, hv, close, !crater);
 			}
 		}
 	}
-	if (damage > 100.0 && destroy_thresh <= 1) {
-		bool const big(type == BLAST_RADIUS);
-		destroy_coll_objs(pos, damage, shooter, type);
-		float const radius((big ? 4.0 : 1.0)*sqrt(damage)/650.0); // same as in destroy_coll_objs()
+}
+
+void apply_explosion_destroy(exp_world_effect_t const &e) {
+
+	if (e.damage > 100.0 && destroy_thresh <= 1) {
+		bool const big(e.type == BLAST_RADIUS);
+		destroy_coll_objs(e.pos, e.damage, e.shooter, e.type);
+		float const radius((big ? 4.0 : 1.0)*sqrt(e.damage)/650.0); // same as in destroy_coll_objs()
 		unsigned const num_fragments((big ? 2 : 1)*(10 + rand()%10)); // 20-40
-		update_voxel_sphere_region(pos, radius, -0.5, shooter, num_fragments);
+		update_voxel_sphere_region(e.pos, radius, -0.5, e.shooter, num_fragments);
 	}
-	//PRINT_TIME("Blast Radius");
+}
+
+// called once per frame before object physics; each pass of the loop is one generation of an explosion chain,
+// where cobjs destroyed by this generation's explosions can create explosions that are processed in the next pass
+void apply_explosion_world_effects() {
+
+	if (exp_world_effects.empty()) return;
+	//RESET_TIME;
+	vector<exp_world_effect_t> cur;
+
+	while (!exp_world_effects.empty()) {
+		cur.clear();
+		cur.swap(exp_world_effects);
+		begin_cobj_destroy_batch(); // static cobj tree is rebuilt once for the whole generation
+		for (auto i = cur.begin(); i != cur.end(); ++i) {apply_explosion_destroy(*i);}
+		for (auto i = cur.begin(); i != cur.end(); ++i) {apply_explosion_crater (*i);} // last, since cobjs moved by craters aren't in the static tree until the rebuild
+		end_cobj_destroy_batch(); // may create chained explosions, which add to exp_world_effects
+	}
+	//PRINT_TIME("Explosion World Effects");
 }
 
 
@@ -1414,16 +1463,19 @@ void do_impact_damage(point const &fpos, vector3d const &dir, vector3d const &ve
 	}
 	point pos(fpos + dir*(1.25*radius));
 	float const coll_radius(0.75*radius);
+	vector<unsigned> ixs;
 
 	for (int g = 0; g < num_groups; ++g) {
 		obj_group &objg(obj_groups[g]);
 		if (!objg.enabled || (!objg.large_radius() && (objg.type != FRAGMENT || weapon != W_BLADE))) continue;
 		int const type(objg.type);
 		float const robj(object_types[type].radius), rad(coll_radius + robj);
+		objg.get_objs_within_dist(pos, rad, ixs);
 		
-		for (unsigned i = 0; i < objg.end_id; ++i) {
+		for (auto ix = ixs.begin(); ix != ixs.end(); ++ix) {
+			unsigned const i(*ix);
 			if (type == SMILEY && (int)i == shooter) continue; // this is the shooter
-			if (!objg.obj_within_dist(i, pos, rad))  continue;
+			if (objg.get_obj(i).disabled()) continue;
 
 			if (type == SMILEY) {
 				if (weapon == W_BLADE) {++sstates[shooter].cb_hurt;}
@@ -1491,11 +1543,12 @@ void do_area_effect_damage(point const &pos, float effect_radius, float damage,
 	obj_group const &objg(obj_groups[coll_id[SMILEY]]);
 	
 	if (objg.enabled) { // test the smileys
-		for (unsigned i = 0; i < objg.end_id; ++i) {
-			if (!objg.get_obj(i).disabled() && dist_less_than(pos, objg.get_obj(i).pos, radius)) {
-				// test for objects blocking the damage effects?
-				smiley_collision(i, ((source == NO_SOURCE) ? i : source), zero_vector, pos, damage, type);
-			}
+		vector<unsigned> ixs;
+		objg.get_objs_within_dist(pos, radius, ixs);
+
+		for (auto i = ixs.begin(); i != ixs.end(); ++i) {
+			// test for objects blocking the damage effects?
+			smiley_collision(*i, ((source == NO_SOURCE) ? *i : source), zero_vector, pos, damage, type);
 		}
 	}
 }
@@ -2172,13 +2225,17 @@ point projectile_test(point const &pos, vector3d const &vcf_, float firing_error
 			is_metal   = (cp.metalness > 0.0);
 		}
 	}
-	for (int g = 0; g < num_groups; ++g) { // collisions with dynamic group objects - this can be slow (Note that some of these are already in cobjs test)
+	vector<unsigned> ixs;
+
+	for (int g = 0; g < num_groups; ++g) { // collisions with dynamic group objects (Note that some of these are already in cobjs test)
 		obj_group const &objg(obj_groups[g]);
 		int const type(objg.type);
 		obj_type const &otype(object_types[type]);
 		if (!objg.enabled || !objg.large_radius() || type == PLASMA || type == TELEPORTER) continue;
+		objg.get_objs_within_dist(pos, (range + otype.radius + SMALL_NUMBER), ixs); // range can only decrease below
 		
-		for (unsigned i = 0; i < objg.end_id; ++i) {
+		for (auto ix = ixs.begin(); ix != ixs.end(); ++ix) {
+			unsigned const i(*ix);
 			if (type == SMILEY && (int)i == shooter && !laser_m2) continue; // this is the shooter
 			if (!objg.obj_within_dist(i, pos, (range + otype.radius + SMALL_NUMBER))) continue;
 			point const &apos(objg.get_obj(i).pos);
@@ -715,6 +715,78 @@ float dwobject::get_true_mass() const {
 }
 
 
+// applies gravity, wind, and air/water friction, then moves the object; no collision detection; only modifies this object
+void dwobject::integrate_airborne(int iter, float radius, float friction, bool coll_last_frame) {
+
+	obj_type const &otype(object_types[type]);
+	float air_factor(0.0);
+
+	if (!(flags & UNDERWATER)) {
+		if (flags & FLOATING) {
+			if (is_flat()) {
+				//init_dir.z = 0.0;
+				int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y));
+				vector3d const wnorm(has_water(xpos, ypos) ? wat_vert_normals[ypos][xpos] : plus_z);
+				set_orient_for_coll(&wnorm);
+			}
+			if (WATER_SURF_FRICTION < 1.0) {air_factor = (1.0 - WATER_SURF_FRICTION)*otype.air_factor;}
+		}
+		else {
+			air_factor = otype.air_factor;
+		}
+	}
+	bool const collided(coll_last_frame || fabs(velocity.z) < 1.0E-6);
+	vector3d v_flow(enable_fsource ? get_flow_velocity(pos) : velocity), vtot(v_flow);
+	vector3d const local_wind(get_local_wind(pos));
+	
+	if (iter == 0) {
+		if (collided) {vtot.z += local_wind.z;} else {vtot += local_wind;}
+	}
+	if (!(flags & Z_STOPPED)) {
+		double gscale((type == PLASMA && init_dir.x != 0.0) ? 1.0/sqrt(init_dir.x) : 1.0);
+		float const density(get_true_density());
+		if ((flags & IN_WATER) && density > WATER_DENSITY) {gscale *= (density - WATER_DENSITY)/density;}
+
+		if (enable_fsource) {
+			double const grav_well(min(1.0f, 0.1f*v_flow.mag()));
+
+			if (-velocity.z < otype.terminal_vel) {
+				velocity.z -= (1.0 - grav_well)*base_gravity*gscale*GRAVITY*tstep*otype.gravity;
+				velocity.z  = grav_well*velocity.z - (1.0 - grav_well)*min(-velocity.z, otype.terminal_vel);
+			}
+			if (fabs(air_factor*vtot.z) > fabs(velocity.z) || ((vtot.z < 0) != (velocity.z < 0))) {
+				velocity.z = (1.0 - grav_well*air_factor)*velocity.z + air_factor*vtot.z; // wind?
+			}
+		}
+		else {
+			if (-velocity.z < otype.terminal_vel) {
+				velocity.z -= base_gravity*gscale*GRAVITY*tstep*otype.gravity;
+				velocity.z  = -min(-velocity.z, otype.terminal_vel);
+			}
+			if (fabs(air_factor*local_wind.z) > fabs(velocity.z) || ((local_wind.z < 0) != (velocity.z < 0))) {
+				velocity.z += air_factor*local_wind.z;
+			}
+		}
+	}
+	if (!(flags & XY_STOPPED)) {
+		for (unsigned d = 0; d < 2; ++d) {
+			if (fabs(air_factor*vtot[d]) > fabs(velocity[d]) || ((vtot[d] < 0) != (velocity[d] < 0))) {
+				velocity[d] = (1.0 - air_factor)*velocity[d] + air_factor*vtot[d];
+			}
+			if (collided && iter == 0 && !(flags | IN_WATER)) { // apply static friction
+				bool const stopped(friction >= 2.0*STICK_THRESHOLD || fabs(velocity[d]) <= friction);
+				velocity[d] = (stopped ? 0.0 : max(0.0f, (velocity[d] + ((velocity[d] > 0.0) ? -friction : friction))));
+			}
+			pos[d] += tstep*velocity[d]; // move object
+		}
+		if (flags & FLOATING) {float_downstream(pos, radius);}
+	}
+	assert(!is_nan(tstep));
+	pos.z += tstep*velocity.z;
+	verify_data();
+}
+
+
 // 0 = out of range/expired, 1 = airborne, 2 = collision, 3 = moving on ground, 4 = motionless
 void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj_index) { // returns collision status
 
@@ -757,22 +829,6 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 		if (type == ROCKET && direction == 1) { // rapid fire rocket
 			rotate_vector3d(signed_rand_vector(), 0.02*fticks*signed_rand_float(), velocity);
 		}
-		float air_factor(0.0);
-
-		if (!(flags & UNDERWATER)) {
-			if (flags & FLOATING) {
-				if (is_flat()) {
-					//init_dir.z = 0.0;
-					int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y));
-					vector3d const wnorm(has_water(xpos, ypos) ? wat_vert_normals[ypos][xpos] : plus_z);
-					set_orient_for_coll(&wnorm);
-				}
-				if (WATER_SURF_FRICTION < 1.0) {air_factor = (1.0 - WATER_SURF_FRICTION)*otype.air_factor;}
-			}
-			else {
-				air_factor = otype.air_factor;
-			}
-		}
 		if (flags & Z_STOPPED) {
 			int const xpos(get_xpos(pos.x)), ypos(get_ypos(pos.y));
 
@@ -786,56 +842,8 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 			}
 		}
 		point old_pos(pos);
-		bool const collided(coll_last_frame || fabs(velocity.z) < 1.0E-6);
-		vector3d v_flow(enable_fsource ? get_flow_velocity(pos) : velocity), vtot(v_flow);
 		float const vz_old(velocity.z);
-		vector3d const local_wind(get_local_wind(pos));
-		
-		if (iter == 0) {
-			if (collided) {vtot.z += local_wind.z;} else {vtot += local_wind;}
-		}
-		if (!(flags & Z_STOPPED)) {
-			double gscale((type == PLASMA && init_dir.x != 0.0) ? 1.0/sqrt(init_dir.x) : 1.0);
-			float const density(get_true_density());
-			if ((flags & IN_WATER) && density > WATER_DENSITY) {gscale *= (density - WATER_DENSITY)/density;}
-
-			if (enable_fsource) {
-				double const grav_well(min(1.0f, 0.1f*v_flow.mag()));
-
-				if (-velocity.z < otype.terminal_vel) {
-					velocity.z -= (1.0 - grav_well)*base_gravity*gscale*GRAVITY*tstep*otype.gravity;
-					velocity.z  = grav_well*velocity.z - (1.0 - grav_well)*min(-velocity.z, otype.terminal_vel);
-				}
-				if (fabs(air_factor*vtot.z) > fabs(velocity.z) || ((vtot.z < 0) != (velocity.z < 0))) {
-					velocity.z = (1.0 - grav_well*air_factor)*velocity.z + air_factor*vtot.z; // wind?
-				}
-			}
-			else {
-				if (-velocity.z < otype.terminal_vel) {
-					velocity.z -= base_gravity*gscale*GRAVITY*tstep*otype.gravity;
-					velocity.z  = -min(-velocity.z, otype.terminal_vel);
-				}
-				if (fabs(air_factor*local_wind.z) > fabs(velocity.z) || ((local_wind.z < 0) != (velocity.z < 0))) {
-					velocity.z += air_factor*local_wind.z;
-				}
-			}
-		}
-		if (!(flags & XY_STOPPED)) {
-			for (unsigned d = 0; d < 2; ++d) {
-				if (fabs(air_factor*vtot[d]) > fabs(velocity[d]) || ((vtot[d] < 0) != (velocity[d] < 0))) {
-					velocity[d] = (1.0 - air_factor)*velocity[d] + air_factor*vtot[d];
-				}
-				if (collided && iter == 0 && !(flags | IN_WATER)) { // apply static friction
-					bool const stopped(friction >= 2.0*STICK_THRESHOLD || fabs(velocity[d]) <= friction);
-					velocity[d] = (stopped ? 0.0 : max(0.0f, (velocity[d] + ((velocity[d] > 0.0) ? -friction : friction))));
-				}
-				pos[d] += tstep*velocity[d]; // move object
-			}
-			if (flags & FLOATING) {float_downstream(pos, radius);}
-		}
-		assert(!is_nan(tstep));
-		pos.z += tstep*velocity.z;
-		verify_data();
+		integrate_airborne(iter, radius, friction, coll_last_frame);
 
 		// check collisions
 		float dz;
@@ -942,6 +950,36 @@ void dwobject::advance_object(bool disable_motionless_objects, int iter, int obj
 }
 
 
+// advances an airborne object by one step, but only if it can't interact with anything (mesh, water, cobjs) this frame;
+// only modifies this object, so can be called in parallel across objects; returns 0 with no changes if advance_object() must be used instead
+bool dwobject::try_advance_free_flight(point const &pred_pos, vector<unsigned> &cobjs) {
+
+	if (world_mode != WMODE_GROUND || status != 1 || temperature <= ABSOLUTE_ZERO) return 0;
+	if (flags & (CAMERA_VIEW | Z_STOPPED | FLOATING | UNDERWATER | IN_WATER | IS_ON_ICE | OBJ_COLLIDED | STATIC_COBJ_COLL)) return 0;
+	if (type == ROCKET || type == LANDMINE || type == PLASMA || type == PARTICLE || type == SMILEY) return 0;
+	obj_type const &otype(object_types[type]);
+	if (pos.z < zmin || (otype.lifetime > 0 && time > otype.lifetime)) return 0; // expired
+	dwobject obj(*this); // advance a copy so that nothing is modified unless the step is collision free
+	obj.time += iticks;
+	float const radius(obj.get_true_radius());
+	obj.integrate_airborne(0, radius, otype.friction_factor, 0);
+	float dz(0.0);
+	if (get_obj_zval(obj.pos, dz, ((otype.flags & COLL_DESTROYS) ? 0.25*radius : radius)) != 1) return 0; // mesh coll or out of simulation region
+	if ((obj.pos.z - otype.radius) <= max_water_height) return 0; // may collide with water
+	cube_t bcube(pos, obj.pos);
+	bcube.union_with_pt(pred_pos); // include the line used for the MORE_COLL_TSTEPS test
+	bcube.expand_by(radius);
+
+	for (unsigned d = 0; d < 2; ++d) { // static, dynamic
+		cobjs.clear();
+		get_intersecting_cobjs_tree(bcube, cobjs, -1, 0.0, (d != 0), 0);
+		if (!cobjs.empty()) return 0;
+	}
+	*this = obj;
+	return 1;
+}
+
+
 int get_obj_zval(point &pt, float &dz, float z_offset) { // 0 = out of bounds/error, 1 = airborne, 2 = on ground
 
 	if (world_mode == WMODE_GROUND) { // this stuff doesn't apply to tiled terrain mode
@@ -7,6 +7,7 @@
 #include "textures_3dw.h"
 #include "gl_ext_arb.h"
 #include "shaders.h"
+#include <limits>
 
 
 float const TEXTURE_SMOOTH        = 0.01;
@@ -204,9 +205,10 @@ unsigned char *landscape0 = NULL;
 extern bool mesh_difuse_tex_comp, water_is_lava, invert_bump_maps;
 extern unsigned smoke_tid, dl_tid, elem_tid, gb_tid, reflection_tid, depth_tid, empty_smap_tid, frame_buffer_RGB_tid;
 extern int world_mode, read_landscape, default_ground_tex, xoff2, yoff2, DISABLE_WATER;
-extern int scrolling, dx_scroll, dy_scroll, display_mode, iticks, universe_only, window_width, window_height;
-extern float zmax, zmin, glaciate_exp, relh_adj_tex, vegetation, fticks;
+extern int scrolling, dx_scroll, dy_scroll, display_mode, iticks, universe_only, window_width, window_height, frame_counter;
+extern float zmax, zmin, glaciate_exp, relh_adj_tex, vegetation, fticks, max_tex_upload_mb_per_frame;
 extern char *mesh_diffuse_tex_fn;
+extern string texture_cache_dir;
 
 
 void force_upload_all_textures();
@@ -270,10 +272,7 @@ void load_textures() {
 #pragma omp parallel for schedule(dynamic)
 	for (int i = 0; i < (int)textures.size(); ++i) {
 		//cout << "."; cout.flush();
-		if (!is_tex_disabled(i)) {textures[i].load(i, 0, 0, 1);} // ignore word alignment here, since resizing isn't thread safe
-	}
-	for (int i = 0; i < (int)textures.size(); ++i) {
-		if (!is_tex_disabled(i)) {textures[i].fix_word_alignment();}
+		if (!is_tex_disabled(i)) {textures[i].load(i);}
 	}
 	cout << " done" << endl;
 	textures[BULLET_D_TEX].merge_in_alpha_channel(textures[BULLET_A_TEX]);
@@ -298,6 +297,13 @@ void load_textures() {
 		if (is_tex_disabled(i)) continue; // skip
 		textures[i].init();
 	}
+	if (!texture_cache_dir.empty()) {
+		timer_t timer("Texture Compress");
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)textures.size(); ++i) { // after all CPU-side data modification
+			if (!is_tex_disabled(i) && i != LANDSCAPE_TEX) {textures[i].compress_and_cache();} // landscape texture is updated dynamically
+		}
+	}
 	textures[TREE_HEMI_TEX].set_color_alpha_to_one();
 	textures_inited = 1;
 
@@ -330,6 +336,7 @@ int get_texture_by_name(string const &name, bool is_normal_map, bool invert_y, i
 	if (textures_inited) {
 		new_tex.load(tid);
 		new_tex.init();
+		new_tex.compress_and_cache();
 	}
 	textures.push_back(new_tex);
 	texture_name_map[name] = tid;
@@ -348,6 +355,21 @@ void force_upload_all_textures() {
 }
 
 
+// limits the texture data uploaded to the GPU per frame to avoid frame time spikes when many textures become visible at once;
+// at least one texture is always allowed per frame so that progress is made
+bool check_tex_upload_budget(unsigned num_bytes) {
+
+	static int last_frame(-1);
+	static float mb_this_frame(0.0);
+	if (max_tex_upload_mb_per_frame <= 0.0) return 1; // unlimited
+	if (frame_counter != last_frame) {last_frame = frame_counter; mb_this_frame = 0.0;}
+	float const mb(num_bytes/(1024.0*1024.0));
+	if (mb_this_frame > 0.0 && mb_this_frame + mb > max_tex_upload_mb_per_frame) return 0;
+	mb_this_frame += mb;
+	return 1;
+}
+
+
 bool select_texture(int id) {
 
 	bool const no_tex(id < 0);
@@ -461,9 +483,11 @@ GLenum texture_t::calc_internal_format() const {
 
 	assert(ncolors >= 1 && ncolors <= 4);
 	if (is_16_bit_gray) {return GL_R16;} // compressed?
-	return get_internal_texture_format(ncolors, (COMPRESS_TEXTURES && do_compress && type != 2), 0); // linear_space=0
+	return get_internal_texture_format(ncolors, use_compressed_format(), 0); // linear_space=0
 }
 
+bool texture_t::use_compressed_format() const {return (COMPRESS_TEXTURES && do_compress && type != 2);}
+
 GLenum texture_t::calc_format() const {
 	return (is_16_bit_gray ? GL_RED : get_texture_format(ncolors));
 }
@@ -480,9 +504,10 @@ void texture_t::do_gl_init(bool free_after_upload) {
 	}
 	//cout << "bind texture " << name << " size " << width << "x" << height << endl;
 	//RESET_TIME;
-	setup_texture(tid, (use_mipmaps != 0 && !defer_load()), wrap, wrap, mirror, mirror, 0, anisotropy);
+	setup_texture(tid, (use_mipmaps != 0 && defer_load_type != DEFER_TYPE_DDS), wrap, wrap, mirror, mirror, 0, anisotropy); // cached DDS files include mipmaps
 	if (defer_load()) {deferred_load_and_bind();} // FIXME: mipmaps?
-	else {
+
+	if (!defer_load()) { // not deferred, or the compressed texture cache failed to load
 		assert(is_allocated());
 		assert(width > 0 && height > 0);
 		glTexImage2D(GL_TEXTURE_2D, 0, calc_internal_format(), width, height, 0, calc_format(), get_data_format(), data);
@@ -560,6 +585,7 @@ void texture_t::build_mipmaps() {
 
 	if (use_mipmaps != 2) return; // not enabled
 	assert(width == height);
+	assert(!is_16_bit_gray); // mm_data is 8-bit only
 	if (!mm_offsets.empty()) {assert(mm_data); return;} // already built
 	assert(mm_data == NULL);
 	unsigned data_size(0);
@@ -569,14 +595,11 @@ void texture_t::build_mipmaps() {
 		data_size += ncolors*tsz*tsz;
 	}
 	mm_data = new unsigned char[data_size];
-	GLenum const format(calc_format());
 
-	for (unsigned level = 0; level < mm_offsets.size(); ++level) {
+	for (unsigned level = 0; level < mm_offsets.size(); ++level) { // thread safe, no GL calls
 		unsigned const tsz(width >> level);
 		assert(tsz > 1);
-		int const ret(gluScaleImage(format, tsz,   tsz,   get_data_format(), get_mipmap_data(level),
-			                                tsz/2, tsz/2, get_data_format(), (mm_data + mm_offsets[level])));
-		if (ret) cout << "GLU error during mipmap image scale: " << gluErrorString(ret) << "." << endl;
+		downsample_image_2x2(get_mipmap_data(level), tsz, tsz, ncolors, (mm_data + mm_offsets[level]));
 	}
 }
 
@@ -597,6 +620,7 @@ void texture_t::set_to_color(colorRGBA const &c) {
 	if (c == ALPHA0 && (orig_data == NULL || data == orig_data)) return; // color disabled (but never enabled)
 	color = c;
 	gl_delete();
+	drop_comp_cache(); // cached data no longer matches
 
 	if (c == ALPHA0) { // color disabled
 		data = orig_data;
@@ -775,16 +799,107 @@ void texture_t::add_alpha_channel() {
 }
 
 
-void texture_t::resize(int new_w, int new_h) { // Note: not thread safe
+// ************ thread safe image resampling kernels ************
+// These operate on raw texel data with no GL calls, so they can be used within the parallel texture load loops.
+// Inner loops run over contiguous rows with no per-texel branches so that the compiler can vectorize them.
+
+// 2x2 box filter matching the GL mipmap size convention (odd dimensions are truncated, 1 texel dimensions are kept)
+void downsample_image_2x2(unsigned char const *src, unsigned w1, unsigned h1, unsigned ncolors, unsigned char *dest) {
+
+	unsigned const w2(max(w1>>1, 1U)), h2(max(h1>>1, 1U));
+	unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0), xstep((w2 < w1) ? 2*ncolors : ncolors);
+
+	for (unsigned y = 0; y < h2; ++y) {
+		unsigned char const *s(src + (y<<1)*ncolors*w1);
+		unsigned char *d(dest + y*ncolors*w2);
+
+		for (unsigned x = 0; x < w2; ++x, s += xstep, d += ncolors) {
+			for (unsigned n = 0; n < ncolors; ++n) {
+				d[n] = (unsigned char)(((unsigned)s[n] + s[xinc+n] + s[yinc+n] + s[yinc+xinc+n] + 2) >> 2);
+			}
+		}
+	}
+}
+
+struct resample_tap_t {
+	unsigned ix;
+	float weight;
+	resample_tap_t(unsigned ix_, float w) : ix(ix_), weight(w) {}
+};
+
+// box filter footprint of each output texel in input texels, with fractional coverage at the ends;
+// the footprint is at least one input texel wide, which gives linear interpolation when upsampling
+void calc_box_filter_taps(unsigned src_sz, unsigned dest_sz, vector<unsigned> &offsets, vector<resample_tap_t> &taps) {
+
+	float const scale(float(src_sz)/float(dest_sz)), half_width(0.5f*max(scale, 1.0f));
+	offsets.resize(dest_sz+1);
+	taps.clear();
+
+	for (unsigned d = 0; d < dest_sz; ++d) {
+		offsets[d] = taps.size();
+		float const center((d + 0.5f)*scale), lo(max(0.0f, center - half_width)), hi(min(float(src_sz), center + half_width));
+		float wsum(0.0);
+
+		for (unsigned s = unsigned(lo); s < src_sz && float(s) < hi; ++s) {
+			float const w(min(hi, s+1.0f) - max(lo, float(s)));
+			if (w <= 0.0f) continue;
+			taps.push_back(resample_tap_t(s, w));
+			wsum += w;
+		}
+		assert(wsum > 0.0f);
+		for (unsigned t = offsets[d]; t < taps.size(); ++t) {taps[t].weight /= wsum;}
+	}
+	offsets[dest_sz] = taps.size();
+}
+
+// separable box filter resize of 8-bit or 16-bit texel data, replaces gluScaleImage(), which isn't thread safe
+template<typename T> void resample_image(T const *src, unsigned w, unsigned h, unsigned ncolors, T *dest, unsigned new_w, unsigned new_h) {
+
+	vector<unsigned> xoff, yoff;
+	vector<resample_tap_t> xtaps, ytaps;
+	calc_box_filter_taps(w, new_w, xoff, xtaps);
+	calc_box_filter_taps(h, new_h, yoff, ytaps);
+	unsigned const in_row_sz(ncolors*w), out_row_sz(ncolors*new_w);
+	vector<float> tmp(out_row_sz*h), accum(out_row_sz);
+
+	for (unsigned y = 0; y < h; ++y) { // horizontal pass
+		T const *s(src + y*in_row_sz);
+		float *t(&tmp[y*out_row_sz]);
+
+		for (unsigned x = 0; x < new_w; ++x, t += ncolors) {
+			for (unsigned n = 0; n < ncolors; ++n) {t[n] = 0.0f;}
+
+			for (unsigned i = xoff[x]; i < xoff[x+1]; ++i) {
+				T const *sp(s + ncolors*xtaps[i].ix);
+				float const wt(xtaps[i].weight);
+				for (unsigned n = 0; n < ncolors; ++n) {t[n] += wt*sp[n];}
+			}
+		}
+	}
+	float const max_val(std::numeric_limits<T>::max());
+
+	for (unsigned y = 0; y < new_h; ++y) { // vertical pass, accumulating whole rows
+		for (unsigned i = 0; i < out_row_sz; ++i) {accum[i] = 0.0f;}
+
+		for (unsigned t = yoff[y]; t < yoff[y+1]; ++t) {
+			float const *row(&tmp[ytaps[t].ix*out_row_sz]);
+			float const wt(ytaps[t].weight);
+			for (unsigned i = 0; i < out_row_sz; ++i) {accum[i] += wt*row[i];}
+		}
+		T *d(dest + y*out_row_sz);
+		for (unsigned i = 0; i < out_row_sz; ++i) {d[i] = T(min(max_val, (accum[i] + 0.5f)));}
+	}
+}
+
+void texture_t::resize(int new_w, int new_h) { // thread safe
 
 	if (new_w == width && new_h == height) return; // already correct size
 	assert(is_allocated());
 	assert(width > 0 && height > 0 && new_w > 0 && new_h > 0);
-	unsigned char *new_data(new unsigned char[new_w*new_h*ncolors]);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // required to handle calls from from fix_word_alignment()
-	int const ret(gluScaleImage(calc_format(), width, height, get_data_format(), data, new_w, new_h, get_data_format(), new_data));
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-	if (ret) {cout << "GLU error during image scale: " << gluErrorString(ret) << "." << endl;}
+	unsigned char *new_data(new unsigned char[new_w*new_h*ncolors*bytes_per_channel()]);
+
+	if (is_16_bit_gray) {resample_image((unsigned short const *)data, width, height, ncolors, (unsigned short *)new_data, new_w, new_h);}
+	else {resample_image(data, width, height, ncolors, new_data, new_w, new_h);}
 	free_data(); // only if size increases?
 	data   = new_data;
 	width  = new_w;
@@ -828,36 +943,75 @@ void texture_t::make_normal_map() {
 	assert(ncolors == 1 && !is_16_bit_gray); // 8-bit grayscale heightmap
 	ncolors = 3; // convert to RGB
 	unsigned char *new_data(new unsigned char[num_bytes()]);
+	// central differences with wrap; the edge columns are handled by building padded rows so that the inner loops have no branches
+	vector<int> dx(num_pixels()), dy(num_pixels()), row(width+2);
 	int max_delta(1);
 
 	for (int y = 0; y < height; ++y) { // assume texture wraps
-		int const ym1((y == 0) ? height-1 : y-1), yp1((y+1 == height) ? 0 : y+1);
+		unsigned char const *rm1(data + ((y == 0) ? height-1 : y-1)*width), *r(data + y*width), *rp1(data + ((y+1 == height) ? 0 : y+1)*width);
+		int *dxr(&dx[y*width]), *dyr(&dy[y*width]);
+		row[0] = r[width-1];
+		for (int x = 0; x < width; ++x) {row[x+1] = r[x];}
+		row[width+1] = r[0];
 
 		for (int x = 0; x < width; ++x) {
-			int const xm1((x == 0) ? width-1 : x-1), xp1((x+1 == width) ? 0 : x+1);
-			max_delta = max(max_delta, abs((int)data[xp1+y*width] - (int)data[xm1+y*width]));
-			max_delta = max(max_delta, abs((int)data[x+yp1*width] - (int)data[x+ym1*width]));
+			dxr[x] = row[x+2] - row[x];
+			dyr[x] = int(rp1[x]) - int(rm1[x]);
+			max_delta = max(max_delta, max(abs(dxr[x]), abs(dyr[x])));
 		}
 	}
-	float max_delta_inv(1.0/float(max_delta));
-
-	for (int y = 0; y < height; ++y) { // assume texture wraps
-		int const ym1((y == 0) ? height-1 : y-1), yp1((y+1 == height) ? 0 : y+1);
+	float const max_delta_inv(1.0/float(max_delta)), xy_sign(invert_bump_maps ? -1.0 : 1.0);
+	unsigned const npixels(num_pixels());
 
-		for (int x = 0; x < width; ++x) {
-			int const xm1((x == 0) ? width-1 : x-1), xp1((x+1 == width) ? 0 : x+1), off(3*(x + y*width));
-			vector3d n(-((int)data[xp1+y*width] - (int)data[xm1+y*width])*max_delta_inv,
-				        ((int)data[x+yp1*width] - (int)data[x+ym1*width])*max_delta_inv, 1.0);
-			n.normalize();
-			if (invert_bump_maps) {n.x = -n.x; n.y = -n.y;}
-			UNROLL_3X(new_data[off+i_] = (unsigned char)(127.5*(n[i_]+1.0)););
-		}
+	for (unsigned i = 0; i < npixels; ++i) {
+		float const nx(-dx[i]*max_delta_inv*xy_sign), ny(dy[i]*max_delta_inv*xy_sign), inv_len(1.0f/sqrt(nx*nx + ny*ny + 1.0f));
+		new_data[3*i+0] = (unsigned char)(127.5f*(nx*inv_len + 1.0f));
+		new_data[3*i+1] = (unsigned char)(127.5f*(ny*inv_len + 1.0f));
+		new_data[3*i+2] = (unsigned char)(127.5f*(inv_len + 1.0f));
 	}
 	free_data();
 	data = new_data;
 }
 
 
+// computes the next custom mipmap level from idata of size w1 x h1; thread safe
+void texture_t::calc_custom_mipmap_level(vector<unsigned char> const &idata, unsigned w1, unsigned h1, vector<unsigned char> &odata) const {
+
+	unsigned const w2(max(w1>>1, 1U)), h2(max(h1>>1, 1U));
+	odata.resize(ncolors*w2*h2);
+	if (ncolors != 4) {downsample_image_2x2(&idata.front(), w1, h1, ncolors, &odata.front()); return;} // no alpha, use a simple box filter
+	unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
+	bool const use_avg_color(use_mipmaps == 4);
+	float const maw(mipmap_alpha_weight);
+	color_wrapper cw; cw.set_c4(color);
+
+	for (unsigned y = 0; y < h2; ++y) {
+		for (unsigned x = 0; x < w2; ++x) {
+			unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
+			unsigned char const *i1(&idata[ix2]), *i2(i1 + xinc), *i3(i1 + yinc), *i4(i1 + yinc + xinc);
+			unsigned char *o(&odata[ix1]);
+			unsigned const a1(i1[3]), a2(i2[3]), a3(i3[3]), a4(i4[3]);
+			unsigned const a_sum(a1 + a2 + a3 + a4);
+
+			if (a_sum == 0) { // fully transparent
+				if (use_avg_color) {UNROLL_3X(o[i_] = cw.c[i_];)} // use average texture color
+				else {UNROLL_3X(o[i_] = (unsigned char)(((unsigned)i1[i_] + i2[i_] + i3[i_] + i4[i_]) / 4);)} // color is average of all 4 values
+				o[3] = 0;
+			}
+			else { // pre-multiplied and normalized colors
+				if (use_avg_color) {
+					unsigned const a_cw(1020 - a_sum); // use average texture color for transparent pixels
+					UNROLL_3X(o[i_] = (unsigned char)((a1*i1[i_] + a2*i2[i_] + a3*i3[i_] + a4*i4[i_] + a_cw*cw.c[i_]) / 1020);)
+				}
+				else {
+					UNROLL_3X(o[i_] = (unsigned char)((a1*i1[i_] + a2*i2[i_] + a3*i3[i_] + a4*i4[i_]) / a_sum);)
+				}
+				o[3] = min(255U, min(max(max(a1, a2), max(a3, a4)), unsigned(maw*a_sum)));
+			}
+		} // for x
+	} // for y
+}
+
 void texture_t::create_custom_mipmaps() {
 
 	assert(is_allocated());
@@ -866,49 +1020,11 @@ void texture_t::create_custom_mipmaps() {
 	vector<unsigned char> idata, odata;
 	idata.resize(tsize);
 	memcpy(&idata.front(), data, tsize);
-	color_wrapper cw; cw.set_c4(color);
 
 	for (unsigned w = width, h = height, level = 1; w > 1 || h > 1; w >>= 1, h >>= 1, ++level) {
 		unsigned const w1(max(w,    1U)), h1(max(h,    1U));
 		unsigned const w2(max(w>>1, 1U)), h2(max(h>>1, 1U));
-		unsigned const xinc((w2 < w1) ? ncolors : 0), yinc((h2 < h1) ? ncolors*w1 : 0);
-		odata.resize(ncolors*w2*h2);
-
-		for (unsigned y = 0; y < h2; ++y) {
-			for (unsigned x = 0; x < w2; ++x) {
-				unsigned const ix1(ncolors*(y*w2+x)), ix2(ncolors*((y<<1)*w1+(x<<1)));
-
-				if (ncolors == 1) {
-					odata[ix1] = (unsigned char)(((unsigned)idata[ix2] + idata[ix2+xinc] + idata[ix2+yinc] + idata[ix2+yinc+xinc]) >> 2);
-				}
-				else if (ncolors == 3) {
-					UNROLL_3X(odata[ix1+i_] = (unsigned char)(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) >> 2);)
-				}
-				else { // custom alpha mipmaps
-					assert(ncolors == 4);
-					unsigned const a1(idata[ix2+3]), a2(idata[ix2+xinc+3]), a3(idata[ix2+yinc+3]), a4(idata[ix2+yinc+xinc+3]);
-					unsigned const a_sum(a1 + a2 + a3 + a4);
-
-					if (a_sum == 0) { // fully transparent
-						if (use_mipmaps == 4) {UNROLL_3X(odata[ix1+i_] = cw.c[i_];)} // use average texture color
-						else { // color is average of all 4 values
-							UNROLL_3X(odata[ix1+i_] = (unsigned char)(((unsigned)idata[ix2+i_] + idata[ix2+xinc+i_] + idata[ix2+yinc+i_] + idata[ix2+yinc+xinc+i_]) / 4);)
-						}
-						odata[ix1+3] = 0;
-					}
-					else { // pre-multiplied and normalized colors
-						if (use_mipmaps == 4) {
-							unsigned const a_cw(1020 - a_sum); // use average texture color for transparent pixels
-							UNROLL_3X(odata[ix1+i_] = (unsigned char)((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_] + a_cw*cw.c[i_]) / 1020);)
-						}
-						else {
-							UNROLL_3X(odata[ix1+i_] = (unsigned char)((a1*idata[ix2+i_] + a2*idata[ix2+xinc+i_] + a3*idata[ix2+yinc+i_] + a4*idata[ix2+yinc+xinc+i_]) / a_sum);)
-						}
-						odata[ix1+3] = min(255U, min(max(max(a1, a2), max(a3, a4)), unsigned(mipmap_alpha_weight*a_sum)));
-					}
-				}
-			} // for x
-		} // for y
+		calc_custom_mipmap_level(idata, w1, h1, odata);
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // needed for mipmap levels where width*ncolors is not aligned
 		glTexImage2D(GL_TEXTURE_2D, level, calc_internal_format(), w2, h2, 0, format, get_data_format(), &odata.front());
 		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
@@ -33,6 +33,8 @@ int const TLEAF_START_TUID   = 8; // trees use texture units 8-12
 bool const FORCE_TREE_TYPE   = 1;
 unsigned const CYLINS_PER_ROOT     = 3;
 unsigned const TREE_BILLBOARD_SIZE = 256;
+unsigned const MAX_SPARSE_LEAF_UPDATES = 64; // max number of changed leaves uploaded as separate runs
+unsigned const SPARSE_LEAF_MERGE_DIST  = 4;  // changed leaves closer than this are uploaded as a single run
 
 
 // bark_tex, leaf_tex, branch_size, branch_radius, leaf_size, leaf_x_ar, height_scale, branch_break_off, branch_tscale, branch_color_var, bush_prob, barkc, leafc
@@ -44,9 +46,9 @@ tree_type tree_types[NUM_TREE_TYPES] = { // not const - config file can override
 	tree_type(BARK6_TEX, PAPAYA_TEX,   1.0, 1.0, 1.0, 1.00, 2.0, 2.0, 0.5, 0.1,  0.0, colorRGBA(0.7, 0.6,  0.5,  1.0), WHITE)
 };
 
-vector<tree_cylin >   tree_builder_t::cylin_cache;
-vector<tree_branch>   tree_builder_t::branch_cache;
-vector<tree_branch *> tree_builder_t::branch_ptr_cache;
+thread_local vector<tree_cylin >   tree_builder_t::cylin_cache;
+thread_local vector<tree_branch>   tree_builder_t::branch_cache;
+thread_local vector<tree_branch *> tree_builder_t::branch_ptr_cache;
 
 
 // tree_mode: 0 = no trees, 1 = large only, 2 = small only, 3 = both large and small
@@ -60,6 +62,8 @@ tree_data_manager_t tree_data_manager;
 tree_cont_t t_trees(tree_data_manager);
 tree_cont_t *cur_tile_trees(nullptr);
 tree_placer_t tree_placer;
+vector<int> billboard_coll_hits; // billboard cobjs hit this frame, filled by coll_obj::register_coll()
+unsigned num_stale_billboard_hits(0); // entries at the front of billboard_coll_hits that were added before the start of this frame
 
 
 extern bool has_snow, no_sun_lpos_update, has_dl_sources, gen_tree_roots, tt_lightning_enabled, tree_indir_lighting, begin_motion, enable_grass_fire;
@@ -68,6 +72,7 @@ extern int xoff2, yoff2, rand_gen_index, game_mode, leaf_color_changed, scrollin
 extern unsigned smoke_tid;
 extern float zmin, zmax, zmax_est, zbottom, water_plane_z, tree_scale, temperature, fticks, vegetation, tree_density_thresh, tree_slope_thresh;
 extern double sim_ticks;
+extern string tree_cache_dir;
 extern vector3d wind;
 extern lightning l_strike;
 extern coll_obj_group coll_objects;
@@ -257,9 +262,14 @@ void tree::add_tree_collision_objects() {
 			point pts[4];
 			get_abs_leaf_pts(pts, i);
 			for (int p = 0; p < 4; ++p) {pts[p] += xlate;}
+			cpl.cf_index  = i; // leaf index, used to map collision hits back to leaves (there is no coll_func)
 			leaf_cobjs[i] = add_simple_coll_polygon(pts, 4, cpl, leaves[i].norm, 2);
 			coll_objects[leaf_cobjs[i]].is_billboard = 1;
 		}
+		if (!leaf_cobjs.empty()) {
+			leaf_cobj_range[0] = *min_element(leaf_cobjs.begin(), leaf_cobjs.end());
+			leaf_cobj_range[1] = *max_element(leaf_cobjs.begin(), leaf_cobjs.end());
+		}
 	}
 	//PRINT_TIME("Tree Cobjs");
 }
@@ -275,6 +285,39 @@ void tree::remove_collision_objects() {
 	}
 	branch_cobjs.clear();
 	leaf_cobjs.clear();
+	coll_leaves.clear();
+	leaf_cobj_range[0] = leaf_cobj_range[1] = -1;
+}
+
+
+// add hits on this tree's leaf cobjs to coll_leaves; most trees are rejected by the cobj index range test
+void tree::add_leaf_coll_hits(vector<int> const &hits) {
+
+	if (leaf_cobjs.empty()) return;
+
+	for (auto h = hits.begin(); h != hits.end(); ++h) {
+		if (*h < leaf_cobj_range[0] || *h > leaf_cobj_range[1]) continue;
+		int const ix(coll_objects.get_cobj(*h).cp.cf_index);
+		if (ix < 0 || ix >= (int)leaf_cobjs.size() || leaf_cobjs[ix] != *h) continue; // not one of our leaves
+		if (find(coll_leaves.begin(), coll_leaves.end(), (unsigned)ix) == coll_leaves.end()) {coll_leaves.push_back(ix);}
+	}
+}
+
+void tree_cont_t::dispatch_leaf_coll_hits() {
+
+	num_stale_billboard_hits = 0;
+	if (billboard_coll_hits.empty()) return;
+	sort(billboard_coll_hits.begin(), billboard_coll_hits.end());
+	billboard_coll_hits.erase(unique(billboard_coll_hits.begin(), billboard_coll_hits.end()), billboard_coll_hits.end()); // remove duplicates once rather than in every tree
+	for (iterator i = begin(); i != end(); ++i) {i->add_leaf_coll_hits(billboard_coll_hits);}
+	billboard_coll_hits.clear();
+}
+
+// called once per frame; drops hits that were never dispatched because trees weren't drawn in the last frame (shadow only, trees disabled, map mode, etc.)
+void next_frame_billboard_coll_hits() {
+
+	billboard_coll_hits.erase(billboard_coll_hits.begin(), billboard_coll_hits.begin() + min(num_stale_billboard_hits, (unsigned)billboard_coll_hits.size()));
+	num_stale_billboard_hits = billboard_coll_hits.size();
 }
 
 
@@ -476,6 +519,7 @@ void draw_trees(bool shadow_only, bool reflection_pass) {
 		if (shadow_only) {t_trees.draw(1, reflection_pass);}
 		else {
 			next_has_any_billboard_coll = 0; // reset for this frame
+			t_trees.dispatch_leaf_coll_hits();
 			t_trees.draw(0, reflection_pass);
 			has_any_billboard_coll = next_has_any_billboard_coll; // keep only if some leaf already has a coll
 		}
@@ -525,6 +569,7 @@ void tree_data_t::mark_leaf_changed(unsigned ix) {
 	assert(ix < leaves.size());
 	leaf_change_start = min(ix,   leaf_change_start);
 	leaf_change_end   = max(ix+1, leaf_change_end);
+	if (changed_leaves.size() <= MAX_SPARSE_LEAF_UPDATES) {changed_leaves.push_back(ix);} // past this size the full range is uploaded
 }
 
 
@@ -596,6 +641,15 @@ void tree::remove_leaf(unsigned i, bool update_data) {
 		remove_coll_object(leaf_cobjs[i]);
 		leaf_cobjs[i] = leaf_cobjs.back();
 		leaf_cobjs.pop_back();
+		if (i < leaf_cobjs.size()) {get_leaf_cobj(i).cp.cf_index = i;} // the last leaf was moved to i
+	}
+	unsigned const last_ix(tdata().get_leaves().size() - 1);
+
+	for (unsigned n = 0; n < coll_leaves.size(); ++n) { // keep the hit list in sync with the leaf swap below
+		if (coll_leaves[n] == i) {coll_leaves[n] = coll_leaves.back(); coll_leaves.pop_back(); --n;}
+	}
+	for (auto n = coll_leaves.begin(); n != coll_leaves.end(); ++n) {
+		if (*n == last_ix) {*n = i;}
 	}
 	make_private_tdata_copy();
 	update_data &= has_leaf_data();
@@ -1137,10 +1191,25 @@ void tree_data_t::ensure_leaf_vbo() {
 		assert(leaf_change_end <= leaves.size());
 		bind_vbo(leaf_vbo);
 		unsigned const per_leaf_stride(4*sizeof(leaf_vert_type_t));
-		upload_vbo_sub_data((&leaf_data.front() + 4*leaf_change_start), leaf_change_start*per_leaf_stride, (leaf_change_end - leaf_change_start)*per_leaf_stride);
+
+		if (changed_leaves.size() <= MAX_SPARSE_LEAF_UPDATES) { // few changes, such as leaves hit by objects: upload runs of nearby leaves
+			sort(changed_leaves.begin(), changed_leaves.end());
+
+			for (auto i = changed_leaves.begin(); i != changed_leaves.end();) {
+				unsigned const start(*i);
+				unsigned end(start+1);
+				for (++i; i != changed_leaves.end() && *i <= end + SPARSE_LEAF_MERGE_DIST; ++i) {end = max(end, *i+1);} // merge runs separated by small gaps
+				end = min(end, (unsigned)leaves.size()); // skip leaves that have since been removed
+				if (start < end) {upload_vbo_sub_data((&leaf_data.front() + 4*start), start*per_leaf_stride, (end - start)*per_leaf_stride);}
+			}
+		}
+		else { // many changes, such as wind: upload the whole range
+			upload_vbo_sub_data((&leaf_data.front() + 4*leaf_change_start), leaf_change_start*per_leaf_stride, (leaf_change_end - leaf_change_start)*per_leaf_stride);
+		}
 	}
 	leaf_change_start = leaves.size();
 	leaf_change_end   = 0;
+	changed_leaves.clear();
 }
 
 
@@ -1232,16 +1301,16 @@ void tree::update_leaf_orients_all(vector<tree *> &to_update_leaves) {
 
 	tree_data_t &td(tdata());
 	if (td.check_if_needs_updated() || !leaf_orients_valid) {to_update_leaves.push_back(this);}
-	if (!has_any_billboard_coll || leaf_cobjs.empty()) return; // no coll movement
-	// leaves move when struck by an object
-	vector<tree_leaf> const &leaves(td.get_leaves());
+	if (coll_leaves.empty()) return; // no coll movement
+	// leaves move when struck by an object; only leaves in the hit list are visited
 	rand_gen_t rgen;
-	rgen.set_state(frame_counter, leaves.size());
-	unsigned num(min(leaves.size(), leaf_cobjs.size())); // should be the same size
+	rgen.set_state(frame_counter, td.get_leaves().size());
 
-	for (unsigned i = 0; i < num; ++i) {
+	for (unsigned n = 0; n < coll_leaves.size();) {
+		unsigned const i(coll_leaves[n]);
+		if (i >= leaf_cobjs.size()) {coll_leaves[n] = coll_leaves.back(); coll_leaves.pop_back(); continue;} // leaf no longer exists
 		coll_obj &cobj(get_leaf_cobj(i));
-		if (cobj.last_coll == 0) continue; // no collision
+		if (cobj.last_coll == 0) {coll_leaves[n] = coll_leaves.back(); coll_leaves.pop_back(); continue;} // done moving
 		bool removed(0);
 		float hit_angle(0.0);
 		if (cobj.coll_type == BEAM) {removed = damage_leaf(i, BEAM_DAMAGE, rgen);} // do burn damage
@@ -1256,11 +1325,12 @@ void tree::update_leaf_orients_all(vector<tree *> &to_update_leaves) {
 			}
 			hit_angle += PI_TWO*cobj.last_coll/TICKS_PER_SECOND; // 90 degree max rotate
 		}
-		if (removed) {--i; --num; continue;}
+		if (removed) continue; // remove_leaf() replaced this entry in coll_leaves
 		cobj.last_coll = ((hit_angle == 0.0 || cobj.last_coll < iticks) ? 0 : (cobj.last_coll - iticks));
 		if (cobj.last_coll) {next_has_any_billboard_coll = 1;}
 		if (hit_angle != 0.0) {td.bend_leaf(i, hit_angle);} // do we want to update collision objects as well?
-	} // for i
+		++n; // removed from the list on the next frame once last_coll reaches 0
+	} // for n
 }
 
 
@@ -1525,6 +1595,30 @@ void tree_data_t::gen_tree_data(int tree_type_, int size, float tree_depth, floa
 	leaf_data.clear();
 	clear_vbo_ixs();
 	float deadness(DISABLE_LEAVES ? 1.0 : tree_deadness);
+	tree_gen_params_t params;
+
+	if (!tree_cache_dir.empty()) { // capture everything that affects the generated tree, including the rand state
+		params.tree_type         = tree_type;
+		params.size              = size;
+		params.rseed1            = rgen.rseed1;
+		params.rseed2            = rgen.rseed2;
+		params.has_4th_branches  = has_4th_branches;
+		params.create_bush       = create_bush;
+		params.has_clip_cube     = (clip_cube != nullptr);
+		params.tree_depth        = tree_depth;
+		params.height_scale      = height_scale;
+		params.br_scale_mult     = br_scale_mult;
+		params.nl_scale          = nl_scale;
+		params.bbo_scale         = bbo_scale;
+		params.deadness          = deadness;
+		params.dead_prob         = tree_dead_prob;
+		params.br_radius_scale   = branch_radius_scale;
+		params.nleaves_scale     = nleaves_scale;
+		params.tree_scale        = tree_scale;
+		params.tree_height_scale = tree_height_scale;
+		if (clip_cube) {UNROLL_3X(params.clip[2*i_] = clip_cube->d[i_][0]; params.clip[2*i_+1] = clip_cube->d[i_][1];)}
+		if (read_from_cache(params, rgen)) {calc_bounds(); return;}
+	}
 
 	if (deadness < 0.0) {
 		int const num(rgen.rand_int(1, 100));
@@ -1538,6 +1632,14 @@ void tree_data_t::gen_tree_data(int tree_type_, int size, float tree_depth, floa
 	b_tex_scale = tree_types[tree_type].branch_tscale*height_scale/br_scale;
 	base_radius = builder.create_tree_branches(tree_type, size, tree_depth, base_color, height_scale, br_scale, nl_scale, bbo_scale, has_4th_branches, create_bush);
 	builder.create_all_cylins_and_leaves(all_cylins, leaves, tree_type, deadness, br_scale, nl_scale, has_4th_branches, size);
+	reverse(leaves.begin(), leaves.end()); // order leaves so that LOD removes from the center first, which is less noticeable
+	calc_bounds();
+	if (!tree_cache_dir.empty()) {write_to_cache(params, rgen);}
+	//PRINT_TIME("Gen Tree");
+}
+
+
+void tree_data_t::calc_bounds() {
 
 	// set the bounding sphere center
 	assert(!all_cylins.empty());
@@ -1567,8 +1669,70 @@ void tree_data_t::gen_tree_data(int tree_type_, int size, float tree_depth, floa
 	sphere_radius = sqrt(sphere_radius);
 	lr_z_cent     = 0.5*(lr_z1 + lr_z2);
 	lr_z          = 0.5*(lr_z2 - lr_z1);
-	reverse(leaves.begin(), leaves.end()); // order leaves so that LOD removes from the center first, which is less noticeable
-	//PRINT_TIME("Gen Tree");
+}
+
+
+unsigned const TREE_CACHE_MAGIC   = 0x74726565; // "tree"
+unsigned const TREE_CACHE_VERSION = 1; // increment when tree generation changes so that old cache entries are ignored
+
+std::string tree_data_t::get_cache_fn(tree_gen_params_t const &params) const {
+	std::ostringstream oss;
+	oss << tree_cache_dir << "/tree_" << params.tree_type << "_" << std::hex << jenkins_one_at_a_time_hash((uint8_t const *)&params, sizeof(params))
+		<< std::dec << "_v" << TREE_CACHE_VERSION << ".bin"; // version is also checked in the file header
+	return oss.str();
+}
+
+template<typename T> bool read_cache_vector(FILE *fp, vector<T> &v) {
+	unsigned sz(0);
+	if (fread(&sz, sizeof(unsigned), 1, fp) != 1) return 0;
+	v.resize(sz);
+	return (v.empty() || fread(&v.front(), sizeof(T), v.size(), fp) == v.size());
+}
+template<typename T> bool write_cache_vector(FILE *fp, vector<T> const &v) {
+	unsigned const sz(v.size());
+	if (fwrite(&sz, sizeof(unsigned), 1, fp) != 1) return 0;
+	return (v.empty() || fwrite(&v.front(), sizeof(T), v.size(), fp) == v.size());
+}
+
+// returns true if a valid cache entry matching params was found; also restores the final rand state so that callers see the same sequence
+bool tree_data_t::read_from_cache(tree_gen_params_t const &params, rand_gen_t &rgen) {
+
+	FILE *fp(fopen(get_cache_fn(params).c_str(), "rb"));
+	if (fp == NULL) return 0; // not cached
+	unsigned header[2] = {0};
+	tree_gen_params_t fparams;
+	int seeds[2] = {0};
+	bool good(fread(header, sizeof(unsigned), 2, fp) == 2 && header[0] == TREE_CACHE_MAGIC && header[1] == TREE_CACHE_VERSION);
+	good = (good && fread(&fparams, sizeof(fparams), 1, fp) == 1 && fparams == params); // check for hash collisions
+	good = (good && fread(seeds, sizeof(int), 2, fp) == 2);
+	good = (good && fread(&base_color, sizeof(base_color), 1, fp) == 1);
+	good = (good && fread(&base_radius, sizeof(float), 1, fp) == 1 && fread(&br_scale, sizeof(float), 1, fp) == 1 && fread(&b_tex_scale, sizeof(float), 1, fp) == 1);
+	good = (good && read_cache_vector(fp, all_cylins) && read_cache_vector(fp, leaves) && !all_cylins.empty());
+	fclose(fp);
+	if (!good) {all_cylins.clear(); leaves.clear(); return 0;} // invalid or truncated, regenerate
+	rgen.set_state(seeds[0], seeds[1]);
+	return 1;
+}
+
+// writes to a temp file and renames it so that partial files are never seen by readers
+void tree_data_t::write_to_cache(tree_gen_params_t const &params, rand_gen_t const &rgen) const {
+
+	std::string const fn(get_cache_fn(params)), tmp_fn(fn + ".tmp" + std::to_string(omp_get_thread_num_3dw()));
+	FILE *fp(fopen(tmp_fn.c_str(), "wb"));
+
+	if (fp == NULL) {
+		std::cerr << "Error opening tree cache file " << tmp_fn << " for write" << endl;
+		return;
+	}
+	unsigned const header[2] = {TREE_CACHE_MAGIC, TREE_CACHE_VERSION};
+	int const seeds[2] = {int(rgen.rseed1), int(rgen.rseed2)};
+	bool good(fwrite(header, sizeof(unsigned), 2, fp) == 2 && fwrite(&params, sizeof(params), 1, fp) == 1 && fwrite(seeds, sizeof(int), 2, fp) == 2);
+	good = (good && fwrite(&base_color, sizeof(base_color), 1, fp) == 1);
+	good = (good && fwrite(&base_radius, sizeof(float), 1, fp) == 1 && fwrite(&br_scale, sizeof(float), 1, fp) == 1 && fwrite(&b_tex_scale, sizeof(float), 1, fp) == 1);
+	good = (good && write_cache_vector(fp, all_cylins) && write_cache_vector(fp, leaves));
+	fclose(fp);
+	if (good && rename(tmp_fn.c_str(), fn.c_str()) == 0) return;
+	remove(tmp_fn.c_str()); // Note: on Windows rename fails if another thread already wrote this file, which is fine
 }
 
 
@@ -2240,9 +2404,36 @@ void tree_cont_t::gen_trees_tt_within_radius(int x1, int y1, int x2, int y2, poi
 				if (!adjust_tree_zval(pos, 0, ttype, 0, cur_tile)) continue; // create_bush=0
 			}
 			add_new_tree(rgen, ttype);
-			back().gen_tree(pos, 0, ttype, 0, 1, 0, rgen, 1.0, 1.0, 1.0, tree_4th_branches, 1); // allow bushes
+			gen_reqs.emplace_back(size()-1, ttype, pos, rgen); // each tree has its own rand state, so they can be generated in any order
 		} // for j
 	} // for i
+	gen_pending_trees();
+}
+
+void tree_cont_t::gen_pending_trees() {
+
+	// the first tree bound to each shared tree_data_t that hasn't been created yet creates it, the same as in serial order, so results are deterministic;
+	// those trees and trees with private data are generated in the first parallel pass, and the remaining instanced trees in the second pass
+	vector<unsigned> passes[2];
+	set<tree_data_t const *> td_owned;
+
+	for (unsigned i = 0; i < gen_reqs.size(); ++i) {
+		tree_data_t const *const td(at(gen_reqs[i].ix).get_shared_tdata());
+		bool const first_pass(td == nullptr || (!td->is_created() && td_owned.insert(td).second));
+		passes[!first_pass].push_back(i);
+	}
+	for (unsigned p = 0; p < 2; ++p) {
+#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < (int)passes[p].size(); ++i) {
+			tree_gen_req_t &r(gen_reqs[passes[p][i]]);
+			// the shared template may have been created with a different type than requested (bush, or too few templates per type),
+			// which add_new_tree() couldn't see at queue time; use its actual type, as the serial path would
+			if (p == 1) {r.ttype = at(r.ix).get_shared_tdata()->get_tree_type();}
+			at(r.ix).gen_tree(r.pos, 0, r.ttype, 0, 0, 0, r.rgen, 1.0, 1.0, 1.0, tree_4th_branches, 1); // allow bushes; cobjs are added below
+		}
+	}
+	for (auto r = gen_reqs.begin(); r != gen_reqs.end(); ++r) {at(r->ix).add_tree_collision_objects();} // serial, in placement order
+	gen_reqs.clear();
 }
 
 
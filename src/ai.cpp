@@ -147,6 +147,94 @@ pos_dir_up get_smiley_pdu(point const &pos, vector3d const &orient) {
 }
 
 
+// line of sight rays from each smiley to each potential enemy, traced in one parallel batch before the smileys are advanced;
+// an entry is only used if neither the smiley nor its target has moved since, so the result is the same as tracing the rays later
+class smiley_target_vis_t {
+
+	struct entry_t {
+		bool valid;
+		point viewer, target;
+		unsigned qix, nrays; // range of queries in batch
+		entry_t() : valid(0), qix(0), nrays(0) {}
+	};
+	vector<entry_t> entries; // num_smileys+1 targets per smiley, camera first
+	line_query_batch_t batch;
+	unsigned num_targets;
+
+	entry_t const *get_entry(int smiley_id, int target) const {
+		if (entries.empty() || smiley_id < 0 || smiley_id >= num_smileys || target < CAMERA_ID || target >= num_smileys) return nullptr;
+		unsigned const ix(smiley_id*num_targets + (target - CAMERA_ID));
+		return ((ix < entries.size() && entries[ix].valid) ? &entries[ix] : nullptr);
+	}
+
+public:
+	smiley_target_vis_t() : num_targets(0) {}
+
+	void build() {
+		entries.clear();
+		batch.clear();
+		if (!game_mode || world_mode != WMODE_GROUND || num_smileys == 0) return;
+		obj_group const &objg(obj_groups[coll_id[SMILEY]]);
+		if (!objg.is_enabled()) return;
+		float const radius(object_types[SMILEY].radius);
+		bool const camera_is_target(camera_mode != 0 && !spectate);
+		int const orig_display_mode(display_mode);
+		display_mode |= 0x08; // enable occlusion culling, as in smiley_select_target()
+		num_targets = num_smileys + 1;
+		entries.resize(num_smileys*num_targets);
+
+		for (int i = 0; i < num_smileys; ++i) {
+			dwobject const &obj(objg.get_obj(i));
+			if (obj.disabled()) continue;
+			pos_dir_up const pdu(get_smiley_pdu(obj.pos, obj.orientation));
+
+			for (int t = CAMERA_ID; t < num_smileys; ++t) { // same candidates as find_nearest_enemy(), minus the more expensive darkness test
+				if (t == i || same_team(i, t)) continue;
+				if ((t == CAMERA_ID) ? !camera_is_target : (!free_for_all || objg.get_obj(t).disabled())) continue;
+				point const &tpos(get_sstate_pos(t));
+				if (!sphere_in_view(pdu, tpos, radius, 2)) continue; // frustum, mesh, and occluder tests are done later without rays
+				sphere_vis_rays_t const rays(obj.pos, tpos, radius, 5);
+				entry_t &e(entries[i*num_targets + (t - CAMERA_ID)]);
+				e.valid  = 1;
+				e.viewer = obj.pos;
+				e.target = tpos;
+				e.qix    = batch.size();
+				e.nrays  = rays.nrays;
+				rays.add_to_batch(batch, obj.pos);
+			}
+		}
+		display_mode = orig_display_mode;
+		batch.run();
+	}
+
+	int lookup(int smiley_id, int target, point const &viewer, point const &target_pos) const { // returns -1 if not cached
+		entry_t const *const e(get_entry(smiley_id, target));
+		if (e == nullptr || e->viewer != viewer || e->target != target_pos) return -1; // not queried, or someone has moved
+		if (e->nrays == 0) return 1; // too close to need rays
+
+		for (unsigned r = 0; r < e->nrays; ++r) {
+			if (batch.is_visible(e->qix + r)) return 1;
+		}
+		return 0;
+	}
+};
+
+smiley_target_vis_t smiley_target_vis;
+
+void build_smiley_target_vis() {smiley_target_vis.build();}
+
+
+// equivalent to sphere_in_view(pdu, pos2, radius, 5), but uses the batched rays when they're still valid
+bool smiley_target_in_view(int smiley_id, int target, pos_dir_up const &pdu, point const &pos2, float radius) {
+
+	if (!sphere_in_view(pdu, pos2, radius, 2)) return 0;
+	if (world_mode != WMODE_GROUND || !(display_mode & 0x08)) return 1; // no occlusion culling
+	int const cached(smiley_target_vis.lookup(smiley_id, target, pdu.pos, pos2));
+	if (cached >= 0) return (cached != 0);
+	return sphere_vis_rays_t(pdu.pos, pos2, radius, 5).any_visible(pdu.pos);
+}
+
+
 bool check_left_and_right(point const &pos, point const &tpos, vector3d const &orient,
 	float check_radius, float radius, int weapon, int coll_id)
 {
@@ -335,7 +423,7 @@ int player_state::find_nearest_enemy(point const &pos, pos_dir_up const &pdu, po
 		if (avoid_dir != zero_vector && dot_product_ptv(pos2, pos, avoid_dir) > 0.0) continue; // need to avoid this direction
 		float const dist(oddatav[i].dist);
 
-		if (sphere_in_view(pdu, pos2, radius, 5)) {
+		if (smiley_target_in_view(smiley_id, oddatav[i].id, pdu, pos2, radius)) {
 			min_dist = sqrt(dist);
 			min_i    = oddatav[i].id;
 			assert(min_i >= CAMERA_ID);
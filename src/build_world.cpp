@@ -26,6 +26,7 @@ unsigned const BLOOD_PER_SMILEY   = 300;
 unsigned const LG_STEPS_PER_FRAME = 10;
 unsigned const SM_STEPS_PER_FRAME = 1;
 unsigned const SHRAP_DLT_IX_MOD   = 8;
+unsigned const PAR_ADVANCE_MIN_OBJS = 256; // min group size for parallel object advance
 float const STAR_INNER_RAD        = 0.4;
 float const ROTATE_RATE           = 25.0;
 
@@ -50,7 +51,7 @@ vector<colorRGBA> colors_by_id; // for keycards
 vector<popup_text_t> popup_text;
 cube_light_src_vect sky_cube_lights, global_cube_lights;
 
-extern bool clear_landscape_vbo, use_voxel_cobjs, tree_4th_branches, lm_alloc, reflect_dodgeballs, begin_motion, disable_fire_delay;
+extern bool clear_landscape_vbo, use_voxel_cobjs, tree_4th_branches, lm_alloc, reflect_dodgeballs, begin_motion, disable_fire_delay, parallel_obj_advance;
 extern int camera_view, camera_mode, camera_reset, animate2, recreated, temp_change, preproc_cube_cobjs, precip_mode;
 extern int is_cloudy, num_smileys, load_coll_objs, world_mode, start_ripple, has_snow_accum, has_accumulation, scrolling, num_items, camera_coll_id;
 extern int num_dodgeballs, display_mode, game_mode, num_trees, tree_mode, has_scenery2, UNLIMITED_WEAPONS, ground_effects_level;
@@ -310,6 +311,28 @@ void set_global_state() {
 }
 
 
+unsigned get_obj_steps_per_frame(dwobject const &obj, int type, unsigned group_flags, bool large_radius) {
+
+	if (obj.flags & CAMERA_VIEW) return 4*LG_STEPS_PER_FRAME; // smaller timesteps if camera view
+	if (type == PLASMA || type == BALL || type == SAWBLADE) return 3*LG_STEPS_PER_FRAME;
+	if (is_rocket_type(type)) return 2*LG_STEPS_PER_FRAME;
+	if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) return LG_STEPS_PER_FRAME;
+	if (type == SHRAPNEL) return max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));
+	if (type == PRECIP || (group_flags & PRECIPITATION)) return 1;
+	return SM_STEPS_PER_FRAME;
+}
+
+bool is_multistep_advance_obj(dwobject const &obj) { // What about rolling objects (type_flags & OBJ_ROLLS) on the ground (status == 3)?
+	return (obj.status == 1 && is_over_mesh(obj.pos) && !((obj.flags & XY_STOPPED) && (obj.flags & Z_STOPPED)));
+}
+
+point get_obj_pred_pos(dwobject const &obj, float time, float grav_dz) {
+	point pos2(obj.pos + obj.velocity*time);
+	pos2.z -= grav_dz; // maybe want to try with and without this?
+	return pos2;
+}
+
+
 void process_groups() {
 
 	if (animate2) {advance_physics_objects();}
@@ -320,6 +343,7 @@ void process_groups() {
 		d_part_sys.add_lights();
 	}
 	set_global_state();
+	apply_explosion_world_effects(); // craters and cobj destruction from last frame's explosions
 	if (num_groups == 0) return; // groups not enabled
 	RESET_TIME;
 	unsigned num_objs(0);
@@ -391,7 +415,33 @@ void process_groups() {
 		if (reflective) {cp.metalness = dodgeball_metalness; cp.tscale = 0.0; cp.color = WHITE; cp.spec_color = WHITE; cp.shine = 100.0;} // reflective metal sphere
 		size_t const iter_count((large_radius || type == MAT_SPHERE || app_rate > 0) ? max_objs : objg.end_id); // optimization to use end_id when valid
 		bool defer_remove_cobj(0);
+		static vector<unsigned char> par_advanced; // objects already advanced this frame by the parallel pass below
+		par_advanced.clear();
+		if (type == SMILEY) {build_smiley_target_vis();} // trace smiley line of sight rays in parallel up front
+
+		if (parallel_obj_advance && world_mode == WMODE_GROUND && !large_radius && coll_func == NULL && type != SMILEY &&
+			iter_count >= PAR_ADVANCE_MIN_OBJS && !have_voxel_cobjs())
+		{
+			// objects that can't interact with anything this frame (no mesh, water, or cobj contact along their path) are advanced in parallel;
+			// everything else is left for the serial pass below, which processes objects in the same order as before
+			bool const can_teleport(!teleporters[0].empty() || !teleporters[1].empty());
+			bool const teleport_type(type == BLOOD || type == CHARRED || type == SHRAPNEL || type == STAR5);
+			par_advanced.resize(iter_count, 0);
 
+#pragma omp parallel
+			{
+				vector<unsigned> cobjs; // per-thread temporary
+
+#pragma omp for schedule(static,64)
+				for (int j = 0; j < (int)iter_count; ++j) {
+					dwobject &obj(objg.get_obj(j));
+					if (obj.status != 1 || obj.type != type || obj.health < 0.0 || obj.time < 0) continue; // status change, precip type change, or not yet started
+					if (can_teleport && teleport_type) continue;
+					if (!is_multistep_advance_obj(obj) || get_obj_steps_per_frame(obj, type, flags, large_radius) != 1) continue;
+					par_advanced[j] = obj.try_advance_free_flight(get_obj_pred_pos(obj, time, grav_dz), cobjs);
+				}
+			} // end omp parallel
+		}
 		for (size_t jj = 0; jj < iter_count; ++jj) {
 			unsigned const j(unsigned((type == SMILEY) ? (jj + scounter)%max_objs : jj)); // handle smiley permutation
 			dwobject &obj(objg.get_obj(j));
@@ -456,6 +506,7 @@ void process_groups() {
 
 			if (obj.health < 0.0) {obj.status = 0;} // can get here for smileys?
 			else if (type == SMILEY) {advance_smiley(obj, j);}
+			else if (j < par_advanced.size() && par_advanced[j]) {} // already advanced in parallel
 			else {
 				if (obj.time >= 0) {
 					if (type == PLASMA && obj.velocity.mag_sq() < 1.0) {obj.disable();} // plasma dies when it stops
@@ -471,19 +522,11 @@ void process_groups() {
 						unsigned spf(1);
 						int cindex(-1);
 
-						// What about rolling objects (type_flags & OBJ_ROLLS) on the ground (status == 3)?
-						if (obj.status == 1 && is_over_mesh(pos) && !((obj_flags & XY_STOPPED) && (obj_flags & Z_STOPPED))) {
-							if (obj.flags & CAMERA_VIEW) {spf = 4*LG_STEPS_PER_FRAME;} // smaller timesteps if camera view
-							else if (type == PLASMA || type == BALL || type == SAWBLADE) {spf = 3*LG_STEPS_PER_FRAME;}
-							else if (is_rocket_type(type)) {spf = 2*LG_STEPS_PER_FRAME;}
-							else if (large_radius /*|| type == STAR5 || type == SHELLC*/ || type == FRAGMENT) {spf = LG_STEPS_PER_FRAME;}
-							else if (type == SHRAPNEL) {spf = max(1, min(((obj.direction == W_GRENADE) ? 4 : 20), int(0.2*obj.velocity.mag())));}
-							else if (type == PRECIP || (flags & PRECIPITATION)) {spf = 1;}
-							else {spf = SM_STEPS_PER_FRAME;}
+						if (is_multistep_advance_obj(obj)) {
+							spf = get_obj_steps_per_frame(obj, type, flags, large_radius);
 
 							if (MORE_COLL_TSTEPS && obj.status == 1 && spf < LG_STEPS_PER_FRAME && pos.z < czmax && pos.z > czmin) {
-								point pos2(pos + obj.velocity*time); // makes precipitation slower, but collision detection is more correct
-								pos2.z -= grav_dz; // maybe want to try with and without this?
+								point const pos2(get_obj_pred_pos(obj, time, grav_dz)); // makes precipitation slower, but collision detection is more correct
 								// Note: we only do the line intersection test if the object moves by more than its radius this frame (static leaves don't)
 								// Note: could also test pos.z > v_collision_matrix[y][x].zmax
 								if (!dist_less_than(pos, pos2, radius)) {check_coll_line(pos, pos2, cindex, -1, 0, 0);} // return value is unused
@@ -595,6 +638,7 @@ void process_groups() {
 			if (defer_remove_cobj) {remove_reset_coll_obj(obj.coll_id); defer_remove_cobj = 0;}
 		} // for jj
 		objg.flags |= WAS_ADVANCED;
+		objg.build_obj_grid(); // for explosion and proximity queries until this group is advanced again
 		if (num_objs > 0 && (SHOW_PROC_TIME /*|| type == SMILEY*/)) {cout << "type = " << type << ", num = " << num_objs << " "; PRINT_TIME("Process");}
 	} // for i
 	temp_change = 0;
@@ -224,15 +224,13 @@ bool car_t::check_collision(car_t &c, road_gen_base_t const &road_gen) {
 }
 
 
-bool comp_car_road_then_pos::operator()(car_t const &c1, car_t const &c2) const { // sort spatially for collision detection and drawing
-	if (c1.cur_city != c2.cur_city) return (c1.cur_city < c2.cur_city);
-	if (c1.is_parked() != c2.is_parked()) {return c2.is_parked();} // parked cars last
-	if (c1.cur_road != c2.cur_road) return (c1.cur_road < c2.cur_road);
-
-	if (c1.is_parked()) { // sort parked cars back to front relative to camera so that alpha blending works
-		return (p2p_dist_xy_sq(c1.bcube.get_cube_center(), camera_pos) > p2p_dist_xy_sq(c2.bcube.get_cube_center(), camera_pos));
-	}
-	return (c1.bcube.d[c1.dim][c1.dir] < c2.bcube.d[c2.dim][c2.dir]); // compare front end of car (used for collisions)
+// sort spatially for collision detection and drawing; key bits: {city:16, parked:1, road:16, pos:31}
+uint64_t get_car_sort_key(car_t const &c, vector3d const &camera_pos) {
+	unsigned pos_key(0);
+	// sort parked cars back to front relative to camera so that alpha blending works; otherwise compare front end of car (used for collisions)
+	if (c.is_parked()) {pos_key = ~float_to_ordered_uint(p2p_dist_xy_sq(c.bcube.get_cube_center(), camera_pos));}
+	else {pos_key = float_to_ordered_uint(c.bcube.d[c.dim][c.dir]);}
+	return ((uint64_t(c.cur_city) << 48) | (uint64_t(c.is_parked()) << 47) | (uint64_t(c.cur_road) << 31) | (pos_key >> 1)); // parked cars last
 }
 
 
@@ -303,14 +301,14 @@ void city_model_loader_t::draw_model(shader_t &s, vector3d const &pos, cube_t co
 	if ((low_detail || is_shadow_pass) && !model_file.shadow_mat_ids.empty()) { // low detail pass, normal maps disabled
 		if (!is_shadow_pass && use_model3d_bump_maps()) {model3d::bind_default_flat_normal_map();} // still need to set the default here in case the shader is using it
 		// TODO: combine shadow materials into a single VBO and draw with one call when is_shadow_pass==1; this is complex and may not yield a significant improvement
-		for (auto i = model_file.shadow_mat_ids.begin(); i != model_file.shadow_mat_ids.end(); ++i) {model.render_material(s, *i, is_shadow_pass, 0, 0, 0);}
+		for (auto i = model_file.shadow_mat_ids.begin(); i != model_file.shadow_mat_ids.end(); ++i) {model.render_material(s, *i, is_shadow_pass, 0, 0, 0, nullptr, sz_scale);}
 	}
 	else {
 		auto const &unbound_mat(model.get_unbound_material());
 
 		for (unsigned sam_pass = 0; sam_pass < (is_shadow_pass ? 2U : 1U); ++sam_pass) {
 			model.render_materials(s, is_shadow_pass, 0, 0, (sam_pass == 1), 3, 3, unbound_mat, rotation_t(),
-				nullptr, nullptr, is_shadow_pass, model_file.lod_mult, (is_shadow_pass ? 10.0 : 0.0));
+				nullptr, nullptr, is_shadow_pass, model_file.lod_mult, (is_shadow_pass ? 10.0 : 0.0), sz_scale);
 		}
 	}
 	fgPopMatrix();
@@ -338,6 +336,7 @@ void car_draw_state_t::occlusion_checker_t::set_camera(pos_dir_up const &pdu) {
 }
 
 bool car_draw_state_t::occlusion_checker_t::is_occluded(cube_t const &c) {
+	if (sw_zbuf_cube_occluded(c, state.pos)) return 1;
 	if (state.building_ids.empty()) return 0;
 	float const z(c.z2()); // top edge
 	point const corners[4] = {point(c.x1(), c.y1(), z), point(c.x2(), c.y1(), z), point(c.x2(), c.y2(), z), point(c.x1(), c.y2(), z)};
@@ -519,6 +518,18 @@ void car_manager_t::remove_destroyed_cars() {
 	car_destroyed = 0;
 }
 
+void car_manager_t::update_soa() {
+	soa.resize(cars.size());
+
+	for (unsigned i = 0; i < cars.size(); ++i) {
+		car_t const &car(cars[i]);
+		vector3d vel(zero_vector);
+		vel[car.dim] = (car.dir ? 1.0 : -1.0)*car.cur_speed;
+		uint32_t const state((car.is_parked() ? agent_soa_t::STATE_PARKED : 0) | (car.is_stopped() ? agent_soa_t::STATE_STOPPED : 0) | (car.destroyed ? agent_soa_t::STATE_DESTROYED : 0));
+		soa.set(i, car.bcube, vel, car.cur_speed, car.cur_city, state);
+	}
+}
+
 void car_manager_t::init_cars(unsigned num) {
 	if (num == 0) return;
 	timer_t timer("Init Cars");
@@ -544,6 +555,7 @@ void car_manager_t::finalize_cars() {
 		i->color_id = ((fixed_color >= 0) ? fixed_color : (rgen.rand() % NUM_CAR_COLORS));
 		assert(i->is_valid());
 	} // for i
+	update_soa();
 	cout << "Total Cars: " << cars.size() << endl;
 }
 
@@ -574,8 +586,11 @@ bool car_manager_t::proc_sphere_coll(point &pos, point const &p_last, float radi
 		cube_t sphere_bc; sphere_bc.set_from_sphere((pos - xlate), radius);
 		unsigned start(0), end(0);
 		get_car_ix_range_for_cube(cb, sphere_bc, start, end);
+		sphere_bc.expand_by(dist); // include p_last
+		vector<unsigned> ixs;
+		soa.get_ixs_intersecting_cube(sphere_bc, start, end, ixs);
 
-		for (unsigned c = start; c != end; ++c) {
+		for (unsigned c : ixs) {
 			if (cars[c].proc_sphere_coll(pos, p_last, radius, xlate, cnorm)) return 1;
 		}
 	} // for cb
@@ -593,8 +608,11 @@ void car_manager_t::destroy_cars_in_radius(point const &pos_in, float radius) {
 		if (is_pt ? !city_bcube.contains_pt_xy(pos) : !sphere_cube_intersect_xy(pos, radius, city_bcube)) continue;
 		unsigned const start(cb->start), end((cb+1)->start); // Note: shouldnt be called frequently enough to need road/parking lot acceleration
 		assert(end <= cars.size() && start <= end);
+		cube_t sphere_bc; sphere_bc.set_from_sphere(pos, radius); // contains the centers of cars to destroy
+		vector<unsigned> ixs;
+		soa.get_ixs_intersecting_cube(sphere_bc, start, end, ixs);
 
-		for (unsigned c = start; c != end; ++c) {
+		for (unsigned c : ixs) {
 			car_t &car(cars[c]);
 
 			if (is_pt ? car.bcube.contains_pt(pos) : dist_less_than(car.get_center(), pos, radius)) { // destroy if within the sphere
@@ -618,8 +636,10 @@ bool car_manager_t::get_color_at_xy(point const &pos, colorRGBA &color, int int_
 		if      (int_ret == INT_ROAD)    {end   = cb->first_parked;} // moving cars only (beginning of range)
 		else if (int_ret == INT_PARKING) {start = cb->first_parked;} // parked cars only (end of range)
 		assert(start <= end);
+		vector<unsigned> ixs;
+		soa.get_ixs_intersecting_cube(cube_t(pos.x, pos.x, pos.y, pos.y, -FLT_MAX, FLT_MAX), start, end, ixs); // Note: could use road as accel structure
 
-		for (unsigned c = start; c != end; ++c) { // Note: slow, could use road as accel structure
+		for (unsigned c : ixs) {
 			if (cars[c].bcube.contains_pt_xy(pos)) {color = cars[c].get_color(); return 1;}
 		}
 	} // for cb
@@ -631,8 +651,10 @@ car_t const *car_manager_t::get_car_at(point const &p1, point const &p2) const {
 		if (!get_cb_bcube(*cb).line_intersects(p1, p2)) continue; // skip
 		unsigned start(cb->start), end((cb+1)->start);
 		assert(start <= end && end <= cars.size());
+		vector<unsigned> ixs;
+		soa.get_ixs_intersecting_cube(cube_t(p1, p2), start, end, ixs);
 
-		for (unsigned c = start; c != end; ++c) { // Note: includes parked cars
+		for (unsigned c : ixs) { // Note: includes parked cars
 			if (cars[c].bcube.line_intersects(p1, p2)) {return &cars[c];}
 		}
 	} // for cb
@@ -646,8 +668,10 @@ bool car_manager_t::line_intersect_cars(point const &p1, point const &p2, float
 		if (!get_cb_bcube(*cb).line_intersects(p1, p2)) continue; // skip
 		unsigned start(cb->start), end((cb+1)->start);
 		assert(start <= end && end <= cars.size());
+		vector<unsigned> ixs;
+		soa.get_ixs_intersecting_cube(cube_t(p1, p2), start, end, ixs);
 
-		for (unsigned c = start; c != end; ++c) { // Note: includes parked cars
+		for (unsigned c : ixs) { // Note: includes parked cars
 			ret |= check_line_clip_update_t(p1, p2, t, cars[c].bcube);
 		}
 	} // for cb
@@ -742,7 +766,11 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 #pragma omp critical(modify_car_data)
 	{
 		if (car_destroyed) {remove_destroyed_cars();} // at least one car was destroyed in the previous frame - remove it/them
-		sort(cars.begin(), cars.end(), comp_car_road_then_pos(camera_pdu.pos - dstate.xlate)); // sort by city/road/position for intersection tests and tile shadow map binds
+		// sort by city/road/position for intersection tests and tile shadow map binds
+		vector3d const camera_pos(camera_pdu.pos - dstate.xlate);
+		sort_keys.resize(cars.size());
+		for (unsigned i = 0; i < cars.size(); ++i) {sort_keys[i] = agent_sort_key_t(get_car_sort_key(cars[i], camera_pos), i);}
+		sort_agents_by_keys(cars, 0, sort_keys, cars_temp);
 	}
 	entering_city.clear();
 	car_blocks.clear();
@@ -797,6 +825,7 @@ void car_manager_t::next_frame(ped_manager_t const &ped_manager, float car_speed
 		if (!peds_crossing_roads.peds.empty()) {check_car_for_ped_colls(*i);}
 	} // for i
 	update_cars(); // run update logic
+	update_soa(); // for queries until the next frame
 	//cout << TXT(cars.size()) << TXT(entering_city.size()) << TXT(in_isects.size()) << TXT(num_on_conn_road) << endl; // TESTING
 }
 
@@ -189,10 +189,73 @@ struct car_city_vect_t {
 struct comp_car_road {
 	bool operator()(car_base_t const &c1, car_base_t const &c2) const {return (c1.cur_road < c2.cur_road);}
 };
-struct comp_car_road_then_pos {
-	vector3d const &camera_pos;
-	comp_car_road_then_pos(vector3d const &camera_pos_) : camera_pos(camera_pos_) {}
-	bool operator()(car_t const &c1, car_t const &c2) const;
+
+struct agent_sort_key_t { // compact sort record for cars/peds; sorting these and then moving each agent once is much less memory traffic than sorting the agents
+	uint64_t key;
+	unsigned ix;
+	agent_sort_key_t(uint64_t key_=0, unsigned ix_=0) : key(key_), ix(ix_) {}
+	bool operator<(agent_sort_key_t const &k) const {return ((key == k.key) ? (ix < k.ix) : (key < k.key));} // ix makes the order deterministic
+};
+
+inline unsigned float_to_ordered_uint(float val) { // preserves float ordering as unsigned ints
+	unsigned bits(0);
+	memcpy(&bits, &val, sizeof(unsigned));
+	return ((bits & 0x80000000) ? ~bits : (bits | 0x80000000));
+}
+
+// sorts keys, which index into v starting at start, then reorders v to match with a single gather pass into temp; returns true if the order changed
+template<typename T> bool sort_agents_by_keys(vector<T> &v, unsigned start, vector<agent_sort_key_t> &keys, vector<T> &temp) {
+	assert(start + keys.size() <= v.size());
+	sort(keys.begin(), keys.end());
+	bool changed(0);
+	for (unsigned n = 0; n < keys.size() && !changed; ++n) {changed = (keys[n].ix != start + n);}
+	if (!changed) return 0; // already sorted, common case when agents move a small amount each frame
+	temp.clear();
+	temp.reserve(keys.size());
+	for (auto k = keys.begin(); k != keys.end(); ++k) {temp.push_back(v[k->ix]);}
+	if (start == 0 && temp.size() == v.size()) {v.swap(temp);}
+	else {std::copy(temp.begin(), temp.end(), v.begin()+start);}
+	return 1;
+}
+
+// structure-of-arrays copy of the hot per-frame fields of cars or peds, indexed the same as the agent vector and rebuilt at the end of next_frame();
+// read-only spatial queries scan these compact arrays with branch-free tests that vectorize, and only touch the agents that pass
+struct agent_soa_t {
+	enum {STATE_PARKED=0x10000, STATE_STOPPED=0x20000, STATE_IN_ROAD=0x40000, STATE_DESTROYED=0x80000};
+	vector<float> x1, x2, y1, y2, z1, z2; // bcube
+	vector<float> vx, vy, vz, speed;
+	vector<uint32_t> id_state; // {city for cars, ssn for peds} in the low 16 bits, STATE_* bits above
+
+	unsigned size() const {return x1.size();}
+	bool has_state(unsigned i, uint32_t state) const {return ((id_state[i] & state) != 0);}
+	vector3d get_vel(unsigned i) const {return vector3d(vx[i], vy[i], vz[i]);}
+
+	void resize(unsigned n) {
+		for (vector<float> *v : {&x1, &x2, &y1, &y2, &z1, &z2, &vx, &vy, &vz, &speed}) {v->resize(n);}
+		id_state.resize(n);
+	}
+	void set(unsigned i, cube_t const &bc, vector3d const &vel, float speed_, unsigned id, uint32_t state) {
+		x1[i] = bc.x1(); x2[i] = bc.x2(); y1[i] = bc.y1(); y2[i] = bc.y2(); z1[i] = bc.z1(); z2[i] = bc.z2();
+		vx[i] = vel.x; vy[i] = vel.y; vz[i] = vel.z; speed[i] = speed_;
+		id_state[i] = ((id & 0xFFFF) | state);
+	}
+	// appends the indices in [start, end) whose bcube intersects c, including touching; flags are computed in fixed size chunks to allow vectorization
+	void get_ixs_intersecting_cube(cube_t const &c, unsigned start, unsigned end, vector<unsigned> &ixs) const {
+		assert(start <= end && end <= size());
+		unsigned const CHUNK_SZ = 64;
+		unsigned char hit[CHUNK_SZ];
+		float const cx1(c.x1()), cx2(c.x2()), cy1(c.y1()), cy2(c.y2()), cz1(c.z1()), cz2(c.z2());
+
+		for (unsigned b = start; b < end; b += CHUNK_SZ) {
+			unsigned const n(min(CHUNK_SZ, (end - b)));
+			float const *X1(&x1[b]), *X2(&x2[b]), *Y1(&y1[b]), *Y2(&y2[b]), *Z1(&z1[b]), *Z2(&z2[b]);
+
+			for (unsigned k = 0; k < n; ++k) {
+				hit[k] = ((X1[k] <= cx2) & (X2[k] >= cx1) & (Y1[k] <= cy2) & (Y2[k] >= cy1) & (Z1[k] <= cz2) & (Z2[k] >= cz1));
+			}
+			for (unsigned k = 0; k < n; ++k) {if (hit[k]) {ixs.push_back(b + k);}}
+		}
+	}
 };
 
 
@@ -608,7 +671,9 @@ class car_manager_t {
 		car_block_t(unsigned s, unsigned c) : start(s), cur_city(c), first_parked(0) {}
 	};
 	city_road_gen_t const &road_gen;
-	vector<car_t> cars;
+	vector<car_t> cars, cars_temp;
+	vector<agent_sort_key_t> sort_keys;
+	agent_soa_t soa; // hot fields of cars, for queries
 	vector<car_block_t> car_blocks;
 	ped_city_vect_t peds_crossing_roads;
 	car_draw_state_t dstate;
@@ -623,12 +688,13 @@ class car_manager_t {
 	void add_car();
 	void get_car_ix_range_for_cube(vector<car_block_t>::const_iterator cb, cube_t const &bc, unsigned &start, unsigned &end) const;
 	void remove_destroyed_cars();
+	void update_soa();
 	void update_cars();
 	int find_next_car_after_turn(car_t &car);
 public:
 	car_manager_t(city_road_gen_t const &road_gen_) : road_gen(road_gen_), dstate(car_model_loader), car_destroyed(0) {}
 	bool empty() const {return cars.empty();}
-	void clear() {cars.clear(); car_blocks.clear();}
+	void clear() {cars.clear(); car_blocks.clear(); soa.resize(0);}
 	void init_cars(unsigned num);
 	void add_parked_cars(vector<car_t> const &new_cars) {vector_add_to(new_cars, cars);}
 	void finalize_cars();
@@ -729,7 +795,9 @@ class ped_manager_t { // pedestrians
 	city_road_gen_t const &road_gen;
 	car_manager_t const &car_manager; // used for ped road crossing safety
 	ped_model_loader_t ped_model_loader;
-	vector<pedestrian_t> peds;
+	vector<pedestrian_t> peds, peds_temp;
+	vector<agent_sort_key_t> sort_keys;
+	agent_soa_t soa; // hot fields of peds, for queries
 	vector<city_ixs_t> by_city; // first ped/plot index for each city
 	vector<unsigned> by_plot;
 	vector<unsigned char> need_to_sort_city;
@@ -744,6 +812,7 @@ class ped_manager_t { // pedestrians
 	void expand_cube_for_ped(cube_t &cube) const;
 	void remove_destroyed_peds();
 	void sort_by_city_and_plot();
+	void update_soa();
 	road_isec_t const &get_car_isec(car_base_t const &car) const;
 	void register_ped_new_plot(pedestrian_t const &ped);
 	int get_road_ix_for_ped_crossing(pedestrian_t const &ped, bool road_dim) const;
@@ -769,7 +838,7 @@ public:
 	void next_animation();
 	static float get_ped_radius();
 	bool empty() const {return peds.empty();}
-	void clear() {peds.clear(); by_city.clear();}
+	void clear() {peds.clear(); by_city.clear(); soa.resize(0);}
 	void init(unsigned num);
 	bool proc_sphere_coll(point &pos, float radius, vector3d *cnorm) const;
 	bool line_intersect_peds(point const &p1, point const &p2, float &t) const;
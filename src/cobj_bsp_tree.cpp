@@ -4,11 +4,13 @@
 
 #include "3DWorld.h"
 #include "cobj_bsp_tree.h"
+#include <cfloat> // for FLT_MAX
 
 
 unsigned const MAX_LEAF_SIZE = 2;
 float const POLY_TOLER       = 1.0E-6;
 float const OVERLAP_AMT      = 0.02;
+float const MOVING_COBJ_EXT  = 1.0E20; // leaf bcube extent for cobjs that may move without a tree rebuild
 
 
 extern bool mt_cobj_tree_build, begin_motion;
@@ -395,6 +397,27 @@ void cobj_bvh_tree::clear() {
 
 	cobj_tree_base::clear();
 	cixs.resize(0);
+	leaf_bcubes.resize(0);
+}
+
+
+// leaf bcubes are a conservative prefilter: the full cobj is still tested when they pass
+void cobj_bvh_tree::calc_leaf_bcubes() {
+
+	cube_t const all_space(-MOVING_COBJ_EXT, MOVING_COBJ_EXT, -MOVING_COBJ_EXT, MOVING_COBJ_EXT, -MOVING_COBJ_EXT, MOVING_COBJ_EXT);
+	leaf_bcubes.resize(cixs.size());
+
+#pragma omp parallel for schedule(static,4096) if (cixs.size() > 100000)
+	for (int i = 0; i < (int)cixs.size(); ++i) {
+		coll_obj const &c(get_cobj(i));
+
+		// dynamic cobjs are removed and re-added during the frame, and moving cobjs can change bounds before the next rebuild
+		if (is_dynamic || c.maybe_is_moving() || c.is_movable()) {leaf_bcubes[i] = all_space;}
+		else {
+			leaf_bcubes[i] = c;
+			leaf_bcubes[i].expand_by(POLY_TOLER); // handle zero area bcubes in the line clip test
+		}
+	}
 }
 
 
@@ -431,6 +454,7 @@ void cobj_bvh_tree::build_tree_from_cixs(bool do_mt_build) {
 		nodes.resize(ptd.get_next_node_ix());
 	}
 	nodes[root].next_node_id = (unsigned)nodes.size();
+	calc_leaf_bcubes();
 }
 
 
@@ -452,6 +476,7 @@ bool cobj_bvh_tree::check_coll_line(point const &p1, point const &p2, point &cpo
 			// Note: we test cobj against the original (unclipped) p1 and p2 so that t is correct
 			// Note: we probably don't need to return cnorm and cpos in inexact mode, but it shouldn't be too expensive to do so
 			if ((int)cixs[i] == ignore_cobj) continue;
+			if (!nixm.get_line_clip_func(p1, nixm.dinv, leaf_bcubes[i].d)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (!obj_ok(c))                  continue;
 			if (skip_non_drawn  && !c.cp.might_be_drawn())                    continue;
@@ -489,6 +514,7 @@ bool cobj_bvh_tree::check_point_contained(point const &p, int &cindex) const {
 			continue;
 		}
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
+			if (!leaf_bcubes[i].contains_pt(p)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (c.contains_point(p) && obj_ok(c)) {cindex = cixs[i]; return 1;}
 		}
@@ -513,7 +539,7 @@ void cobj_bvh_tree::get_intersecting_cobjs(cube_t const &cube, vector<unsigned>
 			continue;
 		}
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] == ignore_cobj) continue;
+			if ((int)cixs[i] == ignore_cobj || !cube.intersects(leaf_bcubes[i], toler)) continue;
 			coll_obj const &c(get_cobj(i));
 			if (check_ccounter && c.counter == cobj_counter) continue;
 			if (!cube.intersects(c, toler) || !obj_ok(c))    continue;
@@ -602,7 +628,7 @@ void cobj_bvh_tree::get_coll_sphere_cobjs(point const &center, float radius, int
 		++nix;
 		
 		for (unsigned i = n.start; i < n.end; ++i) { // check leaves
-			if ((int)cixs[i] != ignore_cobj && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
+			if ((int)cixs[i] != ignore_cobj && leaf_bcubes[i].intersects(bcube) && get_cobj(i).intersects(bcube)) vcd.check_cobj(cixs[i]);
 		}
 	}
 }
@@ -772,9 +798,16 @@ void build_static_moving_cobj_tree() {
 	}
 }
 
+// static cobjs added while a static tree rebuild is deferred (see begin_cobj_destroy_batch()); only used for intersecting cobj queries
+vector<unsigned> static_cobjs_not_in_tree;
+
+void add_static_cobj_not_in_tree(unsigned ix) {static_cobjs_not_in_tree.push_back(ix);}
+
 void build_cobj_tree(bool dynamic, bool verbose) {
 	
 	if (!dynamic) { // static
+		kill_incremental_relight(); // background relight threads read the static tree, so they can't be running while it's rebuilt
+		static_cobjs_not_in_tree.clear();
 		get_tree(0).add_cobjs(verbose);
 		cobj_tree_occlude.add_cobjs(verbose);
 		//cout << "occluders: " << cobj_tree_occlude.get_num_objs() << endl;
@@ -816,7 +849,18 @@ void get_intersecting_cobjs_tree(cube_t const &cube, vector<unsigned> &cobjs, in
 	bool dynamic, bool check_ccounter, int id_for_cobj_int)
 {
 	get_tree(dynamic).get_intersecting_cobjs(cube, cobjs, ignore_cobj, toler, check_ccounter, id_for_cobj_int);
-	if (!dynamic) {cobj_tree_static_moving.get_intersecting_cobjs(cube, cobjs, ignore_cobj, toler, check_ccounter, id_for_cobj_int);}
+	if (dynamic) return;
+	cobj_tree_static_moving.get_intersecting_cobjs(cube, cobjs, ignore_cobj, toler, check_ccounter, id_for_cobj_int);
+
+	for (auto i = static_cobjs_not_in_tree.begin(); i != static_cobjs_not_in_tree.end(); ++i) { // same filtering as the static tree
+		if ((int)*i == ignore_cobj) continue;
+		coll_obj const &c(coll_objects.get_cobj(*i));
+		if (c.status != COLL_STATIC || (c.cp.flags & COBJ_NO_COLL)) continue; // removed since it was added
+		if (check_ccounter && c.counter == cobj_counter) continue;
+		if (!cube.intersects(c, toler)) continue;
+		if (id_for_cobj_int >= 0 && coll_objects[id_for_cobj_int].intersects_cobj(c, toler) != 1) continue;
+		cobjs.push_back(*i);
+	}
 }
 
 // used in cobj_contained_ref() for grass occlusion
@@ -839,6 +883,54 @@ void get_coll_sphere_cobjs_tree(point const &center, float radius, int cobj, ver
 	if (!dynamic) {get_voxel_coll_sphere_cobjs(center, radius, cobj, vcd);}
 }
 
+struct cobj_ix_by_x1 {
+	bool operator()(unsigned const a, unsigned const b) const {return (coll_objects.get_cobj(a).d[0][0] < coll_objects.get_cobj(b).d[0][0]);}
+};
+
+// batched version of check_coll_line_exact() without voxels for a row of vertical rays at {x0 + i*dx, y} from z1[i] down to z2[i]; rays with z1 <= z2 are skipped;
+// the cobj trees are traversed once for the bounds of the row, then each ray is tested against the candidate cobjs that overlap it in x
+void check_coll_vert_ray_row(float x0, float dx, float y, unsigned num, float const *z1, float const *z2, vector<vert_ray_hit_t> &hits, bool skip_dynamic) {
+
+	hits.assign(num, vert_ray_hit_t());
+	if (num == 0 || world_mode != WMODE_GROUND) return;
+	assert(dx > 0.0);
+	float zmin(FLT_MAX), zmax(-FLT_MAX);
+
+	for (unsigned i = 0; i < num; ++i) {
+		if (z1[i] <= z2[i]) continue; // inactive
+		min_eq(zmin, z2[i]);
+		max_eq(zmax, z1[i]);
+	}
+	if (zmin > zmax) return; // no active rays
+	cube_t const row_bcube(x0, x0+(num-1)*dx, y, y, zmin, zmax);
+	vector<unsigned> cands, active;
+	get_tree(0).get_intersecting_cobjs(row_bcube, cands, -1, 0.0, 0, -1);
+	cobj_tree_static_moving.get_intersecting_cobjs(row_bcube, cands, -1, 0.0, 0, -1);
+	if (!skip_dynamic && begin_motion) {get_tree(1).get_intersecting_cobjs(row_bcube, cands, -1, 0.0, 0, -1);}
+	if (cands.empty()) return;
+	sort(cands.begin(), cands.end(), cobj_ix_by_x1());
+	unsigned next(0);
+
+	for (unsigned i = 0; i < num; ++i) { // sweep in x, keeping the set of cobjs that overlap the current ray
+		if (z1[i] <= z2[i]) continue;
+		float const x(x0 + i*dx);
+		for (; next < cands.size() && coll_objects.get_cobj(cands[next]).d[0][0] <= x; ++next) {active.push_back(cands[next]);}
+		point const p1(x, y, z1[i]), p2(x, y, z2[i]);
+		vert_ray_hit_t &hit(hits[i]);
+		float tmax(1.0);
+
+		for (unsigned n = 0; n < active.size();) {
+			coll_obj const &c(coll_objects.get_cobj(active[n]));
+			if (c.d[0][1] < x) {active[n] = active.back(); active.pop_back(); continue;} // no longer overlaps
+			float t(0.0);
+			vector3d cnorm;
+			if (c.d[2][1] >= p2.z && c.d[2][0] <= p1.z && c.line_int_exact(p1, p2, t, cnorm, 0.0, tmax)) {tmax = t; hit.cindex = active[n]; hit.cnorm = cnorm;} // closest hit
+			++n;
+		}
+		if (hit.cindex >= 0) {hit.cpos = p1 + (p2 - p1)*tmax;}
+	} // for i
+}
+
 bool check_point_contained_tree(point const &p, int &cindex, bool dynamic) { // Note: doesn't test voxels
 	if (get_tree(dynamic).check_point_contained(p, cindex)) return 1;
 	if (!dynamic && cobj_tree_static_moving.check_point_contained(p, cindex)) return 1;
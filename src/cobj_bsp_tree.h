@@ -109,6 +109,7 @@ class cobj_bvh_tree : public cobj_tree_base {
 
 	coll_obj_group const *cobjs;
 	vector<unsigned> cixs;
+	vector<cube_t> leaf_bcubes; // compact copy of cobj bounds in cixs order, so that most leaf tests don't touch the full coll_obj
 	bool is_static, is_dynamic, occluders_only, cubes_only, inc_voxel_cobjs;
 
 	struct per_thread_data {
@@ -127,6 +128,7 @@ class cobj_bvh_tree : public cobj_tree_base {
 	coll_obj const &get_cobj(unsigned ix) const {return (*cobjs)[cixs[ix]];}
 	bool create_cixs();
 	void calc_node_bbox(tree_node &n) const;
+	void calc_leaf_bcubes();
 	void build_tree_top_level_omp();
 	void build_tree(unsigned nix, unsigned skip_dims, unsigned depth, per_thread_data &ptd);
 
@@ -467,4 +467,20 @@ void get_occluders() {
 }
 
 
+void build_cobj_sw_occlusion_zbuf() {
+
+	static vector<cube_t> occluders;
+	occluders.clear();
+
+	if (sw_occlusion_zbuf_enabled() && have_occluders()) {
+		for (cobj_id_set_t::const_iterator i = coll_objects.drawn_ids.begin(); i != coll_objects.drawn_ids.end(); ++i) {
+			coll_obj const &cobj(coll_objects.get_cobj(*i));
+			if (cobj.type != COLL_CUBE || !cobj.is_occluder() || !camera_pdu.cube_visible(cobj)) continue;
+			occluders.push_back(cobj);
+		}
+	}
+	build_sw_occlusion_zbuf(camera_pdu, occluders); // invalidates the zbuf if there are no occluders
+}
+
+
 
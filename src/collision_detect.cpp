@@ -24,6 +24,7 @@ float czmin(FAR_DISTANCE), czmax(-FAR_DISTANCE), coll_rmax(0.0);
 point camera_last_pos(all_zeros); // not sure about this, need to reset sometimes
 coll_obj_group coll_objects;
 cobj_groups_t cobj_groups;
+vector<int> coll_cell::packed_cvals;
 cobj_draw_groups cdraw_groups;
 
 extern bool lm_alloc, has_snow;
@@ -101,11 +102,11 @@ void decal_obj::check_cobj() {
 	else {
 		int const xpos(get_xpos(ipos.x)), ypos(get_ypos(ipos.y));
 		if (point_outside_mesh(xpos, ypos)) {status = 0; return;}
-		vector<int> const &cvals(v_collision_matrix[ypos][xpos].cvals);
+		coll_cell const &cell(v_collision_matrix[ypos][xpos]);
 		cid = -1;
 
-		for (unsigned i = 0; i < cvals.size(); ++i) {
-			if (is_on_cobj(cvals[i])) {cid = cvals[i]; break;}
+		for (unsigned i = 0; i < cell.size(); ++i) {
+			if (is_on_cobj(cell.get(i))) {cid = cell.get(i); break;}
 		}
 		if (cid >= 0) {cobj_cent_mass = coll_objects.get_cobj(cid).get_center_of_mass();}
 	}
@@ -641,11 +642,95 @@ void coll_cell::clear(bool clear_vectors) {
 
 	if (clear_vectors) {
 		if (cvals.capacity() > INIT_CCELL_SIZE) {cvals.clear();} else {cvals.resize(0);}
+		pnum = 0; // packed entries are reclaimed by the next compaction
 	}
 	zmin =  FAR_DISTANCE;
 	zmax = -FAR_DISTANCE;
 }
 
+bool coll_cell::remove_entry(int index) { // returns true if found
+
+	for (unsigned k = 0; k < pnum; ++k) {
+		int *const vals(&packed_cvals[pstart]);
+		if (vals[k] != index) continue;
+		std::copy((vals + k + 1), (vals + pnum), (vals + k)); // shift down within this cell's packed range
+		--pnum;
+		return 1;
+	}
+	for (unsigned k = 0; k < cvals.size(); ++k) {
+		if (cvals[k] == index) {cvals.erase(cvals.begin()+k); return 1;}
+	}
+	return 0;
+}
+
+bool coll_cell::remove_freed_unused() { // returns true if any entries were removed
+
+	unsigned const orig_size(size());
+	int *const vals(pnum ? &packed_cvals[pstart] : nullptr);
+	unsigned num(0);
+
+	for (unsigned k = 0; k < pnum; ++k) {
+		if (!coll_objects[vals[k]].freed_unused()) {vals[num++] = vals[k];}
+	}
+	pnum = num;
+	num  = 0;
+
+	for (unsigned k = 0; k < cvals.size(); ++k) {
+		if (!coll_objects[cvals[k]].freed_unused()) {cvals[num++] = cvals[k];}
+	}
+	cvals.resize(num);
+	return (size() < orig_size);
+}
+
+void coll_cell::move_last_to_front() { // of the overflow entries; packed entries are all static and already come first
+	if (cvals.size() > 1) {std::rotate(cvals.begin(), cvals.begin()+cvals.size()-1, cvals.end());}
+}
+
+
+// moves static cobj entries of every cell into one contiguous array in cell order; everything else stays in the per-cell overflow vectors
+void compact_coll_cells() {
+
+	//RESET_TIME;
+	unsigned const num_cells(XY_MULT_SIZE);
+	coll_cell *const cells(v_collision_matrix[0]); // matrix data is allocated as one block
+	vector<unsigned> cell_start(num_cells+1, 0);
+
+#pragma omp parallel for schedule(static,1)
+	for (int y = 0; y < MESH_Y_SIZE; ++y) { // count static entries
+		for (int x = 0; x < MESH_X_SIZE; ++x) {
+			unsigned const ix(y*MESH_X_SIZE + x);
+			coll_cell const &cell(cells[ix]);
+			unsigned num(cell.pnum);
+			for (unsigned k = 0; k < cell.cvals.size(); ++k) {num += (coll_objects[cell.cvals[k]].status == COLL_STATIC);}
+			cell_start[ix+1] = num;
+		}
+	}
+	for (unsigned i = 0; i < num_cells; ++i) {cell_start[i+1] += cell_start[i];}
+	vector<int> packed(cell_start[num_cells]);
+
+#pragma omp parallel for schedule(static,1)
+	for (int y = 0; y < MESH_Y_SIZE; ++y) { // fill and remove from overflow
+		for (int x = 0; x < MESH_X_SIZE; ++x) {
+			unsigned const ix(y*MESH_X_SIZE + x);
+			coll_cell &cell(cells[ix]);
+			unsigned pos(cell_start[ix]), num_overflow(0);
+			for (unsigned k = 0; k < cell.pnum; ++k) {packed[pos++] = coll_cell::packed_cvals[cell.pstart + k];}
+
+			for (unsigned k = 0; k < cell.cvals.size(); ++k) {
+				int const cid(cell.cvals[k]);
+				if (coll_objects[cid].status == COLL_STATIC) {packed[pos++] = cid;} else {cell.cvals[num_overflow++] = cid;}
+			}
+			assert(pos == cell_start[ix+1]);
+			cell.pstart = cell_start[ix];
+			cell.pnum   = pos - cell.pstart;
+			cell.cvals.resize(num_overflow);
+			if (cell.cvals.empty()) {vector<int>().swap(cell.cvals);} // free the memory
+		}
+	}
+	coll_cell::packed_cvals.swap(packed);
+	//PRINT_TIME("Compact Coll Cells");
+}
+
 
 void cobj_stats() {
 
@@ -654,7 +739,7 @@ void cobj_stats() {
 
 	for (int y = 0; y < MESH_Y_SIZE; ++y) {
 		for (int x = 0; x < MESH_X_SIZE; ++x) {
-			unsigned const sz((unsigned)v_collision_matrix[y][x].cvals.size());
+			unsigned const sz(v_collision_matrix[y][x].size());
 			ncv += sz;
 			nonempty += (sz > 0);
 		}
@@ -675,10 +760,10 @@ void add_coll_point(int i, int j, int index, float zminv, float zmaxv, int add_t
 	coll_cell &vcm(v_collision_matrix[i][j]);
 	vcm.add_entry(index);
 	coll_obj const &cobj(coll_objects.get_cobj(index));
-	unsigned const size((unsigned)vcm.cvals.size());
+	unsigned const size(vcm.size());
 
-	if (size > 1 && cobj.status == COLL_STATIC && coll_objects[vcm.cvals[size-2]].status == COLL_DYNAMIC) {
-		std::rotate(vcm.cvals.begin(), vcm.cvals.begin()+size-1, vcm.cvals.end()); // rotate last point to first point???
+	if (size > 1 && cobj.status == COLL_STATIC && coll_objects[vcm.get(size-2)].status == COLL_DYNAMIC) {
+		vcm.move_last_to_front(); // rotate last point to first point???
 	}
 	if (is_dynamic) return;
 
@@ -740,15 +825,7 @@ int remove_coll_object(int index, bool reset_draw) {
 
 	for (int i = y1; i <= y2; ++i) {
 		for (int j = x1; j <= x2; ++j) {
-			vector<int> &cvals(v_collision_matrix[i][j].cvals);
-			unsigned const num_cvals(cvals.size());
-			
-			for (unsigned k = 0; k < num_cvals; ++k) {
-				if (cvals[k] == index) {
-					cvals.erase(cvals.begin()+k); // can't change zmin or zmax (I think)
-					break; // should only be in here once
-				}
-			}
+			v_collision_matrix[i][j].remove_entry(index); // can't change zmin or zmax (I think); should only be in here once
 		}
 	}
 	cobj_manager.free_index(index);
@@ -769,34 +846,23 @@ void purge_coll_freed(bool force) {
 	if (!force && cobj_manager.cobjs_removed < PURGE_THRESH) return;
 	//RESET_TIME;
 
-	for (int i = 0; i < MESH_Y_SIZE; ++i) {
+#pragma omp parallel for schedule(static,1)
+	for (int i = 0; i < MESH_Y_SIZE; ++i) { // Note: each cell only modifies its own packed range
 		for (int j = 0; j < MESH_X_SIZE; ++j) {
-			bool changed(0);
 			coll_cell &vcm(v_collision_matrix[i][j]);
-			unsigned const size((unsigned)vcm.cvals.size());
-
-			for (unsigned k = 0; k < size && !changed; ++k) {
-				if (coll_objects[vcm.cvals[k]].freed_unused()) changed = 1;
-			}
 			// Note: don't actually have to recalculate zmin/zmax unless a removed object was on the top or bottom of the coll cell
-			if (!changed) continue;
+			if (!vcm.remove_freed_unused()) continue;
 			vcm.zmin = mesh_height[i][j];
 			vcm.zmax = zmin;
-			vector<int>::const_iterator in(vcm.cvals.begin());
-			vector<int>::iterator o(vcm.cvals.begin());
 
-			for (; in != vcm.cvals.end(); ++in) {
-				coll_obj &cobj(coll_objects[*in]);
-
-				if (!cobj.freed_unused()) {
-					if (cobj.status == COLL_STATIC) {vcm.update_zmm(cobj.d[2][0], cobj.d[2][1]);}
-					*o++ = *in;
-				}
+			for (unsigned k = 0; k < vcm.size(); ++k) {
+				coll_obj const &cobj(coll_objects[vcm.get(k)]);
+				if (cobj.status == COLL_STATIC) {vcm.update_zmm(cobj.d[2][0], cobj.d[2][1]);}
 			}
-			vcm.cvals.erase(o, vcm.cvals.end()); // excess capacity?
 			h_collision_matrix[i][j] = vcm.zmax; // need to think about add_to_hcm...
 		}
 	}
+	compact_coll_cells();
 	unsigned const ncobjs((unsigned)coll_objects.size());
 
 	for (unsigned i = 0; i < ncobjs; ++i) {
@@ -917,12 +983,12 @@ int check_legal_move(int x_new, int y_new, float zval, float radius, int &cindex
 
 	if (point_outside_mesh(x_new, y_new)) return 0; // object out of simulation region
 	coll_cell const &cell(v_collision_matrix[y_new][x_new]);
-	if (cell.cvals.empty()) return 1;
+	if (cell.empty()) return 1;
 	float const xval(get_xval(x_new)), yval(get_yval(y_new)), z1(zval - radius), z2(zval + radius);
 	point const pval(xval, yval, zval);
 
-	for (int k = (int)cell.cvals.size()-1; k >= 0; --k) { // iterate backwards
-		int const index(cell.cvals[k]);
+	for (int k = (int)cell.size()-1; k >= 0; --k) { // iterate backwards
+		int const index(cell.get(k));
 		if (index < 0) continue;
 		coll_obj &cobj(coll_objects.get_cobj(index));
 		if (cobj.no_collision()) continue;
@@ -1884,8 +1950,8 @@ int set_true_obj_height(point &pos, point const &lpos, float step_height, float
 	int any_coll(0), moved(0);
 	float zceil(0.0), zfloor(0.0);
 
-	for (int k = (int)cell.cvals.size()-1; k >= 0; --k) { // iterate backwards
-		int const index(cell.cvals[k]);
+	for (int k = (int)cell.size()-1; k >= 0; --k) { // iterate backwards
+		int const index(cell.get(k));
 		if (index < 0) continue;
 		coll_obj const &cobj(coll_objects.get_cobj(index));
 		if (cobj.d[2][0] > z2)         continue; // above the top of the object - can't affect it
@@ -380,6 +380,52 @@ struct cobj_query_callback {
 };
 
 
+// independent line of sight queries collected in one phase, run in parallel, and read back in the next phase;
+// each query has the same semantics as coll_pt_vis_test(), and the cobj trees must not be modified until run() returns
+class line_query_batch_t {
+
+	struct query_t {
+		point p1, p2;
+		float ext_dist; // p1 is moved this far toward p2 to skip the object the ray starts at
+		int ignore_cobj, skip_dynamic, test_alpha, hit_cobj;
+		bool blocked;
+		query_t(point const &p1_, point const &p2_, float ed, int ic, int sd, int ta) :
+			p1(p1_), p2(p2_), ext_dist(ed), ignore_cobj(ic), skip_dynamic(sd), test_alpha(ta), hit_cobj(-1), blocked(0) {}
+	};
+	vector<query_t> queries;
+	vector<pair<unsigned, unsigned> > order; // {sort key, query index}
+	bool was_run;
+
+public:
+	line_query_batch_t() : was_run(0) {}
+	void clear() {queries.clear(); was_run = 0;}
+	unsigned size() const {return (unsigned)queries.size();}
+	unsigned add(point const &p1, point const &p2, float ext_dist, int ignore_cobj, int skip_dynamic, int test_alpha);
+	void run();
+	bool is_visible(unsigned ix) const {assert(was_run && ix < queries.size()); return !queries[ix].blocked;}
+	int get_hit_cobj(unsigned ix) const {assert(was_run && ix < queries.size()); return queries[ix].hit_cobj;} // -1 if visible or no cobj was hit
+};
+
+struct vert_ray_hit_t { // result of one ray of a check_coll_vert_ray_row() query
+	int cindex; // -1 = no hit
+	point cpos;
+	vector3d cnorm;
+	vert_ray_hit_t() : cindex(-1) {}
+};
+
+struct sphere_vis_rays_t { // the cobj rays tested by sphere_in_view() for max_level >= 3
+
+	unsigned nrays; // 0 if the viewer is too close to need any rays
+	int cid, skip_dynamic;
+	float ext_dist;
+	point qp[5];
+
+	sphere_vis_rays_t(point const &viewer, point const &pos, float radius, int max_level);
+	bool any_visible(point const &viewer) const;
+	void add_to_batch(line_query_batch_t &batch, point const &viewer) const;
+};
+
+
 class polygon_t : public vector<vert_norm_tc> {
 
 public:
@@ -430,12 +476,19 @@ void copy_polygon_to_cobj(polygon_t const &poly, coll_obj &cobj);
 void copy_tquad_to_cobj(coll_tquad const &tquad, coll_obj &cobj);
 
 
-struct coll_cell { // size = 52
+struct coll_cell { // size = 40
 
 	float zmin, zmax;
-	vector<int> cvals;
+	unsigned pstart, pnum; // static cobj entries stored contiguously in packed_cvals by compact_coll_cells(); these come first
+	vector<int> cvals; // overflow entries: dynamic cobjs and cobjs added since the last compaction
+
+	static vector<int> packed_cvals; // shared by all cells
 
+	coll_cell() : zmin(FAR_DISTANCE), zmax(-FAR_DISTANCE), pstart(0), pnum(0) {}
 	void clear(bool clear_vectors);
+	unsigned size() const {return (pnum + (unsigned)cvals.size());}
+	bool empty() const {return (pnum == 0 && cvals.empty());}
+	int get(unsigned i) const {return ((i < pnum) ? packed_cvals[pstart + i] : cvals[i - pnum]);}
 
 	void update_zmm(float zmin_, float zmax_) {
 		assert(zmin_ <= zmax_);
@@ -446,6 +499,9 @@ struct coll_cell { // size = 52
 		if (INIT_CCELL_SIZE > 0 && cvals.capacity() == 0) {cvals.reserve(INIT_CCELL_SIZE);}
 		cvals.push_back(index);
 	}
+	bool remove_entry(int index);
+	bool remove_freed_unused();
+	void move_last_to_front();
 };
 
 
@@ -16,6 +16,7 @@ bool const ONLY_SUB_PREV_NEG  = 1;
 bool const CHECK_ADJACENCY    = 0; // doesn't seem to make any significant difference
 int  const REMOVE_T_JUNCTIONS = 1; // fewer hole pixels and better ambient transitions but more cobjs and render time
 float const REL_DMAX          = 0.2;
+unsigned const PARALLEL_CSG_MIN_COBJS = 10000;
 
 
 bool sphere_t::contains_point(point const &p) const {return dist_less_than(pos, p, radius);}
@@ -833,6 +834,136 @@ void coll_obj_group::check_cubes() {
 }
 
 
+// Merges compatible adjacent cubes. Merge candidates are tracked per cube and inherited from the cubes it absorbs, rather than looked up
+// in a cobj tree whose bounds go stale as cubes grow. Since merged cubes only ever cover the union of their original cubes, cubes can
+// only interact with other cubes in the same connected set of original compatible overlapping/adjacent cubes, and these sets are
+// independent. This allows them to be processed in parallel, each in cobj index order, with the same result as a serial pass.
+class cube_merger_t {
+
+	coll_obj_group &cobjs;
+	float toler;
+	vector<vector<unsigned> > cands; // merge candidates for each cube
+	vector<unsigned> parent; // cube this cube was merged into, or itself
+
+	unsigned find_root(unsigned i) { // Note: only touches cubes in the same set, so is safe to call from multiple threads
+		unsigned root(i);
+		while (parent[root] != root) {root = parent[root];}
+		
+		while (parent[i] != root) { // path compression
+			unsigned const next(parent[i]);
+			parent[i] = root;
+			i = next;
+		}
+		return root;
+	}
+	unsigned merge_cube(unsigned i) {
+		if (cobjs[i].type != COLL_CUBE || cands[i].empty()) return 0; // already merged into another cube, or nothing to merge with
+		csg_cube cube(cobjs[i]);
+		if (cube.is_zero_area()) return 0;
+		vector<unsigned> &cand(cands[i]);
+		vector<unsigned> absorbed;
+		unsigned merged(0);
+
+		while (1) {
+			for (auto c = cand.begin(); c != cand.end(); ++c) {*c = find_root(*c);} // map to the cubes that the candidates were merged into
+			sort(cand.begin(), cand.end());
+			cand.erase(unique(cand.begin(), cand.end()), cand.end());
+			cand.erase(std::remove(cand.begin(), cand.end(), i), cand.end());
+			cube_t const query(cube); // match against the cube as it was at the start of this pass
+			absorbed.resize(0);
+
+			for (auto c = cand.begin(); c != cand.end(); ++c) {
+				unsigned const j(*c);
+				assert(cobjs[j].type == COLL_CUBE);
+				if (!query.intersects(cobjs[j], toler)) continue;
+				csg_cube cube2(cobjs[j]);
+
+				if (cube.cube_merge(cube2)) {
+					cobjs[j].type = COLL_INVALID; // remove old coll obj
+					parent[j] = i;
+					absorbed.push_back(j);
+				}
+			}
+			if (absorbed.empty()) break; // cube hasn't changed
+			cube.write_to_cobj(cobjs[i]);
+			merged += absorbed.size();
+
+			for (auto j = absorbed.begin(); j != absorbed.end(); ++j) { // inherit merge candidates from absorbed cubes
+				cand.insert(cand.end(), cands[*j].begin(), cands[*j].end());
+				vector<unsigned>().swap(cands[*j]); // free the memory
+			}
+		} // end while
+		return merged;
+	}
+
+public:
+	cube_merger_t(coll_obj_group &cobjs_, float toler_) : cobjs(cobjs_), toler(toler_) {}
+
+	void find_candidates() {
+		unsigned const ncobjs((unsigned)cobjs.size());
+		cands.resize(ncobjs);
+		parent.resize(ncobjs);
+		for (unsigned i = 0; i < ncobjs; ++i) {parent[i] = i;}
+		cobj_bvh_tree cube_tree(&cobjs, 0, 0, 0, 1, 0); // cubes only
+		cube_tree.add_cobjs(0);
+
+#pragma omp parallel for schedule(dynamic,256) if (ncobjs >= PARALLEL_CSG_MIN_COBJS)
+		for (int i = 0; i < (int)ncobjs; ++i) {
+			if (cobjs[i].type != COLL_CUBE) continue;
+			vector<unsigned> &cand(cands[i]);
+			cube_tree.get_intersecting_cobjs(csg_cube(cobjs[i]), cand, i, toler, 0, -1);
+			unsigned num(0);
+
+			for (auto j = cand.begin(); j != cand.end(); ++j) {
+				assert(*j < ncobjs && (int)*j != i);
+				assert(cobjs[*j].type == COLL_CUBE);
+				if (cobjs[i].equal_params(cobjs[*j])) {cand[num++] = *j;} // compatible
+			}
+			cand.resize(num);
+			cand.shrink_to_fit();
+		} // for i
+	}
+	unsigned merge_all() {
+		unsigned const ncobjs((unsigned)cobjs.size());
+		vector<unsigned> set_id(ncobjs);
+		for (unsigned i = 0; i < ncobjs; ++i) {set_id[i] = i;}
+
+		for (unsigned i = 0; i < ncobjs; ++i) { // union the candidate sets
+			for (auto j = cands[i].begin(); j != cands[i].end(); ++j) {
+				unsigned a(i), b(*j);
+				while (set_id[a] != a) {a = set_id[a] = set_id[set_id[a]];}
+				while (set_id[b] != b) {b = set_id[b] = set_id[set_id[b]];}
+				if (a != b) {set_id[max(a, b)] = min(a, b);} // lowest index is the root
+			}
+		}
+		vector<unsigned> set_start(ncobjs+1, 0), set_ixs; // CSR sets, each in cobj index order
+		vector<unsigned> sets; // roots of sets with more than one cube
+
+		for (unsigned i = 0; i < ncobjs; ++i) {
+			unsigned a(i);
+			while (set_id[a] != a) {a = set_id[a];}
+			set_id[i] = a;
+			++set_start[a+1];
+		}
+		for (unsigned i = 0; i < ncobjs; ++i) {
+			if (set_start[i+1] > 1) {sets.push_back(i);}
+			set_start[i+1] += set_start[i];
+		}
+		set_ixs.resize(ncobjs);
+		vector<unsigned> pos(set_start.begin(), set_start.end()-1);
+		for (unsigned i = 0; i < ncobjs; ++i) {set_ixs[pos[set_id[i]]++] = i;}
+		unsigned merged(0);
+
+#pragma omp parallel for schedule(dynamic,1) reduction(+:merged) if (ncobjs >= PARALLEL_CSG_MIN_COBJS)
+		for (int s = 0; s < (int)sets.size(); ++s) {
+			unsigned const root(sets[s]);
+			for (unsigned n = set_start[root]; n < set_start[root+1]; ++n) {merged += merge_cube(set_ixs[n]);}
+		}
+		return merged;
+	}
+}; // cube_merger_t
+
+
 // Note: also sorts by alpha so that transparency works correctly
 void coll_obj_group::merge_cubes() { // only merge compatible cubes
 
@@ -840,37 +971,9 @@ void coll_obj_group::merge_cubes() { // only merge compatible cubes
 	RESET_TIME;
 	float const tolerance(-X_SCENE_SIZE*1.0E-6); // tiny negative tolerance to include adjacencies
 	unsigned const ncobjs((unsigned)size());
-	unsigned merged(0);
-	cobj_bvh_tree cube_tree(this, 0, 0, 0, 1, 0); // cubes only
-	cube_tree.add_cobjs(0);
-	vector<unsigned> cids;
-
-	for (unsigned i = 0; i < ncobjs; ++i) { // choose merge candidates
-		if ((*this)[i].type != COLL_CUBE) continue;
-		csg_cube cube((*this)[i]);
-		if (cube.is_zero_area()) continue;
-		cids.resize(0);
-		cube_tree.get_intersecting_cobjs(cube, cids, i, tolerance, 0, -1);
-		unsigned mi(0);
-
-		for (vector<unsigned>::const_iterator it = cids.begin(); it != cids.end(); ++it) {
-			unsigned const j(*it);
-			assert(j < ncobjs && j != i);
-			assert((*this)[j].type == COLL_CUBE);
-			if (!(*this)[i].equal_params((*this)[j])) continue; // not compatible
-			csg_cube cube2((*this)[j]);
-
-			if (cube.cube_merge(cube2)) {
-				(*this)[j].type = COLL_INVALID; // remove old coll obj
-				++mi;
-			}
-		}
-		if (mi > 0) { // cube has changed
-			cube.write_to_cobj((*this)[i]);
-			merged += mi;
-			--i; // force this cube to be processed again
-		}
-	}
+	cube_merger_t merger(*this, tolerance);
+	merger.find_candidates();
+	unsigned const merged(merger.merge_all());
 	if (merged > 0) remove_invalid_cobjs();
 	cout << ncobjs << " => " << size() << endl;
 	PRINT_TIME("Cube Merge");
@@ -894,49 +997,75 @@ void coll_obj_group::remove_overlapping_cubes(int min_split_destroy_thresh) { //
 	float const tolerance(X_SCENE_SIZE*1.0E-6); // tiny tolerance to prevent adjacencies
 	cobj_bvh_tree cube_tree(this, 0, 0, 0, 1, 0); // cubes only
 	cube_tree.add_cobjs(0);
-	bool overlaps(0);
-	coll_obj_group cur_cobjs, next_cobjs;
-	vector<unsigned> cids;
+	vector<unsigned> id_runs; // start of each run of cubes with the same id in proc_order
+	vector<unsigned char> was_split(ncobjs, 0);
+	vector<vector<coll_obj> > fragments(proc_order.size()); // indexed by proc_order position
 
-	for (vector<pair<unsigned, unsigned> >::const_reverse_iterator it = proc_order.rbegin(); it != proc_order.rend(); ++it) {
-		unsigned const i(it->second);
-		csg_cube const cube((*this)[i]); // remove all other cobjs from cobjs[i] with lower id
-		if (cube.is_zero_area()) continue;
-		bool const neg((*this)[i].status == COLL_NEGATIVE);
-		cids.resize(0);
-		cube_tree.get_intersecting_cobjs(cube, cids, i, tolerance, 0, -1);
-		if (cids.empty()) continue;
-		cur_cobjs.resize(0);
-		cur_cobjs.push_back((*this)[i]); // start with the current cobj
-		bool was_removed(0);
-
-		for (vector<unsigned>::const_iterator it = cids.begin(); it != cids.end(); ++it) {
-			unsigned const j(*it);
-			assert(j < size());
-			assert((*this)[j].type == COLL_CUBE && j != i);
-			if ((*this)[i].id < (*this)[j].id)              continue; // enforce ordering
-			if (neg ^ ((*this)[j].status == COLL_NEGATIVE)) continue; // sign must be the same
-			csg_cube sub_cube((*this)[j]);
-
-			for (coll_obj_group::const_iterator c = cur_cobjs.begin(); c != cur_cobjs.end(); ++c) {
-				if (sub_cube.subtract_from_cube(next_cobjs, *c)) {
-					was_removed = overlaps = 1;
+	for (unsigned p = 0; p < proc_order.size(); ++p) {
+		if (p == 0 || proc_order[p].first != proc_order[p-1].first) {id_runs.push_back(p);}
+	}
+	id_runs.push_back(proc_order.size()); // end marker
+
+	// cubes are only ever subtracted by the original cubes with lower or equal id, so runs of different ids are independent and can be
+	// processed in parallel; results are added back in the serial processing order (highest id first) below, so the output is always the same
+#pragma omp parallel if (ncobjs >= PARALLEL_CSG_MIN_COBJS)
+	{
+		coll_obj_group cur_cobjs, next_cobjs;
+		vector<unsigned> cids;
+
+#pragma omp for schedule(dynamic,1)
+		for (int r = 0; r < (int)id_runs.size()-1; ++r) {
+			for (unsigned p = id_runs[r+1]; p-- > id_runs[r];) { // reverse order within this id
+				unsigned const i(proc_order[p].second);
+				csg_cube const cube((*this)[i]); // remove all other cobjs from cobjs[i] with lower id
+				if (cube.is_zero_area()) continue;
+				bool const neg((*this)[i].status == COLL_NEGATIVE);
+				cids.resize(0);
+				cube_tree.get_intersecting_cobjs(cube, cids, i, tolerance, 0, -1);
+				if (cids.empty()) continue;
+				cur_cobjs.resize(0);
+				cur_cobjs.push_back((*this)[i]); // start with the current cobj
+				bool was_removed(0);
+
+				for (vector<unsigned>::const_iterator it = cids.begin(); it != cids.end(); ++it) {
+					unsigned const j(*it);
+					assert(j < ncobjs);
+					assert((*this)[j].type == COLL_CUBE && j != i);
+					if ((*this)[i].id < (*this)[j].id)              continue; // enforce ordering
+					if ((*this)[i].id == (*this)[j].id && was_split[j]) continue; // already removed earlier in this run (only written by this thread)
+					if (neg ^ ((*this)[j].status == COLL_NEGATIVE)) continue; // sign must be the same
+					csg_cube sub_cube((*this)[j]);
+
+					for (coll_obj_group::const_iterator c = cur_cobjs.begin(); c != cur_cobjs.end(); ++c) {
+						if (sub_cube.subtract_from_cube(next_cobjs, *c)) {
+							was_removed = 1;
+						}
+						else { // didn't overlap
+							next_cobjs.push_back(*c);
+						}
+					}
+					cur_cobjs.clear();
+					cur_cobjs.swap(next_cobjs);
+				} // for it
+				if (was_removed) {
+					fragments[p].assign(cur_cobjs.begin(), cur_cobjs.end());
+					was_split[i] = 1;
 				}
-				else { // didn't overlap
-					next_cobjs.push_back(*c);
+				else {
+					assert(cur_cobjs.size() == 1); // the original cobjs[i]
 				}
-			}
-			cur_cobjs.clear();
-			cur_cobjs.swap(next_cobjs);
-		} // for it
-		if (was_removed) {
-			copy(cur_cobjs.begin(), cur_cobjs.end(), back_inserter(*this));
-			(*this)[i].type = COLL_INVALID; // remove old coll obj
-		}
-		else {
-			assert(cur_cobjs.size() == 1); // the original cobjs[i]
-		}
-	} // for i
+			} // for p
+		} // for r
+	} // end omp parallel
+	bool overlaps(0);
+
+	for (unsigned p = proc_order.size(); p-- > 0;) { // add new fragments in serial processing order
+		unsigned const i(proc_order[p].second);
+		if (!was_split[i]) continue;
+		copy(fragments[p].begin(), fragments[p].end(), back_inserter(*this));
+		(*this)[i].type = COLL_INVALID; // remove old coll obj
+		overlaps = 1;
+	}
 	if (overlaps) remove_invalid_cobjs();
 	cout << ncobjs << " => " << size() << endl;
 	PRINT_TIME("Cube Overlap Removal");
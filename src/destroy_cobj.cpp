@@ -31,6 +31,61 @@ unsigned subtract_cube(vector<color_tid_vol> &cts, vector3d &cdir, csg_cube cons
 // **************** Cobj Destroy Code ****************
 
 
+struct deferred_explosion_t {
+	point pos;
+	int shooter;
+	float damage, size;
+
+	deferred_explosion_t(point const &pos_, int shooter_, float damage_, float size_) : pos(pos_), shooter(shooter_), damage(damage_), size(size_) {}
+};
+
+// while active, the static cobj tree rebuild, cobj waypoint adds, voxel flow updates, and chained explosions from all cobjs destroyed
+// are collected and done once in end_cobj_destroy_batch() rather than once per destroy_coll_objs()/subtract_cube() call
+struct cobj_destroy_batch_t {
+	bool active, tree_invalid;
+	vector<int> waypt_cobjs;
+	vector<cube_t> flow_cubes;
+	vector<deferred_explosion_t> explosions;
+
+	cobj_destroy_batch_t() : active(0), tree_invalid(0) {}
+};
+
+cobj_destroy_batch_t destroy_batch;
+
+
+void begin_cobj_destroy_batch() {
+	assert(!destroy_batch.active);
+	destroy_batch.active = 1;
+}
+
+void end_cobj_destroy_batch() {
+
+	assert(destroy_batch.active);
+	destroy_batch.active = 0;
+
+	if (destroy_batch.tree_invalid) {
+		invalidate_static_cobjs();
+		destroy_batch.tree_invalid = 0;
+	}
+	for (auto i = destroy_batch.waypt_cobjs.begin(); i != destroy_batch.waypt_cobjs.end(); ++i) { // after the tree rebuild
+		coll_obj &cobj(coll_objects.get_cobj(*i));
+		if (cobj.status == COLL_STATIC && cobj.waypt_id < 0) {cobj.add_connect_waypoint();} // skip cobjs destroyed later in the batch; slow
+	}
+	if (!destroy_batch.flow_cubes.empty()) { // shared cells are only updated once
+		update_flow_for_voxels(destroy_batch.flow_cubes);
+		add_lighting_dirty_region(destroy_batch.flow_cubes);
+	}
+	vector<deferred_explosion_t> explosions;
+	explosions.swap(destroy_batch.explosions);
+	destroy_batch.waypt_cobjs.clear();
+	destroy_batch.flow_cubes.clear();
+
+	for (auto i = explosions.begin(); i != explosions.end(); ++i) {
+		create_explosion(i->pos, i->shooter, 0, i->damage, i->size, BLAST_RADIUS, 0);
+	}
+}
+
+
 void destroy_coll_objs(point const &pos, float damage, int shooter, int damage_type, float force_radius) {
 
 	//RESET_TIME;
@@ -48,21 +103,25 @@ void destroy_coll_objs(point const &pos, float damage, int shooter, int damage_t
 
 	if (!point_outside_mesh(xpos, ypos)) {
 		// check for waypoints that can be added near this cube (at the center only)
-		vector<int> const &cvals(v_collision_matrix[ypos][xpos].cvals);
+		coll_cell const &cell(v_collision_matrix[ypos][xpos]);
 
-		for (vector<int>::const_iterator i = cvals.begin(); i != cvals.end(); ++i) {
-			if (*i >= 0 && coll_objects.get_cobj(*i).waypt_id < 0) {coll_objects.get_cobj(*i).add_connect_waypoint();} // slow
+		for (unsigned i = 0; i < cell.size(); ++i) {
+			int const cid(cell.get(i));
+			if (cid < 0 || coll_objects.get_cobj(cid).waypt_id >= 0) continue;
+			if (destroy_batch.active) {destroy_batch.waypt_cobjs.push_back(cid);}
+			else {coll_objects.get_cobj(cid).add_connect_waypoint();} // slow
 		}
 	}
 
 	// update voxel pflow map for removal
-	vector<cube_t> cubes;
+	vector<cube_t> local_cubes;
+	vector<cube_t> &cubes(destroy_batch.active ? destroy_batch.flow_cubes : local_cubes);
 	cubes.push_back(cube);
 
 	for (unsigned i = 0; i < cts.size(); ++i) {
 		if (cts[i].destroy >= SHATTERABLE || cts[i].unanchored) {cubes.push_back(cts[i]);}
 	}
-	update_flow_for_voxels(cubes);
+	if (!destroy_batch.active) {update_flow_for_voxels(cubes); add_lighting_dirty_region(cubes);}
 
 	// create fragments
 	float const cdir_mag(cdir.mag());
@@ -71,7 +130,9 @@ void destroy_coll_objs(point const &pos, float damage, int shooter, int damage_t
 	for (unsigned i = 0; i < cts.size(); ++i) {
 		if (cts[i].destroy >= EXPLODEABLE) {
 			float const val(float(pow(double(cts[i].volume), 1.0/3.0))), exp_damage(25000.0*val + 0.25*damage + 500.0);
-			create_explosion(pos, shooter, 0, exp_damage, 10.0*val, BLAST_RADIUS, 0);
+
+			if (destroy_batch.active) {destroy_batch.explosions.push_back(deferred_explosion_t(pos, shooter, exp_damage, 10.0*val));} // after the tree rebuild
+			else {create_explosion(pos, shooter, 0, exp_damage, 10.0*val, BLAST_RADIUS, 0);}
 			gen_fire(pos, min(4.0, 12.0*val), shooter);
 		}
 		if (!cts[i].draw) continue;
@@ -255,7 +316,10 @@ void add_to_falling_cobjs(set<unsigned> const &ids) {
 }
 
 
-void invalidate_static_cobjs() {build_cobj_tree(0, 0);}
+void invalidate_static_cobjs() {
+	if (destroy_batch.active) {destroy_batch.tree_invalid = 1;} // rebuilt in end_cobj_destroy_batch()
+	else {build_cobj_tree(0, 0);}
+}
 
 
 // Note: should be named partially_destroy_cube_area() or something like that
@@ -357,9 +421,14 @@ unsigned subtract_cube(vector<color_tid_vol> &cts, vector3d &cdir, csg_cube cons
 	}
 	if (!to_remove.empty()) {invalidate_static_cobjs();} // after destroyed cobj removal
 
-	// add new waypoints (after build_cobj_tree and end_batch)
-	for (vector<int>::const_iterator i = just_added.begin(); i != just_added.end(); ++i) {
-		cobjs[*i].add_connect_waypoint(); // slow
+	if (destroy_batch.active) { // tree rebuild is deferred, so make new cobjs visible to intersection queries, and add waypoints later
+		for (vector<int>::const_iterator i = just_added.begin(); i != just_added.end(); ++i) {add_static_cobj_not_in_tree(*i);}
+		copy(just_added.begin(), just_added.end(), back_inserter(destroy_batch.waypt_cobjs));
+	}
+	else { // add new waypoints (after build_cobj_tree and end_batch)
+		for (vector<int>::const_iterator i = just_added.begin(); i != just_added.end(); ++i) {
+			cobjs[*i].add_connect_waypoint(); // slow
+		}
 	}
 
 	// process unanchored cobjs
@@ -503,13 +572,14 @@ int coll_obj::is_anchored() const {
 void fire_damage_cobjs(int xpos, int ypos) {
 
 	if (point_outside_mesh(xpos, ypos)) return;
-	vector<int> const &cvals(v_collision_matrix[ypos][xpos].cvals);
-	if (cvals.empty()) return;
+	coll_cell const &cell(v_collision_matrix[ypos][xpos]);
+	if (cell.empty()) return;
 	point const pos(get_xval(xpos), get_yval(ypos), mesh_height[ypos][xpos]);
 
-	for (vector<int>::const_iterator i = cvals.begin(); i != cvals.end(); ++i) {
-		if (*i < 0) continue;
-		coll_obj &cobj(coll_objects.get_cobj(*i));
+	for (unsigned i = 0; i < cell.size(); ++i) {
+		int const cid(cell.get(i));
+		if (cid < 0) continue;
+		coll_obj &cobj(coll_objects.get_cobj(cid));
 		if (cobj.destroy < EXPLODEABLE) continue;
 		if (!cobj.sphere_intersects(pos, HALF_DXY)) continue;
 		destroy_coll_objs(pos, 1000.0, NO_SOURCE, FIRE, HALF_DXY);
@@ -47,7 +47,7 @@ extern bool nop_frame, combined_gu, have_sun, clear_landscape_vbo, show_lightnin
 extern bool user_action_key, flashlight_on, enable_clip_plane_z, begin_motion, config_unlimited_weapons;
 extern unsigned inf_terrain_fire_mode, reflection_tid;
 extern int auto_time_adv, camera_flight, reset_timing, run_forward, window_width, window_height, voxel_editing, UNLIMITED_WEAPONS;
-extern int advanced, b2down, dynamic_mesh_scroll, spectate, animate2, used_objs, disable_inf_terrain, curr_window, DISABLE_WATER;
+extern int map_export_on_load, advanced, b2down, dynamic_mesh_scroll, spectate, animate2, used_objs, disable_inf_terrain, curr_window, DISABLE_WATER;
 extern float TIMESTEP, NEAR_CLIP, FAR_CLIP, cloud_cover, univ_sun_rad, atmosphere, vegetation, zmin, zbottom, ztop, ocean_wave_height, brightness;
 extern float def_atmosphere, def_vegetation, clip_plane_z, ambient_scale;
 extern double camera_zh;
@@ -71,6 +71,8 @@ void run_postproc_effects();
 void play_camera_footstep_sound();
 void draw_voxel_edit_volume();
 void play_switch_weapon_sound();
+void export_map_tiles();
+void quit_3dworld();
 
 vector3d calc_camera_direction();
 void draw_player_model(point const &pos, vector3d const &dir, int time);
@@ -765,6 +767,7 @@ void display(void) {
 		iticks = 1;
 	}
 	flashlight_next_frame();
+	next_frame_billboard_coll_hits();
 	tstep         = TIMESTEP*fticks;
 	reset_timing  = 0;
 	check_gl_error(1);
@@ -1023,6 +1026,11 @@ void display(void) {
 			float const cdist(max(fabs(camera.x/X_SCENE_SIZE), fabs(camera.y/Y_SCENE_SIZE)));
 			if (cdist > REL_SCROLL_DIST) {scroll_scene();}
 		}
+		if (map_export_on_load) { // after the first frame, since tiled terrain buildings and cities are generated on the first draw
+			export_map_tiles();
+			if (map_export_on_load == 2) {quit_3dworld();}
+			map_export_on_load = 0;
+		}
 	} // not universe mode
 #ifdef USE_GPU_TIMER
 	gpu_timer.show();
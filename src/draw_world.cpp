@@ -536,6 +536,7 @@ void setup_object_render_data() {
 	upload_dlights_textures(dlight_bounds); // get_scene_bounds()
 	if (TIMETEST) {PRINT_TIME("4 Dlights Textures");}
 	get_occluders();
+	build_cobj_sw_occlusion_zbuf();
 	if (TIMETEST) {PRINT_TIME("5 Get Occluders");}
 	//scene_smap_vbo_invalid = 0; // needs to be after dlights update
 }
@@ -702,7 +703,7 @@ bool check_cobj_vis_occlude(coll_obj const &c, pos_dir_up const &pdu, int reflec
 	if (reflection_pass == 1 && c.d[2][1] <= ref_plane_z) return 0; // reflection plane z clip
 	if (c.group_id >= 0) return 1; // grouped cobjs can't be culled
 	if (!c.check_pdu_visible(pdu)) return 0; // VFC
-	if (reflection_pass == 0) return !c.is_occluded_from_viewer(pdu.pos); // not reflections
+	if (reflection_pass == 0) return !(c.is_occluded_from_viewer(pdu.pos) || sw_zbuf_cube_occluded(c, pdu.pos)); // not reflections
 	if (reflection_pass == 1) return 1; // no occlusion culling for planar reflections
 	if ((display_mode & 0x08) == 0 || !have_occluders()) return 1;
 	return !cube_cobj_occluded(pdu.pos, c);
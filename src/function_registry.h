@@ -8,6 +8,7 @@
 #include "3DWorld.h"
 
 struct xform_matrix;
+struct vert_ray_hit_t;
 
 int omp_get_thread_num_3dw();
 
@@ -177,6 +178,7 @@ float get_mesh_zmax(point const *const pts, unsigned npts);
 void add_shadow_obj(point const &pos, float radius, int coll_id);
 void add_coll_shadow_objs();
 void get_occluders();
+void build_cobj_sw_occlusion_zbuf();
 
 // function prototypes - draw primitives
 void get_ortho_vectors(vector3d const &v12, vector3d *vab, int force_dim=-1);
@@ -380,6 +382,7 @@ void reset_other_objects_status();
 void auto_advance_time();
 
 // function prototypes - ai
+void build_smiley_target_vis();
 void advance_smiley(dwobject &obj, int smiley_id);
 void shift_player_state(vector3d const &vd, int smiley_id);
 void player_clip_to_scene(point &pos);
@@ -438,6 +441,7 @@ void free_cobj_draw_group_vbos();
 // function prototypes - coll_cell_search
 void build_static_moving_cobj_tree();
 void build_cobj_tree(bool dynamic=0, bool verbose=1);
+void add_static_cobj_not_in_tree(unsigned ix);
 bool check_coll_line_exact_tree(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj,
 	bool dynamic=0, int test_alpha=0, bool skip_non_drawn=0, bool include_voxels=1, bool skip_init_colls=0, bool skip_movable=0, bool no_stat_moving=0);
 bool check_coll_line_tree(point const &p1, point const &p2, int &cindex, int ignore_cobj, bool dynamic=0, int test_alpha=0,
@@ -447,6 +451,7 @@ void get_coll_line_cobjs_tree(point const &pos1, point const &pos2, int ignore_c
 	vector<int> *cobjs, cobj_query_callback *cqc, bool dynamic, bool occlude, bool do_expand);
 void get_coll_sphere_cobjs_tree(point const &center, float radius, int cobj, vert_coll_detector &vcd, bool dynamic);
 bool check_point_contained_tree(point const &p, int &cindex, bool dynamic);
+void check_coll_vert_ray_row(float x0, float dx, float y, unsigned num, float const *z1, float const *z2, vector<vert_ray_hit_t> &hits, bool skip_dynamic);
 bool have_occluders();
 void get_intersecting_cobjs_tree(cube_t const &cube, vector<unsigned> &cobjs, int ignore_cobj, float toler,
 	bool dynamic, bool check_ccounter, int id_for_cobj_int=-1);
@@ -588,6 +593,7 @@ void load_textures();
 int texture_lookup(std::string const &name);
 int get_texture_by_name(std::string const &name, bool is_normal_map=0, bool invert_y=0, int wrap_mir=1, float aniso=0.0);
 bool select_texture(int id);
+bool check_tex_upload_budget(unsigned num_bytes);
 void update_player_bbb_texture(float extra_blood, bool recreate);
 float get_tex_ar(int id);
 void bind_1d_texture(unsigned tid, bool is_array=0);
@@ -661,6 +667,7 @@ void gen_landmine_scorch(point const &pos);
 int get_smiley_hit(vector3d &hdir, int index);
 void blast_radius(point const &pos, int type, int obj_index, int shooter, int chain_level);
 void create_explosion(point const &pos, int shooter, int chain_level, float damage, float size, int type, bool cview);
+void apply_explosion_world_effects();
 void do_area_effect_damage(point const &pos, float effect_radius, float damage, int index, int source, int type);
 void switch_player_weapon(int val);
 void draw_beams(bool clear_at_end);
@@ -761,6 +768,7 @@ bool update_small_tree_zvals(int x1, int y1, int x2, int y2);
 void exp_damage_trees(point const &epos, float damage, float bradius, int type);
 void apply_tree_fire(point const &pos, float radius, float val, bool spread_mode=0);
 void next_frame_tree_fires();
+void next_frame_billboard_coll_hits();
 void draw_tree_fires(shader_t &s);
 bool any_trees_on_fire();
 
@@ -788,6 +796,7 @@ void update_flow_for_voxels(vector<cube_t> const &cubes);
 void regen_lightmap();
 void clear_lightmap();
 void build_lightmap(bool verbose);
+unsigned get_llvol_scene_hash();
 void add_line_light(point const &p1, point const &p2, colorRGBA const &color, float size, float intensity=1.0);
 void add_dynamic_light(float sz, point const &p, colorRGBA const &c=WHITE, vector3d const &d=plus_z, float bw=1.0, point *line_end_pos=nullptr, bool is_static_pos=0);
 colorRGBA gen_fire_color(float &cval, float &inten, float rate=1.0);
@@ -803,6 +812,10 @@ bool is_in_darkness(point const &pos, float radius, int cobj);
 void get_indir_light(colorRGBA &a, point const &p);
 bool is_any_dlight_visible(point const &p);
 
+// function prototypes - ray_trace
+void add_lighting_dirty_region(vector<cube_t> const &cubes);
+void kill_incremental_relight();
+
 // function prototypes - smoke
 void add_smoke(point const &pos, float val);
 void distribute_smoke();
@@ -849,6 +862,9 @@ void draw_waypoints();
 void destroy_coll_objs(point const &pos, float damage, int shooter, int damage_type, float force_radius=0.0);
 void check_falling_cobjs();
 void fire_damage_cobjs(int xpos, int ypos);
+void invalidate_static_cobjs();
+void begin_cobj_destroy_batch();
+void end_cobj_destroy_batch();
 
 // function prototypes - shadow_map
 cube_t get_scene_bounds();
@@ -881,6 +897,7 @@ bool update_voxel_sphere_region(point const &center, float radius, float val_at_
 void proc_voxel_updates();
 bool check_voxel_coll_line(point const &p1, point const &p2, point &cpos, vector3d &cnorm, int &cindex, int ignore_cobj, bool exact);
 void get_voxel_coll_sphere_cobjs(point const &center, float radius, int ignore_cobj, vert_coll_detector &vcd);
+bool have_voxel_cobjs();
 bool write_voxel_brushes();
 void change_voxel_editing_mode(int val);
 void undo_voxel_brush();
@@ -984,9 +1001,17 @@ bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id,
 bool select_building_in_plot(unsigned plot_id, unsigned rand_val, unsigned &building_id);
 void get_building_bcubes(cube_t const &xy_range, vector<cube_t> &bcubes);
 bool get_buildings_line_hit_color(point const &p1, point const &p2, colorRGBA &color);
+void get_buildings_vert_row_hit_colors(float x0, float dx, float y, unsigned num, float const *z1, float const *z2, vector<colorRGBA> &colors, vector<unsigned char> &hits);
 bool have_buildings();
+unsigned get_num_buildings();
 vector3d const &get_buildings_max_extent();
 void clear_building_vbos();
+void get_building_occluder_parts(pos_dir_up const &pdu, vector<cube_t> &cubes);
+
+// function prototypes - occlusion_zbuf
+bool sw_occlusion_zbuf_enabled();
+void build_sw_occlusion_zbuf(pos_dir_up const &pdu, vector<cube_t> &occluders);
+bool sw_zbuf_cube_occluded(cube_t const &c, point const &viewer);
 
 #include "inlines.h"
 
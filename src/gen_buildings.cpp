@@ -8,6 +8,7 @@
 #include "gl_ext_arb.h"
 #include "file_utils.h"
 #include "buildings.h"
+#include <cfloat> // for FLT_MAX
 
 using std::string;
 
@@ -1519,6 +1520,7 @@ class building_creator_t {
 public:
 	building_creator_t() : max_extent(zero_vector) {}
 	bool empty() const {return buildings.empty();}
+	unsigned get_num_buildings() const {return buildings.size();}
 	void clear() {buildings.clear(); grid.clear();}
 	vector3d const &get_max_extent() const {return max_extent;}
 	building_t const &get_building(unsigned ix) const {assert(ix < buildings.size()); return buildings[ix];}
@@ -1845,6 +1847,60 @@ public:
 		return coll;
 	}
 
+	// batched version of check_line_coll() for a row of vertical lines at {x0 + i*dx, y} from z1[i] down to z2[i]; lines with z1 <= z2 are skipped;
+	// the grid is only traversed once for the whole row, then each line is tested against the buildings that overlap it in x
+	void check_vert_row_coll(float x0, float dx, float y, unsigned num, float const *z1, float const *z2, vector<unsigned char> &rets, vector<unsigned> &hit_bixs) const {
+		rets.assign(num, 0); // 0=none, 1=side, 2=roof, 3=details
+		hit_bixs.resize(num);
+		if (empty() || num == 0) return;
+		assert(dx > 0.0);
+		float zmin(FLT_MAX), zmax(-FLT_MAX);
+
+		for (unsigned i = 0; i < num; ++i) {
+			if (z1[i] <= z2[i]) continue; // inactive
+			min_eq(zmin, z2[i]);
+			max_eq(zmax, z1[i]);
+		}
+		if (zmin > zmax) return; // no active lines
+		vector3d const xlate(get_camera_coord_space_xlate());
+		cube_t const row_bcube(x0-xlate.x, x0+(num-1)*dx-xlate.x, y-xlate.y, y-xlate.y, zmin-xlate.z, zmax-xlate.z);
+		unsigned ixr[2][2];
+		get_grid_range(row_bcube, ixr);
+		vector<unsigned> cands, active;
+		vector<point> points; // reused across calls
+
+		for (unsigned y = ixr[0][1]; y <= ixr[1][1]; ++y) {
+			for (unsigned x = ixr[0][0]; x <= ixr[1][0]; ++x) {
+				grid_elem_t const &ge(get_grid_elem(x, y));
+				if (ge.ixs.empty() || !ge.bcube.intersects(row_bcube)) continue;
+
+				for (auto b = ge.ixs.begin(); b != ge.ixs.end(); ++b) {
+					if (get_building(*b).bcube.intersects(row_bcube)) {cands.push_back(*b);}
+				}
+			}
+		}
+		sort(cands.begin(), cands.end());
+		cands.erase(unique(cands.begin(), cands.end()), cands.end()); // buildings can span multiple grid elements
+		sort(cands.begin(), cands.end(), bix_by_x1(buildings));
+		unsigned next(0);
+
+		for (unsigned i = 0; i < num; ++i) { // sweep in x, keeping the set of buildings that overlap the current line
+			if (z1[i] <= z2[i]) continue;
+			float const x(x0 + i*dx), bx(x - xlate.x);
+			for (; next < cands.size() && get_building(cands[next]).bcube.x1() <= bx; ++next) {active.push_back(cands[next]);}
+			point const p1(x, y, z1[i]), p2(x, y, z2[i]);
+
+			for (unsigned n = 0; n < active.size();) {
+				building_t const &building(get_building(active[n]));
+				if (building.bcube.x2() < bx) {active[n] = active.back(); active.pop_back(); continue;} // no longer overlaps
+				float t(1.0);
+				unsigned const ret(building.check_line_coll(p1, p2, xlate, t, points, 0, 0));
+				if (ret) {rets[i] = ret; hit_bixs[i] = active[n]; break;} // vertical lines can only intersect one building
+				++n;
+			}
+		} // for i
+	}
+
 	// Note: we can get building_id by calling check_ped_coll() or get_building_bcube_at_pos()
 	bool check_line_coll_building(point const &p1, point const &p2, unsigned building_id) const { // Note: not thread safe sue to static points
 		assert(building_id < buildings.size());
@@ -1937,6 +1993,20 @@ public:
 		} // for b
 		return 0;
 	}
+	void get_occluder_parts(pos_dir_up const &pdu, vector<cube_t> &cubes) const { // for software occlusion culling, in camera space
+		building_occlusion_state_t state;
+		get_occluders(pdu, state);
+
+		for (auto b = state.building_ids.begin(); b != state.building_ids.end(); ++b) {
+			building_t const &building(get_building(*b));
+			if (!building.is_simple_cube() || building.is_rotated()) continue; // parts are only solid for axis aligned cube buildings
+
+			for (auto p = building.parts.begin(); p != building.parts.end(); ++p) {
+				cube_t const part(*p + state.xlate);
+				if (pdu.cube_visible(part)) {cubes.push_back(part);}
+			}
+		}
+	}
 }; // building_creator_t
 
 
@@ -1970,24 +2040,36 @@ bool check_buildings_ped_coll(point const &pos, float radius, unsigned plot_id,
 bool select_building_in_plot(unsigned plot_id, unsigned rand_val, unsigned &building_id) {return building_creator.select_building_in_plot(plot_id, rand_val, building_id);}
 void get_building_bcubes(cube_t const &xy_range, vector<cube_t> &bcubes) {building_creator.get_overlapping_bcubes(xy_range, bcubes);} // Note: no xlate applied
 
+colorRGBA get_building_hit_color(unsigned hit_bix, unsigned ret) {
+	building_t const &b(building_creator.get_building(hit_bix));
+	switch (ret) {
+	case 1: return b.get_avg_side_color  ();
+	case 2: return b.get_avg_roof_color  ();
+	case 3: return b.get_avg_detail_color();
+	default: assert(0);
+	}
+	return BLACK; // never gets here
+}
 bool get_buildings_line_hit_color(point const &p1, point const &p2, colorRGBA &color) {
 	float t(0.0); // unused
 	unsigned hit_bix(0);
 	unsigned const ret(check_buildings_line_coll(p1, p2, t, hit_bix, 0)); // apply_tt_xlate=0; 0=no hit, 1=hit side, 2=hit roof
 	if (ret == 0) return 0;
-	building_t const &b(building_creator.get_building(hit_bix));
-	switch (ret) {
-	case 1: color = b.get_avg_side_color  (); break;
-	case 2: color = b.get_avg_roof_color  (); break;
-	case 3: color = b.get_avg_detail_color(); break;
-	default: assert(0);
-	}
+	color = get_building_hit_color(hit_bix, ret);
 	return 1;
 }
+void get_buildings_vert_row_hit_colors(float x0, float dx, float y, unsigned num, float const *z1, float const *z2, vector<colorRGBA> &colors, vector<unsigned char> &hits) {
+	vector<unsigned> hit_bixs;
+	building_creator.check_vert_row_coll(x0, dx, y, num, z1, z2, hits, hit_bixs);
+	colors.resize(num);
+	for (unsigned i = 0; i < num; ++i) {if (hits[i]) {colors[i] = get_building_hit_color(hit_bixs[i], hits[i]);}}
+}
 bool have_buildings() {return !building_creator.empty();}
+unsigned get_num_buildings() {return building_creator.get_num_buildings();}
 vector3d const &get_buildings_max_extent() {return building_creator.get_max_extent();} // used for TT shadow bounds
 void get_building_occluders(pos_dir_up const &pdu, building_occlusion_state_t &state) {building_creator.get_occluders(pdu, state);}
 bool check_pts_occluded(point const *const pts, unsigned npts, building_occlusion_state_t &state) {return building_creator.check_pts_occluded(pts, npts, state);}
+void get_building_occluder_parts(pos_dir_up const &pdu, vector<cube_t> &cubes) {building_creator.get_occluder_parts(pdu, cubes);}
 
 void clear_building_vbos() {
 	building_draw.clear_vbos();
@@ -347,8 +347,8 @@ public:
 					cube_t const test_cube(xval-0.5*DX_VAL, xval+0.5*DX_VAL, yval-0.5*DY_VAL, yval+0.5*DY_VAL, mesh_height[y][x], czmax+grass_length);
 					float const nz_thresh = 0.4;
 
-					for (unsigned k = 0; k < cell.cvals.size(); ++k) {
-						int const index(cell.cvals[k]);
+					for (unsigned k = 0; k < cell.size(); ++k) {
+						int const index(cell.get(k));
 						if (index < 0) continue;
 						coll_obj const &cobj(coll_objects.get_cobj(index));
 						if (cobj.type != COLL_POLYGON || cobj.cp.cobj_type != COBJ_TYPE_VOX_TERRAIN) continue;
@@ -693,9 +693,17 @@ void texture_t::deferred_load_and_bind() {
 	switch (defer_load_type) {
 #ifdef ENABLE_DDS
 	case DEFER_TYPE_DDS:
+	case DEFER_TYPE_DDS_CACHE: // compressed on the CPU, not flipped
 		{
-			//cout << "Loading DDS image " << name << endl;
-			gli::texture2d Texture(gli::load_dds(name.c_str()));
+			bool const from_cache(defer_load_type == DEFER_TYPE_DDS_CACHE);
+			//cout << "Loading DDS image " << (from_cache ? cache_fn : name) << endl;
+			gli::texture2d Texture(gli::load_dds((from_cache ? cache_fn : name).c_str()));
+
+			if (from_cache && Texture.empty()) { // cache file was removed or is corrupt; caller will upload the uncompressed data instead
+				cerr << "Error loading compressed texture cache file " << cache_fn << " for texture " << name << endl;
+				drop_comp_cache();
+				return;
+			}
 			bool const compressed(gli::is_compressed(Texture.format()));
 			// here we assume the texture is upside down and flip it, if it's uncompressed and flippable
 			if (!compressed && !invert_y) {Texture = flip(Texture);}
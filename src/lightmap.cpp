@@ -39,9 +39,10 @@ indir_dlight_group_manager_t indir_dlight_group_manager;
 
 
 extern int animate2, display_mode, frame_counter, camera_coll_id, scrolling, read_light_files[], write_light_files[];
-extern unsigned create_voxel_landscape;
-extern float czmin, czmax, fticks, zbottom, ztop, XY_SCENE_SIZE, FAR_CLIP, CAMERA_RADIUS, indir_light_exp, light_int_scale[], force_czmin, force_czmax;
+extern unsigned create_voxel_landscape, DYNAMIC_RAYS, MAX_RAY_BOUNCES;
+extern float ray_step_size_mult, czmin, czmax, fticks, zbottom, ztop, XY_SCENE_SIZE, FAR_CLIP, CAMERA_RADIUS, indir_light_exp, light_int_scale[], force_czmin, force_czmax;
 extern colorRGB cur_ambient, cur_diffuse;
+extern string flow_cache_fn, llvol_cache_fn;
 extern coll_obj_group coll_objects;
 extern vector<light_source> enabled_lights;
 
@@ -248,25 +249,34 @@ void lmap_manager_t::init_from(lmap_manager_t const &src) {
 }
 
 
-// *this = blend_weight*dest + (1.0 - blend_weight)*(*this)
-void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight) {
+void lmap_manager_t::get_region_bounds(cube_t const &region, int bnds[3][2]) const { // cell ranges are [start, end), clamped to the lightmap
+
+	bnds[0][0] = max(get_xpos_round_down(region.d[0][0]), 0); bnds[0][1] = min(get_xpos_round_down(region.d[0][1])+1, (int)lm_xsize);
+	bnds[1][0] = max(get_ypos_round_down(region.d[1][0]), 0); bnds[1][1] = min(get_ypos_round_down(region.d[1][1])+1, (int)lm_ysize);
+	bnds[2][0] = max(get_zpos(region.d[2][0]), 0);            bnds[2][1] = min(get_zpos(region.d[2][1])+1, (int)lm_zsize);
+}
+
+// *this = blend_weight*dest + (1.0 - blend_weight)*(*this); if region is specified, only cells inside it are modified
+void lmap_manager_t::copy_data(lmap_manager_t const &src, float blend_weight, cube_t const *region) {
 
 	assert(vlmap && src.vlmap);
 	assert(src.lm_xsize == lm_xsize && src.lm_ysize == lm_ysize && src.lm_zsize == lm_zsize);
 	assert(src.vldata_alloc.size() == vldata_alloc.size());
 	assert(blend_weight >= 0.0);
 	if (blend_weight == 0.0) return; // keep existing dest
+	int bnds[3][2] = {{0, (int)lm_xsize}, {0, (int)lm_ysize}, {0, (int)lm_zsize}};
 
-	if (blend_weight == 1.0) {
+	if (region) {get_region_bounds(*region, bnds);}
+	else if (blend_weight == 1.0) {
 		vldata_alloc = src.vldata_alloc; // deep copy all lmcell data
 		return;
 	}
-	for (unsigned i = 0; i < lm_ysize; ++i) { // openmp?
-		for (unsigned j = 0; j < lm_xsize; ++j) {
+	for (int i = bnds[1][0]; i < bnds[1][1]; ++i) { // openmp?
+		for (int j = bnds[0][0]; j < bnds[0][1]; ++j) {
 			if (!vlmap[i][j]) {assert(!src.vlmap[i][j]); continue;}
 			assert(src.vlmap[i][j]);
 			
-			for (unsigned z = 0; z < lm_zsize; ++z) {
+			for (int z = bnds[2][0]; z < bnds[2][1]; ++z) {
 				vlmap[i][j][z].mix_lighting_with(src.vlmap[i][j][z], blend_weight);
 			}
 		}
@@ -286,10 +296,41 @@ void lmcell::mix_lighting_with(lmcell const &lmc, float val) {
 }
 
 
-int light_grid_base::check_lmap_get_grid_index(point const &p) const {
+void llv_accum_t::init() {
+
+	nbx = (MESH_X_SIZE + LLV_BLOCK_SZ - 1) >> LLV_BLOCK_BITS;
+	nby = (MESH_Y_SIZE + LLV_BLOCK_SZ - 1) >> LLV_BLOCK_BITS;
+	blocks.clear();
+	blocks.resize(nbx*nby);
+}
+
+void llv_accum_t::add_color(point const &p, colorRGBA const &color) {
+
 	int const x(get_xpos_round_down(p.x)), y(get_ypos_round_down(p.y)), z(get_zpos(p.z));
-	if (!lmap_manager.is_valid_cell(x, y, z)) return -1; // the global lightmap doesn't have this cell
-	return get_ix(x, y, z);
+	if (!lmap_manager.is_valid_cell(x, y, z)) return; // if the global lightmap doesn't have this cell, the local lmap shouldn't need it
+	assert(z < MESH_SIZE[2]);
+	vector<lmcell_local> &block(blocks[get_block_ix(x, y)]);
+	if (block.empty()) {block.resize(LLV_BLOCK_SZ*LLV_BLOCK_SZ*MESH_SIZE[2]);} // allocate on first touch, init to all zeros
+	UNROLL_3X(block[get_cell_ix(x, y, z)].lc[i_] += color[i_]*color.alpha;)
+}
+
+void llv_accum_t::merge(llv_accum_t const &a) {
+
+	assert(a.blocks.size() == blocks.size());
+
+	for (unsigned b = 0; b < blocks.size(); ++b) {
+		vector<lmcell_local> const &src(a.blocks[b]);
+		if (src.empty()) continue;
+		vector<lmcell_local> &dest(blocks[b]);
+		if (dest.empty()) {dest = src; continue;}
+		assert(dest.size() == src.size());
+		for (unsigned i = 0; i < dest.size(); ++i) {UNROLL_3X(dest[i].lc[i_] += src[i].lc[i_];)}
+	}
+}
+
+lmcell_local const *llv_accum_t::get_column(int x, int y) const {
+	vector<lmcell_local> const &block(blocks[get_block_ix(x, y)]);
+	return (block.empty() ? nullptr : &block[get_cell_ix(x, y, 0)]);
 }
 
 
@@ -300,16 +341,6 @@ void light_volume_local::allocate() {
 	data.resize(get_num_data()); // init to all zeros
 }
 
-void light_volume_local::add_color(point const &p, colorRGBA const &color) { // inlined in the header?
-
-	assert(!compressed); // compressed is read only
-	int const ix(check_lmap_get_grid_index(p));
-	if (ix < 0) return; // if the global lightmap doesn't have this cell, the local lmap shouldn't need it
-	assert((unsigned)ix < data.size());
-	UNROLL_3X(data[ix].lc[i_] += color[i_]*color.alpha;)
-	changed = 1;
-}
-
 void light_volume_local::add_lighting(colorRGB &color, int x, int y, int z) const {
 
 	//if (!is_active()) return; // not yet allocated - caller should check this
@@ -367,18 +398,29 @@ void light_volume_local::set_bounds(int x1, int x2, int y1, int y2, int z1, int
 
 void update_range(int bnds[2], int v) {bnds[0] = min(bnds[0], v); bnds[1] = max(bnds[1], v+1);} // max is one past the end
 
-void light_volume_local::compress(bool verbose) {
+void light_volume_local::set_data(int const bnds[3][2], vector<lmcell_local> const &data_) {
+
+	memcpy(bounds, bnds, sizeof(bounds));
+	data = data_;
+	assert(data.size() == get_num_data());
+	compressed = 1; // cached data is always compressed
+	changed    = 1;
+}
+
+// builds the compressed (bounded) representation directly from the sparse accumulated rays, without allocating the full uncompressed volume
+void light_volume_local::build_from_accum(llv_accum_t const &accum, bool verbose) {
 
-	if (compressed) return; // already compressed
 	float const toler(1.0/(256.0 * max(0.001f, scale)));
-	assert(is_allocated());
 	set_bounds(MESH_X_SIZE, 0, MESH_Y_SIZE, 0, MESH_SIZE[2], 0);
 	bool nonempty(0);
 
 	for (int y = 0; y < MESH_Y_SIZE; ++y) {
 		for (int x = 0; x < MESH_X_SIZE; ++x) {
+			lmcell_local const *const col(accum.get_column(x, y));
+			if (col == nullptr) continue; // untouched block
+
 			for (int z = 0; z < MESH_SIZE[2]; ++z) {
-				if (data[get_ix(x, y, z)].is_near_zero(toler)) continue;
+				if (col[z].is_near_zero(toler)) continue;
 				update_range(bounds[0], x);
 				update_range(bounds[1], y);
 				update_range(bounds[2], z);
@@ -386,51 +428,144 @@ void light_volume_local::compress(bool verbose) {
 			}
 		}
 	}
+	compressed = 1;
+	changed    = 1;
+
 	if (!nonempty) { // empty case, generally shouldn't happen
 		set_bounds(0, 0, 0, 0, 0, 0);
 		data.clear();
 		return;
 	}
-	vector<lmcell_local> comp_data(get_num_data());
+	data.clear();
+	data.resize(get_num_data()); // init to all zeros
 	unsigned data_pos(0);
 	
 	for (int y = bounds[1][0]; y < bounds[1][1]; ++y) {
 		for (int x = bounds[0][0]; x < bounds[0][1]; ++x) {
-			for (int z = bounds[2][0]; z < bounds[2][1]; ++z) {
-				comp_data[data_pos++] = data[get_ix(x, y, z)];
-			}
+			lmcell_local const *const col(accum.get_column(x, y));
+			if (col == nullptr) {data_pos += (bounds[2][1] - bounds[2][0]); continue;} // leave as zeros
+			for (int z = bounds[2][0]; z < bounds[2][1]; ++z) {data[data_pos++] = col[z];}
 		}
 	}
-	assert(data_pos == comp_data.size());
+	assert(data_pos == data.size());
 
 	if (verbose) {
-		cout << "uncomp size: " << data.size() << ", bounds: {" << bounds[0][0] << "," << bounds[0][1] << "},{" << bounds[1][0] << ","
-			 << bounds[1][1] << "},{" << bounds[2][0] << "," << bounds[2][1] << "}" << " comp size: " << comp_data.size() << endl;
+		cout << "bounds: {" << bounds[0][0] << "," << bounds[0][1] << "},{" << bounds[1][0] << "," << bounds[1][1] << "},{"
+			 << bounds[2][0] << "," << bounds[2][1] << "}" << " comp size: " << data.size() << endl;
 	}
-	data.swap(comp_data);
-	compressed = 1;
 }
 
-void light_volume_local::init(unsigned lvol_ix, float scale_, string const &filename) {
 
-	RESET_TIME;
-	set_scale(scale_);
-	if (!filename.empty() && read(filename)) return; // see if there is an existing file to read
-	gen_data(lvol_ix, 1);
-	if (!filename.empty()) {write(filename);} // write the output file
-	PRINT_TIME("Local Dlight Volume Creation");
-}
+unsigned const LLVOL_CACHE_MAGIC   = 0x4C4C564F; // "LLVO"
+unsigned const LLVOL_CACHE_VERSION = 1;
 
-void light_volume_local::gen_data(unsigned lvol_ix, bool verbose) {
-	
-	//RESET_TIME;
-	allocate();
-	//PRINT_TIME("Alloc");
-	compute_ray_trace_lighting((LIGHTING_DYNAMIC + lvol_ix), verbose);
-	//PRINT_TIME("Alloc + Trace");
-	compress(verbose);
-	//PRINT_TIME("Alloc + Trace + Compress");
-}
+// single indexed file holding the compressed data of every generated local light volume, keyed by light group and validated by scene hash;
+// format: {magic, version, scene_hash, num_entries}, then an index of {key, bounds[3][2], num_cells} per entry, then the cell data in index order
+class llvol_cache_t {
+
+	struct entry_t {
+		int bounds[3][2];
+		vector<lmcell_local> data;
+	};
+	bool loaded;
+	unsigned scene_hash;
+	map<unsigned, entry_t> entries; // light group key => volume data
+
+public:
+	llvol_cache_t() : loaded(0), scene_hash(0) {}
+	bool is_loaded() const {return loaded;}
+
+	void read(string const &fn, unsigned scene_hash_) {
+
+		loaded     = 1; // only try once
+		scene_hash = scene_hash_;
+		binary_file_reader reader;
+		if (!reader.open(fn)) return; // file doesn't exist yet
+		unsigned header[4] = {0};
+
+		if (!reader.read(header, sizeof(unsigned), 4) || header[0] != LLVOL_CACHE_MAGIC || header[1] != LLVOL_CACHE_VERSION) {
+			cerr << "Error: Invalid header in local light volume cache file '" << fn << "'; ignoring." << endl;
+			return;
+		}
+		if (header[2] != scene_hash) {
+			cout << "Local light volume cache file '" << fn << "' is for a different scene and will be regenerated." << endl;
+			return;
+		}
+		unsigned const num_entries(header[3]);
+		vector<unsigned> keys(num_entries);
+		vector<entry_t> new_entries(num_entries);
+
+		for (unsigned i = 0; i < num_entries; ++i) { // read the index
+			unsigned vals[8] = {0}; // {key, bounds[3][2], num_cells}
+			
+			if (!reader.read(vals, sizeof(unsigned), 8)) {
+				cerr << "Error: Failed to read index from local light volume cache file '" << fn << "'." << endl;
+				return;
+			}
+			keys[i] = vals[0];
+			memcpy(new_entries[i].bounds, vals+1, sizeof(new_entries[i].bounds));
+			new_entries[i].data.resize(vals[7]);
+		}
+		for (unsigned i = 0; i < num_entries; ++i) { // read the data blocks
+			vector<lmcell_local> &data(new_entries[i].data);
+			
+			if (!data.empty() && !reader.read(&data.front(), sizeof(lmcell_local), data.size())) {
+				cerr << "Error: Failed to read data from local light volume cache file '" << fn << "'." << endl;
+				return;
+			}
+		}
+		for (unsigned i = 0; i < num_entries; ++i) {entries[keys[i]] = std::move(new_entries[i]);}
+		cout << "Read " << num_entries << " entries from local light volume cache file '" << fn << "'." << endl;
+	}
+	bool get(unsigned key, light_volume_local &lvol) const {
+
+		auto it(entries.find(key));
+		if (it == entries.end()) return 0;
+		entry_t const &e(it->second);
+		int const num((e.bounds[0][1] - e.bounds[0][0])*(e.bounds[1][1] - e.bounds[1][0])*(e.bounds[2][1] - e.bounds[2][0]));
+		if (e.data.empty() || num != (int)e.data.size()) return 0; // empty or inconsistent; regenerate
+		lvol.set_data(e.bounds, e.data);
+		return 1;
+	}
+	void add(unsigned key, light_volume_local const &lvol) {
+		entry_t &e(entries[key]);
+		lvol.copy_bounds(e.bounds);
+		e.data = lvol.get_data();
+	}
+	bool write(string const &fn) const {
+
+		binary_file_writer writer;
+		if (!writer.open(fn)) return 0;
+		unsigned const header[4] = {LLVOL_CACHE_MAGIC, LLVOL_CACHE_VERSION, scene_hash, (unsigned)entries.size()};
+
+		if (!writer.write(header, sizeof(unsigned), 4)) {
+			cerr << "Error: Failed to write header to local light volume cache file '" << fn << "'." << endl;
+			return 0;
+		}
+		for (auto i = entries.begin(); i != entries.end(); ++i) { // write the index
+			unsigned vals[8] = {i->first};
+			memcpy(vals+1, i->second.bounds, sizeof(i->second.bounds));
+			vals[7] = i->second.data.size();
+			
+			if (!writer.write(vals, sizeof(unsigned), 8)) {
+				cerr << "Error: Failed to write index to local light volume cache file '" << fn << "'." << endl;
+				return 0;
+			}
+		}
+		for (auto i = entries.begin(); i != entries.end(); ++i) { // write the data blocks
+			vector<lmcell_local> const &data(i->second.data);
+			
+			if (!data.empty() && !writer.write(&data.front(), sizeof(lmcell_local), data.size())) {
+				cerr << "Error: Failed to write data to local light volume cache file '" << fn << "'." << endl;
+				return 0;
+			}
+		}
+		cout << "Wrote " << entries.size() << " entries to local light volume cache file '" << fn << "'." << endl;
+		return 1;
+	}
+};
+
+llvol_cache_t llvol_cache;
 
 
 unsigned tag_ix_map::get_ix_for_name(string const &name) {
@@ -447,6 +582,7 @@ unsigned indir_dlight_group_manager_t::get_ix_for_name(std::string const &name,
 	if (tag_ix >= groups.size()) {groups.resize(tag_ix+1);}
 	else if (groups[tag_ix].scale != scale) {cout << "Warning: dlight name '" << name << "' was set to two different scales of " << groups[tag_ix].scale << " and " << scale << endl;}
 	groups[tag_ix].scale = scale;
+	groups[tag_ix].name  = name;
 	if (name.find_last_of('.') != string::npos) {groups[tag_ix].filename = name;} // if it has a file extension (.), assume it's a filename
 	return tag_ix;
 }
@@ -458,8 +594,29 @@ void indir_dlight_group_manager_t::add_dlight_ix_for_tag_ix(unsigned tag_ix, uns
 	groups[tag_ix].dlight_ixs.push_back(dlight_ix); // check valid dlight_ix?
 }
 
+unsigned indir_dlight_group_manager_t::get_cache_key(unsigned tag_ix) const { // hash of the group name and its light parameters
+
+	assert(tag_ix < groups.size());
+	group_t const &g(groups[tag_ix]);
+	uLong crc(crc32(0L, Z_NULL, 0));
+	crc = crc32(crc, (Bytef const *)g.name.c_str(), g.name.size());
+
+	for (auto l = g.dlight_ixs.begin(); l != g.dlight_ixs.end(); ++l) {
+		assert(*l < light_sources_d.size());
+		light_source_trig const &ls(light_sources_d[*l]);
+		float fvals[14] = {0}; // 12 packed values + r_inner + num_rays
+		ls.pack_to_floatv(fvals);
+		fvals[12] = ls.get_r_inner();
+		fvals[13] = ls.get_num_rays();
+		crc = crc32(crc, (Bytef const *)fvals, sizeof(fvals));
+	}
+	return (unsigned)crc;
+}
+
 void indir_dlight_group_manager_t::create_needed_llvols() {
 
+	vector<unsigned> to_gen, new_groups; // local light volumes to generate (new + dynamic updates), groups with newly created volumes
+
 	for (unsigned i = 0; i < groups.size(); ++i) {
 		group_t &g(groups[i]);
 		if (g.dlight_ixs.empty()) continue; // no lights for this group (including empty group 0)
@@ -480,14 +637,41 @@ void indir_dlight_group_manager_t::create_needed_llvols() {
 		if (g.llvol_ix >= 0) { // already valid - check enabled state
 			assert((unsigned)g.llvol_ix < local_light_volumes.size());
 			local_light_volumes[g.llvol_ix]->set_scale(scale);
-			if (is_dynamic && num_enabled > 0) {local_light_volumes[g.llvol_ix]->gen_data(g.llvol_ix, 0);} // dynamic update
+			if (is_dynamic && num_enabled > 0) {to_gen.push_back(g.llvol_ix);} // dynamic update
 		}
 		else if (num_enabled > 0) { // not valid but needed - create
 			g.llvol_ix = local_light_volumes.size();
 			local_light_volumes.push_back(std::unique_ptr<light_volume_local>(new light_volume_local(i)));
-			local_light_volumes[g.llvol_ix]->init(g.llvol_ix, scale, g.filename);
+			light_volume_local &lvol(*local_light_volumes[g.llvol_ix]);
+			lvol.set_scale(scale);
+			if (!g.filename.empty() && lvol.read(g.filename)) continue; // see if there is an existing file to read
+
+			if (!llvol_cache_fn.empty()) { // see if it's in the cache file
+				if (!llvol_cache.is_loaded()) {llvol_cache.read(llvol_cache_fn, get_llvol_scene_hash());}
+				if (llvol_cache.get(get_cache_key(i), lvol)) continue;
+			}
+			to_gen.push_back(g.llvol_ix);
+			new_groups.push_back(i);
 		}
 	}
+	if (to_gen.empty()) return; // nothing to do
+	bool const verbose(!new_groups.empty()); // print stats for new volumes but not for per-frame dynamic updates
+	RESET_TIME;
+	vector<llv_accum_t> accums;
+	trace_local_light_volumes(to_gen, accums, verbose, new_groups.empty()); // all volumes are traced together on the same worker threads; reserve a thread for rendering on dynamic updates
+	assert(accums.size() == to_gen.size());
+	for (unsigned i = 0; i < to_gen.size(); ++i) {local_light_volumes[to_gen[i]]->build_from_accum(accums[i], verbose);}
+	if (!verbose) return;
+
+	for (auto i = new_groups.begin(); i != new_groups.end(); ++i) {
+		group_t const &g(groups[*i]);
+		light_volume_local const &lvol(*local_light_volumes[g.llvol_ix]);
+		if (!lvol.is_allocated()) continue; // empty
+		if (!g.filename.empty()) {lvol.write(g.filename);} // write the output file
+		if (!llvol_cache_fn.empty()) {llvol_cache.add(get_cache_key(*i), lvol);}
+	}
+	if (!llvol_cache_fn.empty()) {llvol_cache.write(llvol_cache_fn);}
+	PRINT_TIME("Local Dlight Volume Creation");
 }
 
 
@@ -497,10 +681,11 @@ void create_dlight_volumes() {indir_dlight_group_manager.create_needed_llvols();
 bool has_fixed_cobjs(int x, int y) {
 
 	assert(!point_outside_mesh(x, y));
-	vector<int> const &cvals(v_collision_matrix[y][x].cvals);
+	coll_cell const &cell(v_collision_matrix[y][x]);
 
-	for (vector<int>::const_iterator i = cvals.begin(); i != cvals.end(); ++i) {
-		if (coll_objects[*i].fixed && coll_objects[*i].status == COLL_STATIC) {return 1;}
+	for (unsigned i = 0; i < cell.size(); ++i) {
+		coll_obj const &c(coll_objects[cell.get(i)]);
+		if (c.fixed && c.status == COLL_STATIC) {return 1;}
 	}
 	return 0;
 }
@@ -537,10 +722,10 @@ void calc_flow_profile(r_profile flow_prof[3], int i, int j, bool proc_cobjs, fl
 
 	if (proc_cobjs) {
 		coll_cell const &cell(v_collision_matrix[i][j]);
-		unsigned const ncv((unsigned)cell.cvals.size());
+		unsigned const ncv(cell.size());
 
 		for (unsigned q = 0; q < ncv; ++q) {
-			unsigned const cid(cell.cvals[q]);
+			unsigned const cid(cell.get(q));
 			coll_obj const &cobj(coll_objects.get_cobj(cid));
 			if (cobj.status != COLL_STATIC) continue;
 			if (cobj.d[2][1] < zbottom)     continue; // below the mesh
@@ -576,17 +761,15 @@ void calc_flow_profile(r_profile flow_prof[3], int i, int j, bool proc_cobjs, fl
 			flow_prof[2].reset_bbox(bbz);
 			
 			for (unsigned c2 = 0; c2 < ncv2; ++c2) { // could make this more efficient
-				coll_obj &cobj(coll_objects[cobj_z[c2].second]);
+				coll_obj const &cobj(coll_objects[cobj_z[c2].second]);
 				if (cobj.d[0][0] >= bb[0][1] || cobj.d[0][1]     <= bb[0][0]) continue; // no intersection
 				if (cobj.d[1][0] >= bb[1][1] || cobj.d[1][1]     <= bb[1][0]) continue;
 				if (cobj.d[2][0] >= bb[2][1] || cobj_z[c2].first <= bb[2][0]) continue;
-				float const cztop(cobj.d[2][1]);
-				cobj.d[2][1] = cobj_z[c2].first;
+				float d[3][2] = {{cobj.d[0][0], cobj.d[0][1]}, {cobj.d[1][0], cobj.d[1][1]}, {cobj.d[2][0], cobj_z[c2].first}}; // local copy, may be called from multiple threads
 						
-				for (unsigned d = 0; d < 3; ++d) { // critical path
-					flow_prof[d].add_rect(cobj.d, (d+1)%3, (d+2)%3, 1.0);
+				for (unsigned e = 0; e < 3; ++e) { // critical path
+					flow_prof[e].add_rect(d, (e+1)%3, (e+2)%3, 1.0);
 				}
-				cobj.d[2][1] = cztop; // restore original value
 			} // for c2
 			for (unsigned e = 0; e < 3; ++e) {
 				float const fv(flow_prof[e].den_inv());
@@ -598,6 +781,49 @@ void calc_flow_profile(r_profile flow_prof[3], int i, int j, bool proc_cobjs, fl
 }
 
 
+uLong add_static_scene_to_crc(uLong crc) { // mesh size and heights + static cobjs
+
+	int const sizes[3] = {MESH_X_SIZE, MESH_Y_SIZE, MESH_SIZE[2]};
+	crc = crc32(crc, (Bytef const *)sizes, sizeof(sizes));
+	for (int i = 0; i < MESH_Y_SIZE; ++i) {crc = crc32(crc, (Bytef const *)mesh_height[i], MESH_X_SIZE*sizeof(float));}
+
+	for (unsigned i = 0; i < coll_objects.size(); ++i) {
+		coll_obj const &cobj(coll_objects[i]);
+		if (cobj.status != COLL_STATIC || !add_cobj_ok(cobj)) continue;
+		int const type(cobj.type);
+		crc = crc32(crc, (Bytef const *)&i,    sizeof(unsigned));
+		crc = crc32(crc, (Bytef const *)&type, sizeof(int));
+		float const shape[3] = {cobj.radius, cobj.radius2, cobj.thickness}; // cylinder/cone/sphere radii and polygon thickness aren't implied by the bcube
+		crc = crc32(crc, (Bytef const *)cobj.d, sizeof(cobj.d));
+		crc = crc32(crc, (Bytef const *)shape,  sizeof(shape));
+		if (cobj.npoints > 0) {crc = crc32(crc, (Bytef const *)cobj.points, cobj.npoints*sizeof(point));}
+	}
+	return crc;
+}
+
+// hash of everything the particle flow values depend on, used to validate the flow cache file
+unsigned get_flow_scene_hash(unsigned char **need_lmcell, float zstep) {
+
+	uLong crc(crc32(0L, Z_NULL, 0));
+	float const zvals[2] = {czmin0, zstep};
+	crc = crc32(crc, (Bytef const *)zvals, sizeof(zvals));
+	crc = add_static_scene_to_crc(crc);
+	for (int i = 0; i < MESH_Y_SIZE; ++i) {crc = crc32(crc, (Bytef const *)need_lmcell[i], MESH_X_SIZE*sizeof(unsigned char));}
+	return (unsigned)crc;
+}
+
+// hash of the scene and ray tracing parameters that local light volumes depend on, used to validate the local light volume cache file
+unsigned get_llvol_scene_hash() {
+
+	uLong crc(crc32(0L, Z_NULL, 0));
+	float const fvals[3] = {czmin, DZ_VAL2, ray_step_size_mult};
+	unsigned const uvals[2] = {DYNAMIC_RAYS, MAX_RAY_BOUNCES};
+	crc = crc32(crc, (Bytef const *)fvals, sizeof(fvals));
+	crc = crc32(crc, (Bytef const *)uvals, sizeof(uvals));
+	return (unsigned)add_static_scene_to_crc(crc);
+}
+
+
 float calc_czspan() {return max(0.0f, ((czmax + lm_dz_adj) - czmin0 + TOLER));}
 
 unsigned get_grid_xsize() {return max((MESH_X_SIZE >> DL_GRID_BS), 1);}
@@ -637,11 +863,12 @@ void build_lightmap(bool verbose) {
 	bool has_fixed(0);
 	
 	// determine where we will need lmcells
+#pragma omp parallel for schedule(static,1) reduction(+:nonempty) reduction(||:has_fixed)
 	for (int i = 0; i < MESH_Y_SIZE; ++i) {
 		for (int j = 0; j < MESH_X_SIZE; ++j) {
 			bool const fixed(!coll_objects.empty() && has_fixed_cobjs(j, i));
 			need_lmcell[i][j] = (use_dense_voxels || fixed);
-			has_fixed        |= fixed; // only used in an assertion below
+			has_fixed         = (has_fixed || fixed); // only used in an assertion below
 			if (need_lmcell[i][j]) ++nonempty;
 		}
 	}
@@ -692,14 +919,23 @@ void build_lightmap(bool verbose) {
 	using_lightmap = (nonempty > 0);
 	lm_alloc       = 1;
 
-	// calculate particle flow values
-	r_profile flow_prof[3]; // particle {x, y, z}
+	// calculate particle flow values, or read them from the cache file if the scene is unchanged
+	unsigned const flow_hash(flow_cache_fn.empty() ? 0 : get_flow_scene_hash(need_lmcell, zstep));
 
-	for (int i = 0; i < MESH_Y_SIZE; ++i) {
-		for (int j = 0; j < MESH_X_SIZE; ++j) {
-			bool const proc_cobjs(need_lmcell[i][j] & 1);
-			calc_flow_profile(flow_prof, i, j, proc_cobjs, zstep);
-		}
+	if (flow_cache_fn.empty() || !lmap_manager.read_flow_from_file(flow_cache_fn, flow_hash)) {
+#pragma omp parallel
+		{
+			r_profile flow_prof[3]; // particle {x, y, z}, per-thread scratch
+
+#pragma omp for schedule(dynamic,1)
+			for (int i = 0; i < MESH_Y_SIZE; ++i) {
+				for (int j = 0; j < MESH_X_SIZE; ++j) {
+					bool const proc_cobjs(need_lmcell[i][j] & 1);
+					calc_flow_profile(flow_prof, i, j, proc_cobjs, zstep);
+				}
+			}
+		} // end omp parallel
+		if (!flow_cache_fn.empty()) {lmap_manager.write_flow_to_file(flow_cache_fn, flow_hash);}
 	}
 
 	// add in static light sources
@@ -865,35 +1101,60 @@ void upload_dlights_textures(cube_t const &bounds) {
 
 	// step 2: grid bag entries
 	static unsigned num_warnings(0);
-	static vector<unsigned> gb_data;
+	static vector<unsigned> gb_data, row_start;
 	static vector<unsigned short> elem_data;
 	unsigned const elem_tex_x = (1<<8); // must agree with value in shader
 	unsigned const elem_tex_y = (1<<10); // larger = slower, but more lights/higher quality
 	unsigned const max_gb_entries(elem_tex_x*elem_tex_y), gbx(get_grid_xsize()), gby(get_grid_ysize());
 	assert(max_gb_entries <= (1<<24)); // gb_data low bits allocation
-	elem_data.resize(0);
 	gb_data.resize(gbx*gby, 0);
+	row_start.assign(gby+1, 0);
+	bool const use_omp(gbx*gby > 4096);
 
-	for (unsigned y = 0; y < gby && elem_data.size() < max_gb_entries; ++y) {
-		for (unsigned x = 0; x < gbx && elem_data.size() < max_gb_entries; ++x) {
-			unsigned const gb_ix(x + y*gbx); // {start, end, unused}
-			gb_data[gb_ix] = elem_data.size(); // 24 low bits = start_ix
-			dls_cell const &dlsc(ldynamic[gb_ix]);
+	// first pass: count the entries of each cell (stored in gb_data) and row (prefix summed into row_start)
+#pragma omp parallel for schedule(static) if (use_omp)
+	for (int y = 0; y < (int)gby; ++y) {
+		unsigned row_sum(0);
+
+		for (unsigned x = 0; x < gbx; ++x) {
+			dls_cell const &dlsc(ldynamic[x + y*gbx]);
 			unsigned short const *const ixs(dlsc.get_src_ixs());
-			unsigned num_ixs(dlsc.size());
+			unsigned const num_ixs(dlsc.size());
 			assert(num_ixs < 256);
-			num_ixs = min(num_ixs, unsigned(max_gb_entries - elem_data.size())); // enforce max_gb_entries limit
-			
-			for (unsigned i = 0; i < num_ixs; ++i) {
-				if (ixs[i] < ndl) {elem_data.push_back((unsigned short)ixs[i]);} // if dlight index is too high, skip
+			unsigned num_ix(0);
+			for (unsigned i = 0; i < num_ixs; ++i) {num_ix += (ixs[i] < ndl);} // if dlight index is too high, skip
+			gb_data[x + y*gbx] = num_ix;
+			row_sum += num_ix;
+		}
+		row_start[y+1] = row_sum;
+	} // for y
+	for (unsigned y = 0; y < gby; ++y) {row_start[y+1] += row_start[y];}
+	unsigned const num_entries(row_start[gby]), num_elems(min(num_entries, max_gb_entries));
+	elem_data.resize(num_elems);
+
+	// second pass: fill in {start_ix, num_ix} and the element list; cells past max_gb_entries are truncated or empty
+#pragma omp parallel for schedule(static) if (use_omp)
+	for (int y = 0; y < (int)gby; ++y) {
+		unsigned start_ix(row_start[y]);
+
+		for (unsigned x = 0; x < gbx; ++x) {
+			unsigned const gb_ix(x + y*gbx);
+			dls_cell const &dlsc(ldynamic[gb_ix]);
+			unsigned short const *const ixs(dlsc.get_src_ixs());
+			unsigned const num_ixs(dlsc.size()), cell_start(min(start_ix, num_elems));
+			unsigned ix(cell_start);
+
+			for (unsigned i = 0; i < num_ixs && ix < num_elems; ++i) {
+				if (ixs[i] < ndl) {elem_data[ix++] = (unsigned short)ixs[i];}
 			}
-			unsigned const num_ix(elem_data.size() - gb_data[gb_ix]);
+			start_ix += gb_data[gb_ix];
+			unsigned const num_ix(ix - cell_start);
 			assert(num_ix < (1<<8));
-			gb_data[gb_ix] += (num_ix << 24); // 8 high bits = num_ix
+			gb_data[gb_ix] = cell_start + (num_ix << 24); // 24 low bits = start_ix, 8 high bits = num_ix
 		}
-	}
-	if (elem_data.size() > 0.9*max_gb_entries) {
-		if (elem_data.size() >= max_gb_entries && num_warnings < 100) {
+	} // for y
+	if (num_entries > 0.9*max_gb_entries) {
+		if (num_entries >= max_gb_entries && num_warnings < 100) {
 			std::cerr << "Warning: Exceeded max # indexes (" << max_gb_entries << ") in dynamic light texture upload" << endl;
 			++num_warnings;
 		}
@@ -1034,22 +1295,6 @@ void add_line_light(point const &p1, point const &p2, colorRGBA const &color, fl
 }
 
 
-bool dls_cell::check_add_light(unsigned ix) const {
-
-	if (empty()) return 1;
-	assert(ix < dl_sources.size());
-	light_source const &ls(dl_sources[ix]);
-
-	for (unsigned i = 0; i < sz; ++i) {
-		unsigned const ix2(lsrc[i]);
-		assert(ix2 < dl_sources.size());
-		assert(ix2 != ix);
-		if (ls.try_merge_into(dl_sources[ix2])) return 0;
-	}
-	return 1;
-}
-
-
 void clear_dynamic_lights() {
 
 	//if (!animate2) return;
@@ -1070,6 +1315,90 @@ void calc_spotlight_pdu(light_source const &ls, pos_dir_up &pdu) {
 }
 
 
+struct dlight_bin_t { // footprint of one dynamic light in the ldynamic grid
+
+	unsigned ix; // index into dl_sources
+	int xcent, ycent, rsq, bnds[2][2]; // in grid cells
+	bool line_light;
+	float line_rsq;
+	pos_dir_up pdu; // spotlights only
+
+	dlight_bin_t(unsigned ix_, int xc, int yc) : ix(ix_), xcent(xc), ycent(yc), rsq(0), line_light(0), line_rsq(0.0) {
+		for (unsigned d = 0; d < 4; ++d) {bnds[d>>1][d&1] = 0;}
+	}
+};
+
+// returns 0 if light ix was merged into an earlier light centered at or next to its center cell
+bool check_merge_dlight(unsigned ix, int xcent, int ycent, unsigned gbx, unsigned gby, vector<dlight_bin_t> const &bins, map<unsigned, vector<unsigned> > const &cent_lights) {
+
+	vector<unsigned> cands; // mergeable lights are close enough to be centered in adjacent cells
+	light_source const &ls(dl_sources[ix]);
+
+	for (int y = max(0, ycent-1); y <= min((int)gby-1, ycent+1); ++y) {
+		for (int x = max(0, xcent-1); x <= min((int)gbx-1, xcent+1); ++x) {
+			auto it(cent_lights.find(y*gbx + x));
+			if (it == cent_lights.end()) continue;
+			for (auto i = it->second.begin(); i != it->second.end(); ++i) {cands.push_back(bins[*i].ix);}
+		}
+	}
+	sort(cands.begin(), cands.end()); // try to merge in the order that lights were added
+
+	for (auto i = cands.begin(); i != cands.end(); ++i) {
+		assert(*i != ix);
+		if (ls.try_merge_into(dl_sources[*i])) return 0;
+	}
+	return 1;
+}
+
+// tile_cube is the grid tile bcube relative to its center, used for spotlight culling
+void add_dlight_row(dlight_bin_t const &bin, int y, unsigned gbx, cube_t const &tile_cube) {
+
+	light_source const &ls(dl_sources[bin.ix]);
+	point const &lpos(ls.get_pos()), &lpos2(ls.get_pos2());
+	int const y_sq((y - bin.ycent)*(y - bin.ycent)), offset(y*gbx);
+
+	for (int x = bin.bnds[0][0]; x <= bin.bnds[0][1]; ++x) {
+		if (bin.line_light) {
+			float const px(get_xval(x << DL_GRID_BS)), py(get_yval(y << DL_GRID_BS)), lx(lpos2.x - lpos.x), ly(lpos2.y - lpos.y);
+			float const cp_mag(lx*(lpos.y - py) - ly*(lpos.x - px));
+			if (cp_mag*cp_mag > bin.line_rsq*(lx*lx + ly*ly)) continue;
+		} else if (((x - bin.xcent)*(x - bin.xcent) + y_sq) > bin.rsq) continue; // skip
+
+		if (bin.pdu.valid) {
+			cube_t tile(tile_cube);
+			tile.translate(point(get_xval(x << DL_GRID_BS), get_yval(y << DL_GRID_BS), 0.0));
+			if (!bin.pdu.cube_visible_for_light_cone(tile)) continue; // tile not in spotlight cylinder
+		}
+		//if (DL_GRID_BS == 0 && bcube.z1() > v_collision_matrix[y << DL_GRID_BS][x << DL_GRID_BS].zmax) continue; // should be legal, but doesn't seem to help
+		ldynamic[offset + x].add_light(bin.ix); // could do flow clipping here?
+	} // for x
+}
+
+// bins lights into rows with a counting sort, then fills rows in parallel; each row is filled by one thread in light order,
+// so the result is the same as adding the lights serially (which matters when a cell reaches MAX_LSRC)
+void add_dlight_bins_to_grid(vector<dlight_bin_t> const &bins, unsigned gbx, unsigned gby, cube_t const &tile_cube) {
+
+	static vector<unsigned> row_start, row_bins, row_pos;
+	row_start.assign(gby+1, 0);
+
+	for (auto i = bins.begin(); i != bins.end(); ++i) {
+		assert(i->bnds[1][0] >= 0 && i->bnds[1][1] < (int)gby);
+		for (int y = i->bnds[1][0]; y <= i->bnds[1][1]; ++y) {++row_start[y+1];}
+	}
+	for (unsigned y = 0; y < gby; ++y) {row_start[y+1] += row_start[y];} // prefix sum
+	row_bins.resize(row_start[gby]);
+	row_pos.assign(row_start.begin(), row_start.end()-1);
+
+	for (unsigned b = 0; b < bins.size(); ++b) {
+		for (int y = bins[b].bnds[1][0]; y <= bins[b].bnds[1][1]; ++y) {row_bins[row_pos[y]++] = b;}
+	}
+#pragma omp parallel for schedule(dynamic, 4) if (row_bins.size() > 256)
+	for (int y = 0; y < (int)gby; ++y) {
+		for (unsigned i = row_start[y]; i < row_start[y+1]; ++i) {add_dlight_row(bins[row_bins[i]], y, gbx, tile_cube);}
+	}
+}
+
+
 void add_dynamic_lights_ground() {
 
 	//RESET_TIME;
@@ -1101,46 +1430,38 @@ void add_dynamic_lights_ground() {
 	point const dlight_shift(-0.5*DX_VAL, -0.5*DY_VAL, 0.0);
 	float const grid_dx(DX_VAL*(1 << DL_GRID_BS)), grid_dy(DY_VAL*(1 << DL_GRID_BS));
 	float const z1(min(czmin, zbottom)), z2(max(czmax, ztop));
+	// light merging depends on which earlier lights were accepted, so it's done serially here, before the parallel binning
+	static vector<dlight_bin_t> bins;
+	bins.clear();
+	map<unsigned, vector<unsigned> > cent_lights; // center cell => indices into bins of lights centered there
 
 	for (unsigned ix = 0; ix < ndl; ++ix) {
 		light_source const &ls(dl_sources[ix]);
 		if (!ls.is_user_placed() && !ls.is_visible()) continue; // view culling (user placed lights are culled above as light_sources_d)
 		float const ls_radius(ls.get_radius());
 		if ((min(ls.get_pos().z, ls.get_pos2().z) - ls_radius) > max(ztop, czmax)) continue; // above everything, rarely occurs
-		point const &lpos(ls.get_pos()), &lpos2(ls.get_pos2());
+		point const &lpos(ls.get_pos());
 		bool const line_light(ls.is_line_light());
 		int const xcent(get_xpos(lpos.x) >> DL_GRID_BS), ycent(get_ypos(lpos.y) >> DL_GRID_BS);
-		if (!line_light && xcent >= 0 && ycent >= 0 && xcent < (int)gbx && ycent < (int)gby && !ldynamic[ycent*gbx + xcent].check_add_light(ix)) continue;
+		bool const cent_in_grid(xcent >= 0 && ycent >= 0 && xcent < (int)gbx && ycent < (int)gby);
+		if (!line_light && cent_in_grid && !check_merge_dlight(ix, xcent, ycent, gbx, gby, bins, cent_lights)) continue;
+		if (cent_in_grid) {cent_lights[ycent*gbx + xcent].push_back(bins.size());}
+		dlight_bin_t bin(ix, xcent, ycent);
 		cube_t bcube;
 		int bnds[3][2];
 		ls.get_bounds(bcube, bnds, sqrt_dlight_add_thresh, 1, dlight_shift); // clip_to_scene_bcube=1
 		if (first) {dlight_bcube = bcube;} else {dlight_bcube.union_with_cube(bcube);}
 		first = 0;
-		int const radius(((int(ls_radius*max(DX_VAL_INV, DY_VAL_INV)) + 1) >> DL_GRID_BS) + 1), rsq(radius*radius);
-		float const line_rsq((ls_radius + HALF_DXY)*(ls_radius + HALF_DXY));
-		if (DL_GRID_BS > 0) {for (unsigned d = 0; d < 4; ++d) {bnds[d>>1][d&1] >>= DL_GRID_BS;}}
-		pos_dir_up pdu;
-		calc_spotlight_pdu(ls, pdu);
-
-		for (int y = bnds[1][0]; y <= bnds[1][1]; ++y) { // add lights to ldynamic
-			int const y_sq((y-ycent)*(y-ycent)), offset(y*gbx);
-
-			for (int x = bnds[0][0]; x <= bnds[0][1]; ++x) {
-				if (line_light) {
-					float const px(get_xval(x << DL_GRID_BS)), py(get_yval(y << DL_GRID_BS)), lx(lpos2.x - lpos.x), ly(lpos2.y - lpos.y);
-					float const cp_mag(lx*(lpos.y - py) - ly*(lpos.x - px));
-					if (cp_mag*cp_mag > line_rsq*(lx*lx + ly*ly)) continue;
-				} else if (((x-xcent)*(x-xcent) + y_sq) > rsq) continue; // skip
-
-				if (pdu.valid) {
-					float const px(get_xval(x << DL_GRID_BS)), py(get_yval(y << DL_GRID_BS));
-					if (!pdu.cube_visible_for_light_cone(cube_t(px-grid_dx, px+grid_dx, py-grid_dy, py+grid_dy, z1, z2))) continue; // tile not in spotlight cylinder
-				}
-				//if (DL_GRID_BS == 0 && bcube.z1() > v_collision_matrix[y << DL_GRID_BS][x << DL_GRID_BS].zmax) continue; // should be legal, but doesn't seem to help
-				ldynamic[offset + x].add_light(ix); // could do flow clipping here?
-			} // for x
-		} // for y
+		int const radius(((int(ls_radius*max(DX_VAL_INV, DY_VAL_INV)) + 1) >> DL_GRID_BS) + 1);
+		bin.rsq        = radius*radius;
+		bin.line_light = line_light;
+		bin.line_rsq   = (ls_radius + HALF_DXY)*(ls_radius + HALF_DXY);
+		for (unsigned d = 0; d < 4; ++d) {bin.bnds[d>>1][d&1] = (bnds[d>>1][d&1] >> DL_GRID_BS);}
+		bins.push_back(bin);
 	} // for ix (light index)
+#pragma omp parallel for schedule(dynamic, 16) if (bins.size() > 64)
+	for (int i = 0; i < (int)bins.size(); ++i) {calc_spotlight_pdu(dl_sources[bins[i].ix], bins[i].pdu);}
+	add_dlight_bins_to_grid(bins, gbx, gby, cube_t(-grid_dx, grid_dx, -grid_dy, grid_dy, z1, z2));
 	//PRINT_TIME("Dynamic Light Add");
 }
 
@@ -1157,37 +1478,26 @@ void add_dynamic_lights_city(cube_t const &scene_bcube) {
 	vector3d const scene_sz(scene_bcube.get_size()); // Note: zval ignored
 	float const sqrt_dlight_add_thresh(sqrt(dlight_add_thresh));
 	float const grid_dx(scene_sz.x/gbx), grid_dy(scene_sz.y/gby), grid_dx_inv(1.0/grid_dx), grid_dy_inv(1.0/grid_dy);
+	static vector<dlight_bin_t> bins;
+	bins.clear();
 
 	for (unsigned ix = 0; ix < ndl; ++ix) {
 		light_source const &ls(dl_sources[ix]); // Note: should always be visible
 		point const &lpos(ls.get_pos());
-		int const xcent((lpos.x - scene_llc.x)*grid_dx_inv + 0.5), ycent((lpos.y - scene_llc.y)*grid_dy_inv + 0.5);
+		dlight_bin_t bin(ix, int((lpos.x - scene_llc.x)*grid_dx_inv + 0.5), int((lpos.y - scene_llc.y)*grid_dy_inv + 0.5));
 		cube_t bcube(ls.calc_bcube(0, sqrt_dlight_add_thresh)); // padded below
 		if (ls.is_very_directional()) {bcube.expand_by(vector3d(grid_dx, grid_dy, 0.0));} // add one grid unit
-		int bnds[2][2];
 
 		for (unsigned e = 0; e < 2; ++e) {
-			bnds[0][e] = max(0, min((int)gbx-1, int((bcube.d[0][e] - scene_llc.x)*grid_dx_inv)));
-			bnds[1][e] = max(0, min((int)gby-1, int((bcube.d[1][e] - scene_llc.y)*grid_dy_inv)));
+			bin.bnds[0][e] = max(0, min((int)gbx-1, int((bcube.d[0][e] - scene_llc.x)*grid_dx_inv)));
+			bin.bnds[1][e] = max(0, min((int)gby-1, int((bcube.d[1][e] - scene_llc.y)*grid_dy_inv)));
 		}
-		int const radius(ls.get_radius()*max(grid_dx_inv, grid_dy_inv) + 2), rsq(radius*radius);
-		pos_dir_up pdu;
-		//calc_spotlight_pdu(ls, pdu); // correct, but doesn't really help because lights are small
-
-		for (int y = bnds[1][0]; y <= bnds[1][1]; ++y) { // add lights to ldynamic
-			int const y_sq((y-ycent)*(y-ycent)), offset(y*gbx);
-
-			for (int x = bnds[0][0]; x <= bnds[0][1]; ++x) {
-				if (((x-xcent)*(x-xcent) + y_sq) > rsq) continue; // skip
-				
-				/*if (pdu.valid) {
-					float const px(x*grid_dx + scene_llc.x), py(y*grid_dy + scene_llc.y);
-					if (!pdu.cube_visible(cube_t(px-grid_dx, px+grid_dx, py-grid_dy, py+grid_dy, scene_bcube.z1(), scene_bcube.z2()))) continue; // tile not in spotlight cylinder
-				}*/
-				ldynamic[offset + x].add_light(ix);
-			} // for x
-		} // for y
+		int const radius(ls.get_radius()*max(grid_dx_inv, grid_dy_inv) + 2);
+		bin.rsq = radius*radius;
+		//calc_spotlight_pdu(ls, bin.pdu); // correct, but doesn't really help because lights are small
+		bins.push_back(bin);
 	} // for ix (light index)
+	add_dlight_bins_to_grid(bins, gbx, gby, all_zeros_cube); // tile cube is unused since there are no spotlight pdus
 	//PRINT_TIME("Dynamic Light Add");
 }
 
@@ -22,7 +22,6 @@ float const SQRT_CTHRESH     = sqrt(CTHRESH);
 class light_grid_base {
 protected:
 	unsigned get_ix(int x, int y, int z) const {return ((y*MESH_X_SIZE + x)*MESH_SIZE[2] + z);}
-	int check_lmap_get_grid_index(point const &p) const;
 };
 
 
@@ -62,7 +61,10 @@ public:
 	size_t size() const {return vldata_alloc.size();}
 	bool read_data_from_file(char const *const fn, int ltype);
 	bool write_data_to_file(char const *const fn, int ltype) const;
-	void clear_lighting_values(int ltype);
+	bool read_flow_from_file(std::string const &fn, unsigned scene_hash);
+	bool write_flow_to_file(std::string const &fn, unsigned scene_hash) const;
+	void clear_lighting_values(int ltype, cube_t const *region=nullptr);
+	void get_region_bounds(cube_t const &region, int bnds[3][2]) const;
 	bool is_valid_cell(int x, int y, int z) const;
 	lmcell const *get_column(int x, int y) const {return vlmap[y][x];} // Note: no bounds checking
 	lmcell *get_column(int x, int y) {return vlmap[y][x];} // Note: no bounds checking
@@ -71,7 +73,7 @@ public:
 	lmcell *get_lmcell(point const &p);
 	template<typename T> void alloc(unsigned nbins, unsigned xsize, unsigned ysize, unsigned zsize, T **nonempty_bins, lmcell const &init_lmcell);
 	void init_from(lmap_manager_t const &src);
-	void copy_data(lmap_manager_t const &src, float blend_weight=1.0);
+	void copy_data(lmap_manager_t const &src, float blend_weight=1.0, cube_t const *region=nullptr);
 };
 
 
@@ -81,6 +83,25 @@ struct lmcell_local { // size = 12 (must be packed)
 	bool is_near_zero(float toler) const {return (lc[0] < toler && lc[1] < toler && lc[2] < toler);}
 };
 
+unsigned const LLV_BLOCK_BITS = 3; // sparse accumulation blocks are 8x8 lightmap columns
+unsigned const LLV_BLOCK_SZ   = (1 << LLV_BLOCK_BITS);
+
+class llv_accum_t : public light_grid_base { // sparse ray accumulation for one light_volume_local generation task; blocks are allocated on first touch
+
+	unsigned nbx, nby;
+	vector<vector<lmcell_local>> blocks;
+
+	unsigned get_block_ix(int x, int y) const {return ((y >> LLV_BLOCK_BITS)*nbx + (x >> LLV_BLOCK_BITS));}
+	static unsigned get_cell_ix(int x, int y, int z) {return ((((y & (LLV_BLOCK_SZ-1)) << LLV_BLOCK_BITS) + (x & (LLV_BLOCK_SZ-1)))*MESH_SIZE[2] + z);}
+public:
+	llv_accum_t() : nbx(0), nby(0) {}
+	void init();
+	void clear() {blocks.clear(); nbx = nby = 0;}
+	void add_color(point const &p, colorRGBA const &color);
+	void merge(llv_accum_t const &a);
+	lmcell_local const *get_column(int x, int y) const;
+};
+
 class light_volume_local : public light_grid_base {
 
 	bool changed, compressed;
@@ -90,12 +111,11 @@ class light_volume_local : public light_grid_base {
 	vector<lmcell_local> data;
 
 	unsigned get_num_data() const {return (bounds[0][1] - bounds[0][0])*(bounds[1][1] - bounds[1][0])*(bounds[2][1] - bounds[2][0]);}
-	bool read(std::string const &filename);
-	bool write(std::string const &filename) const;
-	void compress(bool verbose);
 public:
 
 	light_volume_local(unsigned tag_ix_) : changed(0), compressed(0), tag_ix(tag_ix_), scale(0.0) {}
+	bool read(std::string const &filename);
+	bool write(std::string const &filename) const;
 	void set_bounds(int x1, int x2, int y1, int y2, int z1, int z2);
 	void set_scale(float scale_) {changed |= (scale != scale_); scale = scale_;} // changing the scale counts as changed
 	bool is_allocated() const {return !data.empty();}
@@ -104,8 +124,10 @@ public:
 	void mark_updated() {changed = 0;}
 	void allocate();
 	unsigned get_tag_ix() const {return tag_ix;}
-	void init(unsigned lvol_ix, float scale_, std::string const &filename);
-	void gen_data(unsigned lvol_ix, bool verbose);
+	void copy_bounds(int bnds[3][2]) const {UNROLL_3X(bnds[i_][0] = bounds[i_][0]; bnds[i_][1] = bounds[i_][1];)}
+	vector<lmcell_local> const &get_data() const {return data;}
+	void set_data(int const bnds[3][2], vector<lmcell_local> const &data_);
+	void build_from_accum(llv_accum_t const &accum, bool verbose);
 	
 	void reset_to_zero() {
 		if (!is_allocated()) return;
@@ -114,7 +136,6 @@ public:
 	}
 	bool check_xy_bounds(int x, int y) const {return (x >= bounds[0][0] && x < bounds[0][1] && y >= bounds[1][0] && y < bounds[1][1]);}
 	void add_lighting(colorRGB &color, int x, int y, int z) const;
-	void add_color(point const &p, colorRGBA const &color);
 };
 
 typedef vector<std::unique_ptr<light_volume_local>> llv_vect;
@@ -135,11 +156,13 @@ class indir_dlight_group_manager_t : public tag_ix_map {
 	struct group_t {
 		int llvol_ix;
 		float scale;
-		std::string filename;
+		std::string name, filename;
 		vector<unsigned> dlight_ixs; // Note: dynamic lights should all share the same trigger
 		group_t(float scale_=1.0) : llvol_ix(-1), scale(scale_) {}
 	};
 	vector<group_t> groups;
+
+	unsigned get_cache_key(unsigned tag_ix) const;
 public:
 	unsigned get_ix_for_name(std::string const &name, float scale=1.0);
 	void add_dlight_ix_for_tag_ix(unsigned tag_ix, unsigned dlight_ix);
@@ -282,7 +305,6 @@ public:
 	dls_cell() : sz(0) {}
 	void clear() {sz = 0;}
 	void add_light(unsigned ix) {if (sz+1 < MAX_LSRC) {lsrc[sz++] = ix;}}
-	bool check_add_light(unsigned ix) const;
 	size_t size() const {return sz;}
 	bool empty()  const {return (sz == 0);}
 	unsigned get(unsigned i) const {return lsrc[i];} // no bounds checking
@@ -309,6 +331,7 @@ public:
 
 void check_for_lighting_finished();
 void compute_ray_trace_lighting(unsigned ltype, bool verbose);
+void trace_local_light_volumes(vector<unsigned> const &llvol_ixs, vector<llv_accum_t> &accums, bool verbose, bool reserve_render_thread);
 
 
 #endif
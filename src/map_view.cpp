@@ -9,10 +9,14 @@
 #include "shaders.h"
 #include "heightmap.h"
 #include <cfloat> // for FLT_MAX
+#include <fstream>
+#include <map>
 
 
 bool const MAP_VIEW_LIGHTING = 1;
 bool const MAP_VIEW_SHADOWS  = 1;
+unsigned const MAP_TILE_SIZE = 256; // in pixels
+unsigned const MAP_TILE_VERSION = 2; // increment when map rendering changes so that cached tiles are regenerated
 
 int map_drag_x(0), map_drag_y(0);
 float map_zoom(0.0);
@@ -20,8 +24,12 @@ double map_x(0.0), map_y(0.0);
 
 extern bool water_is_lava, begin_motion, show_map_view_mandelbrot;
 extern int window_width, window_height, xoff2, yoff2, map_mode, map_color, read_landscape, read_heightmap, do_read_mesh;
+extern int mesh_rgen_index, rand_gen_index, mesh_gen_mode;
 extern int world_mode, game_mode, display_mode, num_smileys, DISABLE_WATER, cache_counter, default_ground_tex;
-extern float zmax_est, zmin, zmax, water_plane_z, water_h_off, glaciate_exp, glaciate_exp_inv, vegetation, relh_adj_tex, temperature, mesh_height_scale;
+extern unsigned map_export_levels;
+extern float map_export_size;
+extern string map_export_dir;
+extern float mesh_scale, zmax_est, zmin, zmax, water_plane_z, water_h_off, glaciate_exp, glaciate_exp_inv, vegetation, relh_adj_tex, temperature, mesh_height_scale;
 extern int coll_id[];
 extern obj_group obj_groups[];
 extern coll_obj_group coll_objects;
@@ -87,6 +95,240 @@ void colorize(float val, unsigned char *rgb) {
 }
 
 
+// batched downward vertical ray queries for the buildings and cobjs under one row of map pixels
+struct map_row_rays_t {
+
+	vector<float> mh, z1, z2;
+	vector<unsigned char> flags, bhits; // flags: 1 = over mesh, 2 = mesh height set
+	vector<colorRGBA> bcolors;
+	vector<vert_ray_hit_t> chits;
+
+	void query_ground(int nx, float x0, float dx, float y, bool uses_hmap, float max_building_dz) {
+		mh.resize(nx);
+		flags.resize(nx);
+		z1.resize(nx);
+		z2.resize(nx);
+
+		for (int j = 0; j < nx; ++j) {
+			float const x(x0 + j*dx);
+			bool const over_mesh(is_over_mesh(point(x, y, czmax)));
+			flags[j] = ((over_mesh ? 1 : 0) | ((over_mesh || uses_hmap) ? 2 : 0));
+			// if using a heightmap, clamp values to scene bounds
+			mh[j] = ((flags[j] & 2) ? interpolate_mesh_zval(max(-X_SCENE_SIZE, min(X_SCENE_SIZE-DX_VAL, x)), max(-Y_SCENE_SIZE, min(Y_SCENE_SIZE-DY_VAL, y)), 0.0, 0, 1) : 0.0);
+			z1[j] = mh[j] + max_building_dz;
+			z2[j] = (over_mesh ? mh[j] : z1[j]); // skip if not over the mesh
+		}
+		get_buildings_vert_row_hit_colors(x0, dx, y, nx, &z1.front(), &z2.front(), bcolors, bhits);
+		if (!(czmin < czmax)) {chits.assign(nx, vert_ray_hit_t()); return;} // no cobjs
+
+		for (int j = 0; j < nx; ++j) { // cobj rays start at the top of the scene, and only where no building was hit
+			z1[j] = czmax;
+			z2[j] = (((flags[j] & 1) && !bhits[j]) ? max(mh[j], czmin) : czmax);
+		}
+		check_coll_vert_ray_row(x0, dx, y, nx, &z1.front(), &z2.front(), chits, 0); // skip_dynamic=0
+	}
+	void query_cities(int nx, float x0, float dx, float y, float max_building_dz) {
+		z1.assign(nx, zmax+max_building_dz);
+		z2.assign(nx, zmin);
+		get_buildings_vert_row_hit_colors(x0, dx, y, nx, &z1.front(), &z2.front(), bcolors, bhits);
+	}
+};
+
+
+// fills buf with nx x ny RGB pixels of the overhead map centered at {mx, my} relative to camera, where camera is the zero vector for absolute positions;
+// overlays are the camera, world boundary, and smiley markers
+void gen_map_image(vector<unsigned char> &buf, int nx, int ny, double mx, double my, float xscale, float yscale, point const &camera, bool draw_overlays, mesh_xy_grid_cache_t &height_gen) {
+
+	assert(buf.size() >= 3U*nx*ny);
+	int bx1(0), by1(0), bx2(0), by2(0);
+	int const nx2(nx/2), ny2(ny/2);
+	bool const no_water((DISABLE_WATER == 2) || !(display_mode & 0x04));
+	bool const is_ice(((world_mode == WMODE_GROUND) ? temperature : get_cur_temperature()) <= W_FREEZE_POINT);
+	float const zmax2(zmax_est*((map_color || no_water) ? 1.0 : 0.855)), hscale(0.5/zmax2);
+	float const xscale_val(xscale/64), yscale_val(yscale/64);
+	float x0(mx + xoff2*DX_VAL), y0(my + yoff2*DY_VAL);
+	float const relh_water(get_rel_height_no_clamp(water_plane_z, -zmax_est, zmax_est));
+	float map_heights[6];
+	map_heights[0] = 0.9*lttex_dirt[3].zval  + 0.1*lttex_dirt[4].zval;
+	map_heights[1] = 0.5*(lttex_dirt[2].zval + lttex_dirt[3].zval);
+	map_heights[2] = 0.5*(lttex_dirt[1].zval + lttex_dirt[2].zval);
+	map_heights[3] = 0.5*(lttex_dirt[0].zval + lttex_dirt[1].zval);
+	map_heights[4] = relh_water; // Note: can be negative
+	map_heights[5] = min(0.5*relh_water, relh_water-0.01); // handle negative case
+	
+	for (unsigned i = 0; i < 6; ++i) {
+		if (map_heights[i] > 0.0) {map_heights[i] = pow(map_heights[i], glaciate_exp);} // handle negative case
+	}
+	colorRGBA ground_color(BLACK);
+	if (default_ground_tex >= 0) {ground_color = texture_color(default_ground_tex);}
+
+	colorRGBA const map_colors[6] = {
+		((water_is_lava || DISABLE_WATER == 2) ? DK_GRAY : WHITE),
+		GRAY,
+		((vegetation == 0.0) ? colorRGBA(0.55,0.45,0.35,1.0) : GREEN),
+		LT_BROWN,
+		(no_water ? BROWN    : (water_is_lava ? RED        : colorRGBA(0.3,0.2,0.6))),
+		(no_water ? DK_BROWN : (water_is_lava ? LAVA_COLOR : (is_ice ? LT_BLUE : BLUE)))};
+
+	if (world_mode == WMODE_GROUND) {
+		float const xv(-(camera.x + mx)/X_SCENE_SIZE), yv(-(camera.y + my)/Y_SCENE_SIZE);
+		float const xs(DX_VAL/xscale_val), ys(DY_VAL/yscale_val);
+		x0 += camera.x;
+		y0 += camera.y;
+		bx1 = int(nx2 + xs*(xv - 1.0));
+		by1 = int(ny2 + ys*(yv - 1.0));
+		bx2 = int(nx2 + xs*(xv + 1.0));
+		by2 = int(ny2 + ys*(yv + 1.0));
+	}
+	vector3d const dir(vector3d(cview_dir.x, cview_dir.y, 0.0).get_norm());
+	int const cx(int(nx2 - mx/xscale)), cy(int(ny2 - my/yscale));
+	int const xx(cx + int(4*dir.x)), yy(cy + int(4*dir.y));
+	float const xstart(x0 - nx2*xscale), ystart(y0 - ny2*yscale);
+	float const xsv(xscale_val*(X_SCENE_SIZE/DX_VAL)), ysv(yscale_val*(Y_SCENE_SIZE/DY_VAL));
+	float const max_building_dz(2.0*get_buildings_max_extent().z); // pad by 2x
+
+	bool const uses_hmap(world_mode == WMODE_GROUND && (read_landscape || read_heightmap || do_read_mesh));
+	if (!uses_hmap && !show_map_view_mandelbrot) {setup_height_gen(height_gen, xstart, ystart, xscale, yscale, nx, ny, 1);} // cache_values=1
+	point const lpos(get_light_pos());
+	vector3d const light_dir(lpos.get_norm()); // assume directional lighting to origin
+
+#pragma omp parallel for schedule(static,1)
+	for (int i = 0; i < ny; ++i) {
+		int const inx(i*nx);
+		int64_t const iyy(int64_t(i - yy)*int64_t(i - yy)), icy(int64_t(i - cy)*int64_t(i - cy));
+		float last_height(0.0);
+		int cindex2(-1);
+		float const row_x0(camera.x + mx - nx2*xsv), row_y((i - ny2)*ysv + camera.y + my);
+		map_row_rays_t rays;
+		if (world_mode == WMODE_GROUND) {rays.query_ground(nx, row_x0, xsv, row_y, uses_hmap, max_building_dz);}
+		else if (world_mode == WMODE_INF_TERRAIN && have_cities()) {rays.query_cities(nx, row_x0, xsv, row_y, max_building_dz);}
+
+		for (int j = 0; j < nx; ++j) {
+			int const offset(3*(inx + j));
+			unsigned char *rgb(&buf[offset]);
+			int64_t const jxx(j - xx), jcx(j - cx);
+
+			if (draw_overlays && iyy + jxx*jxx <= 4) {
+				rgb[0] = rgb[1] = rgb[2] = 0; // camera direction
+			}
+			else if (draw_overlays && icy + jcx*jcx <= 9) {
+				rgb[0] = 255;
+				rgb[1] = rgb[2] = 0; // camera position
+			}
+			else if (draw_overlays && world_mode == WMODE_GROUND &&
+				(((i == by1 || i == by2) && j >= bx1 && j < bx2) || ((j == bx1 || j == bx2) && i >= by1 && i < by2)))
+			{
+				rgb[0] = rgb[1] = rgb[2] = 0; // world boundary
+			}
+			else {
+				float mh(0.0);
+				bool mh_set(0), shadowed(0);
+				float const xval((j - nx2)*xsv + camera.x + mx), yval((i - ny2)*ysv + camera.y + my);
+
+				if (world_mode == WMODE_GROUND) {
+					bool const over_mesh(rays.flags[j] & 1);
+					mh     = rays.mh[j];
+					mh_set = ((rays.flags[j] & 2) != 0);
+
+					if (rays.bhits[j]) {
+						unpack_color(rgb, rays.bcolors[j]); // no shadows
+						continue;
+					}
+					if (over_mesh && czmin < czmax) { // check cobjs
+						vert_ray_hit_t const &hit(rays.chits[j]);
+
+						if (hit.cindex >= 0) {
+							colorRGBA const color(get_cobj_color_at_point(hit.cindex, hit.cpos, hit.cnorm, 0));
+							unpack_color(rgb, color*(is_shadowed(hit.cpos, hit.cnorm, lpos, cindex2) ? 0.5 : 1.0));
+							continue;
+						}
+						if (mh_set) {shadowed = is_shadowed(point(xval, yval, mh), plus_z, lpos, cindex2);}
+					}
+				} // end ground mode
+				else if (world_mode == WMODE_INF_TERRAIN && have_cities()) { // show cities and road networks
+					colorRGBA city_color(BLACK);
+
+					if (rays.bhits[j]) {
+						unpack_color(rgb, rays.bcolors[j]); // no shadows
+						continue;
+					}
+					if (get_city_color_at_xy(xval, yval, city_color)) {
+						unpack_color(rgb, city_color); // no shadows
+						continue;
+					}
+				}
+				if (default_ground_tex >= 0 && map_color) {
+					unpack_color(rgb, ground_color*(shadowed ? 0.5 : 1.0));
+					continue;
+				}
+				if (!mh_set) {mh = get_mesh_height(height_gen, xstart, ystart, xscale, yscale, i, j);} // calculate mesh height here if not yet set
+				float height(min(1.0f, hscale*(mh + zmax2))); // can be negative
+
+				if (!map_color) { // grayscale
+					float const val(pow(height, glaciate_exp_inv)); // un-glaciate: slow
+					//rgb[0] = rgb[1] = rgb[2] = (unsigned char)(255.0*val);
+					// http://c0de517e.blogspot.com/2017/11/coder-color-palettes-for-data.html
+					rgb[0] = (unsigned char)(255.0*(-0.121 + 0.893 * val + 0.276 * sin (1.94 - 5.69 * val)));
+					rgb[1] = (unsigned char)(255.0*(0.07 + 0.947 * val));
+					rgb[2] = (unsigned char)(255.0*(0.107 + (1.5 - 1.22 * val) * val));
+				}
+				else {
+					height += relh_adj_tex;
+					colorRGBA color;
+					if      (height <= map_heights[5]) {color = map_colors[5];} // deep water
+					else if (height <= map_heights[3]) {color = map_colors[3];} // sand
+					else if (height >= map_heights[0]) {color = map_colors[0];} // snow
+					else {
+						color = BLACK;
+						for (unsigned k = 0; k < 4; ++k) { // mixed
+							if (height > map_heights[k+1]) {
+								float const h((height - map_heights[k+1])/(map_heights[k] - map_heights[k+1])), v(cubic_interpolate(h));
+								blend_color(color, map_colors[k], map_colors[k+1], v);
+								break;
+							}
+						}
+					}
+					if (height <= map_heights[4] && height > map_heights[5]) { // shallow water
+						float const h(0.5*(height - map_heights[5])/(map_heights[4] - map_heights[5])), v(cubic_interpolate(h));
+						blend_color(color, color, map_colors[5], v);
+					}
+					if (MAP_VIEW_LIGHTING && !uses_hmap && !(display_mode & 0x20)) {
+						vector3d normal(plus_z);
+
+						if (height > map_heights[4]) {
+							float const hx((j == 0) ? height : last_height);
+							float const hy(CLIP_TO_01(hscale*(get_mesh_height(height_gen, xstart, ystart, xscale, yscale, max(i-1, 0), j) + zmax2)));
+							normal = vector3d(DY_VAL*(hx - height), DX_VAL*(hy - height), dxdy).get_norm();
+						}
+						last_height = height;
+						color *= (0.2 + (shadowed ? 0.0 : 0.8)*max(0.0f, dot_product(light_dir, normal)));
+						shadowed = 0; // handled correctly above
+					}
+					unpack_color(rgb, color*(shadowed ? 0.5 : 1.0));
+				}
+			}
+		} // for j
+	} // for i
+	if (draw_overlays && begin_motion && obj_groups[coll_id[SMILEY]].enabled) { // game_mode?
+		float const camx((world_mode == WMODE_GROUND) ? camera.x : 0.0), camy((world_mode == WMODE_GROUND) ? camera.y : 0.0);
+
+		for (int s = 0; s < num_smileys; ++s) { // add in smiley markers
+			point const spos(obj_groups[coll_id[SMILEY]].get_obj(s).pos);
+			int const xpos(int(nx2 + ((-camx - mx + spos.x)/X_SCENE_SIZE)*DX_VAL/xscale_val));
+			int const ypos(int(ny2 + ((-camy - my + spos.y)/Y_SCENE_SIZE)*DY_VAL/yscale_val));
+			colorRGBA const color(get_smiley_team_color(s));
+
+			for (int i = max(0, ypos-1); i < min(ny, ypos+1); ++i) {
+				for (int j = max(0, xpos-1); j < min(nx, xpos+1); ++j) {
+					int const offset(3*(i*nx + j));
+					unpack_color(&buf[offset], color);
+				}
+			}
+		}
+	}
+}
+
+
 void draw_overhead_map() {
 
 	//RESET_TIME
@@ -98,18 +340,13 @@ void draw_overhead_map() {
 		return;
 	}
 	if (map_zoom == 0.0) {map_zoom = ((world_mode == WMODE_GROUND) ? 0.08 : 0.8);} // set reasonable defaults based on mode
-	int bx1(0), by1(0), bx2(0), by2(0), nx(1), ny(1);
+	int nx(1), ny(1);
 	while (window_width  > 2*nx) {nx *= 2;}
 	while (window_height > 2*ny) {ny *= 2;}
 	//nx = (window_width & 0xFFFC); ny = (window_height & 0xFFFC); // looks nicer, but slower
 	if (nx < 4 || ny < 4) return;
-	int const nx2(nx/2), ny2(ny/2);
-	bool const no_water((DISABLE_WATER == 2) || !(display_mode & 0x04));
-	bool const is_ice(((world_mode == WMODE_GROUND) ? temperature : get_cur_temperature()) <= W_FREEZE_POINT);
-	float const zmax2(zmax_est*((map_color || no_water) ? 1.0 : 0.855)), hscale(0.5/zmax2);
 	float const window_ar((float(window_width)*ny)/(float(window_height)*nx)), scene_ar(X_SCENE_SIZE/Y_SCENE_SIZE);
 	float const xscale(2.0*map_zoom*window_ar*HALF_DXY), yscale(2.0*map_zoom*scene_ar*HALF_DXY);
-	float const xscale_val(xscale/64), yscale_val(yscale/64);
 
 	// translate map_drag_x/y (screen pixel space) into map_x/y (world unit space)
 	double const x_scale(nx*xscale/window_width), y_scale(ny*yscale/window_height);
@@ -136,199 +373,8 @@ void draw_overhead_map() {
 		}
 	}
 	else {
-		float x0(map_x + xoff2*DX_VAL), y0(map_y + yoff2*DY_VAL);
-		float const relh_water(get_rel_height_no_clamp(water_plane_z, -zmax_est, zmax_est));
-		point const camera(get_camera_pos());
-		float map_heights[6];
-		map_heights[0] = 0.9*lttex_dirt[3].zval  + 0.1*lttex_dirt[4].zval;
-		map_heights[1] = 0.5*(lttex_dirt[2].zval + lttex_dirt[3].zval);
-		map_heights[2] = 0.5*(lttex_dirt[1].zval + lttex_dirt[2].zval);
-		map_heights[3] = 0.5*(lttex_dirt[0].zval + lttex_dirt[1].zval);
-		map_heights[4] = relh_water; // Note: can be negative
-		map_heights[5] = min(0.5*relh_water, relh_water-0.01); // handle negative case
-		
-		for (unsigned i = 0; i < 6; ++i) {
-			if (map_heights[i] > 0.0) {map_heights[i] = pow(map_heights[i], glaciate_exp);} // handle negative case
-		}
-		colorRGBA ground_color(BLACK);
-		if (default_ground_tex >= 0) {ground_color = texture_color(default_ground_tex);}
-
-		colorRGBA const map_colors[6] = {
-			((water_is_lava || DISABLE_WATER == 2) ? DK_GRAY : WHITE),
-			GRAY,
-			((vegetation == 0.0) ? colorRGBA(0.55,0.45,0.35,1.0) : GREEN),
-			LT_BROWN,
-			(no_water ? BROWN    : (water_is_lava ? RED        : colorRGBA(0.3,0.2,0.6))),
-			(no_water ? DK_BROWN : (water_is_lava ? LAVA_COLOR : (is_ice ? LT_BLUE : BLUE)))};
-
-		if (world_mode == WMODE_GROUND) {
-			float const xv(-(camera.x + map_x)/X_SCENE_SIZE), yv(-(camera.y + map_y)/Y_SCENE_SIZE);
-			float const xs(DX_VAL/xscale_val), ys(DY_VAL/yscale_val);
-			x0 += camera.x;
-			y0 += camera.y;
-			bx1 = int(nx2 + xs*(xv - 1.0));
-			by1 = int(ny2 + ys*(yv - 1.0));
-			bx2 = int(nx2 + xs*(xv + 1.0));
-			by2 = int(ny2 + ys*(yv + 1.0));
-		}
-		vector3d const dir(vector3d(cview_dir.x, cview_dir.y, 0.0).get_norm());
-		int const cx(int(nx2 - map_x/xscale)), cy(int(ny2 - map_y/yscale));
-		int const xx(cx + int(4*dir.x)), yy(cy + int(4*dir.y));
-		float const xstart(x0 - nx2*xscale), ystart(y0 - ny2*yscale);
-		float const xsv(xscale_val*(X_SCENE_SIZE/DX_VAL)), ysv(yscale_val*(Y_SCENE_SIZE/DY_VAL));
-		float const max_building_dz(2.0*get_buildings_max_extent().z); // pad by 2x
-
-		bool const uses_hmap(world_mode == WMODE_GROUND && (read_landscape || read_heightmap || do_read_mesh));
 		mesh_xy_grid_cache_t height_gen;
-		if (!uses_hmap && !show_map_view_mandelbrot) {setup_height_gen(height_gen, xstart, ystart, xscale, yscale, nx, ny, 1);} // cache_values=1
-		point const lpos(get_light_pos());
-		vector3d const light_dir(lpos.get_norm()); // assume directional lighting to origin
-
-#pragma omp parallel for schedule(static,1)
-		for (int i = 0; i < ny; ++i) {
-			int const inx(i*nx);
-			int64_t const iyy(int64_t(i - yy)*int64_t(i - yy)), icy(int64_t(i - cy)*int64_t(i - cy));
-			float last_height(0.0);
-			point cpos;
-			vector3d cnorm;
-			int cindex(-1), cindex2(-1);
-
-			for (int j = 0; j < nx; ++j) {
-				int const offset(3*(inx + j));
-				unsigned char *rgb(&buf[offset]);
-				int64_t const jxx(j - xx), jcx(j - cx);
-
-				if (iyy + jxx*jxx <= 4) {
-					rgb[0] = rgb[1] = rgb[2] = 0; // camera direction
-				}
-				else if (icy + jcx*jcx <= 9) {
-					rgb[0] = 255;
-					rgb[1] = rgb[2] = 0; // camera position
-				}
-				else if (world_mode == WMODE_GROUND &&
-					(((i == by1 || i == by2) && j >= bx1 && j < bx2) || ((j == bx1 || j == bx2) && i >= by1 && i < by2)))
-				{
-					rgb[0] = rgb[1] = rgb[2] = 0; // world boundary
-				}
-				else {
-					float mh(0.0);
-					bool mh_set(0), shadowed(0);
-					float const xval((j - nx2)*xsv + camera.x + map_x), yval((i - ny2)*ysv + camera.y + map_y);
-
-					if (world_mode == WMODE_GROUND) {
-						point p1(xval, yval, czmax);
-						bool const over_mesh(is_over_mesh(p1));
-						colorRGBA building_color;
-					
-						if (over_mesh || uses_hmap) { // if using a heightmap, clamp values to scene bounds
-							mh = interpolate_mesh_zval(max(-X_SCENE_SIZE, min(X_SCENE_SIZE-DX_VAL, xval)), max(-Y_SCENE_SIZE, min(Y_SCENE_SIZE-DY_VAL, yval)), 0.0, 0, 1);
-							mh_set = 1;
-						}
-						if (over_mesh && get_buildings_line_hit_color(point(xval, yval, mh+max_building_dz), point(xval, yval, mh), building_color)) {
-							//unpack_color(rgb, building_color*(is_shadowed(cpos, plus_z, lpos, cindex2) ? 0.5 : 1.0));
-							unpack_color(rgb, building_color); // no shadows
-							continue;
-						}
-						if (over_mesh && czmin < czmax) { // check cobjs
-							// Note: as an optimization, can skip the cobj test if no cobjs at this pos, but it makes little difference and will miss dynamic objects
-							//int const xpos(get_xpos(xval)), ypos(get_ypos(yval));
-							//if (point_outside_mesh(xpos, ypos) || v_collision_matrix[ypos][xpos].zmin == v_collision_matrix[ypos][xpos].zmax) {}
-							point p2(xval, yval, max(mh, czmin));
-							float t;
-							int cindex0(-1);
-							if (cindex >= 0 && coll_objects.get_cobj(cindex).line_int_exact(p1, p2, t, cnorm)) {cpos = p1 + t*(p2 - p1); p2 = cpos;} // previous cobj int
-							else {cindex = -1;} // else reset
-							if (check_coll_line_exact(p1, p2, cpos, cnorm, cindex0, 0.0, cindex, 1, 0, 0, 0, 0)) {cindex = cindex0;} // cobj intersection
-
-							if (cindex >= 0) {
-								colorRGBA const color(get_cobj_color_at_point(cindex, cpos, cnorm, 0));
-								unpack_color(rgb, color*(is_shadowed(cpos, cnorm, lpos, cindex2) ? 0.5 : 1.0));
-								continue;
-							}
-							if (mh_set) {shadowed = is_shadowed(point(xval, yval, mh), plus_z, lpos, cindex2);}
-						}
-					} // end ground mode
-					else if (world_mode == WMODE_INF_TERRAIN && have_cities()) { // show cities and road networks
-						colorRGBA city_color(BLACK);
-
-						if (get_buildings_line_hit_color(point(xval, yval, zmax+max_building_dz), point(xval, yval, zmin), city_color)) {
-							unpack_color(rgb, city_color); // no shadows
-							continue;
-						}
-						if (get_city_color_at_xy(xval, yval, city_color)) {
-							unpack_color(rgb, city_color); // no shadows
-							continue;
-						}
-					}
-					if (default_ground_tex >= 0 && map_color) {
-						unpack_color(rgb, ground_color*(shadowed ? 0.5 : 1.0));
-						continue;
-					}
-					if (!mh_set) {mh = get_mesh_height(height_gen, xstart, ystart, xscale, yscale, i, j);} // calculate mesh height here if not yet set
-					float height(min(1.0f, hscale*(mh + zmax2))); // can be negative
-
-					if (!map_color) { // grayscale
-						float const val(pow(height, glaciate_exp_inv)); // un-glaciate: slow
-						//rgb[0] = rgb[1] = rgb[2] = (unsigned char)(255.0*val);
-						// http://c0de517e.blogspot.com/2017/11/coder-color-palettes-for-data.html
-						rgb[0] = (unsigned char)(255.0*(-0.121 + 0.893 * val + 0.276 * sin (1.94 - 5.69 * val)));
-						rgb[1] = (unsigned char)(255.0*(0.07 + 0.947 * val));
-						rgb[2] = (unsigned char)(255.0*(0.107 + (1.5 - 1.22 * val) * val));
-					}
-					else {
-						height += relh_adj_tex;
-						colorRGBA color;
-						if      (height <= map_heights[5]) {color = map_colors[5];} // deep water
-						else if (height <= map_heights[3]) {color = map_colors[3];} // sand
-						else if (height >= map_heights[0]) {color = map_colors[0];} // snow
-						else {
-							color = BLACK;
-							for (unsigned k = 0; k < 4; ++k) { // mixed
-								if (height > map_heights[k+1]) {
-									float const h((height - map_heights[k+1])/(map_heights[k] - map_heights[k+1])), v(cubic_interpolate(h));
-									blend_color(color, map_colors[k], map_colors[k+1], v);
-									break;
-								}
-							}
-						}
-						if (height <= map_heights[4] && height > map_heights[5]) { // shallow water
-							float const h(0.5*(height - map_heights[5])/(map_heights[4] - map_heights[5])), v(cubic_interpolate(h));
-							blend_color(color, color, map_colors[5], v);
-						}
-						if (MAP_VIEW_LIGHTING && !uses_hmap && !(display_mode & 0x20)) {
-							vector3d normal(plus_z);
-
-							if (height > map_heights[4]) {
-								float const hx((j == 0) ? height : last_height);
-								float const hy(CLIP_TO_01(hscale*(get_mesh_height(height_gen, xstart, ystart, xscale, yscale, max(i-1, 0), j) + zmax2)));
-								normal = vector3d(DY_VAL*(hx - height), DX_VAL*(hy - height), dxdy).get_norm();
-							}
-							last_height = height;
-							color *= (0.2 + (shadowed ? 0.0 : 0.8)*max(0.0f, dot_product(light_dir, normal)));
-							shadowed = 0; // handled correctly above
-						}
-						unpack_color(rgb, color*(shadowed ? 0.5 : 1.0));
-					}
-				}
-			} // for j
-		} // for i
-		if (begin_motion && obj_groups[coll_id[SMILEY]].enabled) { // game_mode?
-			float const camx((world_mode == WMODE_GROUND) ? camera.x : 0.0), camy((world_mode == WMODE_GROUND) ? camera.y : 0.0);
-
-			for (int s = 0; s < num_smileys; ++s) { // add in smiley markers
-				point const spos(obj_groups[coll_id[SMILEY]].get_obj(s).pos);
-				int const xpos(int(nx2 + ((-camx - map_x + spos.x)/X_SCENE_SIZE)*DX_VAL/xscale_val));
-				int const ypos(int(ny2 + ((-camy - map_y + spos.y)/Y_SCENE_SIZE)*DY_VAL/yscale_val));
-				colorRGBA const color(get_smiley_team_color(s));
-
-				for (int i = max(0, ypos-1); i < min(ny, ypos+1); ++i) {
-					for (int j = max(0, xpos-1); j < min(nx, xpos+1); ++j) {
-						int const offset(3*(i*nx + j));
-						unpack_color(&buf[offset], color);
-					}
-				}
-			}
-		}
+		gen_map_image(buf, nx, ny, map_x, map_y, xscale, yscale, get_camera_pos(), 1, height_gen); // draw_overlays=1
 	}
 	set_temp_clear_color(BLACK);
 	shader_t s;
@@ -383,3 +429,98 @@ void write_map_mode_heightmap_image() {
 	timer_t timer("Heightmap Image Write");
 	texture.write_to_png(fn);
 }
+
+
+
+unsigned long add_static_scene_to_crc(unsigned long crc); // in lightmap.cpp
+
+struct map_tile_params_t { // everything that determines the contents of an exported map tile; used as the key for the tile cache; all fields are 4 bytes, so no padding
+
+	unsigned version, level, tx, ty, num_cobjs, has_cities, scene_crc, num_buildings;
+	int world_mode, map_color, display_flags, disable_water, xoff2, yoff2, mesh_rgen_index, mesh_gen_mode, rand_gen_index;
+	float half_size, water_plane_z, zmax_est, mesh_height_scale, mesh_scale, temperature, relh_adj_tex;
+
+	map_tile_params_t() {memset(this, 0, sizeof(map_tile_params_t));}
+	uint32_t get_hash() const {return jenkins_one_at_a_time_hash((uint8_t const *)this, sizeof(map_tile_params_t));}
+};
+
+// renders a square region centered at the origin into a pyramid of MAP_TILE_SIZE PNG tiles, one tile at level 0 and 2^L x 2^L tiles at level L,
+// with tile {0,0} at the top left; independent of the window and map view; tiles that are unchanged since the last export are skipped
+void export_map_tiles() {
+
+	if (map_export_dir.empty() || map_export_levels == 0) return;
+	if (world_mode != WMODE_GROUND && world_mode != WMODE_INF_TERRAIN) return;
+	timer_t timer("Map Tile Export");
+	string const manifest_fn(map_export_dir + "/tiles.txt");
+	map<string, uint32_t> cached, written; // tile filename => params hash
+	std::ifstream in(manifest_fn.c_str());
+	string fn;
+	uint32_t hash(0);
+	while (in >> fn >> hash) {cached[fn] = hash;}
+	in.close();
+	float const half_size((map_export_size > 0.0) ? map_export_size : X_SCENE_SIZE);
+	map_tile_params_t params;
+	params.version           = MAP_TILE_VERSION;
+	params.num_cobjs         = coll_objects.size();
+	params.has_cities        = have_cities();
+	params.scene_crc         = (unsigned)add_static_scene_to_crc(0); // mesh heights + static cobjs
+	params.num_buildings     = get_num_buildings();
+	params.world_mode        = world_mode;
+	params.map_color         = map_color;
+	params.display_flags     = (display_mode & 0x24); // water and shadows
+	params.disable_water     = DISABLE_WATER;
+	params.xoff2             = xoff2;
+	params.yoff2             = yoff2;
+	params.mesh_rgen_index   = mesh_rgen_index; // procedural mesh seed
+	params.mesh_gen_mode     = mesh_gen_mode;
+	params.rand_gen_index    = rand_gen_index; // building placement seed
+	params.half_size         = half_size;
+	params.water_plane_z     = water_plane_z;
+	params.zmax_est          = zmax_est;
+	params.mesh_height_scale = mesh_height_scale;
+	params.mesh_scale        = mesh_scale;
+	params.temperature       = ((world_mode == WMODE_GROUND) ? temperature : get_cur_temperature());
+	params.relh_adj_tex      = relh_adj_tex;
+	vector<unsigned char> buf(3*MAP_TILE_SIZE*MAP_TILE_SIZE);
+	mesh_xy_grid_cache_t height_gen; // reused across tiles
+	unsigned num_drawn(0), num_skipped(0);
+
+	for (unsigned level = 0; level < map_export_levels; ++level) {
+		unsigned const ntiles(1U << level);
+		float const tile_sz(2.0*half_size/ntiles), wpp(tile_sz/MAP_TILE_SIZE); // world units per pixel
+		float const xscale(64.0*wpp*DX_VAL/X_SCENE_SIZE), yscale(64.0*wpp*DY_VAL/Y_SCENE_SIZE); // inverse of the xsv/ysv calculation in gen_map_image()
+
+		for (unsigned ty = 0; ty < ntiles; ++ty) {
+			for (unsigned tx = 0; tx < ntiles; ++tx) {
+				std::ostringstream oss;
+				oss << "tile_" << level << "_" << tx << "_" << ty << ".png";
+				string const tile_fn(oss.str()), full_fn(map_export_dir + "/" + tile_fn);
+				params.level = level;
+				params.tx    = tx;
+				params.ty    = ty;
+				uint32_t const tile_hash(params.get_hash());
+				written[tile_fn] = tile_hash;
+				map<string, uint32_t>::const_iterator it(cached.find(tile_fn));
+
+				if (it != cached.end() && it->second == tile_hash) {
+					FILE *fp(fopen(full_fn.c_str(), "rb"));
+					if (fp != NULL) {fclose(fp); ++num_skipped; continue;} // cached tile exists
+				}
+				double const cx(-half_size + (tx + 0.5)*tile_sz), cy(half_size - (ty + 0.5)*tile_sz);
+				gen_map_image(buf, MAP_TILE_SIZE, MAP_TILE_SIZE, cx, cy, xscale, yscale, all_zeros, 0, height_gen); // draw_overlays=0
+				texture_t texture(0, 6, MAP_TILE_SIZE, MAP_TILE_SIZE, 0, 3, 0, full_fn);
+				texture.alloc();
+				unsigned char *data(texture.get_data());
+				unsigned const row_sz(3*MAP_TILE_SIZE);
+				for (unsigned y = 0; y < MAP_TILE_SIZE; ++y) {memcpy(data + y*row_sz, &buf[(MAP_TILE_SIZE - y - 1)*row_sz], row_sz);} // invert yval
+				if (!texture.write_to_png(full_fn)) {written.erase(tile_fn);}
+				texture.free_data();
+				++num_drawn;
+			} // for tx
+		} // for ty
+	} // for level
+	std::ofstream out(manifest_fn.c_str());
+	if (!out.good()) {std::cerr << "Error: failed to write map tile manifest " << manifest_fn << endl; return;}
+	for (map<string, uint32_t>::const_iterator i = written.begin(); i != written.end(); ++i) {out << i->first << " " << i->second << endl;}
+	cout << "Exported map tiles to " << map_export_dir << ": " << num_drawn << " drawn, " << num_skipped << " cached" << endl;
+}
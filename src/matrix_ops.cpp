@@ -230,7 +230,7 @@ void update_mesh_height(int xpos, int ypos, int rad, float scale, float offset,
 	if (is_large_change) {
 		cobjs_updated |= update_decid_tree_zvals(x1, y1, x2, y2);
 		cobjs_updated |= update_small_tree_zvals(x1, y1, x2, y2);
-		if (cobjs_updated) {build_cobj_tree(0, 0);} // slow, but probably necessary
+		if (cobjs_updated) {invalidate_static_cobjs();} // slow, but probably necessary; deferred during a destroy batch
 	}
 
 	// fourth pass to update grass, after cobjs/shadows have been updated
@@ -17,9 +17,15 @@ bool const ENABLE_BUMP_MAPS  = 1;
 bool const ENABLE_SPEC_MAPS  = 1;
 bool const ENABLE_INTER_REFLECTIONS = 1;
 unsigned const MAGIC_NUMBER  = 42987143; // arbitrary file signature
+unsigned const MAGIC_NUMBER_LODS = 42987144; // file signature for files that also contain simplified LOD levels
 unsigned const BLOCK_SIZE    = 32768; // in vertex indices
+unsigned const MESHLET_MAX_VERTS = 64;
+unsigned const MESHLET_MAX_TRIS  = 126;
+unsigned const QEM_LOD_MIN_TRIS  = 128; // don't simplify LOD levels below this many triangles
 
 bool model_calc_tan_vect(1); // slower and more memory but sometimes better quality/smoother transitions
+bool cur_model_backface_cull(0); // set while drawing models with back face culling, which enables meshlet cone culling
+float cur_model_inst_scale(1.0); // model to world space scale of the instance being drawn when applied outside the model (city cars and pedestrians)
 
 extern bool group_back_face_cull, enable_model3d_tex_comp, disable_shader_effects, texture_alpha_in_red_comp, use_model2d_tex_mipmaps, enable_model3d_bump_maps;
 extern bool two_sided_lighting, have_indir_smoke_tex, use_core_context, model3d_wn_normal, invert_model_nmap_bscale, use_z_prepass, all_model3d_ref_update;
@@ -29,7 +35,9 @@ extern unsigned shadow_map_sz, reflection_tid;
 extern int display_mode;
 extern float model3d_alpha_thresh, model3d_texture_anisotropy, model_triplanar_tc_scale, model_mat_lod_thresh, cobj_z_bias, light_int_scale[];
 extern pos_dir_up orig_camera_pdu;
-extern bool vert_opt_flags[3];
+extern bool vert_opt_flags[3], vert_opt_forsyth, vert_opt_overdraw, use_model_meshlets;
+extern int model_qem_lod_levels, window_height;
+extern float model_qem_lod_pixels;
 extern vector<texture_t> textures;
 
 
@@ -83,22 +91,72 @@ void texture_manager::free_textures() {
 	for (deque<texture_t>::iterator t = textures.begin(); t != textures.end(); ++t) {t->free_data();}
 }
 
-bool texture_manager::ensure_texture_loaded(texture_t &t, int tid, bool is_bump) {
-
-	if (t.is_loaded()) return 0;
+void texture_manager::prepare_texture_load(texture_t &t) const {
 	//if (is_bump) {t.do_compress = 0;} // don't compress normal maps
 	// Note: it's incorrect to call t.has_alpha() here because that uses color, which hasn't been computed yet (t.init() is called later);
 	// but that's okay, do_gl_init() will disable custom mipmaps for textures with color.A == 1.0
 	if (use_model2d_tex_mipmaps && enable_model3d_custom_mipmaps /*&& t.has_alpha()*/) {t.use_mipmaps = 4;}
+}
+
+void texture_manager::finish_texture_load(texture_t &t, bool is_bump) { // called after the alpha channel has been copied
+	if (is_bump) {t.make_normal_map();}
+	t.init(); // must be after alpha copy
+	t.compress_and_cache();
+	assert(t.is_loaded());
+}
+
+bool texture_manager::ensure_texture_loaded(texture_t &t, int tid, bool is_bump) {
+
+	if (t.is_loaded()) return 0;
+	prepare_texture_load(t);
 	t.load(-1);
 		
 	if (t.alpha_tid >= 0 && t.alpha_tid != tid) { // if alpha is the same texture then the alpha channel should already be set
 		ensure_tid_loaded(t.alpha_tid, 0);
 		t.copy_alpha_from_texture(get_texture(t.alpha_tid), texture_alpha_in_red_comp);
 	}
-	if (is_bump) {t.make_normal_map();}
-	t.init(); // must be after alpha copy
-	assert(t.is_loaded());
+	finish_texture_load(t, is_bump);
+	return 1;
+}
+
+// same result as calling ensure_tid_loaded() on each entry in order, but with image decoding done in parallel
+void texture_manager::ensure_textures_loaded(vector<load_req_t> const &reqs) {
+
+	vector<load_req_t> to_load;
+	set<int> seen;
+
+	for (auto r = reqs.begin(); r != reqs.end(); ++r) {
+		if (r->tid < 0 || get_texture(r->tid).is_loaded() || !seen.insert(r->tid).second) continue; // no texture, already loaded, or duplicate
+		int const alpha_tid(get_texture(r->tid).alpha_tid);
+
+		if (alpha_tid >= 0 && alpha_tid != r->tid && !get_texture(alpha_tid).is_loaded() && seen.insert(alpha_tid).second) {
+			to_load.push_back(load_req_t(alpha_tid, 0)); // alpha textures must be loaded first
+		}
+		to_load.push_back(*r);
+	}
+	if (to_load.empty()) return;
+	for (auto r = to_load.begin(); r != to_load.end(); ++r) {prepare_texture_load(get_texture(r->tid));}
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)to_load.size(); ++i) {get_texture(to_load[i].tid).load(-1);}
+
+	for (unsigned i = 0; i < to_load.size(); ++i) { // serial: alpha textures may be shared across materials
+		texture_t &t(get_texture(to_load[i].tid));
+		if (t.alpha_tid < 0 || t.alpha_tid == to_load[i].tid) continue;
+		t.copy_alpha_from_texture(get_texture(t.alpha_tid), texture_alpha_in_red_comp); // alpha texture was either loaded earlier or is before this one in to_load
+	}
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)to_load.size(); ++i) {finish_texture_load(get_texture(to_load[i].tid), to_load[i].is_bump);}
+}
+
+// upload a texture to the GPU if it fits in this frame's upload budget; returns 1 if the texture can be used for drawing
+bool texture_manager::try_bind_tid(int tid) {
+
+	if (tid < 0) return 1; // no texture
+	texture_t &t(get_texture(tid));
+	if (t.is_bound()) return 1; // already uploaded
+	if (!check_tex_upload_budget(t.num_bytes())) return 0; // defer until a later frame
+	t.check_init(free_after_upload);
 	return 1;
 }
 
@@ -236,7 +294,21 @@ template<typename T> void indexed_vntc_vect_t<T>::optimize(unsigned npts) {
 
 	if (vert_opt_flags[0]) { // only if not subdivided?
 		vert_optimizer optimizer(indices, size(), npts);
-		optimizer.run(vert_opt_flags[1], vert_opt_flags[2]);
+		vector<point> pts;
+
+		if (vert_opt_overdraw && vert_opt_flags[1] && npts == 3) { // overdraw sorting requires vertex positions
+			pts.resize(size());
+			for (unsigned i = 0; i < size(); ++i) {pts[i] = (*this)[i].v;}
+		}
+		if (optimizer.run(vert_opt_flags[1], vert_opt_flags[2], vert_opt_forsyth, (pts.empty() ? nullptr : &pts))) { // indices were reordered
+			vector<unsigned> remap;
+			optimizer.reorder_verts_by_first_use(remap);
+			vector<T> verts(size());
+			for (unsigned i = 0; i < size(); ++i) {verts[remap[i]] = (*this)[i];}
+			vector<T> &cur_verts(*this);
+			cur_verts.swap(verts);
+			for (auto i = lod_indices.begin(); i != lod_indices.end(); ++i) {*i = remap[*i];} // LODs read from a model3d file
+		}
 	}
 }
 
@@ -290,6 +362,64 @@ template<typename T> void indexed_vntc_vect_t<T>::gen_lod_blocks(unsigned npts)
 	indices.swap(ixs);
 }
 
+// split the (cache optimized) triangles into small clusters of consecutive triangles, each with a bounding volume and normal cone for CPU culling
+template<typename T> void indexed_vntc_vect_t<T>::gen_meshlets() {
+
+	unsigned const num(indices.size());
+	assert((num % 3) == 0);
+	vector<unsigned> vert_stamp(size(), num); // start index of the last meshlet to use each vertex
+	unsigned start_ix(0), nverts(0);
+
+	for (unsigned i = 0; i <= num; i += 3) {
+		if (i < num) {
+			unsigned new_verts(0);
+			for (unsigned n = 0; n < 3; ++n) {new_verts += (vert_stamp[indices[i+n]] != start_ix);}
+			bool const full(nverts + new_verts > MESHLET_MAX_VERTS || (i - start_ix) == 3*MESHLET_MAX_TRIS);
+
+			if (!full) {
+				for (unsigned n = 0; n < 3; ++n) {
+					unsigned &stamp(vert_stamp[indices[i+n]]);
+					if (stamp != start_ix) {stamp = start_ix; ++nverts;}
+				}
+				continue;
+			}
+		}
+		// add a meshlet for the triangles in [start_ix, i)
+		geom_block_t block(start_ix, (i - start_ix), cube_t());
+		block.bcube.set_from_point(at(indices[start_ix]).v);
+		vector3d nsum(zero_vector);
+
+		for (unsigned j = start_ix; j < i; j += 3) {
+			point const &p0(at(indices[j]).v), &p1(at(indices[j+1]).v), &p2(at(indices[j+2]).v);
+			UNROLL_3X(block.bcube.union_with_pt(at(indices[j+i_]).v);)
+			nsum += cross_product((p1 - p0), (p2 - p0)); // area weighted
+		}
+		block.bsphere.pos = block.bcube.get_cube_center();
+
+		for (unsigned j = start_ix; j < i; ++j) {
+			block.bsphere.radius = max(block.bsphere.radius, p2p_dist(block.bsphere.pos, at(indices[j]).v));
+		}
+		if (nsum != zero_vector) { // calculate the normal cone
+			block.cone_dir = nsum.get_norm();
+			float min_dp(1.0);
+
+			for (unsigned j = start_ix; j < i && min_dp > 0.0; j += 3) {
+				point const &p0(at(indices[j]).v), &p1(at(indices[j+1]).v), &p2(at(indices[j+2]).v);
+				vector3d const n(cross_product((p1 - p0), (p2 - p0)));
+				float const nmag(n.mag());
+				if (nmag > 0.0) {min_dp = min(min_dp, dot_product(n, block.cone_dir)/nmag);} // skip degenerate triangles, which are never drawn
+			}
+			if (min_dp > 0.1) {block.cone_cutoff = sqrt(1.0 - min_dp*min_dp);} // else the cone is too wide to be useful
+		}
+		blocks.push_back(block);
+		if (i == num) break; // done
+		start_ix = i;
+		nverts   = 0;
+		i       -= 3; // add this triangle to the next meshlet
+	} // for i
+	has_meshlets = 1;
+}
+
 template<typename T> void indexed_vntc_vect_t<T>::finalize(unsigned npts) {
 
 	optimize(npts);
@@ -301,16 +431,8 @@ template<typename T> void indexed_vntc_vect_t<T>::finalize(unsigned npts) {
 	if (!empty()) {this->ensure_bounding_volumes();}
 	if (indices.empty() || finalized) return; // nothing to do
 
-	unsigned const simplify_steps = 0; // TESTING, maybe this doesn't really go here
-	if (simplify_steps > 0 && npts == 3) { // Note: triangles only
-		cout << "*** SIMPLIFY: input=" << indices.size() << " ";
-		for (unsigned n = 0; n < simplify_steps; ++n) {
-			vector<unsigned> v;
-			simplify(v, 0.5);
-			if (v.size() == indices.size()) break; // no change, done
-			indices.swap(v);
-		}
-		cout << " output=" << indices.size() << endl;
+	if (model_qem_lod_levels > 0 && npts == 3 && !use_model_lod_blocks && qem_lods.empty() && indices.size() >= 6*QEM_LOD_MIN_TRIS) {
+		gen_qem_lods(); // Note: materials are finalized in parallel
 	}
 	finalized = 1;
 	assert((num_verts() % npts) == 0); // triangles or quads
@@ -319,6 +441,9 @@ template<typename T> void indexed_vntc_vect_t<T>::finalize(unsigned npts) {
 	if (use_model_lod_blocks && indices.size() > 1024) {
 		gen_lod_blocks(npts);
 	}
+	else if (use_model_meshlets && npts == 3 && indices.size() > 3*MESHLET_MAX_TRIS) {
+		gen_meshlets();
+	}
 	else if (!no_subdiv_model && num_verts() > 2*BLOCK_SIZE) { // subdivide large buffers
 		//timer_t timer("Subdivide Model");
 		vector<unsigned> ixs;
@@ -328,145 +453,216 @@ template<typename T> void indexed_vntc_vect_t<T>::finalize(unsigned npts) {
 }
 
 
-template<unsigned N> struct vert_to_tri_t {
-
-	unsigned t[N], n; // if this vertex is used in more than N triangles we give up and never remove it
+struct quadric_t { // symmetric 4x4 matrix of summed plane equations, upper triangle only
 
-	vert_to_tri_t() : n(0) {}
-	void add(unsigned ix) {if (n < N) {t[n] = ix;} ++n;} // only add if it fits, but always increment n
-	void remove(unsigned tix) {assert(tix < min(n, N)); t[tix] = t[n-1]; --n;} // move last element to position tix
-	unsigned get_first_index_ix(unsigned tix) const {assert(tix < min(n, N)); return 3*t[tix];} // multiply by 3 to convert from triangle to index
-	bool ix_overflow() const {return (n > N);}
-};
+	double q[10];
 
-struct merge_entry_t {
+	quadric_t() {for (unsigned i = 0; i < 10; ++i) {q[i] = 0.0;}}
 
-	unsigned vix;
-	float val;
+	void add_plane(vector3d const &n, float d) { // plane is dot(n, p) + d = 0, n normalized
+		double const x(n.x), y(n.y), z(n.z), w(d);
+		q[0] += x*x; q[1] += x*y; q[2] += x*z; q[3] += x*w;
+		q[4] += y*y; q[5] += y*z; q[6] += y*w;
+		q[7] += z*z; q[8] += z*w; q[9] += w*w;
+	}
+	void add(quadric_t const &Q) {for (unsigned i = 0; i < 10; ++i) {q[i] += Q.q[i];}}
 
-	merge_entry_t(unsigned vix_=0, float val_=0.0) : vix(vix_), val(val_) {}
-	bool operator<(merge_entry_t const &e) const {return (val < e.val);}
+	double eval(point const &p) const { // sum of squared distances from p to all planes
+		double const x(p.x), y(p.y), z(p.z);
+		return (q[0]*x*x + q[4]*y*y + q[7]*z*z + 2.0*(q[1]*x*y + q[2]*x*z + q[5]*y*z + q[3]*x + q[6]*y + q[8]*z) + q[9]);
+	}
 };
 
-struct vertex_remap_t {
-
-	vector<unsigned> remap;
-
-	vertex_remap_t(unsigned num_verts) {
-		remap.resize(num_verts);
-		for (unsigned i = 0; i < num_verts; ++i) {remap[i] = i;}
+// quadric error metric mesh simplification using half edge collapses
+// Note: collapses only move a vertex onto one of its neighbors, so vertex attributes (normals, texture coords) are never interpolated;
+// vertices on open or non-manifold edges are never removed, which preserves material boundaries (each material is a separate mesh)
+// and texture/normal seams (which split vertices and therefore create open edges)
+class qem_simplifier_t {
+
+	struct collapse_t {
+		float cost;
+		unsigned src, dst, src_ver, dst_ver;
+		collapse_t(float c, unsigned s, unsigned d, unsigned sv, unsigned dv) : cost(c), src(s), dst(d), src_ver(sv), dst_ver(dv) {}
+		bool operator<(collapse_t const &c) const {return (cost > c.cost);} // lowest cost on top
+	};
+
+	vector<point> const &pts;
+	vector<unsigned> tris; // 3 indices per triangle, updated in place as vertices are collapsed
+	vector<unsigned char> tri_valid, locked, removed;
+	vector<quadric_t> quadrics;
+	vector<vector<unsigned>> vert_tris;
+	vector<unsigned> version, src_nbrs, dst_nbrs;
+	std::priority_queue<collapse_t> queue;
+	unsigned num_valid_tris;
+	double max_cost;
+
+	void add_collapse(unsigned src, unsigned dst) {
+		if (locked[src]) return;
+		quadric_t Q(quadrics[src]);
+		Q.add(quadrics[dst]);
+		queue.push(collapse_t(float(max(0.0, Q.eval(pts[dst]))), src, dst, version[src], version[dst]));
+	}
+	void add_edge(unsigned a, unsigned b) {add_collapse(a, b); add_collapse(b, a);}
+
+	void get_neighbors(unsigned v, vector<unsigned> &nbrs) const {
+		nbrs.clear();
+
+		for (auto t = vert_tris[v].begin(); t != vert_tris[v].end(); ++t) {
+			if (!tri_valid[*t]) continue;
+			for (unsigned n = 0; n < 3; ++n) {if (tris[3*(*t)+n] != v) {nbrs.push_back(tris[3*(*t)+n]);}}
+		}
+		sort(nbrs.begin(), nbrs.end());
+		nbrs.erase(unique(nbrs.begin(), nbrs.end()), nbrs.end());
+	}
+	bool can_collapse(unsigned src, unsigned dst) {
+		// the edge must still exist, and src and dst must share exactly two neighbors (the opposite verts of the two edge triangles),
+		// otherwise the collapse would create a non-manifold fold
+		get_neighbors(src, src_nbrs);
+		if (!binary_search(src_nbrs.begin(), src_nbrs.end(), dst)) return 0;
+		get_neighbors(dst, dst_nbrs);
+		unsigned num_shared(0);
+
+		for (auto i = src_nbrs.begin(); i != src_nbrs.end(); ++i) {
+			if (binary_search(dst_nbrs.begin(), dst_nbrs.end(), *i)) {++num_shared;}
+		}
+		if (num_shared != 2) return 0;
+
+		for (auto t = vert_tris[src].begin(); t != vert_tris[src].end(); ++t) { // reject collapses that flip or degenerate triangles
+			if (!tri_valid[*t]) continue;
+			unsigned const *const ixs(&tris[3*(*t)]);
+			if (ixs[0] == dst || ixs[1] == dst || ixs[2] == dst) continue; // removed by this collapse
+			point p[3], p_new[3];
+			for (unsigned n = 0; n < 3; ++n) {p[n] = p_new[n] = pts[ixs[n]]; if (ixs[n] == src) {p_new[n] = pts[dst];}}
+			vector3d const n_old(cross_product((p[1] - p[0]), (p[2] - p[0]))), n_new(cross_product((p_new[1] - p_new[0]), (p_new[2] - p_new[0])));
+			float const mag_old(n_old.mag()), mag_new(n_new.mag());
+			if (mag_new < 1.0E-6*mag_old || dot_product(n_old, n_new) < 0.2*mag_old*mag_new) return 0;
+		}
+		return 1;
+	}
+	void collapse(unsigned src, unsigned dst) {
+		for (auto t = vert_tris[src].begin(); t != vert_tris[src].end(); ++t) {
+			if (!tri_valid[*t]) continue;
+			unsigned *const ixs(&tris[3*(*t)]);
+
+			if (ixs[0] == dst || ixs[1] == dst || ixs[2] == dst) { // triangle along the collapsed edge
+				tri_valid[*t] = 0;
+				assert(num_valid_tris > 0);
+				--num_valid_tris;
+				continue;
+			}
+			for (unsigned n = 0; n < 3; ++n) {if (ixs[n] == src) {ixs[n] = dst;}}
+			vert_tris[dst].push_back(*t);
+		}
+		vert_tris[src].clear();
+		removed[src] = 1;
+		quadrics[dst].add(quadrics[src]);
+		++version[dst];
+		get_neighbors(dst, dst_nbrs);
+		for (auto i = dst_nbrs.begin(); i != dst_nbrs.end(); ++i) {add_edge(*i, dst);} // costs of all edges at dst have changed
+	}
+
+public:
+	qem_simplifier_t(vector<point> const &pts_, vector<unsigned> const &indices) : pts(pts_), tris(indices), num_valid_tris(0), max_cost(0.0) {
+		unsigned const num_verts(pts.size()), num_tris(tris.size()/3);
+		assert((tris.size() % 3) == 0);
+		tri_valid.resize(num_tris, 0);
+		locked.resize(num_verts, 0);
+		removed.resize(num_verts, 0);
+		quadrics.resize(num_verts);
+		vert_tris.resize(num_verts);
+		version.resize(num_verts, 0);
+		vector<uint64_t> edges;
+		edges.reserve(tris.size());
+
+		for (unsigned t = 0; t < num_tris; ++t) {
+			unsigned const *const ixs(&tris[3*t]);
+			for (unsigned n = 0; n < 3; ++n) {assert(ixs[n] < num_verts);}
+			if (ixs[0] == ixs[1] || ixs[1] == ixs[2] || ixs[2] == ixs[0]) continue; // degenerate, drop
+			tri_valid[t] = 1;
+			++num_valid_tris;
+			vector3d const normal(cross_product((pts[ixs[1]] - pts[ixs[0]]), (pts[ixs[2]] - pts[ixs[0]])));
+			float const nmag(normal.mag());
+
+			for (unsigned n = 0; n < 3; ++n) {
+				unsigned const a(ixs[n]), b(ixs[(n+1)%3]);
+				vert_tris[a].push_back(t);
+				edges.push_back((uint64_t(min(a, b)) << 32) + max(a, b));
+				if (nmag > 0.0) {quadrics[a].add_plane(normal/nmag, -dot_product(normal, pts[a])/nmag);}
+			}
+		}
+		sort(edges.begin(), edges.end());
+
+		for (unsigned i = 0; i < edges.size();) { // lock verts on open and non-manifold edges
+			unsigned j(i+1);
+			while (j < edges.size() && edges[j] == edges[i]) {++j;}
+			unsigned const a(unsigned(edges[i] >> 32)), b(unsigned(edges[i] & 0xFFFFFFFF));
+			if (j - i != 2) {locked[a] = locked[b] = 1;}
+			i = j;
+		}
+		for (unsigned i = 0; i < edges.size(); ++i) {
+			if (i > 0 && edges[i] == edges[i-1]) continue; // duplicate
+			add_edge(unsigned(edges[i] >> 32), unsigned(edges[i] & 0xFFFFFFFF));
+		}
 	}
-	unsigned get_remapped_val(unsigned ix) { // union find with path compression
-		if (is_remapped(ix)) {remap[ix] = get_remapped_val(remap[ix]);} // follow the chain
-		return remap[ix];
+
+	void simplify_to(unsigned target_tris) {
+		while (num_valid_tris > target_tris && !queue.empty()) {
+			collapse_t const c(queue.top());
+			queue.pop();
+			if (removed[c.src] || removed[c.dst] || version[c.src] != c.src_ver || version[c.dst] != c.dst_ver) continue; // stale
+			if (!can_collapse(c.src, c.dst)) continue;
+			max_cost = max(max_cost, double(c.cost));
+			collapse(c.src, c.dst);
+		}
 	}
-	bool is_remapped(unsigned ix) const {assert(ix < remap.size()); return (remap[ix] != ix);}
-	void remap_vertex(unsigned from, unsigned to) {assert(from != to); assert(!is_remapped(from)); remap[from] = to;}
-};
+	void get_indices(vector<unsigned> &out) const {
+		out.clear();
+		out.reserve(3*num_valid_tris);
 
-struct mesh_edge_t {
-	unsigned a, b; // a < b
-	mesh_edge_t(unsigned a_=0, unsigned b_=0) : a(min(a_, b_)), b(max(a_, b_)) {assert(a != b);}
-	bool operator==(mesh_edge_t const &e) const {return (a == e.a && b == e.b);}
+		for (unsigned t = 0; t < tri_valid.size(); ++t) {
+			if (tri_valid[t]) {out.insert(out.end(), tris.begin()+3*t, tris.begin()+3*t+3);}
+		}
+	}
+	unsigned get_num_tris() const {return num_valid_tris;}
+	float get_max_error() const {return sqrt(max_cost);}
 };
 
 
-// target = ratio of output to input vertices in (0.0, 1.0)
-// Note: works on triangles only (not quads), intended for 2-manifold meshes
-template<typename T> void indexed_vntc_vect_t<T>::simplify(vector<unsigned> &out, float target) const {
+// target = ratio of output to input triangles in (0.0, 1.0); returns the approximate max error distance
+// Note: works on triangles only (not quads)
+template<typename T> float indexed_vntc_vect_t<T>::simplify(vector<unsigned> &out, float target) const {
 
-	RESET_TIME;
 	assert(target < 1.0 && target > 0.0);
-	out.clear();
-	unsigned const num_verts(size()), num_ixs(indices.size()), target_num_verts(unsigned(target*num_verts));
-	if (target_num_verts <= 3) {out = indices; return;} // can't simplify
-
-	// build vertex to face/triangle mapping
-	assert((num_ixs % 3) == 0); // must be triangles; num_tris = num_ixs/3
-	vector<vert_to_tri_t<8>> vert_to_tri(num_verts);
-
-	for (unsigned i = 0; i < num_ixs; ++i) {
-		assert(indices[i] < num_verts);
-		vert_to_tri[indices[i]].add(i);
-	}
-
-	// determine which verts/edges can be removed
-	std::priority_queue<merge_entry_t> merge_queue; // of vertices
-
-	for (unsigned i = 0; i < num_verts; ++i) {
-		auto const &vt(vert_to_tri[i]);
-		if (vt.ix_overflow()) continue; // don't remove this vertex
-		bool on_mesh_edge(0);
-		counted_normal normal_sum;
-
-		for (unsigned t = 0; t < vt.n && !on_mesh_edge; ++t) { // iterate over triangles at this vertex
-			assert(vt.t[t] < num_ixs);
-			unsigned const tix(vt.t[t]/3), six(3*tix);
-			assert(six+3 <= num_ixs);
-			
-			for (unsigned j = 0; j < 3; ++j) {
-				normal_sum.add_normal(operator[](indices[six+j]).n);
-				mesh_edge_t const e1(indices[six+j], indices[six+((j+1)%3)]);
-				if (e1.a != i && e1.b != i) continue; // edge doesn't contain the vertex of interest
-				bool found(0);
-
-				for (unsigned t2 = 0; t2 < vt.n && !found; ++t2) {
-					if (t2 == t) continue; // same triangle
-					unsigned const tix2(vt.t[t2]/3), six2(3*tix2);
-					if (e1 == mesh_edge_t(indices[six2+0], indices[six2+1]) ||
-						e1 == mesh_edge_t(indices[six2+1], indices[six2+2]) ||
-						e1 == mesh_edge_t(indices[six2+2], indices[six2+0])) {found = 1; break;}
-				} // for t2
-				if (!found) {on_mesh_edge = 1; break;}
-			} // for j
-		} // for t
-		if (on_mesh_edge) continue; // can't remove this vertex
-		float const val(normal_sum.mag()/normal_sum.count);
-		merge_queue.push(merge_entry_t(i, val));
-	}
-
-	// mapping from orig vertex to collapsed (new) vertex
-	unsigned const cand_verts(merge_queue.size());
-	vertex_remap_t remap(num_verts);
-	unsigned num_valid_verts(num_verts);
-
-	while (!merge_queue.empty() && num_valid_verts > target_num_verts) {
-		unsigned const src_ix(merge_queue.top().vix); // remove this one (half edge collapse)
-		merge_queue.pop();
-		assert(src_ix < num_verts);
-		unsigned dest_ix(src_ix);
-		float min_edge_len_sq(0.0);
-		
-		for (unsigned t = 0; t < vert_to_tri[src_ix].n; ++t) { // iterate over triangles at this vertex
-			unsigned const tix(vert_to_tri[src_ix].t[t]/3), six(3*tix);
-
-			for (unsigned j = 0; j < 3; ++j) {
-				if (remap.is_remapped(indices[six+j])) continue; // already remapped
-				float const edge_len_sq(p2p_dist_sq(operator[](src_ix).v, operator[](indices[six+j]).v));
+	unsigned const target_num_tris(unsigned(target*indices.size()/3));
+	if (target_num_tris <= 1) {out = indices; return 0.0;} // can't simplify
+	vector<point> pts(size());
+	for (unsigned i = 0; i < size(); ++i) {pts[i] = operator[](i).v;}
+	qem_simplifier_t simplifier(pts, indices);
+	simplifier.simplify_to(target_num_tris);
+	simplifier.get_indices(out);
+	return simplifier.get_max_error();
+}
 
-				if (min_edge_len_sq == 0.0 || edge_len_sq < min_edge_len_sq) { // first or shortest edge
-					dest_ix = indices[six+j]; // new vertex
-					min_edge_len_sq = edge_len_sq;
-				}
-			}
-		} // for i
-		if (min_edge_len_sq == 0.0) continue; // can't remove this one
-		remap.remap_vertex(src_ix, dest_ix);
-		assert(num_valid_verts > 0);
-		--num_valid_verts;
-	} // while
+// generates up to model_qem_lod_levels levels, each with half the triangles of the previous one
+template<typename T> void indexed_vntc_vect_t<T>::gen_qem_lods() {
 
-	// generate output
-	out.reserve(unsigned(target*num_ixs));
+	assert(qem_lods.empty() && lod_indices.empty());
+	vector<point> pts(size());
+	for (unsigned i = 0; i < size(); ++i) {pts[i] = operator[](i).v;}
+	qem_simplifier_t simplifier(pts, indices);
+	unsigned prev_num_tris(simplifier.get_num_tris());
+	vector<unsigned> ixs;
 
-	for (unsigned i = 0; i < num_ixs; i += 3) { // iterate by triangle
-		unsigned new_ixs[3];
-		for (unsigned n = 0; n < 3; ++n) {new_ixs[n] = remap.get_remapped_val(indices[i+n]);}
-		if (new_ixs[0] == new_ixs[1] || new_ixs[1] == new_ixs[2] || new_ixs[2] == new_ixs[0]) continue; // duplicate vertices, degenerate triangle, skip
-		UNROLL_3X(out.push_back(new_ixs[i_]);)
+	for (unsigned level = 0; level < (unsigned)model_qem_lod_levels; ++level) {
+		if (prev_num_tris < 2*QEM_LOD_MIN_TRIS) break; // small enough
+		simplifier.simplify_to(prev_num_tris/2);
+		unsigned const num_tris(simplifier.get_num_tris());
+		if (10*num_tris > 9*prev_num_tris) break; // less than 10% reduction, mesh is mostly locked
+		simplifier.get_indices(ixs);
+		qem_lods.push_back(qem_lod_t(lod_indices.size(), ixs.size(), simplifier.get_max_error()));
+		lod_indices.insert(lod_indices.end(), ixs.begin(), ixs.end());
+		prev_num_tris = num_tris;
 	}
-	cout << TXT(num_verts) << TXT(num_ixs) << TXT(target_num_verts) << TXT(cand_verts) << TXT(num_valid_verts) << TXT(out.size()) << endl;
-	PRINT_TIME("Simplify");
 }
 
 
@@ -476,7 +672,9 @@ template<typename T> void indexed_vntc_vect_t<T>::clear() {
 	indices.clear();
 	blocks.clear();
 	lod_blocks.clear();
-	need_normalize = 0;
+	lod_indices.clear();
+	qem_lods.clear();
+	need_normalize = has_meshlets = 0;
 }
 
 
@@ -548,6 +746,7 @@ template<typename T> void indexed_vntc_vect_t<T>::render(shader_t &shader, bool
 	assert(!indices.empty()); // now always using indexed drawing
 	int prim_type(GL_TRIANGLES);
 	unsigned ixn(1), ixd(1), end_ix(indices.size());
+	int lod_ix(-1); // index into qem_lods, -1 = full detail
 
 	if (!is_shadow_pass && !lod_blocks.empty()) { // block LOD
 		float const dmin(2.0*bsphere.radius), dist(p2p_dist(camera_pdu.pos, bsphere.pos));
@@ -559,6 +758,16 @@ template<typename T> void indexed_vntc_vect_t<T>::render(shader_t &shader, bool
 			assert(end_ix <= indices.size());
 		}
 	}
+	else if (!is_shadow_pass && !qem_lods.empty() && model_qem_lod_levels > 0) { // simplified LOD levels, including ones read from a model3d file
+		// camera distance is in world space, while radius and errors are in model space and must be scaled by the instance scale
+		float const dmin(2.0*bsphere.radius*cur_model_inst_scale), dist(p2p_dist(camera_pdu.pos, bsphere.pos));
+
+		if (dist > dmin) { // no LOD if within the bounding sphere
+			float const err_thresh(model_qem_lod_pixels*2.0*(dist - dmin)*camera_pdu.tterm/window_height); // screen space error in pixels
+			unsigned const num_lods(min((unsigned)qem_lods.size(), (unsigned)model_qem_lod_levels)); // file LODs are limited to the configured number of levels
+			for (unsigned i = 0; i < num_lods && qem_lods[i].max_err*cur_model_inst_scale <= err_thresh; ++i) {lod_ix = i;} // use the least detailed valid level
+		}
+	}
 	if (use_core_context && npts == 4) {
 		if (!this->ivbo) {
 			vector<unsigned> tixs;
@@ -569,29 +778,52 @@ template<typename T> void indexed_vntc_vect_t<T>::render(shader_t &shader, bool
 	}
 	else {
 		if (npts == 4) {prim_type = GL_QUADS;}
-		this->create_and_upload(*this, indices);
+
+		if (lod_indices.empty()) {this->create_and_upload(*this, indices);}
+		else if (!this->vao) { // LOD indices are stored in the same index buffer, after the full detail indices
+			vector<unsigned> all_ixs(indices);
+			all_ixs.insert(all_ixs.end(), lod_indices.begin(), lod_indices.end());
+			this->create_and_upload(*this, all_ixs);
+		}
 	}
 	this->pre_render();
 	// Note: we need this call here because we don't know if the VAO was created with the same enables/locations: consider normal vs. shadow pass
 	//if (is_shadow_pass) {T::set_vbo_arrays_shadow(0);} else
 	T::set_vbo_arrays(); // calls check_mvm_update()
 
-	if (is_shadow_pass || blocks.empty() || no_vfc || camera_pdu.sphere_completely_visible_test(bsphere.pos, bsphere.radius)) { // draw the entire range
-		glDrawRangeElements(prim_type, 0, (unsigned)size(), (unsigned)(ixn*end_ix/ixd), GL_UNSIGNED_INT, 0);
+	bool const cone_cull(has_meshlets && cur_model_backface_cull && !is_shadow_pass && !no_vfc);
+
+	if (lod_ix >= 0) { // simplified; not worth culling per block at this distance
+		qem_lod_t const &lod(qem_lods[lod_ix]);
+		draw_ix_range(prim_type, (indices.size() + lod.start_ix), lod.num, ixn, ixd);
+	}
+	else if (is_shadow_pass || blocks.empty() || no_vfc || (!cone_cull && camera_pdu.sphere_completely_visible_test(bsphere.pos, bsphere.radius))) { // draw the entire range
+		draw_ix_range(prim_type, 0, end_ix, ixn, ixd);
 	}
 	else { // draw each block independently
 		// could use glDrawElementsIndirect(), but the draw calls don't seem to add any significant overhead for the current set of models
+		bool const all_visible(camera_pdu.sphere_completely_visible_test(bsphere.pos, bsphere.radius));
+		unsigned run_start(0), run_num(0); // merge adjacent visible blocks into a single draw call
+
 		for (auto i = blocks.begin(); i != blocks.end(); ++i) {
-			if (camera_pdu.cube_visible(i->bcube)) {
-				glDrawRangeElements(prim_type, 0, (unsigned)size(), (ixn*i->num/ixd), GL_UNSIGNED_INT, (void *)((ixn*i->start_ix/ixd)*sizeof(unsigned)));
-			}
+			if (!all_visible && !camera_pdu.cube_visible(i->bcube)) continue;
+			if (cone_cull && i->is_backfacing(camera_pdu.pos)) continue;
+			if (run_num > 0 && run_start + run_num == i->start_ix) {run_num += i->num; continue;} // extend the current run
+			if (run_num > 0) {draw_ix_range(prim_type, run_start, run_num, ixn, ixd);}
+			run_start = i->start_ix;
+			run_num   = i->num;
 		}
+		if (run_num > 0) {draw_ix_range(prim_type, run_start, run_num, ixn, ixd);}
 	}
 	this->post_render();
 	T::unset_attrs();
 }
 
 
+template<typename T> void indexed_vntc_vect_t<T>::draw_ix_range(int prim_type, unsigned start_ix, unsigned num, unsigned ixn, unsigned ixd) const {
+	glDrawRangeElements(prim_type, 0, (unsigned)size(), (ixn*num/ixd), GL_UNSIGNED_INT, (void *)((ixn*start_ix/ixd)*sizeof(unsigned)));
+}
+
 template<typename T> void indexed_vntc_vect_t<T>::reserve_for_num_verts(unsigned num_verts) {
 	if (empty()) {indices.reserve(num_verts);}
 }
@@ -732,11 +964,16 @@ template<typename T> void indexed_vntc_vect_t<T>::invert_tcy() {
 template<typename T> void indexed_vntc_vect_t<T>::write(ostream &out) const {
 	vntc_vect_t<T>::write(out);
 	write_vector(out, indices);
+	write_vector(out, lod_indices);
+	write_vector(out, qem_lods);
 }
 
-template<typename T> void indexed_vntc_vect_t<T>::read(istream &in) {
+template<typename T> void indexed_vntc_vect_t<T>::read(istream &in, bool has_lods) {
 	vntc_vect_t<T>::read(in);
 	read_vector(in, indices);
+	if (!has_lods) return;
+	read_vector(in, lod_indices);
+	read_vector(in, qem_lods);
 }
 
 
@@ -864,11 +1101,11 @@ template<typename T> bool vntc_vect_block_t<T>::write(ostream &out) const {
 	return 1;
 }
 
-template<typename T> bool vntc_vect_block_t<T>::read(istream &in) {
+template<typename T> bool vntc_vect_block_t<T>::read(istream &in, bool has_lods) {
 
 	this->clear();
 	this->resize(read_uint(in));
-	for (auto i = begin(); i != end(); ++i) {i->read(in);}
+	for (auto i = begin(); i != end(); ++i) {i->read(in, has_lods);}
 	return 1;
 }
 
@@ -977,6 +1214,14 @@ void material_t::compute_area_per_tri() {
 	//cout << "name: " << name << " " << TXT(tris) << TXT(area) << TXT(alpha) << "value: " << (1.0E6*avg_area_per_tri) << endl;
 }
 
+void material_t::get_textures_to_load(vector<texture_manager::load_req_t> &reqs) const { // must agree with ensure_textures_loaded()
+
+	reqs.push_back(texture_manager::load_req_t(get_render_texture(), 0));
+	if (use_bump_map()) {reqs.push_back(texture_manager::load_req_t(bump_tid, 1));}
+	if (use_spec_map()) {reqs.push_back(texture_manager::load_req_t(s_tid,    0));}
+	if (use_spec_map()) {reqs.push_back(texture_manager::load_req_t(ns_tid,   0));}
+}
+
 void material_t::ensure_textures_loaded(texture_manager &tmgr) {
 
 	tmgr.ensure_tid_loaded(get_render_texture(), 0); // only one tid for now
@@ -1058,7 +1303,7 @@ void material_t::render(shader_t &shader, texture_manager const &tmgr, int defau
 	else if (is_shadow_pass) {
 		bool const has_alpha_mask(tex_id >= 0 && alpha_tid >= 0);
 		if (has_alpha_mask != enable_alpha_mask) return; // incorrect pass
-		if (has_alpha_mask) {tmgr.bind_texture(tex_id);} // enable alpha mask texture
+		if (has_alpha_mask) {if (tmgr.is_tid_ready(tex_id)) {tmgr.bind_texture(tex_id);} else {select_texture(WHITE_TEX);}} // enable alpha mask texture if uploaded
 		geom.render(shader, 1, xlate);
 		geom_tan.render(shader, 1, xlate);
 		if (has_alpha_mask) {select_texture(WHITE_TEX);} // back to a default white texture
@@ -1069,14 +1314,17 @@ void material_t::render(shader_t &shader, texture_manager const &tmgr, int defau
 		if (disable_model_textures) {
 			select_texture(WHITE_TEX);
 		}
-		else if (tex_id >= 0) {
+		else if (tex_id >= 0 && tmgr.is_tid_ready(tex_id)) {
 			tmgr.bind_texture(tex_id);
 			has_binary_alpha = tmgr.has_binary_alpha(tex_id);
 		}
+		else if (tex_id >= 0) { // not yet uploaded; draw untextured for now
+			select_texture(WHITE_TEX);
+		}
 		else {
 			select_texture((default_tid >= 0) ? default_tid : WHITE_TEX); // no texture specified - use white texture
 		}
-		if (use_bump_map()) {
+		if (use_bump_map() && tmgr.is_tid_ready(bump_tid)) {
 			set_active_texture(5);
 			tmgr.bind_texture(bump_tid);
 			set_active_texture(0);
@@ -1084,9 +1332,9 @@ void material_t::render(shader_t &shader, texture_manager const &tmgr, int defau
 		else if (enable_bump_map() && is_bmap_pass) {
 			model3d::bind_default_flat_normal_map(); // use default normal map in this case instead of leaving it unbound, or bound to the previous material
 		}
-		if (enable_spec_map()) { // all white/specular if no specular map texture
-			bind_texture_tu_or_white_tex(tmgr, s_tid,  8); // specular map
-			bind_texture_tu_or_white_tex(tmgr, ns_tid, 9); // gloss map (FIXME: unclear how to interpret map_ns in object files)
+		if (enable_spec_map()) { // all white/specular if no specular map texture or not yet uploaded
+			bind_texture_tu_or_white_tex(tmgr, (tmgr.is_tid_ready(s_tid)  ? s_tid  : -1), 8); // specular map
+			bind_texture_tu_or_white_tex(tmgr, (tmgr.is_tid_ready(ns_tid) ? ns_tid : -1), 9); // gloss map (FIXME: unclear how to interpret map_ns in object files)
 		}
 		if (metalness >= 0.0) {shader.add_uniform_float("metalness", metalness);} // set metalness if specified/valid; may or may not be used
 		bool const set_ref_ix(!disable_shader_effects /*&& alpha < 1.0*/ && ni != 1.0);
@@ -1156,12 +1404,12 @@ bool material_t::write(ostream &out) const {
 }
 
 
-bool material_t::read(istream &in) {
+bool material_t::read(istream &in, bool has_lods) {
 
 	in.read((char *)this, sizeof(material_params_t));
 	read_vector(in, name);
 	read_vector(in, filename);
-	return (geom.read(in) && geom_tan.read(in));
+	return (geom.read(in, has_lods) && geom_tan.read(in, has_lods));
 }
 
 
@@ -1508,8 +1756,15 @@ void model3d::load_all_used_tids() {
 
 	if (textures_loaded) return; // is this safe to skip?
 	tmgr.free_after_upload = no_store_model_textures_in_memory;
-//#pragma omp parallel for schedule(dynamic) // not thread safe due to texture_t::resize() GL calls and reuse of textures across materials
-	for (int i = 0; i < (int)materials.size(); ++i) {materials[i].init_textures(tmgr);}
+	vector<texture_manager::load_req_t> reqs;
+
+	for (auto m = materials.begin(); m != materials.end(); ++m) { // alpha channels must be bound before textures are loaded
+		if (!m->mat_is_used()) continue;
+		tmgr.bind_alpha_channel_to_texture(m->get_render_texture(), m->alpha_tid);
+		m->get_textures_to_load(reqs);
+	}
+	tmgr.ensure_textures_loaded(reqs); // decode in parallel; textures can be shared across materials, so this is done per-texture rather than per-material
+	for (int i = 0; i < (int)materials.size(); ++i) {materials[i].init_textures(tmgr);} // textures are loaded, this only uploads/frees if needed
 	textures_loaded = 1;
 }
 
@@ -1517,11 +1772,26 @@ void model3d::load_all_used_tids() {
 void model3d::bind_all_used_tids() {
 
 	load_all_used_tids();
-		
-	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
+
+	if (mat_bind_order.size() != materials.size()) { // upload textures of the materials with the most surface area first when the upload budget is limited
+		vector<pair<float, unsigned> > mat_areas;
+
+		for (unsigned i = 0; i < materials.size(); ++i) {
+			unsigned tris(0);
+			float area(0.0);
+			materials[i].geom.calc_area(area, tris);
+			materials[i].geom_tan.calc_area(area, tris);
+			mat_areas.push_back(make_pair(-area, i));
+		}
+		sort(mat_areas.begin(), mat_areas.end());
+		mat_bind_order.clear();
+		for (auto i = mat_areas.begin(); i != mat_areas.end(); ++i) {mat_bind_order.push_back(i->second);}
+	}
+	for (auto i = mat_bind_order.begin(); i != mat_bind_order.end(); ++i) {
+		material_t *m(&materials[*i]);
 		if (!m->mat_is_used()) continue;
 		m->check_for_tc_invert_y(tmgr);
-		tmgr.ensure_tid_bound(m->get_render_texture()); // only one tid for now
+		tmgr.try_bind_tid(m->get_render_texture()); // only one tid for now
 		
 		if (m->use_bump_map()) {
 			if (model_calc_tan_vect && !m->geom.empty()) {
@@ -1529,13 +1799,13 @@ void model3d::bind_all_used_tids() {
 				m->bump_tid = -1; // disable bump map
 			}
 			else {
-				tmgr.ensure_tid_bound(m->bump_tid);
+				tmgr.try_bind_tid(m->bump_tid);
 			}
 			needs_bump_maps = 1;
 		}
 		if (m->use_spec_map()) {
-			tmgr.ensure_tid_bound(m->s_tid);
-			tmgr.ensure_tid_bound(m->ns_tid);
+			tmgr.try_bind_tid(m->s_tid);
+			tmgr.try_bind_tid(m->ns_tid);
 			has_spec_maps  |= (m->s_tid  >= 0);
 			has_gloss_maps |= (m->ns_tid >= 0);
 		}
@@ -1559,14 +1829,16 @@ void set_def_spec_map() {
 
 void model3d::render_materials(shader_t &shader, bool is_shadow_pass, int reflection_pass, bool is_z_prepass, bool enable_alpha_mask,
 	unsigned bmap_pass_mask, int trans_op_mask, base_mat_t const &unbound_mat, rotation_t const &rot, point const *const xlate,
-	xform_matrix const *const mvm, bool force_lod, float model_lod_mult, float fixed_lod_dist)
+	xform_matrix const *const mvm, bool force_lod, float model_lod_mult, float fixed_lod_dist, float inst_scale)
 {
 	bool const is_normal_pass(!is_shadow_pass && !is_z_prepass), is_bmap_pass((bmap_pass_mask & 2) != 0);
+	cur_model_inst_scale = inst_scale;
 	if (is_normal_pass) {smap_data[rot].set_for_all_lights(shader, mvm);} // choose correct shadow map based on rotation
 
 	if (group_back_face_cull && reflection_pass != 2) { // okay enable culling if is_shadow_pass on some scenes
 		if (reflection_pass == 1) {glCullFace(GL_FRONT);} // the reflection pass uses a mirror, which changes the winding direction, so we cull the front faces instead
 		glEnable(GL_CULL_FACE);
+		cur_model_backface_cull = (reflection_pass == 0);
 	}
 
 	// render geom that was not bound to a material
@@ -1620,12 +1892,18 @@ void model3d::render_materials(shader_t &shader, bool is_shadow_pass, int reflec
 	if (group_back_face_cull && reflection_pass != 2) { // okay enable culling if is_shadow_pass on some scenes
 		if (reflection_pass == 1) {glCullFace(GL_BACK);} // restore the default
 		glDisable(GL_CULL_FACE);
+		cur_model_backface_cull = 0;
 	}
+	cur_model_inst_scale = 1.0;
 }
 
-void model3d::render_material(shader_t &shader, unsigned mat_id, bool is_shadow_pass, bool is_z_prepass, bool enable_alpha_mask, bool is_bmap_pass, point const *const xlate) {
+void model3d::render_material(shader_t &shader, unsigned mat_id, bool is_shadow_pass, bool is_z_prepass, bool enable_alpha_mask, bool is_bmap_pass,
+	point const *const xlate, float inst_scale)
+{
 	assert(mat_id < materials.size());
+	cur_model_inst_scale = inst_scale;
 	materials[mat_id].render(shader, tmgr, unbound_mat.tid, is_shadow_pass, is_z_prepass, enable_alpha_mask, is_bmap_pass, xlate);
+	cur_model_inst_scale = 1.0;
 }
 
 
@@ -2067,7 +2345,7 @@ bool model3d::write_to_disk(string const &fn) const { // Note: transforms not wr
 		return 0;
 	}
 	cout << "Writing model3d file " << fn << endl;
-	write_uint(out, MAGIC_NUMBER);
+	write_uint(out, MAGIC_NUMBER_LODS);
 	out.write((char const *)&bcube, sizeof(cube_t));
 	if (!unbound_geom.write(out)) return 0;
 	write_uint(out, (unsigned)materials.size());
@@ -2093,18 +2371,19 @@ bool model3d::read_from_disk(string const &fn) { // Note: transforms not read
 	clear(); // ???
 	unsigned const magic_number_comp(read_uint(in));
 
-	if (magic_number_comp != MAGIC_NUMBER) {
+	if (magic_number_comp != MAGIC_NUMBER && magic_number_comp != MAGIC_NUMBER_LODS) {
 		cerr << "Error reading model3d file " << fn << ": Invalid file format (magic number check failed)." << endl;
 		return 0;
 	}
 	cout << "Reading model3d file " << fn << endl;
+	bool const has_lods(magic_number_comp == MAGIC_NUMBER_LODS); // older files have no LODs, which will be generated in finalize() if enabled
 	from_model3d_file = 1;
 	in.read((char *)&bcube, sizeof(cube_t));
-	if (!unbound_geom.read(in)) return 0;
+	if (!unbound_geom.read(in, has_lods)) return 0;
 	materials.resize(read_uint(in));
 	
 	for (deque<material_t>::iterator m = materials.begin(); m != materials.end(); ++m) {
-		if (!m->read(in)) {
+		if (!m->read(in, has_lods)) {
 			cerr << "Error reading material" << endl;
 			return 0;
 		}
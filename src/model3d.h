@@ -239,10 +239,19 @@ template<typename T> class indexed_vntc_vect_t : public vntc_vect_t<T> {
 	struct geom_block_t {
 		unsigned start_ix, num;
 		cube_t bcube;
-		geom_block_t() : start_ix(0), num(0) {}
-		geom_block_t(unsigned s, unsigned n, cube_t const &bc) : start_ix(s), num(n), bcube(bc) {}
+		sphere_t bsphere; // meshlets only
+		vector3d cone_dir; // meshlets only: average normal of all triangles
+		float cone_cutoff; // meshlets only: >= 1.0 disables backface cone culling
+		geom_block_t() : start_ix(0), num(0), cone_dir(zero_vector), cone_cutoff(1.0) {}
+		geom_block_t(unsigned s, unsigned n, cube_t const &bc) : start_ix(s), num(n), bcube(bc), cone_dir(zero_vector), cone_cutoff(1.0) {}
+		bool is_backfacing(point const &camera) const { // all triangles face away from camera
+			if (cone_cutoff >= 1.0) return 0;
+			vector3d const dir(bsphere.pos - camera);
+			return (dot_product(dir, cone_dir) >= cone_cutoff*dir.mag() + bsphere.radius);
+		}
 	};
 	vector<geom_block_t> blocks;
+	bool has_meshlets;
 
 	struct lod_block_t {
 		unsigned start_ix, num;
@@ -252,7 +261,17 @@ template<typename T> class indexed_vntc_vect_t : public vntc_vect_t<T> {
 		unsigned get_end_ix() const {return (start_ix + num);}
 	};
 	vector<lod_block_t> lod_blocks;
+
+	struct qem_lod_t { // one level of simplified triangles, stored in lod_indices
+		unsigned start_ix, num;
+		float max_err; // approximate max distance of the simplified surface from the original
+		qem_lod_t() : start_ix(0), num(0), max_err(0.0) {}
+		qem_lod_t(unsigned s, unsigned n, float e) : start_ix(s), num(n), max_err(e) {}
+	};
+	vector<unsigned> lod_indices; // concatenated indices of all qem_lods, drawn from the same VBO after indices
+	vector<qem_lod_t> qem_lods; // ordered from most to least detailed
 	unsigned get_block_ix(float area) const;
+	void draw_ix_range(int prim_type, unsigned start_ix, unsigned num, unsigned ixn, unsigned ixd) const;
 
 public:
 	using vntc_vect_t<T>::size;
@@ -265,7 +284,7 @@ public:
 	using vntc_vect_t<T>::bcube;
 	using vntc_vect_t<T>::bsphere;
 	
-	indexed_vntc_vect_t(unsigned obj_id_=0) : vntc_vect_t<T>(obj_id_), need_normalize(0), optimized(0), avg_area_per_tri(0.0), amin(0.0), amax(0.0) {}
+	indexed_vntc_vect_t(unsigned obj_id_=0) : vntc_vect_t<T>(obj_id_), need_normalize(0), optimized(0), avg_area_per_tri(0.0), amin(0.0), amax(0.0), has_meshlets(0) {}
 	void calc_tangents(unsigned npts) {assert(0);}
 	void render(shader_t &shader, bool is_shadow_pass, point const *const xlate, unsigned npts, bool no_vfc=0);
 	void reserve_for_num_verts(unsigned num_verts);
@@ -276,8 +295,10 @@ public:
 	void subdiv_recur(vector<unsigned> const &ixs, unsigned npts, unsigned skip_dims, cube_t *bcube_in=nullptr);
 	void optimize(unsigned npts);
 	void gen_lod_blocks(unsigned npts);
+	void gen_meshlets();
+	void gen_qem_lods();
 	void finalize(unsigned npts);
-	void simplify(vector<unsigned> &out, float target) const;
+	float simplify(vector<unsigned> &out, float target) const;
 	void clear();
 	unsigned num_verts() const {return unsigned(indices.empty() ? size() : indices.size());}
 	T       &get_vert(unsigned i)       {return (*this)[indices.empty() ? i : indices[i]];}
@@ -288,7 +309,7 @@ public:
 	void get_polygons(get_polygon_args_t &args, unsigned npts) const;
 	void invert_tcy();
 	void write(ostream &out) const;
-	void read(istream &in);
+	void read(istream &in, bool has_lods);
 	bool indexing_enabled() const {return !indices.empty();}
 	void mark_need_normalize() {need_normalize = 1;}
 };
@@ -311,7 +332,7 @@ template<typename T> struct vntc_vect_block_t : public deque<indexed_vntc_vect_t
 	void get_polygons(get_polygon_args_t &args, unsigned npts) const;
 	void invert_tcy();
 	bool write(ostream &out) const;
-	bool read(istream &in);
+	bool read(istream &in, bool has_lods);
 };
 
 
@@ -335,7 +356,7 @@ template<typename T> struct geometry_t {
 	void get_stats(model3d_stats_t &stats) const;
 	void calc_area(float &area, unsigned &ntris);
 	bool write(ostream &out) const {return (triangles.write(out) && quads.write(out));}
-	bool read(istream &in)         {return (triangles.read (in ) && quads.read (in ));}
+	bool read(istream &in, bool has_lods) {return (triangles.read(in, has_lods) && quads.read(in, has_lods));}
 };
 
 
@@ -348,15 +369,26 @@ protected:
 public:
 	bool free_after_upload;
 
+	struct load_req_t {
+		int tid;
+		bool is_bump;
+		load_req_t(int tid_, bool is_bump_) : tid(tid_), is_bump(is_bump_) {}
+	};
+
 	texture_manager() : free_after_upload(0) {}
 	unsigned create_texture(string const &fn, bool is_alpha_mask, bool verbose, bool invert_alpha=0, bool wrap=1, bool mirror=0, bool force_grayscale=0);
 	void clear();
 	void free_tids();
 	void free_textures();
+	void prepare_texture_load(texture_t &t) const;
+	void finish_texture_load(texture_t &t, bool is_bump);
 	bool ensure_texture_loaded(texture_t &t, int tid, bool is_bump);
+	void ensure_textures_loaded(vector<load_req_t> const &reqs);
 	void bind_alpha_channel_to_texture(int tid, int alpha_tid);
 	bool ensure_tid_loaded(int tid, bool is_bump) {return ((tid >= 0) ? ensure_texture_loaded(get_texture(tid), tid, is_bump) : 0);}
 	void ensure_tid_bound(int tid) {if (tid >= 0) {get_texture(tid).check_init(free_after_upload);}} // if allocated
+	bool try_bind_tid(int tid);
+	bool is_tid_ready(int tid) const {return (tid < 0 || get_texture(tid).is_bound());} // uploaded to the GPU (or no texture)
 	void bind_texture(int tid) const {get_texture(tid).bind_gl();}
 	colorRGBA get_tex_avg_color(int tid) const {return get_texture(tid).get_avg_color();}
 	bool has_binary_alpha(int tid) const {return get_texture(tid).has_binary_alpha;}
@@ -403,13 +435,14 @@ struct material_t : public material_params_t {
 	bool is_partial_transparent() const {return (alpha < 1.0 || get_needs_alpha_test());}
 	void compute_area_per_tri();
 	void ensure_textures_loaded(texture_manager &tmgr);
+	void get_textures_to_load(vector<texture_manager::load_req_t> &reqs) const;
 	void init_textures(texture_manager &tmgr);
 	void check_for_tc_invert_y(texture_manager &tmgr);
 	void render(shader_t &shader, texture_manager const &tmgr, int default_tid, bool is_shadow_pass, bool is_z_prepass, bool enable_alpha_mask, bool is_bmap_pass, point const *const xlate);
 	colorRGBA get_ad_color() const;
 	colorRGBA get_avg_color(texture_manager const &tmgr, int default_tid=-1) const;
 	bool write(ostream &out) const;
-	bool read(istream &in);
+	bool read(istream &in, bool has_lods);
 };
 
 
@@ -439,6 +472,7 @@ class model3d {
 	set<string> undef_materials; // to reduce warning messages
 	cobj_tree_tquads_t coll_tree;
 	bool textures_loaded;
+	vector<unsigned> mat_bind_order; // materials sorted by decreasing surface area, used to prioritize texture uploads
 
 	// transforms
 	vector<model3d_xform_t> transforms;
@@ -515,8 +549,9 @@ public:
 	}
 	void render_materials(shader_t &shader, bool is_shadow_pass, int reflection_pass, bool is_z_prepass, bool enable_alpha_mask, unsigned bmap_pass_mask,
 		int trans_op_mask, base_mat_t const &unbound_mat, rotation_t const &rot, point const *const xlate=nullptr, xform_matrix const *const mvm=nullptr,
-		bool force_lod=0, float model_lod_mult=1.0, float fixed_lod_dist=0.0);
-	void render_material(shader_t &shader, unsigned mat_id, bool is_shadow_pass, bool is_z_prepass=0, bool enable_alpha_mask=0, bool is_bmap_pass=0, point const *const xlate=nullptr);
+		bool force_lod=0, float model_lod_mult=1.0, float fixed_lod_dist=0.0, float inst_scale=1.0);
+	void render_material(shader_t &shader, unsigned mat_id, bool is_shadow_pass, bool is_z_prepass=0, bool enable_alpha_mask=0, bool is_bmap_pass=0,
+		point const *const xlate=nullptr, float inst_scale=1.0);
 	void render_with_xform(shader_t &shader, model3d_xform_t &xf, xform_matrix const &mvm, bool is_shadow_pass,
 		int reflection_pass, bool is_z_prepass, bool enable_alpha_mask, unsigned bmap_pass_mask, int reflect_mode, int trans_op_mask);
 	void render(shader_t &shader, bool is_shadow_pass, int reflection_pass, bool is_z_prepass, bool enable_alpha_mask,
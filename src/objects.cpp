@@ -10,9 +10,13 @@
 #include "collision_detect.h"
 #include "shaders.h"
 #include "subdiv.h"
+#include <cfloat> // for FLT_MAX
 
 
 float const NDIV_SCALE = 200.0;
+unsigned const OBJ_GRID_MIN_OBJS   = 64; // groups with fewer enabled objects than this are searched linearly
+unsigned const OBJS_PER_GRID_BIN   = 4;
+unsigned const MAX_OBJ_GRID_SZ     = 128;
 
 
 extern bool group_back_face_cull, has_any_billboard_coll, begin_motion;
@@ -23,6 +27,7 @@ extern unsigned ALL_LT[];
 extern obj_type object_types[];
 extern dwobject def_objects[];
 extern vector<texture_t> textures;
+extern vector<int> billboard_coll_hits;
 extern coll_obj_group coll_objects;
 extern platform_cont platforms;
 extern vector<obj_draw_group> obj_draw_groups;
@@ -364,6 +369,7 @@ void coll_obj::register_coll(unsigned char coll_time, unsigned char coll_type_)
 	last_coll = coll_time;
 	coll_type = coll_type_;
 	has_any_billboard_coll |= is_billboard; // set global state
+	if (is_billboard && id >= 0 && (billboard_coll_hits.empty() || billboard_coll_hits.back() != id)) {billboard_coll_hits.push_back(id);} // processed by the tree that owns this leaf; skip repeated hits
 }
 
 void coll_obj::check_indoors_outdoors() {
@@ -938,6 +944,8 @@ void obj_group::update_app_rate(float const val, unsigned min_app, unsigned max_
 
 void obj_group::init_group() {
 
+	grid.invalidate();
+
 	for (unsigned j = 0; j < max_objects(); ++j) {
 		objects[j] = def_objects[type];
 		if (j < init_objects) {gen_object_pos(objects[j].pos, object_types[type].flags);}
@@ -962,6 +970,7 @@ void obj_group::preproc_this_frame() {
 	unsigned const max_used_id(min(nobjs, max(end_id, init_objects+1))); // one past the end
 	end_id = nobjs; // likely will be reset to a smaller value below
 	new_id = 0;
+	grid.invalidate(); // objects may be reordered and will be moved
 	if (!enabled) return;
 
 	if (reorderable && begin_motion) { // some objects such as smileys are position dependent
@@ -1010,6 +1019,7 @@ void obj_group::create_object_at(unsigned i, point const &pos) {
 	if (objects[i].coll_id >= 0) {remove_reset_coll_obj(objects[i].coll_id);} // just in case
 	objects[i]     = def_objects[type];
 	objects[i].pos = pos;
+	grid.invalidate();
 }
 
 
@@ -1017,6 +1027,7 @@ int obj_group::choose_object(bool peek)  { // could return unsigned?
 	
 	enable();
 	assert(max_objects() > 0); // enabled == 1 should be true after before the object is used
+	if (!peek) {grid.invalidate();} // caller will place a new object
 	if (!reorderable) return objects.choose_element(peek);
 	assert(!peek);
 	// Note: To guarantee correctness, the times of all objects should be updated by a constant amount per frame
@@ -1070,6 +1081,7 @@ void obj_group::enable() {
 	}
 	end_id  = 0;
 	enabled = 1;
+	grid.invalidate();
 }
 
 
@@ -1083,6 +1095,7 @@ void obj_group::disable() {
 	for (vector<predef_obj>::iterator i = predef_objs.begin(); i != predef_objs.end(); ++i) {i->obj_used = -1;}
 	end_id  = 0;
 	enabled = 0;
+	grid.invalidate();
 }
 
 
@@ -1097,6 +1110,7 @@ void obj_group::free_objects() {
 void obj_group::shift(vector3d const &vd) {
 
 	if (!enabled) return;
+	grid.invalidate();
 
 	for (unsigned j = 0; j < max_objects(); ++j) {
 		if (!objects[j].disabled()) {
@@ -1116,6 +1130,90 @@ bool obj_group::obj_within_dist(unsigned i, point const &pos, float dist) const
 	return (p2p_dist_sq(objects[i].pos, pos) < dist*dist);
 }
 
+// returns the indices of enabled objects within dist of pos in increasing order, the same as iterating over [0, end_id)
+void obj_group::get_objs_within_dist(point const &pos, float dist, vector<unsigned> &ixs) const {
+
+	ixs.clear();
+	if (!enabled) return;
+
+	if (grid.is_valid()) {
+		grid.get_candidates(pos, dist, ixs);
+		sort(ixs.begin(), ixs.end());
+		unsigned num(0);
+
+		for (auto i = ixs.begin(); i != ixs.end(); ++i) {
+			if (*i < end_id && obj_within_dist(*i, pos, dist)) {ixs[num++] = *i;}
+		}
+		ixs.resize(num);
+	}
+	else {
+		for (unsigned i = 0; i < end_id; ++i) {
+			if (obj_within_dist(i, pos, dist)) {ixs.push_back(i);}
+		}
+	}
+}
+
+// called after objects have been advanced for this frame; any later change to object positions or indices must invalidate the grid
+void obj_group::build_obj_grid() {
+
+	if (enabled) {grid.build(objects, end_id);} else {grid.invalidate();}
+}
+
+
+// ******************* OBJ_GRID_T MEMBERS ******************
+
+
+void obj_grid_t::build(vector<dwobject> const &objects, unsigned end_id) {
+
+	assert(end_id <= objects.size());
+	valid = 0;
+	float xmin(FLT_MAX), ymin(FLT_MAX), xmax(-FLT_MAX), ymax(-FLT_MAX);
+	unsigned num(0);
+
+	for (unsigned i = 0; i < end_id; ++i) {
+		if (objects[i].disabled()) continue;
+		point const &p(objects[i].pos);
+		xmin = min(xmin, p.x); xmax = max(xmax, p.x);
+		ymin = min(ymin, p.y); ymax = max(ymax, p.y);
+		++num;
+	}
+	if (num < OBJ_GRID_MIN_OBJS) return; // linear search is fast enough
+	nx = ny = max(1U, min(MAX_OBJ_GRID_SZ, unsigned(sqrt(float(num)/OBJS_PER_GRID_BIN))));
+	x0 = xmin;
+	y0 = ymin;
+	dx_inv = nx/max((xmax - xmin), TOLERANCE);
+	dy_inv = ny/max((ymax - ymin), TOLERANCE);
+	unsigned const nbins(nx*ny);
+	bin_start.resize(nbins+1);
+	for (unsigned b = 0; b <= nbins; ++b) {bin_start[b] = 0;}
+
+	for (unsigned i = 0; i < end_id; ++i) { // count objects per bin
+		if (!objects[i].disabled()) {++bin_start[get_bin_y(objects[i].pos.y)*nx + get_bin_x(objects[i].pos.x)];}
+	}
+	for (unsigned b = 1; b < nbins; ++b) {bin_start[b] += bin_start[b-1];} // bin_start[b] is now the end of bin b
+	bin_start[nbins] = num;
+	ixs.resize(num);
+
+	for (unsigned i = end_id; i-- > 0;) { // fill in reverse so that each bin ends up sorted and bin_start[b] becomes the start of bin b
+		if (!objects[i].disabled()) {ixs[--bin_start[get_bin_y(objects[i].pos.y)*nx + get_bin_x(objects[i].pos.x)]] = i;}
+	}
+	valid = 1;
+}
+
+// appends the indices of all objects in bins overlapping the XY square of half width dist around pos; objects outside the grid are in the edge bins
+void obj_grid_t::get_candidates(point const &pos, float dist, vector<unsigned> &cands) const {
+
+	assert(valid);
+	unsigned const x1(get_bin_x(pos.x - dist)), x2(get_bin_x(pos.x + dist)), y1(get_bin_y(pos.y - dist)), y2(get_bin_y(pos.y + dist));
+
+	for (unsigned y = y1; y <= y2; ++y) {
+		for (unsigned x = x1; x <= x2; ++x) {
+			unsigned const bin(y*nx + x);
+			cands.insert(cands.end(), (ixs.begin() + bin_start[bin]), (ixs.begin() + bin_start[bin+1]));
+		}
+	}
+}
+
 bool obj_group::temperature_ok() const {
 	return ((flags & PRECIPITATION) || type == PRECIP || (temperature >= object_types[type].min_t && temperature < object_types[type].max_t));
 }
@@ -0,0 +1,256 @@
+// 3D World - Software Occlusion Culling with a CPU Hierarchical Depth Buffer
+// by Frank Gennari
+// 10/18/26
+
+#include "function_registry.h"
+#include <cfloat> // for FLT_MAX
+
+
+unsigned const SW_ZBUF_XSIZE     = 256; // in pixels; ysize is computed from the aspect ratio
+unsigned const SW_ZBUF_TILE_BITS = 3;   // 8x8 pixel tiles in the coarse level
+unsigned const SW_ZBUF_TILE_SZ   = (1 << SW_ZBUF_TILE_BITS);
+unsigned const MAX_SW_OCCLUDERS  = 1024;
+float    const MIN_OCCLUDER_SCREEN_AREA = 4.0; // in pixels
+
+
+bool use_sw_occlusion_zbuf(0);
+
+extern int display_mode, frame_counter;
+
+
+// Note: all depths are linear distances along the view dir; FLT_MAX = no occluder
+class sw_occlusion_zbuf_t {
+
+	struct screen_pt_t {
+		float x, y;
+		screen_pt_t() : x(0.0), y(0.0) {}
+		screen_pt_t(float x_, float y_) : x(x_), y(y_) {}
+	};
+	struct occ_poly_t { // convex screen space polygon with constant (farthest) depth
+		unsigned npts;
+		float depth;
+		int x1, y1, x2, y2; // pixel bounds, inclusive
+		screen_pt_t pts[8];
+		occ_poly_t() : npts(0), depth(0.0), x1(0), y1(0), x2(0), y2(0) {}
+	};
+
+	unsigned xsize, ysize, tx, ty;
+	int built_frame;
+	pos_dir_up pdu;
+	float xscale, yscale; // world => pixel projection terms
+	vector<float> zbuf, tile_zmax; // full res and coarse (max depth per tile) levels
+	vector<occ_poly_t> polys;
+
+	bool project_pt(point const &p, screen_pt_t &sp, float &depth) const {
+		vector3d const v(p - pdu.pos);
+		depth = dot_product(v, pdu.dir);
+		if (depth < pdu.near_) return 0; // behind or too close to the near clip plane
+		float const inv_depth(1.0/depth);
+		sp.x = (0.5 + xscale*dot_product(v, pdu.cp  )*inv_depth)*xsize;
+		sp.y = (0.5 + yscale*dot_product(v, pdu.upv_)*inv_depth)*ysize;
+		return 1;
+	}
+	bool add_poly(screen_pt_t const *const pts, unsigned npts, float depth) {
+		assert(npts >= 3 && npts <= 8);
+		occ_poly_t poly;
+		float xmin(FLT_MAX), ymin(FLT_MAX), xmax(-FLT_MAX), ymax(-FLT_MAX), area(0.0);
+
+		for (unsigned i = 0; i < npts; ++i) {
+			screen_pt_t const &a(pts[i]), &b(pts[(i+1)%npts]);
+			area += a.x*b.y - b.x*a.y;
+			xmin = min(xmin, a.x); xmax = max(xmax, a.x);
+			ymin = min(ymin, a.y); ymax = max(ymax, a.y);
+			poly.pts[i] = a;
+		}
+		if (fabs(0.5*area) < MIN_OCCLUDER_SCREEN_AREA) return 0; // too small to occlude anything
+		if (area < 0.0) {std::reverse(poly.pts, poly.pts+npts);} // make CCW
+		poly.npts  = npts;
+		poly.depth = depth;
+		poly.x1 = max(0, int(floor(xmin))); poly.x2 = min(int(xsize)-1, int(ceil(xmax)));
+		poly.y1 = max(0, int(floor(ymin))); poly.y2 = min(int(ysize)-1, int(ceil(ymax)));
+		if (poly.x1 > poly.x2 || poly.y1 > poly.y2) return 0; // off screen
+		polys.push_back(poly);
+		return 1;
+	}
+	void add_cube(cube_t const &c) {
+		if (c.contains_pt(pdu.pos)) return; // camera inside occluder
+		point corners[8];
+		screen_pt_t spts[8];
+		float depths[8], max_depth(0.0);
+
+		for (unsigned i = 0; i < 8; ++i) {
+			corners[i].assign(c.d[0][i&1], c.d[1][(i>>1)&1], c.d[2][i>>2]);
+			if (!project_pt(corners[i], spts[i], depths[i])) return; // clipped by the near plane - skip rather than clip
+			max_depth = max(max_depth, depths[i]);
+		}
+		// rasterize each front face with its own farthest depth
+		for (unsigned dim = 0; dim < 3; ++dim) {
+			unsigned const d1((dim+1)%3), d2((dim+2)%3);
+
+			for (unsigned dir = 0; dir < 2; ++dir) {
+				if (dir ? (pdu.pos[dim] <= c.d[dim][1]) : (pdu.pos[dim] >= c.d[dim][0])) continue; // back face
+				unsigned const ixs[4][2] = {{0,0}, {1,0}, {1,1}, {0,1}};
+				screen_pt_t face_pts[4];
+				float face_depth(0.0);
+
+				for (unsigned n = 0; n < 4; ++n) {
+					unsigned ix((dir << dim) | (ixs[n][0] << d1) | (ixs[n][1] << d2));
+					face_pts[n] = spts[ix];
+					face_depth  = max(face_depth, depths[ix]);
+				}
+				add_poly(face_pts, 4, face_depth);
+			} // for dir
+		} // for dim
+		// fill in the gaps between faces that the conservative rasterizer leaves along shared edges using the silhouette at the farthest depth
+		screen_pt_t hull[8];
+		unsigned const nhull(calc_convex_hull(spts, 8, hull));
+		if (nhull >= 3) {add_poly(hull, nhull, max_depth);}
+	}
+	static float cross2d(screen_pt_t const &o, screen_pt_t const &a, screen_pt_t const &b) {return ((a.x - o.x)*(b.y - o.y) - (a.y - o.y)*(b.x - o.x));}
+	static bool pt_less(screen_pt_t const &a, screen_pt_t const &b) {return ((a.x < b.x) || (a.x == b.x && a.y < b.y));}
+
+	static unsigned calc_convex_hull(screen_pt_t const *const pts, unsigned npts, screen_pt_t *hull) { // monotone chain; npts <= 8
+		screen_pt_t sorted[8], h[16];
+		for (unsigned i = 0; i < npts; ++i) {sorted[i] = pts[i];}
+		std::sort(sorted, sorted+npts, pt_less);
+		unsigned k(0);
+
+		for (unsigned i = 0; i < npts; ++i) { // lower hull
+			while (k >= 2 && cross2d(h[k-2], h[k-1], sorted[i]) <= 0.0) {--k;}
+			h[k++] = sorted[i];
+		}
+		for (int i = int(npts)-2, t = k+1; i >= 0; --i) { // upper hull
+			while ((int)k >= t && cross2d(h[k-2], h[k-1], sorted[i]) <= 0.0) {--k;}
+			h[k++] = sorted[i];
+		}
+		unsigned const nhull((k > 1) ? k-1 : k); // last point is the same as the first
+		if (nhull > 8) return 0; // should never get here
+		for (unsigned i = 0; i < nhull; ++i) {hull[i] = h[i];}
+		return nhull;
+	}
+
+	// inner conservative rasterization: a pixel is only written if the polygon covers all of it
+	void raster_poly_rows(occ_poly_t const &poly, int y1, int y2) {
+		y1 = max(y1, poly.y1); y2 = min(y2, poly.y2);
+		if (y1 > y2) return;
+		float ea[8], eb[8], ec[8];
+
+		for (unsigned i = 0; i < poly.npts; ++i) { // edge functions: e(x,y) = a*x + b*y + c >= 0 inside
+			screen_pt_t const &p1(poly.pts[i]), &p2(poly.pts[(i+1)%poly.npts]);
+			ea[i] = p1.y - p2.y;
+			eb[i] = p2.x - p1.x;
+			ec[i] = p1.x*p2.y - p2.x*p1.y - 0.5f*(fabs(ea[i]) + fabs(eb[i])); // offset by the pixel half extent projected onto the edge normal
+		}
+		for (int y = y1; y <= y2; ++y) {
+			float const yc(y + 0.5f);
+			float *const row(&zbuf[y*xsize]);
+
+			for (int x = poly.x1; x <= poly.x2; ++x) {
+				float const xc(x + 0.5f);
+				bool inside(1);
+				for (unsigned i = 0; i < poly.npts && inside; ++i) {inside = (ea[i]*xc + eb[i]*yc + ec[i] >= 0.0f);}
+				if (inside) {row[x] = min(row[x], poly.depth);}
+			}
+		}
+	}
+
+public:
+	sw_occlusion_zbuf_t() : xsize(0), ysize(0), tx(0), ty(0), built_frame(-1), xscale(0.0), yscale(0.0) {}
+	void invalidate() {built_frame = -1;}
+
+	void build(pos_dir_up const &pdu_, vector<cube_t> const &occluders) {
+		invalidate();
+		if (!pdu_.valid || occluders.empty()) return;
+		pdu    = pdu_;
+		xsize  = SW_ZBUF_XSIZE;
+		ysize  = max(SW_ZBUF_TILE_SZ, (unsigned(xsize/pdu.A) + SW_ZBUF_TILE_SZ-1) & ~(SW_ZBUF_TILE_SZ-1)); // round up to a multiple of the tile size
+		tx     = xsize >> SW_ZBUF_TILE_BITS;
+		ty     = ysize >> SW_ZBUF_TILE_BITS;
+		yscale = 0.5/pdu.tterm;
+		xscale = yscale/pdu.A;
+		polys.clear();
+		for (auto i = occluders.begin(); i != occluders.end(); ++i) {add_cube(*i);}
+		if (polys.empty()) return;
+		zbuf.resize(xsize*ysize);
+		tile_zmax.resize(tx*ty);
+
+		// each thread owns a band of tile rows, so polygons can be rasterized without synchronization
+#pragma omp parallel for schedule(dynamic,1)
+		for (int t = 0; t < (int)ty; ++t) {
+			int const y1(t*SW_ZBUF_TILE_SZ), y2(y1 + SW_ZBUF_TILE_SZ - 1);
+			std::fill(zbuf.begin()+y1*xsize, zbuf.begin()+(y2+1)*xsize, FLT_MAX);
+			for (auto p = polys.begin(); p != polys.end(); ++p) {raster_poly_rows(*p, y1, y2);}
+
+			for (unsigned x = 0; x < tx; ++x) { // build the coarse level
+				float zmax(0.0);
+
+				for (int y = y1; y <= y2; ++y) {
+					float const *const row(&zbuf[y*xsize + (x << SW_ZBUF_TILE_BITS)]);
+					for (unsigned n = 0; n < SW_ZBUF_TILE_SZ; ++n) {zmax = max(zmax, row[n]);}
+				}
+				tile_zmax[t*tx + x] = zmax;
+			}
+		} // for t
+		built_frame = frame_counter;
+	}
+
+	bool is_cube_occluded(cube_t const &c, point const &viewer) const {
+		if (built_frame != frame_counter || viewer != pdu.pos || c.contains_pt(viewer)) return 0; // not built for this view
+		float xmin(FLT_MAX), ymin(FLT_MAX), xmax(-FLT_MAX), ymax(-FLT_MAX), min_depth(FLT_MAX);
+
+		for (unsigned i = 0; i < 8; ++i) {
+			point const corner(c.d[0][i&1], c.d[1][(i>>1)&1], c.d[2][i>>2]);
+			screen_pt_t sp;
+			float depth;
+			if (!project_pt(corner, sp, depth)) return 0; // crosses the near plane
+			xmin = min(xmin, sp.x); xmax = max(xmax, sp.x);
+			ymin = min(ymin, sp.y); ymax = max(ymax, sp.y);
+			min_depth = min(min_depth, depth);
+		}
+		int const x1(max(0, int(floor(xmin)))), x2(min(int(xsize)-1, int(floor(xmax))));
+		int const y1(max(0, int(floor(ymin)))), y2(min(int(ysize)-1, int(floor(ymax))));
+		if (x1 > x2 || y1 > y2) return 0; // off screen - leave this to VFC
+		bool coarse_occluded(1);
+
+		for (int y = (y1 >> SW_ZBUF_TILE_BITS); y <= (y2 >> SW_ZBUF_TILE_BITS) && coarse_occluded; ++y) { // coarse level test
+			for (int x = (x1 >> SW_ZBUF_TILE_BITS); x <= (x2 >> SW_ZBUF_TILE_BITS); ++x) {
+				if (tile_zmax[y*tx + x] >= min_depth) {coarse_occluded = 0; break;}
+			}
+		}
+		if (coarse_occluded) return 1;
+
+		for (int y = y1; y <= y2; ++y) { // full res test
+			float const *const row(&zbuf[y*xsize]);
+			for (int x = x1; x <= x2; ++x) {if (row[x] >= min_depth) return 0;}
+		}
+		return 1;
+	}
+}; // sw_occlusion_zbuf_t
+
+sw_occlusion_zbuf_t sw_occlusion_zbuf;
+
+
+bool sw_occlusion_zbuf_enabled() {return (use_sw_occlusion_zbuf && (display_mode & 0x08));}
+
+void build_sw_occlusion_zbuf(pos_dir_up const &pdu, vector<cube_t> &occluders) { // Note: may reorder occluders
+
+	if (!sw_occlusion_zbuf_enabled()) {sw_occlusion_zbuf.invalidate(); return;}
+
+	if (occluders.size() > MAX_SW_OCCLUDERS) { // keep the occluders with the largest (approximate) projected area
+		vector<pair<float, unsigned>> weights(occluders.size());
+
+		for (unsigned i = 0; i < occluders.size(); ++i) {
+			cube_t const &c(occluders[i]);
+			float const area(c.dx()*c.dy() + c.dx()*c.dz() + c.dy()*c.dz());
+			weights[i] = make_pair(-area/max(p2p_dist_sq(pdu.pos, c.get_cube_center()), TOLERANCE), i); // sort largest first
+		}
+		std::nth_element(weights.begin(), weights.begin()+MAX_SW_OCCLUDERS, weights.end());
+		vector<cube_t> best(MAX_SW_OCCLUDERS);
+		for (unsigned i = 0; i < MAX_SW_OCCLUDERS; ++i) {best[i] = occluders[weights[i].second];}
+		occluders.swap(best);
+	}
+	sw_occlusion_zbuf.build(pdu, occluders);
+}
+
+bool sw_zbuf_cube_occluded(cube_t const &c, point const &viewer) {return sw_occlusion_zbuf.is_cube_occluded(c, viewer);}
+
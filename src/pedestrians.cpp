@@ -647,11 +647,19 @@ void ped_manager_t::init(unsigned num) {
 	}
 	cout << "Pedestrians: " << peds.size() << endl; // testing
 	sort_by_city_and_plot();
+	update_soa();
 }
 
-struct ped_by_plot {
-	bool operator()(pedestrian_t const &a, pedestrian_t const &b) const {return (a.plot < b.plot);}
-};
+void ped_manager_t::update_soa() {
+	soa.resize(peds.size());
+
+	for (unsigned i = 0; i < peds.size(); ++i) {
+		pedestrian_t const &ped(peds[i]);
+		cube_t bc; bc.set_from_sphere(ped.pos, ped.radius);
+		uint32_t const state((ped.is_stopped ? agent_soa_t::STATE_STOPPED : 0) | (ped.in_the_road ? agent_soa_t::STATE_IN_ROAD : 0) | (ped.destroyed ? agent_soa_t::STATE_DESTROYED : 0));
+		soa.set(i, bc, ped.vel, ped.speed, ped.ssn, state);
+	}
+}
 
 void ped_manager_t::sort_by_city_and_plot() {
 	//timer_t timer("Ped Sort"); // 0.12ms
@@ -659,7 +667,9 @@ void ped_manager_t::sort_by_city_and_plot() {
 	bool const first_sort(by_city.empty()); // since peds can't yet move between cities, we only need to sorty by city the first time
 
 	if (first_sort) { // construct by_city
-		sort(peds.begin(), peds.end());
+		sort_keys.resize(peds.size());
+		for (unsigned i = 0; i < peds.size(); ++i) {sort_keys[i] = agent_sort_key_t(((uint64_t(peds[i].city) << 32) | peds[i].plot), i);} // same order as pedestrian_t::operator<
+		sort_agents_by_keys(peds, 0, sort_keys, peds_temp);
 		unsigned const max_city(peds.back().city), max_plot(peds.back().plot);
 		by_city.resize(max_city + 2); // one per city + terminator
 		need_to_sort_city.resize(max_city+1, 0);
@@ -674,7 +684,10 @@ void ped_manager_t::sort_by_city_and_plot() {
 		for (unsigned city = 0; city+1 < by_city.size(); ++city) {
 			if (!need_to_sort_city[city]) continue;
 			need_to_sort_city[city] = 0;
-			sort((peds.begin() + by_plot[by_city[city].plot_ix]), (peds.begin() + by_plot[by_city[city+1].plot_ix]), ped_by_plot());
+			unsigned const ped_start(by_plot[by_city[city].plot_ix]), ped_end(by_plot[by_city[city+1].plot_ix]);
+			sort_keys.clear();
+			for (unsigned i = ped_start; i < ped_end; ++i) {sort_keys.emplace_back(peds[i].plot, i);}
+			sort_agents_by_keys(peds, ped_start, sort_keys, peds_temp);
 		}
 	}
 	// construct by_plot
@@ -700,9 +713,11 @@ bool ped_manager_t::proc_sphere_coll(point &pos, float radius, vector3d *cnorm)
 			cube_t const plot_bcube(get_expanded_city_plot_bcube_for_peds(city, plot));
 			if (!sphere_cube_intersect_xy(pos, radius, plot_bcube)) continue;
 			unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
+			cube_t sphere_bc; sphere_bc.set_from_sphere(pos, radius);
+			vector<unsigned> ixs;
+			soa.get_ixs_intersecting_cube(sphere_bc, ped_start, ped_end, ixs);
 
-			for (unsigned i = ped_start; i < ped_end; ++i) { // peds iteration
-				assert(i < peds.size());
+			for (unsigned i : ixs) { // peds iteration
 				if (!dist_less_than(pos, peds[i].pos, rsum)) continue;
 				if (cnorm) {*cnorm = (pos - peds[i].pos).get_norm();}
 				return 1; // return on first coll
@@ -721,9 +736,10 @@ bool ped_manager_t::line_intersect_peds(point const &p1, point const &p2, float
 		for (unsigned plot = by_city[city].plot_ix; plot < by_city[city+1].plot_ix; ++plot) {
 			if (!get_expanded_city_plot_bcube_for_peds(city, plot).line_intersects(p1, p2)) continue;
 			unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
+			vector<unsigned> ixs;
+			soa.get_ixs_intersecting_cube(cube_t(p1, p2), ped_start, ped_end, ixs);
 
-			for (unsigned i = ped_start; i < ped_end; ++i) { // peds iteration
-				assert(i < peds.size());
+			for (unsigned i : ixs) { // peds iteration
 				float tmin(0.0);
 				if (line_sphere_int_closest_pt_t(p1, p2, peds[i].pos, peds[i].radius, tmin) && tmin < t) {t = tmin; ret = 1;}
 			}
@@ -746,9 +762,11 @@ void ped_manager_t::destroy_peds_in_radius(point const &pos_in, float radius) {
 			cube_t const plot_bcube(get_expanded_city_plot_bcube_for_peds(city, plot));
 			if (is_pt ? !plot_bcube.contains_pt_xy(pos) : !sphere_cube_intersect_xy(pos, radius, plot_bcube)) continue;
 			unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
+			cube_t sphere_bc; sphere_bc.set_from_sphere(pos, radius);
+			vector<unsigned> ixs;
+			soa.get_ixs_intersecting_cube(sphere_bc, ped_start, ped_end, ixs);
 
-			for (unsigned i = ped_start; i < ped_end; ++i) { // peds iteration
-				assert(i < peds.size());
+			for (unsigned i : ixs) { // peds iteration
 				if (!dist_less_than(pos, peds[i].pos, rsum)) continue;
 				peds[i].destroy();
 				ped_destroyed = 1;
@@ -789,6 +807,7 @@ void ped_manager_t::next_frame() {
 	}
 	for (auto i = peds.begin(); i != peds.end(); ++i) {i->next_frame(*this, peds, (i - peds.begin()), rgen, delta_dir);}
 	if (need_to_sort_peds) {sort_by_city_and_plot();}
+	update_soa(); // for queries until the next frame
 	first_frame = 0;
 }
 
@@ -799,9 +818,10 @@ pedestrian_t const *ped_manager_t::get_ped_at(point const &p1, point const &p2)
 		for (unsigned plot = by_city[city].plot_ix; plot < by_city[city+1].plot_ix; ++plot) {
 			if (!get_expanded_city_plot_bcube_for_peds(city, plot).line_intersects(p1, p2)) continue; // skip
 			unsigned const ped_start(by_plot[plot]), ped_end(by_plot[plot+1]);
+			vector<unsigned> ixs;
+			soa.get_ixs_intersecting_cube(cube_t(p1, p2), ped_start, ped_end, ixs);
 
-			for (unsigned i = ped_start; i < ped_end; ++i) { // peds iteration
-				assert(i < peds.size());
+			for (unsigned i : ixs) { // peds iteration
 				if (line_sphere_intersect(p1, p2, peds[i].pos, peds[i].radius)) {return &peds[i];}
 			}
 		} // for plot
@@ -813,11 +833,11 @@ void ped_manager_t::get_peds_crossing_roads(ped_city_vect_t &pcv) const {
 	//timer_t timer("Get Peds Corssing Roads");
 	pcv.clear();
 
-	for (auto i = peds.begin(); i != peds.end(); ++i) {
-		if (!i->in_the_road || i->is_stopped) continue; // not actively crossing the road
-		bool const road_dim(fabs(i->vel.y) < fabs(i->vel.x)); // ped should be moving across the road, so velocity should give us the road dim (opposite of velocity dim)
-		int const road_ix(get_road_ix_for_ped_crossing(*i, road_dim));
-		if (road_ix >= 0) {pcv.add_ped(*i, road_ix);}
+	for (unsigned i = 0; i < soa.size(); ++i) { // scan the state bits and only touch peds in the road
+		if (!soa.has_state(i, agent_soa_t::STATE_IN_ROAD) || soa.has_state(i, agent_soa_t::STATE_STOPPED)) continue; // not actively crossing the road
+		bool const road_dim(fabs(soa.vy[i]) < fabs(soa.vx[i])); // ped should be moving across the road, so velocity should give us the road dim (opposite of velocity dim)
+		int const road_ix(get_road_ix_for_ped_crossing(peds[i], road_dim));
+		if (road_ix >= 0) {pcv.add_ped(peds[i], road_ix);}
 	} // for i
 }
 
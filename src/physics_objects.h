@@ -199,6 +199,8 @@ struct dwobject : public basic_physics_obj { // size = 67(68) (dynamic world obj
 	float get_true_density() const;
 	float get_true_mass() const;
 	void advance_object(bool disable_motionless_objects, int iter, int obj_index);
+	void integrate_airborne(int iter, float radius, float friction, bool coll_last_frame);
+	bool try_advance_free_flight(point const &pred_pos, vector<unsigned> &cobjs);
 	int surface_advance();
 	void set_orient_for_coll(vector3d const *const forced_norm);
 	int check_water_collision(float vz_old);
@@ -385,11 +387,30 @@ struct predef_obj { // size = 28
 };
 
 
+class obj_grid_t { // uniform XY grid over the enabled objects of a group, rebuilt after the group is advanced each frame
+
+	unsigned nx, ny;
+	bool valid;
+	float x0, y0, dx_inv, dy_inv;
+	vector<unsigned> bin_start, ixs; // objects in bin b are ixs[bin_start[b]:bin_start[b+1]), in increasing index order
+
+	unsigned get_bin_x(float x) const {return unsigned(max(0.0f, min(float(nx-1), (x - x0)*dx_inv)));}
+	unsigned get_bin_y(float y) const {return unsigned(max(0.0f, min(float(ny-1), (y - y0)*dy_inv)));}
+public:
+	obj_grid_t() : nx(0), ny(0), valid(0), x0(0.0), y0(0.0), dx_inv(0.0), dy_inv(0.0) {}
+	bool is_valid() const {return valid;}
+	void invalidate() {valid = 0;}
+	void build(vector<dwobject> const &objects, unsigned end_id);
+	void get_candidates(point const &pos, float dist, vector<unsigned> &cands) const;
+};
+
+
 class obj_group { // size = 36
 
 	obj_vector_t<dwobject> objects;
 	vector<predef_obj> predef_objs;
 	p_transform_data td;
+	obj_grid_t grid;
 
 public:
 	unsigned init_objects, max_objs, app_rate, end_id, new_id;
@@ -421,6 +442,8 @@ public:
 	dwobject       &get_obj(unsigned i)       {assert(enabled); assert(i < objects.size()); return objects[i];}
 	dwobject const &get_obj(unsigned i) const {assert(enabled); assert(i < objects.size()); return objects[i];}
 	bool obj_within_dist(unsigned i, point const &pos, float dist) const;
+	void get_objs_within_dist(point const &pos, float dist, vector<unsigned> &ixs) const;
+	void build_obj_grid();
 	bool temperature_ok() const;
 	bool obj_has_shadow(unsigned obj_id) const;
 	int get_ptype() const;
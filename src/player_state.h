@@ -54,7 +54,7 @@ typedef vector<wpt_ix_t> waypt_adj_vect;
 
 struct waypoint_t {
 
-	bool user_placed, placed_item, goal, temp, visited, disabled, next_valid;
+	bool user_placed, placed_item, goal, temp, visited, disabled;
 	int came_from, item_group, item_ix, coll_id, connected_to;
 	float g_score, h_score, f_score;
 	point pos;
@@ -8,6 +8,7 @@
 #include "binary_file_io.h"
 #include <atomic>
 #include <thread>
+#include <omp.h>
 
 
 bool const COLOR_FROM_COBJ_TEX = 0; // 0 = fast/average color, 1 = true color
@@ -17,18 +18,33 @@ float const DIFFUSE_REFL  = 0.9; // 90%  diffuse  reflectivity
 float const SPEC_REFL     = 1.0; // 100% specular reflectivity
 float const SNOW_ALBEDO   = 0.9;
 float const ICE_ALBEDO    = 0.8;
+float const RELIGHT_PAD   = 2.0; // in lightmap cells
 
 bool keep_beams(0); // debugging mode
 bool kill_raytrace(0);
 bool no_stat_moving(0); // generally not thread safe for dynamic lighting update, since BVH is rebuilt per-frame; also, wrong to cache lighting for moving cobjs
 unsigned NPTS(50000), NRAYS(40000), LOCAL_RAYS(1000000), GLOBAL_RAYS(1000000), DYNAMIC_RAYS(1000000), NUM_THREADS(1), MAX_RAY_BOUNCES(20);
 std::atomic<unsigned long long> tot_rays(0), num_hits(0), cells_touched(0);
+thread_local llv_accum_t *cur_llv_accum(nullptr); // destination of local light volume rays traced on this thread
+thread_local cube_t const *cur_relight_region(nullptr); // set while re-tracing a dirty lighting region on this thread
+cube_t relight_pending(all_zeros), relight_active(all_zeros); // dirty lighting regions {waiting, being re-traced}
+int relight_first_dirty_frame(0), relight_last_dirty_frame(0); // frames when relight_pending was {first, last} added to
+unsigned relight_num_kills(0); // times the current relight was killed and re-queued before it could finish
 unsigned const NUM_RAY_SPLITS [NUM_LIGHTING_TYPES] = {1, 1, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 unsigned const INIT_RAY_SPLITS[NUM_LIGHTING_TYPES] = {1, 4, 1, 1, 1}; // sky, global, local, cobj_accum, dynamic
 
-extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked;
-extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER;
-extern float water_plane_z, temperature, snow_depth, indir_light_exp, ray_step_size_mult, first_ray_weight[];
+unsigned const ADAPT_RAY_TILES = 16; // adaptive ray tiles per side
+unsigned const ADAPT_PILOT_RAYS = 16; // pilot rays per tile
+
+unsigned const RAY_FP_MAX_BLOCKS = (1 << 14); // per thread and lighting type; the rays per block double when this is exceeded
+unsigned const RAY_FP_GRID       = 256; // footprint bounds resolution across the scene in each dim
+unsigned const RELIGHT_QUIET_FRAMES = 10;  // frames without new dirty regions before a relight is started
+unsigned const RELIGHT_MAX_WAIT     = 120; // frames after which a relight is started even if dirty regions are still being added
+unsigned const RELIGHT_MAX_KILLS    = 2;   // after this many restarts, a BVH rebuild waits for the active relight to finish instead
+
+extern bool has_snow, combined_gu, global_lighting_update, lighting_update_offline, store_cobj_accum_lighting_as_blocked, adaptive_ray_tracing, incremental_relight;
+extern int read_light_files[], write_light_files[], display_mode, DISABLE_WATER, frame_counter;
+extern float water_plane_z, temperature, snow_depth, indir_light_exp, ray_step_size_mult, first_ray_weight[], adaptive_ray_budget, adaptive_ray_floor;
 extern char *lighting_file[];
 extern point sun_pos, moon_pos;
 extern vector<light_source> light_sources_a;
@@ -214,10 +230,133 @@ light_volume_local &get_local_light_volume(int ltype) {
 }
 
 
+// bounds of the lit path segments, including bounces, of each block of consecutive primary rays traced by one thread for one lighting type;
+// each primary ray uses its own random sequence, so replaying a thread with the same seed regenerates the same paths, and an incremental relight
+// only re-traces the blocks that reach the dirty region: removing geometry there only changes paths that hit inside it
+class ray_footprint_t {
+
+	struct block_t {
+		unsigned char lo[3], hi[3]; // in RAY_FP_GRID cells
+		unsigned ray_hash; // of the first ray, to detect when the primary rays no longer match the recorded ones
+
+		block_t(unsigned h=0) : ray_hash(h) {UNROLL_3X(lo[i_] = RAY_FP_GRID-1; hi[i_] = 0;)}
+		bool is_empty() const {return (lo[0] > hi[0]);}
+		void add_cell(unsigned char const c[3]) {UNROLL_3X(lo[i_] = min(lo[i_], c[i_]); hi[i_] = max(hi[i_], c[i_]);)}
+		void union_with(block_t const &b) {if (!b.is_empty()) {add_cell(b.lo); add_cell(b.hi);}}
+
+		bool intersects(block_t const &b) const {
+			if (is_empty() || b.is_empty()) return 0;
+			UNROLL_3X(if (lo[i_] > b.hi[i_] || b.lo[i_] > hi[i_]) return 0;)
+			return 1;
+		}
+	};
+	vector<block_t> blocks;
+	vector<unsigned char> pilot_hits; // results of adaptive tracing pilot rays, reused so that a relight allocates rays like the original trace
+	cube_t grid;
+	block_t region; // active relight region
+	unsigned block_sz, ray_ix, pilot_ix;
+	int rseed;
+	bool valid, replay, trace_block;
+
+	void get_cell(point const &p, unsigned char c[3]) const {
+		UNROLL_3X(c[i_] = (unsigned char)max(0, min(int(RAY_FP_GRID)-1, int(floor(RAY_FP_GRID*(p[i_] - grid.d[i_][0])/max((grid.d[i_][1] - grid.d[i_][0]), TOLERANCE)))));)
+	}
+	static unsigned get_ray_hash(point const &p1, point const &p2) {
+		uint32_t v[6];
+		memcpy(v, &p1.x, 3*sizeof(float));
+		memcpy(v+3, &p2.x, 3*sizeof(float));
+		return (unsigned)fnv1a_64_hash(v, 6);
+	}
+public:
+	rand_gen_t path_rgen; // random sequence of the current primary ray
+
+	ray_footprint_t() : grid(all_zeros), block_sz(1), ray_ix(0), pilot_ix(0), rseed(1), valid(0), replay(0), trace_block(1) {}
+
+	void begin_pass(int rseed_, cube_t const *relight_region) { // replays the recorded rays if relighting and valid, otherwise records new ones
+		rseed    = rseed_;
+		ray_ix   = pilot_ix = 0;
+		replay   = (relight_region && valid);
+		trace_block = 1;
+		
+		if (replay) {
+			unsigned char c[3];
+			region = block_t();
+			get_cell(relight_region->get_llc(), c); region.add_cell(c);
+			get_cell(relight_region->get_urc(), c); region.add_cell(c);
+		}
+		else {
+			blocks.clear();
+			pilot_hits.clear();
+			block_sz = 1;
+			grid     = get_scene_bounds();
+		}
+	}
+	void end_pass() {
+		valid  = (replay || !kill_raytrace); // a killed replay only grew its blocks, so it's still conservative; a killed recording is incomplete
+		replay = 0;
+	}
+
+	bool begin_ray(point const &p1, point const &p2) { // returns 1 if this primary ray should be traced, using path_rgen
+		unsigned const ix(ray_ix++);
+
+		if ((ix % block_sz) == 0) { // first ray of a block
+			unsigned const bix(ix/block_sz), hash(get_ray_hash(p1, p2));
+
+			if (replay && (bix >= blocks.size() || blocks[bix].ray_hash != hash)) { // rays no longer match, so record the rest
+				replay = 0;
+				blocks.resize(bix);
+				pilot_hits.resize(min(pilot_ix, (unsigned)pilot_hits.size()));
+			}
+			if (replay) {trace_block = blocks[bix].intersects(region);}
+			else {
+				if (blocks.size() == RAY_FP_MAX_BLOCKS) { // merge pairs of blocks to bound memory; ix is a multiple of the new block size
+					for (unsigned i = 0; i < blocks.size()/2; ++i) {
+						blocks[i] = blocks[2*i];
+						blocks[i].union_with(blocks[2*i+1]);
+					}
+					blocks.resize(blocks.size()/2);
+					block_sz *= 2;
+				}
+				blocks.push_back(block_t(hash));
+				trace_block = 1;
+			}
+		}
+		if (!trace_block) return 0;
+		unsigned const key[2] = {ix, (unsigned)rseed};
+		uint64_t const h(fnv1a_64_hash(key, 2));
+		path_rgen.set_state(1 + long((h & 0xFFFFFFFF) % 2147483562), 1 + long((h >> 32) % 2147483398));
+		return 1;
+	}
+	void add_segment(point const &p1, point const &p2) { // called for each lit segment of the current ray's path
+		assert(ray_ix > 0 && (ray_ix-1)/block_sz < blocks.size());
+		block_t &b(blocks[(ray_ix-1)/block_sz]);
+		unsigned char c[3];
+		get_cell(p1, c); b.add_cell(c);
+		get_cell(p2, c); b.add_cell(c);
+	}
+	bool get_pilot_hit(bool &hit) {
+		if (!replay || pilot_ix >= pilot_hits.size()) return 0;
+		hit = (pilot_hits[pilot_ix++] != 0);
+		return 1;
+	}
+	void add_pilot_hit(bool hit) {
+		pilot_hits.resize(pilot_ix);
+		pilot_hits.push_back(hit);
+		++pilot_ix;
+	}
+};
+
+vector<ray_footprint_t> ray_footprints[LIGHTING_LOCAL+1]; // {sky, global, local} x thread
+thread_local ray_footprint_t *cur_ray_fp(nullptr); // set while tracing a relit lighting type on this thread
+
+int get_thread_rseed(unsigned t) {return 234323*(t+1);}
+
+
 void add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point const &p2, float weight, colorRGBA const &color, int ltype, bool first_pt) {
 
 	bool const dynamic(is_ltype_dynamic(ltype));
 	if (first_pt && dynamic) return; // since dynamic lights already have a direct lighting component, we skip the first ray here to avoid double counting it
+	if (cur_ray_fp) {cur_ray_fp->add_segment(p1, p2);} // even if weight is small, since the path's later segments depend on this hit
 	if (first_pt) {weight *= first_ray_weight[ltype];} // lower weight - handled by direct illumination
 	if (fabs(weight) < TOLERANCE) return;
 	weight *= ray_step_size_mult;
@@ -227,11 +366,11 @@ void add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point const
 	if (!first_pt) {p1 += step;} // move past the first step so we don't double count
 
 	// FIXME: probably better time vs. quality tradeoff using a proper line drawing algorithm that chooses step size by distance to closest grid boundary and multiplies weight by segment length
-	if (dynamic) { // it's a local lighting volume
-		light_volume_local &lvol(get_local_light_volume(ltype));
+	if (dynamic) { // it's a local lighting volume, accumulated per task
+		assert(cur_llv_accum != nullptr);
 
 		for (unsigned s = 0; s < nsteps; ++s) {
-			lvol.add_color(p1, cw);
+			cur_llv_accum->add_color(p1, cw);
 			p1 += step;
 		}
 	}
@@ -239,7 +378,7 @@ void add_path_to_lmcs(lmap_manager_t *lmgr, cube_t *bcube, point p1, point const
 		assert(lmgr != nullptr && lmgr->is_allocated());
 
 		for (unsigned s = 0; s < nsteps; ++s) {
-			lmcell *lmc(lmgr->get_lmcell_round_down(p1));
+			lmcell *lmc((cur_relight_region && !cur_relight_region->contains_pt(p1)) ? NULL : lmgr->get_lmcell_round_down(p1)); // relight only updates its region
 		
 			if (lmc != NULL) { // could use a mutex here, but it seems too slow
 				float *color(lmc->get_offset(ltype));
@@ -264,6 +403,11 @@ void cast_light_ray(lmap_manager_t *lmgr, point p1, point p2, float weight, floa
 {
 	if (depth > MAX_RAY_BOUNCES) return;
 	if (ltype == LIGHTING_DYNAMIC && depth > 4) return; // use a sensible default since this is running during rendering
+
+	if (depth == 0 && cur_ray_fp && &rgen != &cur_ray_fp->path_rgen) { // primary ray with a footprint: trace it with its own random sequence, or skip it
+		if (cur_ray_fp->begin_ray(p1, p2)) {cast_light_ray(lmgr, p1, p2, weight, weight0, color, line_length, ignore_cobj, ltype, depth, cur_ray_fp->path_rgen, accum_map, bcube);}
+		return;
+	}
 	//assert(!is_nan(p1) && !is_nan(p2));
 	++tot_rays;
 
@@ -570,22 +714,31 @@ void kill_current_raytrace_threads() {
 		assert(!thread_manager.is_active());
 		kill_raytrace = 0;
 	}
+	if (!relight_active.is_all_zeros()) { // relight was killed before it finished, so retry later
+		relight_pending.assign_or_union_with_cube(relight_active);
+		relight_active.set_to_zeros();
+	}
 }
 
 
 void update_lmap_from_temp_copy() {
 
-	if (!thread_temp_lmap.was_updated) return; // no updates
+	bool const relight(!relight_active.is_all_zeros());
+	if (!thread_temp_lmap.was_updated && !relight) return; // no updates (relight always updates since its region was cleared)
 	float const blend_weight = 1.0; // FIXME: slow blend over time to reduce popping
-	lmap_manager.copy_data(thread_temp_lmap, blend_weight);
+	lmap_manager.copy_data(thread_temp_lmap, blend_weight, (relight ? &relight_active : nullptr)); // relight only changes its region
+	relight_active.set_to_zeros();
+	if (relight) {relight_num_kills = 0;}
 	thread_temp_lmap.was_updated = 0;
 	lmap_manager.was_updated     = 1;
 }
 
 
+void start_incremental_relight();
+
 void check_for_lighting_finished() { // to be called about once per frame
 
-	if (!thread_manager.is_active()) return; // inactive
+	if (!thread_manager.is_active()) {start_incremental_relight(); return;} // inactive
 	if (thread_manager.any_threads_running()) return; // still running
 	thread_manager.join_and_clear(); // clear() or join_and_clear()?
 	update_lmap_from_temp_copy();
@@ -593,7 +746,14 @@ void check_for_lighting_finished() { // to be called about once per frame
 
 
 // see https://computing.llnl.gov/tutorials/pthreads/ (for old pthread implementation - now using std::thread)
-void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype, unsigned job_id=0) {
+bool relight_ltype(int ltype) { // only ray traced lighting types need to be relit
+	if (!(read_light_files[ltype] || write_light_files[ltype])) return 0;
+	return (ltype == LIGHTING_SKY || ltype == LIGHTING_LOCAL || (ltype == LIGHTING_GLOBAL && !global_lighting_update)); // global updates already re-trace everything
+}
+
+void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bool verbose, bool blocking, bool use_temp_lmap, bool randomized, int ltype,
+	unsigned job_id=0, cube_t const *relight_region=nullptr)
+{
 
 	kill_current_raytrace_threads();
 	assert(num_threads > 0 && num_threads < 100);
@@ -602,11 +762,19 @@ void launch_threaded_job(unsigned num_threads, void (*start_func)(rt_data *), bo
 	if (verbose) cout << "Computing lighting on " << num_threads << " threads." << endl;
 	thread_manager.create(num_threads);
 	vector<rt_data> &data(thread_manager.data);
-	if (use_temp_lmap) {thread_temp_lmap.init_from(lmap_manager);}
+	if (use_temp_lmap) {
+		thread_temp_lmap.init_from(lmap_manager);
+
+		if (relight_region) { // lighting in this region will be re-traced from scratch
+			for (int lt = LIGHTING_SKY; lt <= LIGHTING_LOCAL; ++lt) {
+				if (relight_ltype(lt)) {thread_temp_lmap.clear_lighting_values(lt, relight_region);}
+			}
+		}
+	}
 
 	for (unsigned t = 0; t < data.size(); ++t) {
 		// create a custom lmap_manager_t for each thread then merge them together?
-		data[t] = rt_data(t, num_threads, 234323*(t+1), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
+		data[t] = rt_data(t, num_threads, get_thread_rseed(t), !single_thread, (verbose && t == 0), randomized, ltype, job_id);
 		data[t].lmgr = (use_temp_lmap ? &thread_temp_lmap : &lmap_manager);
 	}
 	if (single_thread && blocking) { // threads disabled
@@ -645,6 +813,87 @@ bool cube_light_src_vect::ray_intersects_any(point const &start_pt, point const
 }
 
 
+float radical_inverse(unsigned n, unsigned base) { // for Halton low-discrepancy sequences
+
+	float const inv_base(1.0/base);
+	float val(0.0), f(inv_base);
+	for (; n > 0; n /= base, f *= inv_base) {val += (n % base)*f;}
+	return val;
+}
+
+// stratified sky/global ray allocation over a grid of tiles covering the ray target area;
+// more rays go to tiles where pilot rays show partial occlusion, which is where the lighting estimate converges slowest;
+// each ray is weighted by the inverse of its tile's expected ray count, so the total lighting is unbiased for any allocation with all fractions > 0
+class ray_tile_alloc_t {
+
+	vector<float> frac; // fraction of the ray budget for each tile, sums to 1.0
+	vector<unsigned> seq_ix; // next Halton sequence index for each tile
+	vector<vector3d> offsets; // random Cranley-Patterson rotation for each tile's sequence
+
+public:
+	static unsigned get_num_tiles() {return ADAPT_RAY_TILES*ADAPT_RAY_TILES;}
+
+	void init(vector<float> const &hit_frac, rand_gen_t &rgen) { // hit_frac is the fraction of pilot rays that hit a cobj, per tile
+		unsigned const num(get_num_tiles());
+		assert(hit_frac.size() == num);
+		float const floor_frac(max(0.01f, min(1.0f, adaptive_ray_floor))); // must be nonzero so that every tile gets some rays and get_weight_scale() is finite
+		vector<float> stdev(num);
+		float tot_stdev(0.0);
+
+		for (unsigned t = 0; t < num; ++t) {
+			stdev[t]   = sqrt(hit_frac[t]*(1.0f - hit_frac[t])); // Bernoulli std dev of occlusion
+			tot_stdev += stdev[t];
+		}
+		frac.resize(num);
+		seq_ix.assign(num, 0);
+		offsets.resize(num);
+
+		for (unsigned t = 0; t < num; ++t) {
+			frac[t] = ((tot_stdev > 0.0) ? (floor_frac/num + (1.0f - floor_frac)*stdev[t]/tot_stdev) : 1.0f/num); // uniform if no tile is partially occluded
+			UNROLL_3X(offsets[t][i_] = rgen.rand_float();)
+		}
+	}
+	unsigned get_num_rays(unsigned tile, float tot_rays, rand_gen_t &rgen) const { // stochastic rounding keeps the expected count exact
+		float const num(tot_rays*frac[tile]);
+		unsigned const inum((unsigned)num);
+		return (inum + ((rgen.rand_float() < (num - inum)) ? 1 : 0));
+	}
+	float get_weight_scale(unsigned tile) const {return 1.0/(frac.size()*max(adaptive_ray_budget, 0.001f)*frac[tile]);} // relative to uniform weight
+	
+	vector3d next_sample(unsigned tile) { // returns {u, v, w} in [0,1) within the tile
+		unsigned const n(++seq_ix[tile]);
+		vector3d s(radical_inverse(n, 2), radical_inverse(n, 3), radical_inverse(n, 5));
+		UNROLL_3X(s[i_] += offsets[tile][i_]; if (s[i_] >= 1.0) {s[i_] -= 1.0;})
+		return s;
+	}
+	static void get_tile_xy(unsigned tile, vector3d const &s, float x1, float x2, float y1, float y2, float &x, float &y) {
+		unsigned const tx(tile%ADAPT_RAY_TILES), ty(tile/ADAPT_RAY_TILES);
+		x = x1 + (tx + s.x)*(x2 - x1)/ADAPT_RAY_TILES;
+		y = y1 + (ty + s.y)*(y2 - y1)/ADAPT_RAY_TILES;
+	}
+};
+
+bool check_pilot_ray(point p1, point p2) { // visibility-only test, no lighting is added
+
+	if (!do_line_clip_scene(p1, p2, min(zbottom, czmin), max(ztop, czmax))) return 0;
+	int cindex(-1);
+	point cpos(p2);
+	vector3d cnorm;
+	colorRGBA model_color;
+	if (check_coll_line_exact(p1, p2, cpos, cnorm, cindex, 0.0, -1, 1, 0, 1, 1, 0, no_stat_moving)) return 1;
+	return all_models.check_coll_line(p1, p2, cpos, cnorm, model_color, 1);
+}
+
+bool pilot_ray_hits_cobj(point const &p1, point const &p2) {
+
+	bool hit(0);
+	if (cur_ray_fp && cur_ray_fp->get_pilot_hit(hit)) return hit; // relight: use the recorded result
+	hit = check_pilot_ray(p1, p2);
+	if (cur_ray_fp) {cur_ray_fp->add_pilot_hit(hit);}
+	return hit;
+}
+
+
 void trace_one_global_ray(lmap_manager_t *lmgr, point const &pos, point const &pt, colorRGBA const &color, float ray_wt,
 	int ltype, bool is_scene_cube, rand_gen_t &rgen, cobj_ray_accum_map_t *accum_map, float line_length)
 {
@@ -679,7 +928,36 @@ void trace_ray_block_global_cube(lmap_manager_t *lmgr, cube_t const &bnds, point
 		pt[i] = bnds.d[i][dir];
 		if (verbose) cout << "Dim " << i+1 << " of 3, num (this thread): " << num_rays << ", progress (of " << 1+num_rays/1000 << "): 0";
 
-		if (randomized) {
+		if (adaptive_ray_tracing && !randomized) { // stratified over tiles of this face, with more rays where pilot rays are partially occluded
+			float const x1(bnds.d[d0][0]), x2(bnds.d[d0][1]), y1(bnds.d[d1][0]), y2(bnds.d[d1][1]);
+			vector<float> hit_frac(ray_tile_alloc_t::get_num_tiles(), 0.0);
+			ray_tile_alloc_t alloc;
+
+			for (unsigned t = 0; t < hit_frac.size(); ++t) { // pilot pass
+				unsigned num_hit(0);
+
+				for (unsigned n = 0; n < ADAPT_PILOT_RAYS; ++n) {
+					ray_tile_alloc_t::get_tile_xy(t, vector3d(rgen.rand_float(), rgen.rand_float(), 0.0), x1, x2, y1, y2, pt[d0], pt[d1]);
+					num_hit += pilot_ray_hits_cobj(pos, (pt + (pt - pos).get_norm()*line_length));
+				}
+				hit_frac[t] = float(num_hit)/ADAPT_PILOT_RAYS;
+			}
+			alloc.init(hit_frac, rgen);
+			unsigned num(0);
+
+			for (unsigned t = 0; t < hit_frac.size(); ++t) {
+				if (kill_raytrace) break;
+				unsigned const tile_rays(alloc.get_num_rays(t, num_rays*adaptive_ray_budget, rgen));
+				float const tile_wt(ray_wt*alloc.get_weight_scale(t));
+
+				for (unsigned s = 0; s < tile_rays; ++s, ++num) {
+					if (verbose && ((num%1000) == 0)) {increment_printed_number(num/1000);}
+					ray_tile_alloc_t::get_tile_xy(t, alloc.next_sample(t), x1, x2, y1, y2, pt[d0], pt[d1]);
+					trace_one_global_ray(lmgr, pos, pt, color, tile_wt, ltype, is_scene_cube, rgen, accum_map, line_length);
+				}
+			}
+		}
+		else if (randomized) {
 			for (unsigned s = 0; s < num_rays; ++s) {
 				if (kill_raytrace) break;
 				if (verbose && ((s%1000) == 0)) {increment_printed_number(s/1000);}
@@ -777,25 +1055,71 @@ void trace_ray_block_sky(rt_data *data) {
 		sort(pts.begin(), pts.end());
 		if (data->verbose) {cout << "Sky light source progress (of " << block_npts << "): 0";}
 
-		for (unsigned p = 0; p < block_npts; ++p) {
-			if (kill_raytrace) break;
-			if (data->verbose) {increment_printed_number(p);}
-			point const &pt(pts[p]);
+		if (adaptive_ray_tracing) { // stratified over tiles of the scene's XY area, with more rays where pilot rays are partially occluded
+			vector<float> hit_frac(ray_tile_alloc_t::get_num_tiles(), 0.0);
+			ray_tile_alloc_t alloc;
+
+			for (unsigned t = 0; t < hit_frac.size(); ++t) { // pilot pass
+				unsigned num_hit(0);
 
-			for (unsigned r = 0; r < NRAYS; ++r) {
-				point const target_pt(X_SCENE_SIZE*rgen.signed_rand_float(), Y_SCENE_SIZE*rgen.signed_rand_float(), rgen.rand_uniform(czmin, czmax));
-				dirs[r] = (target_pt - pt).get_norm();
-				//dirs[r].z = -fabs(dirs[r].z); // pointing down
+				for (unsigned n = 0; n < ADAPT_PILOT_RAYS; ++n) {
+					point const &pt(pts[rgen.rand()%block_npts]);
+					point target_pt(all_zeros);
+					ray_tile_alloc_t::get_tile_xy(t, vector3d(rgen.rand_float(), rgen.rand_float(), 0.0), -X_SCENE_SIZE, X_SCENE_SIZE, -Y_SCENE_SIZE, Y_SCENE_SIZE, target_pt.x, target_pt.y);
+					target_pt.z = rgen.rand_uniform(czmin, czmax);
+					vector3d const dir((target_pt - pt).get_norm());
+					if (dot_product(dir, pt) < 0.0) {num_hit += pilot_ray_hits_cobj(pt, (pt + dir*line_length));}
+				}
+				hit_frac[t] = float(num_hit)/ADAPT_PILOT_RAYS;
 			}
-			sort(dirs.begin(), dirs.end());
+			alloc.init(hit_frac, rgen);
 
-			for (unsigned r = 0; r < NRAYS; ++r) {
+			for (unsigned p = 0; p < block_npts; ++p) {
 				if (kill_raytrace) break;
-				if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
-				point const end_pt(pt + dirs[r]*line_length);
-				if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
-				cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
-				++start_rays;
+				if (data->verbose) {increment_printed_number(p);}
+				point const &pt(pts[p]);
+
+				for (unsigned t = 0; t < hit_frac.size(); ++t) {
+					unsigned const tile_rays(alloc.get_num_rays(t, NRAYS*adaptive_ray_budget, rgen));
+					float const tile_wt(ray_wt*alloc.get_weight_scale(t));
+
+					for (unsigned r = 0; r < tile_rays; ++r) {
+						if (kill_raytrace) break;
+						vector3d const s(alloc.next_sample(t));
+						point target_pt(all_zeros);
+						ray_tile_alloc_t::get_tile_xy(t, s, -X_SCENE_SIZE, X_SCENE_SIZE, -Y_SCENE_SIZE, Y_SCENE_SIZE, target_pt.x, target_pt.y);
+						target_pt.z = czmin + s.z*(czmax - czmin);
+						vector3d const dir((target_pt - pt).get_norm());
+						if (dot_product(dir, pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
+						point const end_pt(pt + dir*line_length);
+						if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
+						cast_light_ray(data->lmgr, pt, end_pt, tile_wt, tile_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+						++start_rays;
+					}
+				}
+			}
+		}
+		else {
+			for (unsigned p = 0; p < block_npts; ++p) {
+				if (kill_raytrace) break;
+				if (data->verbose) {increment_printed_number(p);}
+				point const &pt(pts[p]);
+
+				for (unsigned r = 0; r < NRAYS; ++r) {
+					point const target_pt(X_SCENE_SIZE*rgen.signed_rand_float(), Y_SCENE_SIZE*rgen.signed_rand_float(), rgen.rand_uniform(czmin, czmax));
+					dirs[r] = (target_pt - pt).get_norm();
+					//dirs[r].z = -fabs(dirs[r].z); // pointing down
+				}
+				sort(dirs.begin(), dirs.end());
+
+				for (unsigned r = 0; r < NRAYS; ++r) {
+					if (kill_raytrace) break;
+					if (dot_product(dirs[r], pt) >= 0.0) continue; // can get here when (-Z_SCENE_SIZE, Z_SCENE_SIZE) does not contain (czmin, czmax)
+					point const end_pt(pt + dirs[r]*line_length);
+					if (sky_cube_lights.ray_intersects_any(pt, end_pt)) continue; // don't double count
+					cast_light_ray(data->lmgr, pt, end_pt, ray_wt, ray_wt, WHITE, line_length, -1, LIGHTING_SKY, 0, rgen, &data->accum_map);
+					++start_rays;
+				}
 			}
 		}
 		if (data->verbose) {cout << endl;}
@@ -1023,41 +1347,66 @@ void trace_ray_block_local(rt_data *data) {
 }
 
 
-void trace_ray_block_dynamic(rt_data *data) {
+// traces all of the given local light volumes together as tasks of {volume, slice of rays} on NUM_THREADS OpenMP worker threads (one less for per-frame updates);
+// each task accumulates into its own sparse llv_accum_t, which are merged in slice order so that results don't depend on thread scheduling
+void trace_local_light_volumes(vector<unsigned> const &llvol_ixs, vector<llv_accum_t> &accums, bool verbose, bool reserve_render_thread) {
 
-	assert(data);
-	if (DYNAMIC_RAYS == 0) return; // nothing to do
-	light_volume_local const &lvol(get_local_light_volume(data->ltype));
-	vector<unsigned> const &dlight_ixs(indir_dlight_group_manager.get_dlight_ixs_for_tag_ix(lvol.get_tag_ix()));
-	assert(!dlight_ixs.empty());
-	rand_gen_t rgen;
-	data->pre_run(rgen);
+	unsigned const num_vols(llvol_ixs.size()), num_threads(reserve_render_thread ? max(1U, NUM_THREADS-1) : max(1U, NUM_THREADS));
+	unsigned const num_slices(max(1U, (num_threads + num_vols - 1)/max(num_vols, 1U))), num_tasks(num_vols*num_slices);
+	vector<llv_accum_t> task_accums(num_tasks);
+	accums.resize(num_vols);
+	if (num_vols == 0 || DYNAMIC_RAYS == 0) return; // nothing to do
+	if (verbose) {cout << "Tracing " << num_vols << " local light volume(s) as " << num_tasks << " tasks" << endl;}
+	all_models.build_cobj_trees(1);
 	float const max_line_length(2.0*get_scene_radius());
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
+	for (int t = 0; t < (int)num_tasks; ++t) {
+		task_accums[t].init(); // must be initialized for the merge below, even if killed
+		if (kill_raytrace) continue; // can't break out of an OpenMP loop
+		unsigned const vol_ix(llvol_ixs[t/num_slices]), slice(t%num_slices);
+		int const ltype(LIGHTING_DYNAMIC + vol_ix);
+		light_volume_local const &lvol(get_local_light_volume(ltype));
+		vector<unsigned> const &dlight_ixs(indir_dlight_group_manager.get_dlight_ixs_for_tag_ix(lvol.get_tag_ix()));
+		assert(!dlight_ixs.empty());
+		rand_gen_t rgen;
+		rgen.set_state(234323*(slice+1), 1);
+		cur_llv_accum = &task_accums[t];
 	
-	for (auto i = dlight_ixs.begin(); i != dlight_ixs.end(); ++i) {
-		assert(*i < light_sources_d.size());
-		light_source_trig const &ls(light_sources_d[*i]);
-		//if (!ls.is_enabled()) continue; // error?
-		float const line_length(min(4.0f*ls.get_radius(), max_line_length)); // limit ray length to improve perf
-		unsigned const light_nrays(ls.get_num_rays()), NRAYS(light_nrays ? light_nrays : DYNAMIC_RAYS), num_rays(max(1U, NRAYS/data->num));
-		ray_trace_local_light_source(nullptr, ls, line_length, num_rays, rgen, data->ltype, NRAYS); // lmgr is unused, so leave it as null
+		for (auto i = dlight_ixs.begin(); i != dlight_ixs.end(); ++i) {
+			if (kill_raytrace) break;
+			assert(*i < light_sources_d.size());
+			light_source_trig const &ls(light_sources_d[*i]);
+			//if (!ls.is_enabled()) continue; // error?
+			float const line_length(min(4.0f*ls.get_radius(), max_line_length)); // limit ray length to improve perf
+			unsigned const light_nrays(ls.get_num_rays()), NRAYS(light_nrays ? light_nrays : DYNAMIC_RAYS), num_rays(max(1U, NRAYS/num_slices));
+			ray_trace_local_light_source(nullptr, ls, line_length, num_rays, rgen, ltype, NRAYS); // lmgr is unused, so leave it as null
+		}
+		cur_llv_accum = nullptr;
+	}
+#pragma omp parallel for schedule(dynamic,1) num_threads(num_threads)
+	for (int v = 0; v < (int)num_vols; ++v) { // merge slices into the first one
+		llv_accum_t &dest(task_accums[v*num_slices]);
+		for (unsigned s = 1; s < num_slices; ++s) {dest.merge(task_accums[v*num_slices + s]); task_accums[v*num_slices + s].clear();}
+		accums[v] = std::move(dest);
 	}
-	data->post_run();
 }
 
 
 typedef void (*ray_trace_func)(rt_data *);
-ray_trace_func const rt_funcs[NUM_LIGHTING_TYPES] = {trace_ray_block_sky, trace_ray_block_global, trace_ray_block_local, trace_ray_block_cobj_accum, trace_ray_block_dynamic};
+ray_trace_func const rt_funcs[NUM_LIGHTING_TYPES] = {trace_ray_block_sky, trace_ray_block_global, trace_ray_block_local, trace_ray_block_cobj_accum, nullptr}; // dynamic uses trace_local_light_volumes()
 
 
+void trace_ray_block_record(rt_data *data);
+
 void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 
-	bool const dynamic(is_ltype_dynamic(ltype));
+	assert(!is_ltype_dynamic(ltype)); // local light volumes use trace_local_light_volumes()
 	unsigned const c_ltype(clamp_ltype_range(ltype));
 	assert(c_ltype < NUM_LIGHTING_TYPES);
 	const char *fn(lighting_file[c_ltype]);
 
-	if (!dynamic && read_light_files[c_ltype]) {
+	if (read_light_files[c_ltype]) {
 		if (c_ltype == LIGHTING_COBJ_ACCUM) {
 			merged_accum_map.open_and_read(fn, 0);
 
@@ -1069,13 +1418,15 @@ void compute_ray_trace_lighting(unsigned ltype, bool verbose) {
 		else {lmap_manager.read_data_from_file(fn, c_ltype);}
 	}
 	else {
-		if (c_ltype != LIGHTING_LOCAL && !dynamic) {cout << X_SCENE_SIZE << " " << Y_SCENE_SIZE << " " << Z_SCENE_SIZE << " " << czmin << " " << czmax << endl;}
+		if (c_ltype != LIGHTING_LOCAL) {cout << X_SCENE_SIZE << " " << Y_SCENE_SIZE << " " << Z_SCENE_SIZE << " " << czmin << " " << czmax << endl;}
 		all_models.build_cobj_trees(1);
 		if (enable_platform_lights(ltype)) {pre_rt_bvh_build_hook();}
-		launch_threaded_job(NUM_THREADS, rt_funcs[c_ltype], verbose, 1, 0, 0, ltype);
+		bool const record_fp(incremental_relight && relight_ltype(c_ltype));
+		if (record_fp) {ray_footprints[c_ltype].resize(NUM_THREADS);}
+		launch_threaded_job(NUM_THREADS, (record_fp ? trace_ray_block_record : rt_funcs[c_ltype]), verbose, 1, 0, 0, ltype);
 		if (enable_platform_lights(ltype)) {post_rt_bvh_build_hook();}
 	}
-	if (!dynamic && write_light_files[c_ltype]) {
+	if (write_light_files[c_ltype]) {
 		if (c_ltype == LIGHTING_COBJ_ACCUM) {
 			merged_accum_map.open_and_write(fn, 0);
 			// if writing both the cobj accum file and the sky lighting file, and not storing sky lighting as blocked,
@@ -1108,6 +1459,87 @@ void check_update_global_lighting(unsigned lights) {
 	launch_threaded_job(max(1U, NUM_THREADS-1), rt_funcs[LIGHTING_GLOBAL], 0, 0, lighting_update_offline, 0, LIGHTING_GLOBAL); // reserve a thread for rendering
 }
 
+// called with the bcubes of destroyed/moved cobjs; lighting near them is re-traced incrementally on a background thread
+void add_lighting_dirty_region(vector<cube_t> const &cubes) {
+
+	if (!incremental_relight || !lmap_manager.is_allocated()) return;
+
+	for (auto i = cubes.begin(); i != cubes.end(); ++i) {
+		cube_t bc(*i);
+		bc.expand_by(vector3d(DX_VAL, DY_VAL, DZ_VAL2)*RELIGHT_PAD);
+		if (relight_pending.is_all_zeros()) {relight_first_dirty_frame = frame_counter;}
+		relight_pending.assign_or_union_with_cube(bc);
+		relight_last_dirty_frame = frame_counter;
+	}
+}
+
+void trace_ray_block_footprint(rt_data *data, ray_footprint_t &fp, cube_t const *relight_region) {
+
+	fp.begin_pass(data->rseed, relight_region);
+	cur_ray_fp = &fp;
+	rt_funcs[data->ltype](data);
+	cur_ray_fp = nullptr;
+	fp.end_pass();
+}
+
+void trace_ray_block_record(rt_data *data) { // traces a relit lighting type and records its ray footprints
+	assert(data);
+	trace_ray_block_footprint(data, ray_footprints[data->ltype][data->ix], nullptr);
+}
+
+// replays the rays of each thread of the original trace of the ray traced lighting types, re-tracing only the blocks of rays whose footprint reaches
+// the active relight region, which was cleared, and only adding lighting inside it; threads with no valid footprint are traced in full and recorded
+void trace_ray_block_relight(rt_data *data) {
+
+	assert(data);
+	rand_gen_t rgen; // unused, but pre_run() marks this thread as running for the entire job
+	data->pre_run(rgen);
+	cur_relight_region = &relight_active;
+
+	for (int lt = LIGHTING_SKY; lt <= LIGHTING_LOCAL; ++lt) {
+		if (!relight_ltype(lt)) continue;
+		vector<ray_footprint_t> &fps(ray_footprints[lt]);
+
+		for (unsigned s = data->ix; s < fps.size() && !kill_raytrace; s += data->num) { // round robin distribute original threads across relight threads
+			rt_data sub_data(s, fps.size(), get_thread_rseed(s), data->is_thread, 0, 0, lt); // same seeds as the original trace
+			sub_data.lmgr = data->lmgr;
+			trace_ray_block_footprint(&sub_data, fps[s], &relight_active);
+		}
+	}
+	cur_relight_region = nullptr;
+	data->post_run();
+}
+
+void kill_incremental_relight() { // called before the static cobj BVH is rebuilt, since the relight threads are reading it
+
+	if (relight_active.is_all_zeros()) return; // no active relight
+
+	if (relight_num_kills < RELIGHT_MAX_KILLS) {
+		++relight_num_kills;
+		kill_current_raytrace_threads(); // re-queues the active region
+	}
+	else { // restarted too many times; wait for it to finish so that continuous destruction can't starve it
+		thread_manager.join_and_clear();
+		update_lmap_from_temp_copy();
+	}
+}
+
+void start_incremental_relight() { // called when no ray tracing threads are active
+
+	if (relight_pending.is_all_zeros()) return; // nothing to do
+	// debounce: wait until dirty regions stop being added, unless the oldest one has waited too long
+	if (frame_counter - relight_last_dirty_frame < (int)RELIGHT_QUIET_FRAMES && frame_counter - relight_first_dirty_frame < (int)RELIGHT_MAX_WAIT) return;
+	if (!pre_lighting_update()) return; // lmap is not yet allocated
+	no_stat_moving = 1; // async updates aren't thread safe with static moving cobjs; see check_update_global_lighting()
+	relight_active = relight_pending;
+	relight_pending.set_to_zeros();
+
+	for (int lt = LIGHTING_SKY; lt <= LIGHTING_LOCAL; ++lt) {
+		if (relight_ltype(lt) && ray_footprints[lt].empty()) {ray_footprints[lt].resize(NUM_THREADS);} // read from a file, so the first relight records them
+	}
+	launch_threaded_job(max(1U, NUM_THREADS-1), trace_ray_block_relight, 0, 0, 1, 0, LIGHTING_SKY, 0, &relight_active); // non-blocking, into temp lmap; reserve a thread for rendering
+}
+
 void check_all_platform_cobj_lighting_update() {
 
 	if (merged_accum_map.empty()) return; // updates not enabled
@@ -1188,11 +1620,66 @@ bool lmap_manager_t::write_data_to_file(char const *const fn, int ltype) const {
 }
 
 
-void lmap_manager_t::clear_lighting_values(int ltype) {
+unsigned const FLOW_CACHE_MAGIC   = 0x464C4F57; // "FLOW"
+unsigned const FLOW_CACHE_VERSION = 1;
+
+bool lmap_manager_t::read_flow_from_file(string const &fn, unsigned scene_hash) {
+
+	binary_file_reader reader;
+	if (!reader.open(fn)) return 0;
+	unsigned header[7] = {0};
+	if (!reader.read(header, sizeof(unsigned), 7)) return 0;
+	unsigned const expected[7] = {FLOW_CACHE_MAGIC, FLOW_CACHE_VERSION, (unsigned)vldata_alloc.size(), lm_xsize, lm_ysize, lm_zsize, scene_hash};
+	if (memcmp(header, expected, sizeof(header)) != 0) return 0; // wrong file or scene has changed
+	vector<unsigned char> data(3*vldata_alloc.size());
+
+	if (!data.empty() && !reader.read(&data.front(), sizeof(unsigned char), data.size())) {
+		cerr << "Error reading data from flow cache file " << fn << endl;
+		return 0;
+	}
+	for (unsigned i = 0; i < vldata_alloc.size(); ++i) {UNROLL_3X(vldata_alloc[i].pflow[i_] = data[3*i+i_];)}
+	cout << "Read particle flow values from " << fn << endl;
+	return 1;
+}
+
+
+bool lmap_manager_t::write_flow_to_file(string const &fn, unsigned scene_hash) const {
+
+	binary_file_writer writer;
+	if (!writer.open(fn)) return 0;
+	unsigned const header[7] = {FLOW_CACHE_MAGIC, FLOW_CACHE_VERSION, (unsigned)vldata_alloc.size(), lm_xsize, lm_ysize, lm_zsize, scene_hash};
+	vector<unsigned char> data(3*vldata_alloc.size());
+	for (unsigned i = 0; i < vldata_alloc.size(); ++i) {UNROLL_3X(data[3*i+i_] = vldata_alloc[i].pflow[i_];)}
+
+	if (!writer.write(header, sizeof(unsigned), 7) || (!data.empty() && !writer.write(&data.front(), sizeof(unsigned char), data.size()))) {
+		cerr << "Error writing data to flow cache file " << fn << endl;
+		return 0;
+	}
+	return 1;
+}
+
+
+void lmap_manager_t::clear_lighting_values(int ltype, cube_t const *region) {
 
 	assert(ltype < NUM_LIGHTING_TYPES && !is_ltype_dynamic(ltype));
 	unsigned const num(lmcell::get_dsz(ltype));
 
+	if (region) { // clear only cells inside region
+		int bnds[3][2];
+		get_region_bounds(*region, bnds);
+
+		for (int y = bnds[1][0]; y < bnds[1][1]; ++y) {
+			for (int x = bnds[0][0]; x < bnds[0][1]; ++x) {
+				if (!vlmap[y][x]) continue;
+
+				for (int z = bnds[2][0]; z < bnds[2][1]; ++z) {
+					float *color(vlmap[y][x][z].get_offset(ltype));
+					for (unsigned j = 0; j < num; ++j) {color[j] = 0.0;}
+				}
+			}
+		}
+		return;
+	}
 	for (vector<lmcell>::iterator i = vldata_alloc.begin(); i != vldata_alloc.end(); ++i) {
 		float *color(i->get_offset(ltype));
 		for (unsigned j = 0; j < num; ++j) {color[j] = 0.0;}
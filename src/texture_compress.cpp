@@ -0,0 +1,270 @@
+// 3D World - CPU Block Compression (BC1/BC3/BC4/BC5) of Textures with a Persistent DDS Cache
+// by Frank Gennari
+// 10/18/26
+
+#include "3DWorld.h"
+#include "function_registry.h"
+#include "textures_3dw.h"
+#include <cstdio> // for rename() and remove()
+#include <sys/stat.h>
+
+#ifdef ENABLE_DDS
+#include <gli/gli.hpp>
+#endif
+
+using namespace std;
+
+unsigned const TEX_CACHE_VERSION = 2; // increment when the encoder or the cache key changes to invalidate old cache files
+
+extern string texture_cache_dir;
+
+string append_texture_dir(string const &filename);
+
+
+// ************ block encoders ************
+// Each block is 4x4 texels with 4 components per texel (unused components are ignored).
+// Encoders work on a fixed number of texels with no data-dependent inner loop bounds so that the compiler can vectorize them.
+
+typedef unsigned char block_texels_t[16][4];
+
+inline unsigned short pack_565(float const c[3]) {
+	unsigned const r(min(31U, unsigned(c[0]*(31.0f/255.0f) + 0.5f))), g(min(63U, unsigned(c[1]*(63.0f/255.0f) + 0.5f))), b(min(31U, unsigned(c[2]*(31.0f/255.0f) + 0.5f)));
+	return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+inline void unpack_565(unsigned short v, int c[3]) {
+	int const r((v >> 11) & 31), g((v >> 5) & 63), b(v & 31);
+	c[0] = (r << 3) | (r >> 2);
+	c[1] = (g << 2) | (g >> 4);
+	c[2] = (b << 3) | (b >> 2);
+}
+
+inline void write_u16_le(unsigned char *dest, unsigned short v) {dest[0] = (unsigned char)(v & 0xFF); dest[1] = (unsigned char)(v >> 8);}
+
+// BC1 color block (also used as the color part of BC3): endpoints are the extremes of the texels projected onto the principal axis
+void encode_bc1_block(block_texels_t const &px, unsigned char *dest) {
+
+	float mean[3] = {0.0, 0.0, 0.0};
+
+	for (unsigned i = 0; i < 16; ++i) {UNROLL_3X(mean[i_] += px[i][i_];)}
+	UNROLL_3X(mean[i_] *= (1.0f/16.0f);)
+	float cov[6] = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}; // rr rg rb gg gb bb
+
+	for (unsigned i = 0; i < 16; ++i) {
+		float const r(px[i][0] - mean[0]), g(px[i][1] - mean[1]), b(px[i][2] - mean[2]);
+		cov[0] += r*r; cov[1] += r*g; cov[2] += r*b; cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+	}
+	float axis[3] = {1.0, 1.0, 1.0};
+
+	for (unsigned iter = 0; iter < 4; ++iter) { // power iteration to find the principal axis
+		float const x(cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2]);
+		float const y(cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2]);
+		float const z(cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2]);
+		float const mag(max(fabs(x), max(fabs(y), fabs(z))));
+		if (mag < 1.0E-6) break; // constant color block, keep the default axis
+		axis[0] = x/mag; axis[1] = y/mag; axis[2] = z/mag;
+	}
+	float dmin(0.0), dmax(0.0);
+	unsigned imin(0), imax(0);
+
+	for (unsigned i = 0; i < 16; ++i) {
+		float const d(axis[0]*px[i][0] + axis[1]*px[i][1] + axis[2]*px[i][2]);
+		if (i == 0 || d < dmin) {dmin = d; imin = i;}
+		if (i == 0 || d > dmax) {dmax = d; imax = i;}
+	}
+	float cmax[3], cmin[3];
+
+	for (unsigned n = 0; n < 3; ++n) { // inset the endpoints by 1/16 of the range to reduce error for the interior texels
+		float const inset((float(px[imax][n]) - float(px[imin][n]))/16.0f);
+		cmax[n] = px[imax][n] - inset;
+		cmin[n] = px[imin][n] + inset;
+	}
+	unsigned short c0(pack_565(cmax)), c1(pack_565(cmin));
+	if (c0 < c1) {swap(c0, c1);} // always use four color mode (required for BC3)
+	unsigned bits(0);
+
+	if (c0 != c1) {
+		int pal[4][3];
+		unpack_565(c0, pal[0]);
+		unpack_565(c1, pal[1]);
+		UNROLL_3X(pal[2][i_] = (2*pal[0][i_] +   pal[1][i_])/3; pal[3][i_] = (pal[0][i_] + 2*pal[1][i_])/3;)
+
+		for (unsigned i = 0; i < 16; ++i) {
+			unsigned best_ix(0);
+			int best_dist(0);
+
+			for (unsigned p = 0; p < 4; ++p) {
+				int const dr(pal[p][0] - px[i][0]), dg(pal[p][1] - px[i][1]), db(pal[p][2] - px[i][2]);
+				int const dist(dr*dr + dg*dg + db*db);
+				if (p == 0 || dist < best_dist) {best_dist = dist; best_ix = p;}
+			}
+			bits |= (best_ix << (2*i));
+		}
+	} // else all indices are zero
+	write_u16_le(dest+0, c0);
+	write_u16_le(dest+2, c1);
+	for (unsigned n = 0; n < 4; ++n) {dest[4+n] = (unsigned char)((bits >> (8*n)) & 0xFF);}
+}
+
+// BC4 single channel block (also used for BC3 alpha and for both BC5 channels); always uses the 8 value mode
+void encode_bc4_block(block_texels_t const &px, unsigned comp, unsigned char *dest) {
+
+	unsigned char vmin(255), vmax(0);
+
+	for (unsigned i = 0; i < 16; ++i) {
+		vmin = min(vmin, px[i][comp]);
+		vmax = max(vmax, px[i][comp]);
+	}
+	unsigned long long bits(0);
+
+	if (vmax > vmin) {
+		float const scale(7.0f/(vmax - vmin));
+
+		for (unsigned i = 0; i < 16; ++i) {
+			unsigned const t(unsigned((vmax - px[i][comp])*scale + 0.5f)); // 0 = max, 7 = min
+			unsigned const ix((t == 0) ? 0 : ((t == 7) ? 1 : t+1)); // palette order is {max, min, 6 interpolated values from max to min}
+			bits |= ((unsigned long long)ix << (3*i));
+		}
+	} // else all indices are zero
+	dest[0] = vmax;
+	dest[1] = vmin;
+	for (unsigned n = 0; n < 6; ++n) {dest[2+n] = (unsigned char)((bits >> (8*n)) & 0xFF);}
+}
+
+// read a block of texels starting at (x0, y0), replicating edge texels for partial blocks on the right and top
+void get_block_texels(unsigned char const *data, unsigned w, unsigned h, unsigned ncolors, unsigned x0, unsigned y0, block_texels_t &px) {
+
+	for (unsigned y = 0; y < 4; ++y) {
+		unsigned const yy(min(y0+y, h-1));
+
+		for (unsigned x = 0; x < 4; ++x) {
+			unsigned char const *src(data + ncolors*(yy*w + min(x0+x, w-1)));
+			unsigned char *d(px[4*y + x]);
+			d[0] = src[0];
+			d[1] = ((ncolors >= 2) ? src[1] : 0);
+			d[2] = ((ncolors >= 3) ? src[2] : 0);
+			d[3] = ((ncolors == 4) ? src[3] : 255);
+		}
+	}
+}
+
+// returns the number of bytes per 4x4 block
+unsigned encode_block(block_texels_t const &px, unsigned ncolors, unsigned char *dest) {
+
+	switch (ncolors) {
+	case 1: encode_bc4_block(px, 0, dest); return 8; // BC4
+	case 2: encode_bc4_block(px, 0, dest); encode_bc4_block(px, 1, dest+8); return 16; // BC5
+	case 3: encode_bc1_block(px, dest); return 8; // BC1
+	case 4: encode_bc4_block(px, 3, dest); encode_bc1_block(px, dest+8); return 16; // BC3
+	default: assert(0);
+	}
+	return 0; // never gets here
+}
+
+void encode_image_blocks(unsigned char const *data, unsigned w, unsigned h, unsigned ncolors, unsigned char *dest) {
+
+	block_texels_t px;
+
+	for (unsigned y = 0; y < h; y += 4) {
+		for (unsigned x = 0; x < w; x += 4) {
+			get_block_texels(data, w, h, ncolors, x, y, px);
+			dest += encode_block(px, ncolors, dest);
+		}
+	}
+}
+
+
+// ************ texture_t interface ************
+
+#ifdef ENABLE_DDS
+gli::format get_block_comp_format(unsigned ncolors) {
+
+	switch (ncolors) {
+	case 1: return gli::FORMAT_R_ATI1N_UNORM_BLOCK8;
+	case 2: return gli::FORMAT_RG_ATI2N_UNORM_BLOCK16;
+	case 3: return gli::FORMAT_RGB_DXT1_UNORM_BLOCK8;
+	case 4: return gli::FORMAT_RGBA_DXT5_UNORM_BLOCK16;
+	default: assert(0);
+	}
+	return gli::FORMAT_UNDEFINED; // never gets here
+}
+#endif
+
+bool file_exists_and_readable(string const &fn) {
+
+	FILE *fp(fopen(fn.c_str(), "rb"));
+	if (fp == nullptr) return 0;
+	fclose(fp);
+	return 1;
+}
+
+string texture_t::get_comp_cache_fn() const {
+
+	// key on the processed image data rather than the source filename so that edits to the file and load-time processing (alpha, resize, etc.) are captured;
+	// a 64-bit hash plus the source file size and mtime make it very unlikely that two different textures map to the same file
+	uint64_t const data_hash(fnv1a_64_hash(data, num_bytes()));
+	struct stat st = {};
+	if (name.empty() || (stat(append_texture_dir(name).c_str(), &st) != 0 && stat(name.c_str(), &st) != 0)) {st.st_size = 0; st.st_mtime = 0;} // generated texture
+	std::ostringstream oss;
+	oss << texture_cache_dir << "/" << std::hex << data_hash << "_" << (uint64_t)st.st_size << "_" << (uint64_t)st.st_mtime << std::dec
+		<< "_" << width << "x" << height << "_" << ncolors << "_" << (use_mipmaps ? "mm" : "nm") << "_v" << TEX_CACHE_VERSION << ".dds";
+	return oss.str();
+}
+
+bool texture_t::can_cpu_compress() const {
+	return (!texture_cache_dir.empty() && use_compressed_format() && type == 0 && !defer_load() && is_allocated() && !is_16_bit_gray &&
+		use_mipmaps <= 2 && ncolors >= 1 && ncolors <= 4 && width > 0 && height > 0);
+}
+
+// encodes this texture and its mipmaps into BC blocks and writes the result to a DDS file in texture_cache_dir, or reuses an existing file with the same key;
+// on success the texture is switched to deferred DDS upload from the cache file; CPU-side data is kept;
+// thread safe and doesn't make any GL calls, so this can be run within a parallel texture load loop
+bool texture_t::compress_and_cache() {
+
+#ifdef ENABLE_DDS
+	if (!can_cpu_compress()) return 0;
+	string const fn(get_comp_cache_fn());
+
+	if (!file_exists_and_readable(fn)) { // not yet cached, encode and write it
+		gli::extent2d const extent(width, height);
+		unsigned const levels(use_mipmaps ? gli::levels(extent) : 1);
+		gli::texture2d tex(get_block_comp_format(ncolors), extent, levels);
+		vector<unsigned char> idata(data, data+num_bytes()), odata;
+
+		for (unsigned level = 0, w = width, h = height; level < levels; ++level) {
+			assert((unsigned)tex[level].extent().x == w && (unsigned)tex[level].extent().y == h);
+			encode_image_blocks(&idata.front(), w, h, ncolors, (unsigned char *)tex[level].data());
+			if (level+1 == levels) break; // no more mipmaps
+			odata.resize(ncolors*max(w>>1, 1U)*max(h>>1, 1U));
+			downsample_image_2x2(&idata.front(), w, h, ncolors, &odata.front());
+			idata.swap(odata);
+			w = max(w>>1, 1U);
+			h = max(h>>1, 1U);
+		}
+		// write to a temp file first and then rename so that other threads or processes never see a partial file
+		string const tmp_fn(fn + ".tmp" + std::to_string(omp_get_thread_num_3dw()));
+
+		if (!gli::save_dds(tex, tmp_fn)) {
+			cerr << "Error writing compressed texture cache file " << tmp_fn << " for texture " << name << endl;
+			return 0;
+		}
+		if (rename(tmp_fn.c_str(), fn.c_str()) != 0) { // another thread wrote the same file first (Windows doesn't allow replacing it)
+			remove(tmp_fn.c_str());
+			if (!file_exists_and_readable(fn)) return 0;
+		}
+	}
+	cache_fn        = fn;
+	defer_load_type = DEFER_TYPE_DDS_CACHE;
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+void texture_t::drop_comp_cache() {
+
+	if (defer_load_type != DEFER_TYPE_DDS_CACHE) return;
+	defer_load_type = DEFER_TYPE_NONE;
+	cache_fn.clear();
+}
+
@@ -33,5 +33,7 @@ inline void unpack_color(unsigned char dst[3], colorRGBA const &src) {
 	UNROLL_3X(dst[i_] = (unsigned char)(255.0*src[i_]);)
 }
 
+void downsample_image_2x2(unsigned char const *src, unsigned w1, unsigned h1, unsigned ncolors, unsigned char *dest);
+
 
 #endif
@@ -2466,6 +2466,20 @@ void tile_draw_t::draw(bool reflection_pass) {
 			if (tile->use_as_occluder()) {occluders.push_back(tile);}
 		}
 	}
+	if (!reflection_pass && sw_occlusion_zbuf_enabled()) { // rasterize the volume under each occluder tile's mesh and nearby buildings into the software zbuf
+		sw_occluders.clear();
+
+		for (vector<tile_t *>::const_iterator i = occluders.begin(); i != occluders.end(); ++i) {
+			for (unsigned s = 0; s < 16; ++s) {
+				cube_t c((*i)->get_mesh_sub_bcube((s>>2), (s&3)));
+				c.d[2][1] = c.d[2][0]; // cube below the bcube
+				c.d[2][0] = zmin;
+				if (c.dz() > 0.0 && camera_pdu.cube_visible(c)) {sw_occluders.push_back(c);}
+			}
+		}
+		if (have_buildings()) {get_building_occluder_parts(camera_pdu, sw_occluders);}
+		build_sw_occlusion_zbuf(camera_pdu, sw_occluders);
+	}
 	for (tile_map::const_iterator i = tiles.begin(); i != tiles.end(); ++i) {
 		tile_t *const tile(i->second.get());
 		if (DEBUG_TILES) {mem      += tile->get_gpu_mem ();}
@@ -2476,6 +2490,12 @@ void tile_draw_t::draw(bool reflection_pass) {
 		tile_set_t tile_set;
 		if (reflection_pass && !can_have_reflection(tile, tile_set)) continue;
 
+		if (sw_zbuf_cube_occluded(tile->get_bcube(), camera)) { // fast path; only valid for the non-reflection pass
+			tile->set_last_occluded(1);
+			occluded_tiles.push_back(tile);
+			continue;
+		}
+
 		if (!occluders.empty() && !tile->was_last_unoccluded()) {
 			occluder_pts_t tile_os, sub_tile_os;
 			tile_os.calc_cube_top_points(tile->get_bcube());
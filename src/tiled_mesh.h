@@ -432,6 +432,7 @@ class tile_draw_t : public indexed_vbo_manager_t {
 	};
 	vector<tile_t *> occluders; // reused across draw calls
 	vector<cube_t> test_cubes; // reused across draw calls
+	vector<cube_t> sw_occluders; // reused across draw calls
 	void insert_tile(tile_t *tile);
 
 public:
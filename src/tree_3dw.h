@@ -134,9 +134,10 @@ struct tree_xform_t {
 
 class tree_builder_t : public tree_xform_t {
 
-	static vector<tree_cylin >   cylin_cache;
-	static vector<tree_branch>   branch_cache;
-	static vector<tree_branch *> branch_ptr_cache;
+	// per-thread so that trees can be generated in parallel
+	static thread_local vector<tree_cylin >   cylin_cache;
+	static thread_local vector<tree_branch>   branch_cache;
+	static thread_local vector<tree_branch *> branch_ptr_cache;
 
 	tree_branch base, roots, *branches_34[2], **branches;
 	int base_num_cylins, root_num_cylins, ncib, num_1_branches, num_big_branches_min, num_big_branches_max;
@@ -183,6 +184,18 @@ typedef texture_pair_t tree_bb_tex_t;
 bool const TREE_BILLBOARD_MULTISAMPLE = 0;
 
 
+struct tree_gen_params_t { // all inputs that determine a generated tree_data_t; used as the key for the disk cache; all fields are 4 bytes, so no padding
+
+	int tree_type, size, rseed1, rseed2;
+	unsigned has_4th_branches, create_bush, has_clip_cube;
+	float tree_depth, height_scale, br_scale_mult, nl_scale, bbo_scale, clip[6];
+	float deadness, dead_prob, br_radius_scale, nleaves_scale, tree_scale, tree_height_scale;
+
+	tree_gen_params_t() {memset(this, 0, sizeof(tree_gen_params_t));}
+	bool operator==(tree_gen_params_t const &p) const {return (memcmp(this, &p, sizeof(tree_gen_params_t)) == 0);}
+};
+
+
 class tree_data_t {
 
 	typedef vert_norm_comp_color leaf_vert_type_t;
@@ -198,10 +211,15 @@ class tree_data_t {
 	tree_bb_tex_t render_leaf_texture, render_branch_texture;
 	int last_update_frame;
 	unsigned leaf_change_start, leaf_change_end;
+	vector<unsigned> changed_leaves; // sparse leaf changes, uploaded as separate runs
 	bool reset_leaves, has_4th_branches;
 
 	void clear_vbo_ixs();
 	template<typename branch_index_t> void create_branch_vbo();
+	void calc_bounds();
+	std::string get_cache_fn(tree_gen_params_t const &params) const;
+	bool read_from_cache(tree_gen_params_t const &params, rand_gen_t &rgen);
+	void write_to_cache(tree_gen_params_t const &params, rand_gen_t const &rgen) const;
 
 public:
 	float base_radius, sphere_radius, sphere_center_zoff, br_scale, b_tex_scale;
@@ -309,6 +327,8 @@ class tree {
 	float damage, damage_scale, last_size_scale, tree_nl_scale;
 	colorRGBA tree_color;
 	vector<int> branch_cobjs, leaf_cobjs;
+	vector<unsigned> coll_leaves; // leaves that were hit by an object and are still moving
+	int leaf_cobj_range[2]; // min/max leaf cobj index, for fast rejection of hits on other trees
 	cube_t clip_cube;
 	std::shared_ptr<tree_fire_t> tree_fire;
 
@@ -331,13 +351,14 @@ class tree {
 
 public:
 	tree(bool en_lw=1) : tree_data(NULL), type(-1), created(0), leaf_burn_ix(0), no_delete(0), not_visible(0), leaf_orients_valid(0),
-		enable_leaf_wind(en_lw), use_clip_cube(0), damage(0.0), damage_scale(0.0), last_size_scale(0.0), tree_nl_scale(1.0) {}
+		enable_leaf_wind(en_lw), use_clip_cube(0), tree_center(all_zeros), damage(0.0), damage_scale(0.0), last_size_scale(0.0), tree_nl_scale(1.0) {leaf_cobj_range[0] = leaf_cobj_range[1] = -1;}
 	void enable_clip_cube(cube_t const &cc) {clip_cube = cc; use_clip_cube = 1;}
 	void bind_to_td(tree_data_t *td);
 	void gen_tree(point const &pos, int size, int ttype, int calc_z, bool add_cobjs, bool user_placed, rand_gen_t &rgen,
 		float height_scale=1.0, float br_scale_mult=1.0, float nl_scale=1.0, bool has_4th_branches=0, bool allow_bushes=1);
 	void add_tree_collision_objects();
 	void remove_collision_objects();
+	void add_leaf_coll_hits(vector<int> const &hits);
 	bool check_sphere_coll(point &center, float radius) const;
 	float calc_size_scale(point const &draw_pos) const;
 	void update_leaf_orients_wind();
@@ -352,6 +373,7 @@ public:
 	float get_radius()        const {return tdata().sphere_radius;}
 	point sphere_center()     const {return (tree_center + tdata().get_center());}
 	point const &get_center() const {return tree_center;}
+	tree_data_t const *get_shared_tdata() const {return tree_data;}
 	unsigned get_gpu_mem()    const {return (td_is_private() ? tdata().get_gpu_mem() : 0);}
 	bool get_no_delete()      const {return no_delete;}
 	void set_no_delete(bool no_delete_) {no_delete = no_delete_;}
@@ -386,12 +408,22 @@ public:
 
 class tree_cont_t : public vector<tree> {
 
+	struct tree_gen_req_t { // a placed tree waiting to be generated
+		unsigned ix;
+		int ttype;
+		point pos;
+		rand_gen_t rgen;
+		tree_gen_req_t(unsigned ix_, int ttype_, point const &pos_, rand_gen_t const &rgen_) : ix(ix_), ttype(ttype_), pos(pos_), rgen(rgen_) {}
+	};
 	tree_data_manager_t &shared_tree_data;
 	vector<pair<float, unsigned>> sorted;
 	vector<tree *> to_update_leaves;
+	vector<tree_gen_req_t> gen_reqs;
 	cube_t all_bcube;
 	bool generated;
 
+	void gen_pending_trees();
+
 public:
 	tree_cont_t(tree_data_manager_t &tds) : shared_tree_data(tds), generated(0) {all_bcube.set_to_zeros();}
 	bool was_generated() const {return generated;}
@@ -405,6 +437,7 @@ public:
 	unsigned delete_all();
 	unsigned scroll_trees(int ext_x1, int ext_x2, int ext_y1, int ext_y2);
 	void post_scroll_remove();
+	void dispatch_leaf_coll_hits();
 	void gen_deterministic(int x1, int y1, int x2, int y2, float vegetation_, float mesh_dz, tile_t const *const cur_tile=nullptr);
 	void add_new_tree(rand_gen_t &rgen, int &ttype);
 	void gen_trees_tt_within_radius(int x1, int y1, int x2, int y2, point const &center, float radius, bool is_square=0,
@@ -4,8 +4,10 @@
 
 #include "vertex_opt.h"
 #include "triListOpt.h"
+#include "function_registry.h"
 
 unsigned const VBUF_SZ = 32;
+unsigned const TIPSIFY_CACHE_SZ = 24; // target post-transform cache size for tipsify, a bit smaller than VBUF_SZ
 
 
 float vert_optimizer::calc_acmr() const {
@@ -30,14 +32,124 @@ float vert_optimizer::calc_acmr() const {
 }
 
 
-void vert_optimizer::run(bool full_opt, bool verbose) {
+// linear time vertex cache optimization from "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw" (Sander, Nehab, Barczak 2007)
+// cluster_starts is filled in with the index of the start of each cluster of triangles, for use with overdraw sorting
+void vert_optimizer::optimize_tipsify(vector<unsigned> &cluster_starts) {
+
+	assert(npts_per_prim == 3 && (indices.size() % 3) == 0); // must be triangles
+	unsigned const num_tris(indices.size()/3);
+	vector<unsigned> adj_start(num_verts+1, 0), adj_tris(indices.size()), live(num_verts, 0), cache_time(num_verts, 0), dead_end, cands, out;
+	vector<unsigned char> emitted(num_tris, 0);
+	out.reserve(indices.size());
+	cluster_starts.push_back(0);
+
+	for (auto i = indices.begin(); i != indices.end(); ++i) {assert(*i < num_verts); ++live[*i];}
+	for (unsigned v = 0; v < num_verts; ++v) {adj_start[v+1] = adj_start[v] + live[v];}
+	vector<unsigned> pos(adj_start.begin(), adj_start.end()-1);
+	for (unsigned i = 0; i < indices.size(); ++i) {adj_tris[pos[indices[i]]++] = i/3;} // vertex => triangle adjacency
+	unsigned time(TIPSIFY_CACHE_SZ+1), cursor(0);
+	int fan_vert(0);
+
+	while (fan_vert >= 0) {
+		cands.resize(0);
+
+		for (unsigned a = adj_start[fan_vert]; a < adj_start[fan_vert+1]; ++a) { // emit all remaining triangles around the fanning vertex
+			unsigned const t(adj_tris[a]);
+			if (emitted[t]) continue;
+
+			for (unsigned n = 0; n < 3; ++n) {
+				unsigned const v(indices[3*t+n]);
+				out.push_back(v);
+				dead_end.push_back(v);
+				cands.push_back(v);
+				--live[v];
+				if (time - cache_time[v] > TIPSIFY_CACHE_SZ) {cache_time[v] = time++;} // not in the cache, so add it
+			}
+			emitted[t] = 1;
+		}
+		int best(-1), best_priority(-1);
+
+		for (auto c = cands.begin(); c != cands.end(); ++c) { // choose the next fanning vertex that will still be in the cache after fanning
+			if (live[*c] == 0) continue;
+			int priority(0);
+			if (time - cache_time[*c] + 2*live[*c] <= TIPSIFY_CACHE_SZ) {priority = time - cache_time[*c];}
+			if (priority > best_priority) {best = *c; best_priority = priority;}
+		}
+		if (best < 0) { // dead end
+			while (best < 0 && !dead_end.empty()) { // try recently used vertices first
+				unsigned const v(dead_end.back());
+				dead_end.pop_back();
+				if (live[v] > 0) {best = v;}
+			}
+			while (best < 0 && cursor < num_verts) { // then the next unfinished vertex in input order
+				if (live[cursor] > 0) {best = cursor;}
+				++cursor;
+			}
+			if (best >= 0 && out.size() > cluster_starts.back()) {cluster_starts.push_back(out.size());} // start a new cluster
+		}
+		fan_vert = best;
+	} // end while
+	assert(out.size() == indices.size());
+	indices.swap(out);
+}
+
+
+// sort clusters so that those facing away from the mesh center are drawn first, which tends to draw occluders before the triangles they occlude
+void vert_optimizer::sort_clusters_for_overdraw(vector<unsigned> const &cluster_starts, vector<point> const &pts) {
+
+	unsigned const nclusters(cluster_starts.size());
+	if (nclusters < 2) return;
+	assert(pts.size() >= num_verts);
+	vector<point> centers(nclusters, all_zeros);
+	vector<vector3d> normals(nclusters, zero_vector);
+	point mesh_center(all_zeros);
+	float tot_area(0.0);
+
+	for (unsigned c = 0; c < nclusters; ++c) {
+		unsigned const end_ix((c+1 == nclusters) ? indices.size() : cluster_starts[c+1]);
+		float area(0.0);
+
+		for (unsigned i = cluster_starts[c]; i < end_ix; i += 3) {
+			point const &p0(pts[indices[i]]), &p1(pts[indices[i+1]]), &p2(pts[indices[i+2]]);
+			vector3d const cp(cross_product((p1 - p0), (p2 - p0))); // magnitude is 2x the area
+			float const tri_area(0.5*cp.mag());
+			centers[c] += (tri_area/3.0)*(p0 + p1 + p2); // area weighted
+			normals[c] += cp;
+			area       += tri_area;
+		}
+		mesh_center += centers[c];
+		tot_area    += area;
+		if (area > 0.0) {centers[c] /= area;}
+	}
+	if (tot_area == 0.0) return; // degenerate
+	mesh_center /= tot_area;
+	vector<pair<float, unsigned> > order(nclusters);
+
+	for (unsigned c = 0; c < nclusters; ++c) {
+		float const nmag(normals[c].mag());
+		order[c] = make_pair(((nmag > 0.0) ? -dot_product((centers[c] - mesh_center), normals[c])/nmag : 0.0f), c); // largest dot product first
+	}
+	std::stable_sort(order.begin(), order.end());
+	vector<unsigned> out;
+	out.reserve(indices.size());
+
+	for (auto i = order.begin(); i != order.end(); ++i) {
+		unsigned const c(i->second), end_ix((c+1 == nclusters) ? indices.size() : cluster_starts[c+1]);
+		out.insert(out.end(), (indices.begin() + cluster_starts[c]), (indices.begin() + end_ix));
+	}
+	indices.swap(out);
+}
+
+
+// returns 1 if the indices were reordered
+bool vert_optimizer::run(bool full_opt, bool verbose, bool use_forsyth, vector<point> const *const overdraw_pts) {
 
 	assert(npts_per_prim == 3 || npts_per_prim == 4); // triangles or quads
-	if (indices.size() < 1.5*num_verts || num_verts < 2*VBUF_SZ /*|| num_verts < 100000*/) return;
+	if (indices.size() < 1.5*num_verts || num_verts < 2*VBUF_SZ /*|| num_verts < 100000*/) return 0;
 	//RESET_TIME;
 	float const mult((npts_per_prim == 4) ? 2.0 : 3.0);
 	float const acmr(mult*calc_acmr()), perfect_acmr(mult*float(num_verts)/float(indices.size()));
-	if (acmr < 1.05*perfect_acmr) return;
+	if (acmr < 1.05*perfect_acmr) return 0;
 	//PRINT_TIME("Calc 1");
 
 	if (!full_opt || npts_per_prim != 3) { // no full opt or not triangles
@@ -48,12 +160,17 @@ void vert_optimizer::run(bool full_opt, bool verbose) {
 			vert_block_t<4>::sort_by_min_ix(indices);
 		}
 	}
-	else { // full optimization
+	else if (use_forsyth) { // full optimization using the slower Forsyth algorithm
 		assert((indices.size() % 3) == 0); // must be triangles
 		vector<unsigned> out_indices(indices.size());
 		TriListOpt::OptimizeTriangleOrdering(num_verts, indices.size(), &indices.front(), &out_indices.front());
 		indices.swap(out_indices);
 	}
+	else { // full optimization using linear time tipsify
+		vector<unsigned> cluster_starts;
+		optimize_tipsify(cluster_starts);
+		if (overdraw_pts != nullptr) {sort_clusters_for_overdraw(cluster_starts, *overdraw_pts);}
+	}
 	//PRINT_TIME("Opt");
 
 	if (verbose) { // verbose
@@ -62,6 +179,26 @@ void vert_optimizer::run(bool full_opt, bool verbose) {
 		cout << "ix: " << indices.size() << ", v: " << num_verts << ", opt: " << perfect_acmr
 				<< ", ACMR: " << acmr << " => " << new_acmr << ", ratio: " << new_acmr/acmr << endl;
 	}
+	return 1;
+}
+
+
+// renumber vertices in order of first use to improve vertex fetch locality; remap maps old => new vertex index
+void vert_optimizer::reorder_verts_by_first_use(vector<unsigned> &remap) {
+
+	remap.assign(num_verts, num_verts); // num_verts = unassigned
+	unsigned next(0);
+
+	for (auto i = indices.begin(); i != indices.end(); ++i) {
+		assert(*i < num_verts);
+		unsigned &r(remap[*i]);
+		if (r == num_verts) {r = next++;}
+		*i = r;
+	}
+	for (unsigned v = 0; v < num_verts; ++v) { // unreferenced vertices go at the end
+		if (remap[v] == num_verts) {remap[v] = next++;}
+	}
+	assert(next == num_verts);
 }
 
 
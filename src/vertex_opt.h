@@ -32,11 +32,14 @@ class vert_optimizer {
 	};
 
 	float calc_acmr() const;
+	void optimize_tipsify(vector<unsigned> &cluster_starts);
+	void sort_clusters_for_overdraw(vector<unsigned> const &cluster_starts, vector<point> const &pts);
 
 public:
 	vert_optimizer(vector<unsigned> &indices_, unsigned num_verts_, unsigned npts_per_prim_) :
 	  indices(indices_), num_verts(num_verts_), npts_per_prim(npts_per_prim_) {}
-	void run(bool full_opt, bool verbose);
+	bool run(bool full_opt, bool verbose, bool use_forsyth=0, vector<point> const *const overdraw_pts=nullptr);
+	void reorder_verts_by_first_use(vector<unsigned> &remap);
 };
 
 #endif // _VERT_OPT_H_
@@ -16,6 +16,7 @@ unsigned const MAX_FRAMES_BUFFERED = 128;
 extern int window_width, window_height;
 extern unsigned video_framerate; // Note: should probably be either 30 or 60
 extern unsigned num_video_threads; // defaults to 0 = max
+extern bool video_yuv_convert;
 
 void write_video();
 
@@ -38,6 +39,17 @@ public:
 		m_queue.pop_front();
 		return item;
 	}
+	bool try_remove(T &item) { // non-blocking
+		std::unique_lock<std::mutex> mlock(m_mutex);
+		if (m_queue.empty()) return 0;
+		item = m_queue.front();
+		m_queue.pop_front();
+		return 1;
+	}
+	void clear() {
+		std::unique_lock<std::mutex> mlock(m_mutex);
+		m_queue.clear();
+	}
 	size_t size() const {
 		std::unique_lock<std::mutex> mlock(m_mutex);
 		size_t const size(m_queue.size());
@@ -50,28 +62,71 @@ public:
 	}
 };
 
+inline unsigned char rgb_to_y(unsigned char const *const p) {return (unsigned char)(((66*p[0] + 129*p[1] + 25*p[2] + 128) >> 8) + 16);}
+
+// converts a bottom-up RGBA frame (as read from OpenGL) to top-down planar YUV 4:2:0, BT.601 limited range to match ffmpeg's rgba input conversion;
+// the inner loops are branch free integer math so that the compiler can vectorize them
+void rgba_to_yuv420_flip(unsigned char const *const rgba, unsigned char *const yuv, unsigned w, unsigned h) {
+
+	unsigned const cw((w+1)/2), ch((h+1)/2);
+	unsigned char *const Y(yuv), *const U(Y + w*h), *const V(U + cw*ch);
+
+	for (unsigned cy = 0; cy < ch; ++cy) {
+		unsigned const y0(2*cy), y1(min(y0+1, h-1));
+		unsigned char const *const s0(rgba + 4*w*(h-1-y0)), *const s1(rgba + 4*w*(h-1-y1)); // vertical flip
+		unsigned char *const dy0(Y + w*y0), *const dy1(Y + w*y1), *const du(U + cw*cy), *const dv(V + cw*cy);
+		for (unsigned x = 0; x < w; ++x) {dy0[x] = rgb_to_y(s0 + 4*x);}
+		for (unsigned x = 0; x < w; ++x) {dy1[x] = rgb_to_y(s1 + 4*x);} // Note: rewrites row y0 when h is odd
+
+		for (unsigned cx = 0; cx < cw; ++cx) { // average over 2x2 pixel blocks; sums are in [0, 1020], biased to be positive before the shift
+			unsigned const x0(8*cx), x1(4*min(2*cx+1, w-1));
+			int const r(s0[x0+0] + s0[x1+0] + s1[x0+0] + s1[x1+0]), g(s0[x0+1] + s0[x1+1] + s1[x0+1] + s1[x1+1]), b(s0[x0+2] + s0[x1+2] + s1[x0+2] + s1[x1+2]);
+			du[cx] = (unsigned char)((-38*r -  74*g + 112*b + 131584) >> 10);
+			dv[cx] = (unsigned char)((112*r -  94*g -  18*b + 131584) >> 10);
+		}
+	}
+}
+
+unsigned get_yuv420_size(unsigned w, unsigned h) {return (w*h + 2*((w+1)/2)*((h+1)/2));}
+
+
 class video_capture_t {
 
 	class video_buffer {
 		typedef vector<unsigned char> frame_t;
 		typedef shared_ptr<frame_t> p_frame_t;
 		thread_safe_queue<p_frame_t> frames; // queue of frames to compress
+		thread_safe_queue<p_frame_t> free_frames; // recycled frame buffers, to avoid reallocating every frame
+		frame_t yuv_frame; // only used by the writer thread
 
 	public:
 		void push_frame(void const *const data, unsigned data_sz) {
 			assert(data_sz > 0);
-			p_frame_t frame(new frame_t(data_sz));
+			p_frame_t frame;
+			if (!free_frames.try_remove(frame)) {frame.reset(new frame_t);}
+			frame->resize(data_sz);
 			memcpy(&frame->front(), data, data_sz);
 			frames.add(frame);
 		}
-		void pop_and_send_frame(FILE *fp) {
+		void pop_and_send_frame(FILE *fp, bool send_yuv) {
 			assert(fp != nullptr);
 			p_frame_t const frame(frames.remove());
-			fwrite(&frame->front(), frame->size(), 1, fp);
+
+			if (send_yuv) {
+				assert(frame->size() == 4U*window_width*window_height);
+				yuv_frame.resize(get_yuv420_size(window_width, window_height));
+				rgba_to_yuv420_flip(&frame->front(), &yuv_frame.front(), window_width, window_height);
+				fwrite(&yuv_frame.front(), yuv_frame.size(), 1, fp);
+			}
+			else {
+				fwrite(&frame->front(), frame->size(), 1, fp);
+			}
+			free_frames.add(frame); // return to the pool
 		}
-		void write_frames(FILE *fp) {
-			while (!frames.empty()) {pop_and_send_frame(fp);}
+		void write_frames(FILE *fp, bool send_yuv) {
+			while (!frames.empty()) {pop_and_send_frame(fp, send_yuv);}
 		}
+		void free_memory() {free_frames.clear(); frame_t().swap(yuv_frame);}
 		size_t num_pending_frames() const {return frames.size();}
 		bool empty() const {return frames.empty();}
 	};
@@ -80,7 +135,7 @@ class video_capture_t {
 	string filename;
 
 	// multithreaded writing support
-	bool is_recording, is_writing;
+	bool is_recording, is_writing, send_yuv;
 	video_buffer buffer;
 	unique_ptr<std::thread> write_thread;
 
@@ -91,6 +146,7 @@ class video_capture_t {
 		write_thread->join();
 		write_thread.reset();
 		assert(!is_writing);
+		buffer.free_memory();
 	}
 	void queue_frame(void const *const data) {
 		buffer.push_frame(data, get_num_bytes());
@@ -104,13 +160,14 @@ class video_capture_t {
 	static unsigned get_num_bytes() {return 4*window_width*window_height;}
 
 public:
-	video_capture_t() : video_id(0), pbo(0), start_sz(0), is_recording(0), is_writing(0) {}
+	video_capture_t() : video_id(0), pbo(0), start_sz(0), is_recording(0), is_writing(0), send_yuv(0) {}
 
 	void start(string const &fn) {
 		assert(!is_recording); // must end() before calling start() again
 		wait_for_write_complete();
 		assert(!is_writing);
 		is_recording = 1;
+		send_yuv     = video_yuv_convert;
 		start_sz     = get_num_bytes();
 		assert(pbo == 0);
 		glGenBuffers(1, &pbo);
@@ -124,13 +181,13 @@ public:
 	}
 	void write_buffer() {
 		assert(!filename.empty());
-		// start ffmpeg telling it to expect raw RGBA, 60 FPS
+		// start ffmpeg telling it to expect raw RGBA (or already flipped YUV420 if we convert it here, which is 2.67x less data through the pipe), 60 FPS
 		// -i - tells it to read frames from stdin
 		// Note: 0 = max threads; the more threads the lower the frame rate, as video compression competes with 3DWorld for CPU cycles;
 		// however, more threads is less likely to fill the buffer and block, producing heavy lag
 		ostringstream oss;
-		oss << " -r " << video_framerate << " -f rawvideo -pix_fmt rgba -s " << window_width << "x" << window_height
-			<< " -i - -threads " << num_video_threads << " -preset fast -y -pix_fmt yuv420p -crf 21 -vf vflip " << filename;
+		oss << " -r " << video_framerate << " -f rawvideo -pix_fmt " << (send_yuv ? "yuv420p" : "rgba") << " -s " << window_width << "x" << window_height
+			<< " -i - -threads " << num_video_threads << " -preset fast -y -pix_fmt yuv420p -crf 21 " << (send_yuv ? "" : "-vf vflip ") << filename;
 		// open pipe to ffmpeg's stdin in binary write mode
 #ifdef _WIN32
 		string const cmd(string("ffmpeg.exe.lnk") + oss.str());
@@ -146,7 +203,7 @@ public:
 		  return;
 		}
 		is_writing   = 1;
-		while (is_recording || !buffer.empty()) {buffer.write_frames(ffmpeg); alut_sleep(0.001);} // 1ms sleep
+		while (is_recording || !buffer.empty()) {buffer.write_frames(ffmpeg, send_yuv); alut_sleep(0.001);} // 1ms sleep
 #ifdef _WIN32
 		_pclose(ffmpeg);
 #else
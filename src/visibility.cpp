@@ -349,19 +349,66 @@ bool sphere_in_view(pos_dir_up const &pdu, point const &pos, float radius, int m
 	
 	// do collision object visibility test (not guaranteed to be correct, typically used only with smileys)
 	// *** might be unnecessary with real cobj tests ***
-	float ext_dist(1.2*object_types[SMILEY].radius);
-	if (dist_less_than(viewer, pos, ext_dist)) return 1; // too close to sphere
-	int index;
-	point qp[5];
-	unsigned const nrays((radius == 0.0 || max_level == 3) ? 1 : ((max_level == 4) ? 2 : 5));
-	int const skip_dynamic((max_level < 6) ? 1 : 0); // skip dynamic (what about non-drawn?)
+	return sphere_vis_rays_t(viewer, pos, radius, max_level).any_visible(viewer); // case 7 if not visible
+}
+
+
+// the rays sphere_in_view() casts for levels 3 and above, shared with callers that batch these tests
+sphere_vis_rays_t::sphere_vis_rays_t(point const &viewer, point const &pos, float radius, int max_level) : nrays(0), cid(-1), skip_dynamic(0) {
+
+	assert(max_level >= 3);
+	ext_dist = 1.2*object_types[SMILEY].radius;
+	if (dist_less_than(viewer, pos, ext_dist)) return; // too close to sphere
+	nrays        = ((radius == 0.0 || max_level == 3) ? 1 : ((max_level == 4) ? 2 : 5));
+	skip_dynamic = ((max_level < 6) ? 1 : 0); // skip dynamic (what about non-drawn?)
+	cid          = ((viewer == get_camera_pos()) ? camera_coll_id : -1); // what about smiley coll_ids?
 	get_sphere_border_pts(qp, pos, viewer, radius, nrays);
-	int const cid((pdu.pos == get_camera_pos()) ? camera_coll_id : -1); // what about smiley coll_ids?
+}
+
+bool sphere_vis_rays_t::any_visible(point const &viewer) const {
+
+	if (nrays == 0) return 1; // too close to sphere
+	int index;
 
 	for (unsigned i = 0; i < nrays; ++i) { // can see through transparent objects
 		if (coll_pt_vis_test(qp[i], viewer, ext_dist, index, cid, skip_dynamic, 1)) return 1;
 	}
-	return 0; // case 7
+	return 0;
+}
+
+void sphere_vis_rays_t::add_to_batch(line_query_batch_t &batch, point const &viewer) const {
+	for (unsigned i = 0; i < nrays; ++i) {batch.add(qp[i], viewer, ext_dist, cid, skip_dynamic, 1);}
+}
+
+
+unsigned line_query_batch_t::add(point const &p1, point const &p2, float ext_dist, int ignore_cobj, int skip_dynamic, int test_alpha) {
+
+	was_run = 0;
+	queries.push_back(query_t(p1, p2, ext_dist, ignore_cobj, skip_dynamic, test_alpha));
+	return unsigned(queries.size() - 1);
+}
+
+
+void line_query_batch_t::run() {
+
+	// sort by the mesh cell of the start point so that nearby rays, which visit the same cobj tree nodes, run back to back on the same thread
+	order.resize(queries.size());
+
+	for (unsigned i = 0; i < queries.size(); ++i) {
+		point const &p(queries[i].p1);
+		int const x(max(0, min(MESH_X_SIZE-1, get_xpos(p.x)))), y(max(0, min(MESH_Y_SIZE-1, get_ypos(p.y))));
+		order[i] = make_pair(unsigned(y*MESH_X_SIZE + x), i);
+	}
+	sort(order.begin(), order.end());
+
+#pragma omp parallel for schedule(dynamic,16) if (queries.size() > 16)
+	for (int i = 0; i < (int)order.size(); ++i) {
+		query_t &q(queries[order[i].second]);
+		q.hit_cobj = -1;
+		q.blocked  = !coll_pt_vis_test(q.p1, q.p2, q.ext_dist, q.hit_cobj, q.ignore_cobj, q.skip_dynamic, q.test_alpha);
+		if (!q.blocked) {q.hit_cobj = -1;}
+	}
+	was_run = 1;
 }
 
 
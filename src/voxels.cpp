@@ -2132,6 +2132,8 @@ bool check_voxel_coll_line(point const &p1, point const &p2, point &cpos, vector
 	return terrain_voxel_model.check_coll_line(p1, p2, cpos, cnorm, cindex, ignore_cobj, exact);
 }
 
+bool have_voxel_cobjs() {return !terrain_voxel_model.empty();}
+
 void get_voxel_coll_sphere_cobjs(point const &center, float radius, int ignore_cobj, vert_coll_detector &vcd) {
 	if (terrain_voxel_model.empty()) return;
 	terrain_voxel_model.get_coll_sphere_cobjs(center, radius, ignore_cobj, vcd);
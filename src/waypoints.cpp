@@ -8,7 +8,9 @@
 #include "player_state.h"
 #include "draw_utils.h"
 #include "shaders.h"
+#include "binary_file_io.h"
 #include <queue>
+#include <cfloat> // for FLT_MAX
 
 
 int const WP_RESET_FRAMES      = 100; // Note: in frames, not ticks, fix?
@@ -16,12 +18,15 @@ int const WP_RECENT_FRAMES     = 200;
 float const MAX_FALL_DIST_MULT = 20.0;
 float const STEP_SIZE_MULT     = 0.25; // waypoint connectivity algorithm (relative to smiley radius)
 float const STEP_SIZE_MULT2    = 0.50; // reachability tests (relative to smiley radius)
+unsigned const MAX_WPT_DIST_FIELDS = 32; // max number of cached per-goal distance fields
 
 bool has_user_placed(0), has_item_placed(0), has_wpt_goal(0);
 int show_waypoints(0); // 0=none, 1=waypoints, 2=waypoints+edges
+unsigned waypoint_graph_version(0); // incremented when waypoints or edges change; invalidates cached distance fields
 waypoint_vector waypoints;
 
 extern bool use_waypoints;
+extern string waypoint_cache_fn;
 extern int DISABLE_WATER, camera_change, frame_counter, num_smileys, num_groups, display_mode;
 extern float temperature, zmin, water_plane_z, waypoint_sz_thresh, CAMERA_RADIUS;
 extern double tfticks;
@@ -73,7 +78,7 @@ bool waypt_used_set::is_valid(unsigned wp) { // called to determine whether or n
 
 
 waypoint_t::waypoint_t(point const &p, int cid, bool up, bool i, bool g, bool t)
-	: user_placed(up), placed_item(i), goal(g), temp(t), visited(0), disabled(0), next_valid(0),
+	: user_placed(up), placed_item(i), goal(g), temp(t), visited(0), disabled(0),
 	came_from(-1), item_group(-1), item_ix(-1), coll_id(cid), connected_to(-1), g_score(0), h_score(0), f_score(0), pos(p)
 {
 	clear();
@@ -391,6 +396,7 @@ public:
 			remove_adj(waypoints[*i].prev_wpts, ix, is_last);
 		}
 		w.clear();
+		++waypoint_graph_version;
 	}
 
 	void remove_waypoint(unsigned const ix) {
@@ -424,45 +430,58 @@ public:
 		connect_waypoints(0, (unsigned)waypoints.size(), 0, (unsigned)waypoints.size(), 1, 0);
 	}
 
+	// three passes so that the result doesn't depend on thread scheduling:
+	// 1. parallel line of sight tests (the O(n^2) part) into per-waypoint candidate lists
+	// 2. parallel per-waypoint colinear filtering and reachability tests, which only touch waypoint i's own edges
+	// 3. serial redundant edge removal in waypoint order, which needs the final edges of the neighbors
 	void connect_waypoints(unsigned from_start, unsigned from_end, unsigned to_start,
 		unsigned to_end, bool verbose, bool fast)
 	{
-		unsigned visible(0), cand_edges(0), num_edges(0), tot_steps(0);
+		unsigned visible(0), cand_edges(0), num_edges(0), tot_steps(0), num_removed(0);
 		float const fast_dmax(0.25*(X_SCENE_SIZE + Y_SCENE_SIZE));
-		for (int i = from_start; i < (int)from_end; ++i) {waypoints[i].next_valid = 0;}
-		vector<pair<float, unsigned> > cands;
+		assert(from_start <= from_end && from_end <= waypoints.size());
+		unsigned const num_from(from_end - from_start);
+		vector<vector<pair<float, unsigned> > > cands(num_from);
+		vector<unsigned> orig_num_next(num_from, 0);
+		++waypoint_graph_version;
 
-		#pragma omp parallel for schedule(dynamic,1) private(cands) // is this fully thread safe? it's not determinstic across threads
+		#pragma omp parallel for schedule(dynamic,1) reduction(+:visible) if (num_from > 1)
 		for (int i = from_start; i < (int)from_end; ++i) {
-			assert(i < (int)waypoints.size());
 			if (waypoints[i].disabled) continue;
 			point const start(waypoints[i].pos);
+			vector<pair<float, unsigned> > &cur_cands(cands[i - from_start]);
 			int cindex(-1);
-			cands.clear();
 
 			for (unsigned j = to_start; j < to_end; ++j) {
 				if (i == (int)j || waypoints[j].disabled) continue;
 
 				if (waypoints[i].connected_to == (int)j) { // connected by a teleporter
-					cands.push_back(make_pair(CAMERA_RADIUS, j)); // small but nonzero distance
+					cur_cands.push_back(make_pair(CAMERA_RADIUS, j)); // small but nonzero distance
 					continue;
 				}
 				point const end(waypoints[j].pos);
 				if (cindex >= 0 && coll_objects.get_cobj(cindex).line_intersect(start, end)) continue; // hit last cobj
 				if (fast && !dist_less_than(start, end, fast_dmax)) continue; // too far away
 				if (check_coll_line(start, end, cindex, -1, 1, 0, 1, 0, 1)) continue; // no line of sight (skip dynamic/movable)
-				cands.push_back(make_pair(p2p_dist_sq(start, end), j));
+				cur_cands.push_back(make_pair(p2p_dist_sq(start, end), j));
 				++visible;
 			}
-			sort(cands.begin(), cands.end()); // closest to furthest
+			sort(cur_cands.begin(), cur_cands.end()); // closest to furthest
+		}
+		#pragma omp parallel for schedule(dynamic,1) reduction(+:cand_edges, num_edges, tot_steps) if (num_from > 1)
+		for (int i = from_start; i < (int)from_end; ++i) {
+			if (waypoints[i].disabled) continue;
+			point const start(waypoints[i].pos);
+			vector<pair<float, unsigned> > const &cur_cands(cands[i - from_start]);
 			waypt_adj_vect &next(waypoints[i].next_wpts);
+			orig_num_next[i - from_start] = (unsigned)next.size();
 
-			for (unsigned j = 0; j < cands.size(); ++j) {
-				unsigned const k(cands[j].second);
+			for (unsigned j = 0; j < cur_cands.size(); ++j) {
+				unsigned const k(cur_cands[j].second);
 				assert(k < waypoints.size());
 				point const end(waypoints[k].pos);
 				vector3d const dir(end - start), dir_xy(vector3d(dir.x, dir.y, 0.0).get_norm());
-				bool colinear(0), redundant(0);
+				bool colinear(0);
 
 				for (unsigned l = 0; l < next.size() && !colinear; ++l) {
 					assert(next[l] < waypoints.size());
@@ -471,28 +490,42 @@ public:
 					colinear = (dot_product(dir_xy, dir_xy2) > 0.99);
 				}
 				if (colinear) continue;
+				unsigned steps(0);
+
+				if (waypoints[i].connected_to == (int)k || is_point_reachable(start, end, steps, STEP_SIZE_MULT, 1)) {
+					next.push_back(k);
+					++num_edges;
+				}
+				tot_steps += steps;
+				++cand_edges;
+			} // for j
+		}
+		for (unsigned i = from_start; i < from_end; ++i) { // remove edges i => k where some path i => l => k is nearly as short
+			if (waypoints[i].disabled) continue;
+			point const start(waypoints[i].pos);
+			waypt_adj_vect &next(waypoints[i].next_wpts);
+
+			for (unsigned j = orig_num_next[i - from_start]; j < next.size(); ++j) { // only consider edges added in this call
+				unsigned const k(next[j]);
+				if (waypoints[i].connected_to == (int)k) continue; // never remove teleporter edges
+				point const &wk(waypoints[k].pos);
+				bool redundant(0);
 
 				for (unsigned l = 0; l < next.size() && !redundant; ++l) {
+					if (l == j) continue;
 					assert(next[l] < waypoints.size());
-					if (!waypoints[next[l]].next_valid) continue; // another thread is working on this waypoint, so don't use it
 					waypt_adj_vect const &next_next(waypoints[next[l]].next_wpts);
 					point const &wl(waypoints[next[l]].pos);
 
 					for (unsigned m = 0; m < next_next.size() && !redundant; ++m) {
-						assert(next_next[m] < waypoints.size());
-						point const &wm(waypoints[next_next[m]].pos);
-						redundant = (next_next[m] == k && (p2p_dist(start, wl) + p2p_dist(wl, wm) < 1.02*p2p_dist(start, wm)));
+						redundant = (next_next[m] == k && (p2p_dist(start, wl) + p2p_dist(wl, wk) < 1.02*p2p_dist(start, wk)));
 					}
 				}
-				if (redundant) continue;
-
-				if (waypoints[i].connected_to == (int)k || is_point_reachable(start, end, tot_steps, STEP_SIZE_MULT, 1)) {
-					next.push_back(k);
-					++num_edges;
-				}
-				++cand_edges;
+				if (!redundant) continue;
+				next.erase(next.begin() + j); // keep closest first order
+				--j;
+				++num_removed;
 			} // for j
-			waypoints[i].next_valid = 1;
 		}
 		for (unsigned i = from_start; i < from_end; ++i) {
 			if (waypoints[i].disabled) continue;
@@ -505,7 +538,7 @@ public:
 		}
 		if (verbose) {
 			cout << "Waypoints: " << waypoints.size() << ", vis edges: " << visible << ", cand edges: " << cand_edges
-				 << ", true edges: " << num_edges << ", tot steps: " << tot_steps << endl;
+				 << ", true edges: " << (num_edges - num_removed) << ", tot steps: " << tot_steps << endl;
 		}
 	}
 
@@ -580,6 +613,75 @@ struct waypoint_cache {
 waypoint_cache global_wpt_cache;
 
 
+// shortest path distance from every waypoint to the closest goal waypoint, computed with a reverse Dijkstra search;
+// shared by all smileys that have the same goal, so that each path query is a lookup of the neighbor with the lowest total distance
+struct wpt_dist_field_t {
+
+	unsigned version; // waypoint_graph_version when built
+	vector<unsigned> goal_wpts;
+	vector<float> dist; // FLT_MAX if the goal can't be reached from this waypoint
+
+	wpt_dist_field_t() : version(0) {}
+	bool is_reachable(unsigned ix) const {assert(ix < dist.size()); return (dist[ix] < FLT_MAX);}
+
+	void build(vector<unsigned> const &goal_wpts_) {
+		goal_wpts = goal_wpts_;
+		version   = waypoint_graph_version;
+		dist.clear();
+		dist.resize(waypoints.size(), FLT_MAX);
+		std::priority_queue<pair<float, unsigned> > open_queue;
+
+		for (vector<unsigned>::const_iterator i = goal_wpts.begin(); i != goal_wpts.end(); ++i) {
+			assert(*i < waypoints.size());
+			dist[*i] = 0.0;
+			open_queue.push(make_pair(0.0f, *i));
+		}
+		while (!open_queue.empty()) {
+			float const cur_dist(-open_queue.top().first);
+			unsigned const cur(open_queue.top().second);
+			open_queue.pop();
+			if (cur_dist > dist[cur]) continue; // stale entry
+			waypoint_t const &cw(waypoints[cur]);
+
+			for (waypt_adj_vect::const_iterator i = cw.prev_wpts.begin(); i != cw.prev_wpts.end(); ++i) { // follow edges backwards
+				assert(*i < waypoints.size());
+				waypoint_t const &wp(waypoints[*i]);
+				if (wp.disabled) continue;
+				// same edge cost as run_a_star(): distance between the waypoints, or a small but nonzero value if connected by a teleporter
+				float const new_dist(cur_dist + ((wp.connected_to == (int)cur) ? CAMERA_RADIUS : p2p_dist(wp.pos, cw.pos)));
+				if (new_dist >= dist[*i]) continue;
+				dist[*i] = new_dist;
+				open_queue.push(make_pair(-new_dist, *i));
+			}
+		}
+	}
+};
+
+class wpt_dist_field_cache_t {
+
+	map<pair<int, unsigned>, wpt_dist_field_t> fields; // {goal mode, goal waypoint} => distance field
+
+public:
+	wpt_dist_field_t const &get(int mode, unsigned wpt, vector<unsigned> const &goal_wpts) {
+		pair<int, unsigned> const key(mode, wpt);
+		auto it(fields.find(key));
+
+		if (it == fields.end()) {
+			if (fields.size() >= MAX_WPT_DIST_FIELDS) {fields.clear();} // too many goals; start over
+			it = fields.insert(make_pair(key, wpt_dist_field_t())).first;
+		}
+		else if (it->second.version == waypoint_graph_version && it->second.goal_wpts == goal_wpts) {
+			return it->second; // still valid
+		}
+		it->second.build(goal_wpts);
+		return it->second;
+	}
+	void clear() {fields.clear();}
+};
+
+wpt_dist_field_cache_t wpt_dist_field_cache;
+
+
 class waypoint_search {
 
 	wpt_goal goal;
@@ -613,22 +715,52 @@ class waypoint_search {
 		if (waypoints[cur].came_from >= 0) {reconstruct_path(waypoints[cur].came_from, path);}
 		path.push_back(cur);
 	}
+	bool resolve_goal_wpt() { // for modes 4-6; returns false if there is no goal waypoint
+		if (goal.mode == 4) {goal.pos = waypoints[goal.wpt].pos;} // specific waypoint
+
+		if (goal.mode == 5 || goal.mode == 6) { // closest waypoint/closest visible waypoint
+			int const wpt(wb.find_closest_waypoint(goal.pos, (goal.mode == 6)));
+			if (wpt < 0) return 0; // no current waypoint (maybe none visible)
+			goal.wpt = wpt;
+		}
+		return 1;
+	}
 
 public:
 	waypoint_search(wpt_goal const &goal_, waypoint_cache &wc_) : goal(goal_), wc(wc_) {}
 
+	// goal positions add a temporary waypoint, so they must use run_a_star() instead
+	bool can_use_dist_field() const {return (goal.mode != 7);}
+
+	// returns nullptr if there is no goal
+	wpt_dist_field_t const *get_dist_field() {
+		assert(can_use_dist_field());
+		if (!goal.is_reachable() || !resolve_goal_wpt()) return nullptr;
+		vector<unsigned> goal_wpts;
+
+		if (goal.mode >= 4) {goal_wpts.push_back(goal.wpt);}
+		else { // the set of goals can change, for example when items are picked up, so it's part of the cache validation
+			for (unsigned i = 0; i < waypoints.size(); ++i) {
+				if (!waypoints[i].disabled && is_goal(i)) {goal_wpts.push_back(i);}
+			}
+		}
+		if (goal_wpts.empty()) return nullptr;
+		return &wpt_dist_field_cache.get(goal.mode, ((goal.mode >= 4) ? goal.wpt : 0), goal_wpts);
+	}
+
 	// returns min distance to goal following connected waypoints along path
 	float run_a_star(vector<pair<unsigned, float> > const &start, vector<unsigned> &path, set<unsigned> const &wps_penalty) {
 		if (!goal.is_reachable()) return 0.0; // nothing to do
 		assert(path.empty());
 		bool const orig_has_wpt_goal(has_wpt_goal);
-		if (goal.mode == 4) {goal.pos = waypoints[goal.wpt].pos;} // specific waypoint
-		if (goal.mode == 5) {goal.wpt = wb.find_closest_waypoint(goal.pos, 0);}
-		if (goal.mode == 6) {goal.wpt = wb.find_closest_waypoint(goal.pos, 1);}
-		if (goal.mode == 7) {goal.wpt = wb.add_new_waypoint(goal.pos, -1, 1, 1, 1, 1);} // goal position - add temp waypoint
-		if (goal.mode == 7) {has_wpt_goal = 1;}
+		unsigned const orig_graph_version(waypoint_graph_version);
+		if (!resolve_goal_wpt()) return 0.0; // no current waypoint (maybe none visible)
+
+		if (goal.mode == 7) { // goal position - add temp waypoint
+			goal.wpt     = wb.add_new_waypoint(goal.pos, -1, 1, 1, 1, 1);
+			has_wpt_goal = 1;
+		}
 		//cout << "start: " << start.size() << ", goal: mode: " << goal.mode << ", pos: " << goal.pos.str() << ", wpt: " << goal.wpt << endl;
-		if (goal.wpt < 0) return 0.0; // no current waypoint (maybe none visible)
 		std::priority_queue<pair<float, unsigned> > open_queue;
 		wc.open.resize(waypoints.size(), 0); // already resized after the first call
 		wc.closed.resize(waypoints.size(), 0);
@@ -696,6 +828,7 @@ public:
 		if (goal.mode == 7) {
 			wb.remove_last_waypoint(); // goal position - remove temp waypoint
 			has_wpt_goal = orig_has_wpt_goal;
+			waypoint_graph_version = orig_graph_version; // graph is back to its previous state, so cached distance fields are still valid
 		}
 		return min_dist;
 	}
@@ -705,11 +838,65 @@ public:
 // ********** waypoint top level code **********
 
 
+unsigned const WPT_CACHE_MAGIC   = 0x77707473; // "wpts"
+unsigned const WPT_CACHE_VERSION = 1; // increment when waypoint connectivity changes so that old cache files are ignored
+
+// the graph is only reused if the generated waypoints match exactly, so any change to the scene forces a rebuild
+bool read_waypoint_graph(string const &fn) {
+
+	binary_file_reader reader;
+	if (!reader.open(fn)) return 0;
+	unsigned header[3] = {0};
+	if (!reader.read(header, sizeof(unsigned), 3) || header[0] != WPT_CACHE_MAGIC || header[1] != WPT_CACHE_VERSION || header[2] != waypoints.size()) return 0;
+	vector<waypt_adj_vect> next(waypoints.size());
+
+	for (unsigned i = 0; i < waypoints.size(); ++i) {
+		point pos;
+		int coll_id(0);
+		unsigned num_next(0);
+		if (!reader.read(&pos, sizeof(point), 1) || !reader.read(&coll_id, sizeof(int), 1) || !reader.read(&num_next, sizeof(unsigned), 1)) return 0;
+		if (pos != waypoints[i].pos || coll_id != waypoints[i].coll_id || num_next > waypoints.size()) return 0; // scene has changed
+		next[i].resize(num_next);
+		if (num_next > 0 && !reader.read(&next[i].front(), sizeof(wpt_ix_t), num_next)) return 0;
+
+		for (unsigned j = 0; j < num_next; ++j) {
+			if (next[i][j] >= waypoints.size() || next[i][j] == i) return 0; // invalid
+		}
+	}
+	for (unsigned i = 0; i < waypoints.size(); ++i) {
+		waypoints[i].next_wpts.swap(next[i]);
+		for (unsigned j = 0; j < waypoints[i].next_wpts.size(); ++j) {waypoints[waypoints[i].next_wpts[j]].prev_wpts.push_back(i);}
+	}
+	++waypoint_graph_version;
+	cout << "Read " << waypoints.size() << " waypoints from " << fn << endl;
+	return 1;
+}
+
+
+void write_waypoint_graph(string const &fn) {
+
+	binary_file_writer writer;
+	if (!writer.open(fn)) return;
+	unsigned const header[3] = {WPT_CACHE_MAGIC, WPT_CACHE_VERSION, (unsigned)waypoints.size()};
+	bool good(writer.write(header, sizeof(unsigned), 3));
+
+	for (unsigned i = 0; i < waypoints.size() && good; ++i) {
+		waypoint_t const &w(waypoints[i]);
+		unsigned const num_next((unsigned)w.next_wpts.size());
+		good = (writer.write(&w.pos, sizeof(point), 1) && writer.write(&w.coll_id, sizeof(int), 1) && writer.write(&num_next, sizeof(unsigned), 1));
+		good = (good && (num_next == 0 || writer.write(&w.next_wpts.front(), sizeof(wpt_ix_t), num_next)));
+	}
+	if (!good) {cout << "*** Error writing waypoint cache file " << fn << endl;}
+}
+
+
 void create_waypoints(vector<user_waypt_t> const &user_waypoints) {
 
 	RESET_TIME;
 	clear_cached_waypoints();
 	waypoints.clear();
+	wpt_dist_field_cache.clear();
+	++waypoint_graph_version;
 	has_user_placed = (!user_waypoints.empty());
 	has_item_placed = 0;
 	has_wpt_goal    = 0;
@@ -726,7 +913,10 @@ void create_waypoints(vector<user_waypt_t> const &user_waypoints) {
 		wb.add_object_waypoints();
 		PRINT_TIME("  Waypoint Generation");
 	}
-	wb.connect_all_waypoints();
+	if (waypoint_cache_fn.empty() || !read_waypoint_graph(waypoint_cache_fn)) {
+		wb.connect_all_waypoints();
+		if (!waypoint_cache_fn.empty()) {write_waypoint_graph(waypoint_cache_fn);}
+	}
 	PRINT_TIME("  Waypoint Connectivity");
 }
 
@@ -738,6 +928,22 @@ int find_optimal_next_waypoint(unsigned cur, wpt_goal const &goal, set<unsigned>
 	//RESET_TIME;
 	vector<unsigned> path;
 	waypoint_search ws(goal, global_wpt_cache);
+
+	if (ws.can_use_dist_field()) { // choose the neighbor on the shortest path to the goal
+		wpt_dist_field_t const *const df(ws.get_dist_field());
+		if (df == nullptr || !df->is_reachable(cur)) return -1; // no path to goal
+		if (df->dist[cur] == 0.0) return cur; // already at goal
+		waypoint_t const &cw(waypoints[cur]);
+		int best(-1);
+		float best_dist(0.0);
+
+		for (waypt_adj_vect::const_iterator i = cw.next_wpts.begin(); i != cw.next_wpts.end(); ++i) {
+			if (!df->is_reachable(*i)) continue;
+			float const dist(df->dist[*i] + ((cw.connected_to == *i) ? CAMERA_RADIUS : p2p_dist(cw.pos, waypoints[*i].pos)));
+			if (best < 0 || dist < best_dist) {best = *i; best_dist = dist;}
+		}
+		return best;
+	}
 	vector<pair<unsigned, float> > start;
 	start.push_back(make_pair(cur, 0.0));
 	ws.run_a_star(start, path, wps_penalty);
@@ -779,15 +985,29 @@ void find_optimal_waypoint(point const &pos, vector<od_data> &oddatav, wpt_goal
 		}
 	}
 	waypoint_search ws(goal, global_wpt_cache);
-	vector<unsigned> path;
-	ws.run_a_star(start, path, set<unsigned>());
+	int best(-1);
+
+	if (ws.can_use_dist_field()) { // choose the start waypoint with the shortest total path to the goal
+		wpt_dist_field_t const *const df(ws.get_dist_field());
+		float best_dist(0.0);
+
+		for (unsigned i = 0; i < start.size() && df != nullptr; ++i) {
+			if (!df->is_reachable(start[i].first)) continue;
+			float const dist(start[i].second + df->dist[start[i].first]);
+			if (best < 0 || dist < best_dist) {best = start[i].first; best_dist = dist;}
+		}
+	}
+	else {
+		vector<unsigned> path;
+		ws.run_a_star(start, path, set<unsigned>());
+		//cout << "query size: " << oddatav.size() << ", start size: " << start.size() << ", path length: " << path.size() << endl;
+		if (!path.empty()) {best = path[0];}
+	}
 	//PRINT_TIME("Find Optimal Waypoint");
-	//cout << "query size: " << oddatav.size() << ", start size: " << start.size() << ", path length: " << path.size() << endl;
-	if (path.empty()) return; // no path found, nothing to do
-	unsigned const best(path[0]);
+	if (best < 0) return; // no path found, nothing to do
 
 	for (unsigned i = 0; i < oddatav.size(); ++i) {
-		oddatav[i].dist = ((oddatav[i].id == (int)best) ? 1.0 : 1000.0); // large/small distance
+		oddatav[i].dist = ((oddatav[i].id == best) ? 1.0 : 1000.0); // large/small distance
 	}
 }
 